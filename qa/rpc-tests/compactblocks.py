@@ -0,0 +1,74 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The UserV developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test compact block relay between two nodes: blocks are rebuilt from the
+# mempool, missing transactions are fetched with getblocktxn, and
+# -compactblocks=0 falls back to inv/getdata.
+#
+from test_framework import BitcoinTestFramework
+from bitcoinrpc.authproxy import AuthServiceProxy, JSONRPCException
+from util import *
+
+CMPCT_ARGS = ["-debug=cmpctblock"]
+
+class CompactBlocksTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = start_nodes(2, self.options.tmpdir, [CMPCT_ARGS] * 2)
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+
+    def run_test(self):
+        self.nodes[0].setgenerate(True, 101)
+        sync_blocks(self.nodes)
+
+        # Transactions node1 already has make the block rebuild from its mempool
+        before = self.nodes[1].getcompactblockinfo()
+        for i in range(5):
+            self.nodes[0].sendtoaddress(self.nodes[1].getnewaddress(), 1)
+        sync_mempools(self.nodes)
+        self.nodes[0].setgenerate(True, 1)
+        sync_blocks(self.nodes)
+        info = self.nodes[1].getcompactblockinfo()
+        assert_equal(info['received'], before['received'] + 1)
+        assert_equal(info['frommempool'], before['frommempool'] + 1)
+        assert_equal(info['txmempool'], before['txmempool'] + 5)
+        assert_equal(info['txrequested'], before['txrequested'])
+        assert_equal(self.nodes[1].getrawmempool(), [])
+        assert(self.nodes[0].getcompactblockinfo()['sent'] > 0)
+
+        # A transaction sent while node1 was down is fetched with getblocktxn
+        stop_node(self.nodes[1], 1)
+        txid = self.nodes[0].sendtoaddress(self.nodes[0].getnewaddress(), 1)
+        self.nodes[1] = start_node(1, self.options.tmpdir, CMPCT_ARGS)
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.nodes[0].setgenerate(True, 1)
+        sync_blocks(self.nodes)
+        info = self.nodes[1].getcompactblockinfo()
+        assert_equal(info['received'], 1)
+        assert_equal(info['roundtrip'], 1)
+        assert_equal(info['txrequested'], 1)
+        assert(txid in self.nodes[1].getblock(self.nodes[1].getbestblockhash())['tx'])
+        assert(self.nodes[0].getcompactblockinfo()['txnserved'] > 0)
+
+        # Without compact blocks the block is announced with an inv instead
+        stop_nodes(self.nodes)
+        wait_bitcoinds()
+        self.nodes = start_nodes(2, self.options.tmpdir, [CMPCT_ARGS + ["-compactblocks=0"], CMPCT_ARGS])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.nodes[0].setgenerate(True, 1)
+        sync_blocks(self.nodes)
+        assert_equal(self.nodes[0].getcompactblockinfo()['sent'], 0)
+        assert_equal(self.nodes[1].getcompactblockinfo()['received'], 0)
+
+        print "Success"
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
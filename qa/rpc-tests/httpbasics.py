@@ -97,6 +97,43 @@ class HTTPBasicsTest (BitcoinTestFramework):
         out1 = conn.getresponse().read();
         assert_equal('"error":null' in out1, True)
         assert_equal(conn.sock!=None, True) #connection must be closed because bitcoind should use keep-alive by default
-        
+
+        # Check excessive request size
+        conn = httplib.HTTPConnection(urlNode2.hostname, urlNode2.port)
+        conn.connect()
+        conn.request('GET', '/' + ('x'*1000), '', headers)
+        out1 = conn.getresponse()
+        assert_equal(out1.status, httplib.NOT_FOUND)
+
+        conn = httplib.HTTPConnection(urlNode2.hostname, urlNode2.port)
+        conn.connect()
+        conn.request('GET', '/' + ('x'*10000), '', headers)
+        out1 = conn.getresponse()
+        assert_equal(out1.status, httplib.BAD_REQUEST)
+
+        # JSON-RPC only takes POST requests
+        conn = httplib.HTTPConnection(urlNode2.hostname, urlNode2.port)
+        conn.connect()
+        conn.request('GET', '/', '', headers)
+        out1 = conn.getresponse()
+        assert_equal(out1.status, httplib.METHOD_NOT_ALLOWED)
+
+        # The requests above went through the work queue
+        workqueue = self.nodes[2].getrpcstats()['workqueue']
+        assert_equal(workqueue['threads'], 4)
+        assert_equal(workqueue['max_depth'], 16)
+        assert(workqueue['processed'] > 0)
+        assert_equal(workqueue['rejected'], 0)
+
+        # every command called is counted, and read-only ones run without cs_main
+        self.nodes[2].getblockcount()
+        self.nodes[2].getblockcount()
+        commands = self.nodes[2].getrpcstats(True)['commands']
+        assert(commands['getblockcount']['calls'] >= 2)
+        assert_equal(commands['getblockcount']['errors'], 0)
+        assert_equal(commands['getblockcount']['threadsafe'], True)
+        assert_equal(commands['getblockcount']['lock_hold_us'], 0)
+        assert('getblockcount' not in self.nodes[2].getrpcstats()['commands'])
+
 if __name__ == '__main__':
     HTTPBasicsTest ().main ()
@@ -94,6 +94,48 @@ class ListTransactionsTest(BitcoinTestFramework):
                            {"category":"receive","amount":Decimal("0.44")},
                            {"txid":txid, "account" : "toself"} )
 
+        # paging with cursors gives the same entries as listing them at once
+        everything = self.nodes[0].listtransactions("*", 1000)
+        paged = self.nodes[0].listtransactions("*", 3)
+        page = paged
+        while len(page) > 0:
+            page = self.nodes[0].listtransactions("*", 3, 0, False, page[0]["cursor"])
+            paged = page + paged
+        assert_equal(paged, everything)
+        page = self.nodes[0].listtransactions("*", 2, 1, False, everything[-2]["cursor"])
+        assert_equal(page, everything[-5:-3])
+        try:
+            self.nodes[0].listtransactions("*", 10, 0, False, "x")
+            raise AssertionError("Invalid cursor accepted")
+        except JSONRPCException as e:
+            assert_equal(e.error["code"], -8)
+
+        # an account lists the entries with its name, also once an address is relabelled
+        def without_cursor(entries):
+            return [dict((k, v) for k, v in e.items() if k != "cursor") for e in entries]
+        assert_equal(without_cursor(self.nodes[0].listtransactions("from1", 1000)),
+                     without_cursor([e for e in everything if e["account"] == "from1"]))
+        self.nodes[0].setaccount(self.nodes[0].getaccountaddress("from1"), "renamed")
+        check_array_result(self.nodes[0].listtransactions("renamed"),
+                           {"category":"receive","amount":Decimal("0.33")},
+                           {"txid":txid, "account" : "renamed"} )
+        assert_equal(self.nodes[0].listtransactions("from1"), [])
+        assert_equal(self.nodes[0].listtransactions("nosuchaccount"), [])
+
+        # listsinceblock only lists what came after the block
+        self.nodes[1].setgenerate(True, 1)
+        self.sync_all()
+        lastblock = self.nodes[0].getbestblockhash()
+        txid = self.nodes[1].sendtoaddress(self.nodes[0].getnewaddress(), 0.5)
+        self.sync_all()
+        since = [e["txid"] for e in self.nodes[0].listsinceblock(lastblock)["transactions"]]
+        assert_equal(since, [txid])
+        self.nodes[1].setgenerate(True, 1)
+        self.sync_all()
+        since = [e["txid"] for e in self.nodes[0].listsinceblock(lastblock)["transactions"]]
+        assert_equal(since, [txid])
+        assert_equal(self.nodes[0].listsinceblock(self.nodes[0].getbestblockhash())["transactions"], [])
+
 if __name__ == '__main__':
     ListTransactionsTest().main()
 
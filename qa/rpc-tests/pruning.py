@@ -0,0 +1,79 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The UserV developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test -prune: manual pruning with pruneblockchain on a regtest chain spread
+# over many tiny block files (-fastprune), and what a pruned node still serves.
+#
+from test_framework import BitcoinTestFramework
+from bitcoinrpc.authproxy import AuthServiceProxy, JSONRPCException
+from util import *
+import os.path
+
+PRUNE_ARGS = ["-prune=1", "-fastprune", "-maxreorg=10"]
+
+def blk_file(tmpdir, n):
+    return os.path.join(tmpdir, "node0", "regtest", "blocks", "blk%05d.dat" % n)
+
+def rev_file(tmpdir, n):
+    return os.path.join(tmpdir, "node0", "regtest", "blocks", "rev%05d.dat" % n)
+
+class PruningTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug=prune"] + PRUNE_ARGS))
+        self.nodes.append(start_node(1, self.options.tmpdir))
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        info = node.getblockchaininfo()
+        assert_equal(info['pruned'], True)
+        assert_equal(info['pruneheight'], 0)
+
+        # An unpruned node refuses, and a short chain has nothing to prune yet
+        assert_raises(JSONRPCException, self.nodes[1].pruneblockchain, 10)
+        assert_raises(JSONRPCException, node.pruneblockchain, 10)
+
+        node.setgenerate(True, 190)
+        assert(os.path.isfile(blk_file(self.options.tmpdir, 2)))
+        old_hash = node.getblockhash(5)
+        tip_hash = node.getbestblockhash()
+
+        # Pruning up to a height deletes the files holding only older blocks
+        pruned = node.pruneblockchain(100)
+        assert(pruned > 0 and pruned <= 100)
+        assert(not os.path.isfile(blk_file(self.options.tmpdir, 0)))
+        assert(not os.path.isfile(rev_file(self.options.tmpdir, 0)))
+        assert_equal(node.getblockchaininfo()['pruneheight'], pruned + 1)
+
+        # Headers and the index stay, the block data of pruned blocks is gone
+        assert_equal(node.getblockheader(old_hash)['height'], 5)
+        assert_raises(JSONRPCException, node.getblock, old_hash)
+        assert_equal(node.getblock(tip_hash)['height'], 190)
+
+        # Asking for a height close to the tip keeps the reorg and stake window
+        node.pruneblockchain(190)
+        assert(node.getblockchaininfo()['pruneheight'] <= 190 - 10)
+        assert(os.path.isfile(blk_file(self.options.tmpdir, 2)))
+
+        # The pruned state survives a restart and the chain keeps growing
+        stop_node(node, 0)
+        self.nodes[0] = node = start_node(0, self.options.tmpdir, PRUNE_ARGS)
+        assert_equal(node.getblockcount(), 190)
+        assert_raises(JSONRPCException, node.getblock, old_hash)
+        node.setgenerate(True, 5)
+        assert_equal(node.getblockcount(), 195)
+
+        print "Success"
+
+if __name__ == '__main__':
+    PruningTest().main()
@@ -66,6 +66,32 @@ class RESTTest (BitcoinTestFramework):
         txs.append(self.nodes[0].sendtoaddress(self.nodes[2].getnewaddress(), 11))
         self.sync_all()
         
+        # check the mempool
+        json_string = http_get_call(url.hostname, url.port, '/rest/mempool/info'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['size'], 3)
+        json_string = http_get_call(url.hostname, url.port, '/rest/mempool/contents'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(sorted(json_obj.keys()), sorted(txs))
+        response = http_get_call(url.hostname, url.port, '/rest/mempool/contents'+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 200)
+        assert_greater_than(int(response.getheader('content-length')), 3*60)
+        
+        # the unconfirmed outputs are only found when asking to check the mempool
+        n = 0
+        for vout in self.nodes[0].getrawtransaction(txs[0], 1)['vout']:
+            if vout['value'] == 11:
+                n = vout['n']
+        json_string = http_get_call(url.hostname, url.port, '/rest/getutxos/'+txs[0]+'-'+str(n)+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['bitmap'], "0")
+        assert_equal(len(json_obj['utxos']), 0)
+        json_string = http_get_call(url.hostname, url.port, '/rest/getutxos/checkmempool/'+txs[0]+'-'+str(n)+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['bitmap'], "1")
+        assert_equal(json_obj['utxos'][0]['value'], 11)
+        assert_equal(json_obj['chaintipHash'], bb_hash)
+        
         # now mine the transactions
         newblockhash = self.nodes[1].setgenerate(True, 1)
         self.sync_all()
@@ -82,6 +108,38 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(json_string)
         for tx in txs:
             assert_equal(tx in json_obj['tx'], True)
+        
+        # the mined output is now in the UTXO set
+        json_string = http_get_call(url.hostname, url.port, '/rest/getutxos/'+txs[0]+'-'+str(n)+'/'+txs[0]+'-1000'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['bitmap'], "10")
+        assert_equal(json_obj['chainHeight'], self.nodes[0].getblockcount())
+        response = http_get_call(url.hostname, url.port, '/rest/getutxos/'+txs[0]+'-'+str(n)+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 200)
+        
+        # too many outpoints at once are refused
+        response = http_get_call(url.hostname, url.port, '/rest/getutxos/'+'/'.join([txs[0]+'-'+str(i) for i in range(16)])+self.FORMAT_SEPARATOR+'json', True)
+        assert_equal(response.status, 400)
+        
+        # check headers: from the previous tip there are only two
+        json_string = http_get_call(url.hostname, url.port, '/rest/headers/5/'+bb_hash+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(len(json_obj), 2)
+        assert_equal(json_obj[0]['hash'], bb_hash)
+        assert_equal(json_obj[1]['hash'], newblockhash[0])
+        assert_equal(json_obj[1]['previousblockhash'], bb_hash)
+        response = http_get_call(url.hostname, url.port, '/rest/headers/1/'+bb_hash+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 200)
+        hex_string = http_get_call(url.hostname, url.port, '/rest/headers/1/'+bb_hash+self.FORMAT_SEPARATOR+'hex')
+        assert_equal(len(hex_string.strip()), 2*int(response.getheader('content-length')))
+        response = http_get_call(url.hostname, url.port, '/rest/headers/0/'+bb_hash+self.FORMAT_SEPARATOR+'json', True)
+        assert_equal(response.status, 400)
+        
+        # check chaininfo
+        json_string = http_get_call(url.hostname, url.port, '/rest/chaininfo'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['bestblockhash'], newblockhash[0])
+        assert_equal(json_obj['blocks'], self.nodes[0].getblockcount())
                 
         
 
@@ -0,0 +1,66 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The UserV developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test headers-first initial sync: a fresh node syncing from three peers
+# downloads from all of them, and is timed against the getblocks fallback
+# (-headersfirst=0).
+#
+from test_framework import BitcoinTestFramework
+from bitcoinrpc.authproxy import AuthServiceProxy, JSONRPCException
+from util import *
+import os
+import shutil
+import time
+
+NUM_BLOCKS = 150
+
+class SyncHeadersFirstTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 4)
+
+    def setup_network(self):
+        self.nodes = start_nodes(3, self.options.tmpdir, [["-debug=net"]] * 3)
+        connect_nodes_bi(self.nodes, 0, 1)
+        connect_nodes_bi(self.nodes, 0, 2)
+        self.is_network_split = False
+
+    def sync_fresh_node(self, extra_args):
+        datadir = os.path.join(self.options.tmpdir, "node3")
+        shutil.rmtree(datadir)
+        initialize_datadir(self.options.tmpdir, 3)
+        node = start_node(3, self.options.tmpdir, ["-debug=net"] + extra_args)
+        start = time.time()
+        for i in range(3):
+            connect_nodes(node, i)
+        while node.getblockcount() < NUM_BLOCKS:
+            assert(time.time() - start < 120)
+            time.sleep(0.05)
+        elapsed = time.time() - start
+        assert_equal(node.getbestblockhash(), self.nodes[0].getbestblockhash())
+        return node, elapsed
+
+    def run_test(self):
+        self.nodes[0].setgenerate(True, NUM_BLOCKS)
+        sync_blocks(self.nodes)
+
+        node, elapsed_headers = self.sync_fresh_node([])
+        # Every peer told us its best header, so each one could be downloaded from
+        peers = node.getpeerinfo()
+        assert_equal(len(peers), 3)
+        for peer in peers:
+            assert_equal(peer['synced_headers'], NUM_BLOCKS)
+        stop_node(node, 3)
+
+        node, elapsed_getblocks = self.sync_fresh_node(["-headersfirst=0"])
+        stop_node(node, 3)
+
+        print("Synced %d blocks from 3 peers: headers-first %.2fs, getblocks %.2fs" % (NUM_BLOCKS, elapsed_headers, elapsed_getblocks))
+        print "Success"
+
+if __name__ == '__main__':
+    SyncHeadersFirstTest().main()
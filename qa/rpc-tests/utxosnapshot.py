@@ -0,0 +1,74 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The UserV developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test UTXO set snapshots: a node started from one written by dumptxoutset
+# is at its block right away, follows the chain from there, and downloads and
+# validates the blocks before it in the background.
+#
+from test_framework import BitcoinTestFramework
+from bitcoinrpc.authproxy import AuthServiceProxy, JSONRPCException
+from util import *
+import os
+import time
+
+SNAPSHOT_HEIGHT = 120
+
+class UtxoSnapshotTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = [start_node(0, self.options.tmpdir, ["-debug=net"])]
+        self.is_network_split = False
+
+    def run_test(self):
+        self.nodes[0].setgenerate(True, SNAPSHOT_HEIGHT)
+        path = os.path.join(self.options.tmpdir, "utxo.dat")
+        dump = self.nodes[0].dumptxoutset(path)
+        assert_equal(dump['height'], SNAPSHOT_HEIGHT)
+        assert_equal(dump['bestblock'], self.nodes[0].getbestblockhash())
+        try:
+            self.nodes[0].dumptxoutset(path)
+            raise AssertionError("dumptxoutset overwrote a file")
+        except JSONRPCException as e:
+            assert("already exists" in e.error['message'])
+        self.nodes[0].setgenerate(True, 10)
+
+        # The snapshot is the chain state before any block is downloaded
+        # Regtest has no known snapshots, the test names the one it trusts
+        assumeutxo = "-assumeutxo=" + dump['bestblock'] + ":" + dump['hash_outputs']
+        node = start_node(1, self.options.tmpdir, ["-debug=net", "-loadutxosnapshot=" + path, assumeutxo])
+        assert_equal(node.getblockcount(), SNAPSHOT_HEIGHT)
+        info = node.gettxoutsetinfo()
+        assert('hash_serialized' not in info)
+        assert_equal(info['bestblock'], dump['bestblock'])
+        assert_equal(info['hash_outputs'], dump['hash_outputs'])
+
+        connect_nodes(node, 0)
+        self.nodes.append(node)
+        sync_blocks(self.nodes)
+        history = os.path.join(self.options.tmpdir, "node1", "regtest", "chainstate_history")
+        start = time.time()
+        while os.path.exists(history):
+            assert(time.time() - start < 60)
+            time.sleep(0.1)
+        scanned = node.gettxoutsetinfo(True)
+        info = self.nodes[0].gettxoutsetinfo(False, True)
+        assert_equal(scanned['hash_outputs'], info['hash_outputs'])
+        assert_equal(scanned['hash_serialized'], info['hash_serialized'])
+
+        # Once validated, the blocks before the snapshot are there to be served
+        assert_equal(node.getblock(node.getblockhash(1))['height'], 1)
+        stop_node(node, 1)
+        node = start_node(1, self.options.tmpdir, ["-debug=net"])
+        assert_equal(node.getbestblockhash(), self.nodes[0].getbestblockhash())
+        self.nodes[1] = node
+        print "Success"
+
+if __name__ == '__main__':
+    UtxoSnapshotTest().main()
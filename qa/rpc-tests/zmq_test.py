@@ -7,19 +7,11 @@
 # Test ZMQ interface
 #
 
-from test_framework.test_framework import BitcoinTestFramework
-from test_framework.util import *
+from test_framework import BitcoinTestFramework
+from util import *
 import zmq
 import binascii
-
-try:
-    import http.client as httplib
-except ImportError:
-    import httplib
-try:
-    import urllib.parse as urlparse
-except ImportError:
-    import urlparse
+import struct
 
 class ZMQTest (BitcoinTestFramework):
 
@@ -28,63 +20,61 @@ class ZMQTest (BitcoinTestFramework):
     def setup_nodes(self):
         self.zmqContext = zmq.Context()
         self.zmqSubSocket = self.zmqContext.socket(zmq.SUB)
+        self.zmqSubSocket.setsockopt(zmq.RCVTIMEO, 60000)
+        # "hashtx" also matches "hashtxremove"
         self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashblock")
         self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashtx")
+        self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"rawblock")
         self.zmqSubSocket.connect("tcp://127.0.0.1:%i" % self.port)
+        address = 'tcp://127.0.0.1:'+str(self.port)
+        self.sequence = {}
         return start_nodes(4, self.options.tmpdir, extra_args=[
-            ['-zmqpubhashtx=tcp://127.0.0.1:'+str(self.port), '-zmqpubhashblock=tcp://127.0.0.1:'+str(self.port)],
+            ['-zmqpubhashtx='+address, '-zmqpubhashblock='+address, '-zmqpubrawblock='+address,
+             '-zmqpubhashtxremove='+address, '-zmqpubrawblockhwm=10'],
             [],
             [],
             []
             ])
 
+    def wait_for(self, topic, body):
+        """Read notifications until topic arrives with body (hex), checking sequence numbers on the way"""
+        while True:
+            msg = self.zmqSubSocket.recv_multipart()
+            assert_equal(len(msg), 3)
+            seq = struct.unpack('<I', msg[2])[0]
+            if msg[0] in self.sequence:
+                assert_equal(seq, self.sequence[msg[0]] + 1)
+            self.sequence[msg[0]] = seq
+            if msg[0] == topic and binascii.hexlify(msg[1]) == body:
+                return
+
     def run_test(self):
         self.sync_all()
 
-        genhashes = self.nodes[0].generate(1)
+        # blocks are published as hash and in full, the same as stored
+        genhashes = self.nodes[1].setgenerate(True, 1)
         self.sync_all()
-
-        print "listen..."
-        msg = self.zmqSubSocket.recv_multipart()
-        topic = msg[0]
-        body = msg[1]
-
-        msg = self.zmqSubSocket.recv_multipart()
-        topic = msg[0]
-        body = msg[1]
-        blkhash = bytes_to_hex_str(body)
-
-        assert_equal(genhashes[0], blkhash) #blockhash from generate must be equal to the hash received over zmq
+        self.wait_for(b"hashblock", genhashes[0])
+        self.wait_for(b"rawblock", self.nodes[0].getblock(genhashes[0], False))
 
         n = 10
-        genhashes = self.nodes[1].generate(n)
+        genhashes = self.nodes[1].setgenerate(True, n)
         self.sync_all()
-
-        zmqHashes = []
-        for x in range(0,n*2):
-            msg = self.zmqSubSocket.recv_multipart()
-            topic = msg[0]
-            body = msg[1]
-            if topic == b"hashblock":
-                zmqHashes.append(bytes_to_hex_str(body))
-
         for x in range(0,n):
-            assert_equal(genhashes[x], zmqHashes[x]) #blockhash from generate must be equal to the hash received over zmq
+            self.wait_for(b"hashblock", genhashes[x])
 
-        #test tx from a second node
+        # a transaction from a second node is published when it enters the mempool...
         hashRPC = self.nodes[1].sendtoaddress(self.nodes[0].getnewaddress(), 1.0)
         self.sync_all()
+        self.wait_for(b"hashtx", hashRPC)
+        assert_equal(hashRPC in self.nodes[0].getrawmempool(), True)
 
-        # now we should receive a zmq msg because the tx was broadcast
-        msg = self.zmqSubSocket.recv_multipart()
-        topic = msg[0]
-        body = msg[1]
-        hashZMQ = ""
-        if topic == b"hashtx":
-            hashZMQ = bytes_to_hex_str(body)
-
-        assert_equal(hashRPC, hashZMQ) #blockhash from generate must be equal to the hash received over zmq
-
+        # ...and when it leaves it by being mined
+        genhashes = self.nodes[1].setgenerate(True, 1)
+        self.sync_all()
+        self.wait_for(b"hashtxremove", hashRPC)
+        self.wait_for(b"hashblock", genhashes[0])
+        assert_equal(len(self.nodes[0].getrawmempool()), 0)
 
 if __name__ == '__main__':
     ZMQTest ().main ()
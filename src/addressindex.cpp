@@ -0,0 +1,46 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+
+#include "hash.h"
+#include "pubkey.h"
+#include "script/standard.h"
+
+bool GetAddressIndexKey(const CScript& script, int& typeRet, uint160& hashRet)
+{
+    // Fast paths for the templates that make up nearly all outputs, so that
+    // connecting a block does not have to run the generic Solver() per output.
+    if (script.IsPayToScriptHash()) {
+        typeRet = ADDRESS_INDEX_SCRIPTHASH;
+        hashRet = uint160(std::vector<unsigned char>(script.begin() + 2, script.begin() + 22));
+        return true;
+    }
+    if (script.size() == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 &&
+        script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG) {
+        typeRet = ADDRESS_INDEX_PUBKEYHASH;
+        hashRet = uint160(std::vector<unsigned char>(script.begin() + 3, script.begin() + 23));
+        return true;
+    }
+    if ((script.size() == 35 && script[0] == 33) || (script.size() == 67 && script[0] == 65)) {
+        if (script.back() != OP_CHECKSIG)
+            return false;
+        CPubKey pubkey(script.begin() + 1, script.end() - 1);
+        if (!pubkey.IsValid())
+            return false;
+        typeRet = ADDRESS_INDEX_PUBKEYHASH;
+        hashRet = pubkey.GetID();
+        return true;
+    }
+    return false;
+}
+
+CScript GetAddressIndexScript(int type, const uint160& hash)
+{
+    if (type == ADDRESS_INDEX_SCRIPTHASH)
+        return GetScriptForDestination(CScriptID(hash));
+    if (type == ADDRESS_INDEX_PUBKEYHASH)
+        return GetScriptForDestination(CKeyID(hash));
+    return CScript();
+}
@@ -0,0 +1,310 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "crypto/common.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** Kinds of destination tracked by the address index */
+enum AddressIndexType {
+    ADDRESS_INDEX_NONE = 0,
+    ADDRESS_INDEX_PUBKEYHASH = 1, //! P2PKH, and P2PK outputs folded onto their key id
+    ADDRESS_INDEX_SCRIPTHASH = 2, //! P2SH
+};
+
+/**
+ * Map a scriptPubKey onto the (type, hash160) pair it is indexed under.
+ * Pay-to-pubkey outputs (coinstake and most coinbase payouts) are indexed
+ * under the hash of the key so they show up for the matching address.
+ */
+bool GetAddressIndexKey(const CScript& script, int& typeRet, uint160& hashRet);
+
+/** Inverse of GetAddressIndexKey: rebuild the canonical script for an index entry */
+CScript GetAddressIndexScript(int type, const uint160& hash);
+
+namespace addressindex
+{
+/** Heights and positions are stored big endian so that LevelDB orders entries chronologically */
+template <typename Stream>
+inline void WriteBE32(Stream& s, uint32_t n)
+{
+    unsigned char buf[4];
+    ::WriteBE32(buf, n);
+    s.write((char*)buf, 4);
+}
+
+template <typename Stream>
+inline uint32_t ReadBE32(Stream& s)
+{
+    unsigned char buf[4];
+    s.read((char*)buf, 4);
+    return ::ReadBE32(buf);
+}
+}
+
+/**
+ * One credit or debit of an address: key of the 'a' records in the block
+ * tree database. The value is the signed amount (negative when spending).
+ */
+struct CAddressIndexKey {
+    unsigned char type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CAddressIndexKey(int typeIn, const uint160& hashIn, int heightIn, unsigned int txindexIn, const uint256& txhashIn, unsigned int indexIn, bool fSpending)
+    {
+        type = typeIn;
+        hashBytes = hashIn;
+        blockHeight = heightIn;
+        txindex = txindexIn;
+        txhash = txhashIn;
+        index = indexIn;
+        spending = fSpending;
+    }
+
+    CAddressIndexKey()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        type = ADDRESS_INDEX_NONE;
+        hashBytes = 0;
+        blockHeight = 0;
+        txindex = 0;
+        txhash = 0;
+        index = 0;
+        spending = false;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 20 + 4 + 4 + 32 + 4 + 1;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        addressindex::WriteBE32(s, blockHeight);
+        addressindex::WriteBE32(s, txindex);
+        txhash.Serialize(s, nType, nVersion);
+        addressindex::WriteBE32(s, index);
+        ::Serialize(s, spending, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        ::Unserialize(s, type, nType, nVersion);
+        hashBytes.Unserialize(s, nType, nVersion);
+        blockHeight = addressindex::ReadBE32(s);
+        txindex = addressindex::ReadBE32(s);
+        txhash.Unserialize(s, nType, nVersion);
+        index = addressindex::ReadBE32(s);
+        ::Unserialize(s, spending, nType, nVersion);
+    }
+};
+
+/** Prefix of CAddressIndexKey used to seek to the first (or last) entry of an address */
+struct CAddressIndexIteratorKey {
+    unsigned char type;
+    uint160 hashBytes;
+    bool fHeight;
+    int blockHeight;
+
+    CAddressIndexIteratorKey(int typeIn, const uint160& hashIn) : type(typeIn), hashBytes(hashIn), fHeight(false), blockHeight(0) {}
+    CAddressIndexIteratorKey(int typeIn, const uint160& hashIn, int heightIn) : type(typeIn), hashBytes(hashIn), fHeight(true), blockHeight(heightIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 20 + (fHeight ? 4 : 0);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        if (fHeight)
+            addressindex::WriteBE32(s, blockHeight);
+    }
+};
+
+/** Key of the 'u' records: one per unspent output paying to an address */
+struct CAddressUnspentKey {
+    unsigned char type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    CAddressUnspentKey(int typeIn, const uint160& hashIn, const uint256& txhashIn, unsigned int indexIn)
+    {
+        type = typeIn;
+        hashBytes = hashIn;
+        txhash = txhashIn;
+        index = indexIn;
+    }
+
+    CAddressUnspentKey()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        type = ADDRESS_INDEX_NONE;
+        hashBytes = 0;
+        txhash = 0;
+        index = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 20 + 32 + 4;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        ::Unserialize(s, type, nType, nVersion);
+        hashBytes.Unserialize(s, nType, nVersion);
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+    }
+};
+
+struct CAddressUnspentValue {
+    CAmount satoshis;
+    CScript script;
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(satoshis);
+        READWRITE(script);
+        READWRITE(blockHeight);
+    }
+
+    CAddressUnspentValue(CAmount sats, const CScript& scriptPubKey, int height)
+    {
+        satoshis = sats;
+        script = scriptPubKey;
+        blockHeight = height;
+    }
+
+    CAddressUnspentValue()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        satoshis = -1;
+        script.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const
+    {
+        return (satoshis == -1);
+    }
+};
+
+/** Key of the 'v' records holding the running totals of an address */
+struct CAddressBalanceKey {
+    unsigned char type;
+    uint160 hashBytes;
+
+    CAddressBalanceKey(int typeIn, const uint160& hashIn) : type(typeIn), hashBytes(hashIn) {}
+    CAddressBalanceKey() : type(ADDRESS_INDEX_NONE), hashBytes(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(type);
+        READWRITE(hashBytes);
+    }
+
+    friend bool operator<(const CAddressBalanceKey& a, const CAddressBalanceKey& b)
+    {
+        return a.type < b.type || (a.type == b.type && a.hashBytes < b.hashBytes);
+    }
+};
+
+/**
+ * Running totals of an address, kept up to date on every connect and
+ * disconnect so balance queries are a single key lookup. The block the
+ * totals are as of makes replaying a connect or disconnect a no-op, as
+ * happens for the blocks the chainstate had not flushed before a crash.
+ */
+struct CAddressBalance {
+    CAmount nBalance;
+    CAmount nReceived;
+    int64_t nEntries; //! number of CAddressIndexKey records (credits + debits)
+    uint256 hashBlock; //! last block applied to the totals, or the parent of the last one undone
+
+    CAddressBalance() : nBalance(0), nReceived(0), nEntries(0), hashBlock(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nBalance);
+        READWRITE(nReceived);
+        READWRITE(VARINT(nEntries));
+        READWRITE(hashBlock);
+    }
+
+    /** Apply a single index entry; fUndo reverts a previously applied one */
+    void Apply(CAmount nDelta, bool fUndo)
+    {
+        int nSign = fUndo ? -1 : 1;
+        nBalance += nSign * nDelta;
+        if (nDelta > 0)
+            nReceived += nSign * nDelta;
+        nEntries += nSign;
+    }
+
+    CAddressBalance& operator+=(const CAddressBalance& other)
+    {
+        nBalance += other.nBalance;
+        nReceived += other.nReceived;
+        nEntries += other.nEntries;
+        return *this;
+    }
+
+    bool IsEmpty() const
+    {
+        return nEntries == 0 && nBalance == 0 && nReceived == 0;
+    }
+};
+
+#endif // BITCOIN_ADDRESSINDEX_H
@@ -0,0 +1,95 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <univalue.h>
+
+namespace benchmark
+{
+State::State(int nSamplesIn, int64_t nBatchMicrosIn) : nBatchIterations(1), nSamples(nSamplesIn), nBatchMicros(nBatchMicrosIn), nLeft(0), nBatchStart(0), fWarmedUp(false)
+{
+}
+
+bool State::NextBatch()
+{
+    if (nBatchStart != 0) {
+        int64_t nElapsed = GetTimeMicros() - nBatchStart;
+        if (!fWarmedUp) {
+            // The batch that reaches the batch time is the last of the warmup
+            if (nElapsed < nBatchMicros)
+                nBatchIterations *= 2;
+            else
+                fWarmedUp = true;
+        } else {
+            vSamples.push_back(nElapsed * 0.000001 / nBatchIterations);
+            if ((int)vSamples.size() >= nSamples)
+                return false;
+        }
+    }
+    nLeft = nBatchIterations - 1;
+    nBatchStart = GetTimeMicros();
+    return true;
+}
+
+BenchRunner::BenchmarkMap& BenchRunner::Benchmarks()
+{
+    static BenchmarkMap benchmarks;
+    return benchmarks;
+}
+
+BenchRunner::BenchRunner(const std::string& name, BenchFunction func)
+{
+    Benchmarks().insert(std::make_pair(name, func));
+}
+
+void BenchRunner::RunAll(const std::string& strFilter, int nSamples, int64_t nBatchMicros, bool fJson)
+{
+    UniValue results(UniValue::VARR);
+    if (!fJson)
+        std::cout << "# Benchmark, samples, iterations, min(ns), median(ns), max(ns)" << std::endl;
+
+    for (BenchmarkMap::iterator it = Benchmarks().begin(); it != Benchmarks().end(); it++) {
+        if (it->first.find(strFilter) == std::string::npos)
+            continue;
+        State state(nSamples, nBatchMicros);
+        it->second(state);
+        std::vector<double> vSorted = state.vSamples;
+        if (vSorted.empty())
+            continue;
+        std::sort(vSorted.begin(), vSorted.end());
+        size_t nMid = vSorted.size() / 2;
+        double dMedian = vSorted.size() % 2 ? vSorted[nMid] : (vSorted[nMid - 1] + vSorted[nMid]) / 2;
+
+        if (fJson) {
+            UniValue result(UniValue::VOBJ);
+            result.push_back(Pair("name", it->first));
+            result.push_back(Pair("samples", (int64_t)vSorted.size()));
+            result.push_back(Pair("iterations", (int64_t)state.nBatchIterations));
+            result.push_back(Pair("min_ns", vSorted.front() * 1e9));
+            result.push_back(Pair("median_ns", dMedian * 1e9));
+            result.push_back(Pair("max_ns", vSorted.back() * 1e9));
+            results.push_back(result);
+        } else {
+            std::cout << strprintf("%s, %u, %u, %.1f, %.1f, %.1f", it->first, vSorted.size(), state.nBatchIterations,
+                             vSorted.front() * 1e9, dMedian * 1e9, vSorted.back() * 1e9)
+                      << std::endl;
+        }
+    }
+    if (fJson)
+        std::cout << results.write(2) << std::endl;
+}
+
+void BenchRunner::List()
+{
+    for (BenchmarkMap::iterator it = Benchmarks().begin(); it != Benchmarks().end(); it++)
+        std::cout << it->first << std::endl;
+}
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_BENCH_H
+#define BITCOIN_BENCH_BENCH_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+/**
+ * Micro-benchmarks run by bench_userv. A benchmark is a function looping on
+ * State::KeepRunning() around the code it measures, after a setup that is
+ * not measured:
+ *
+ *     static void HashQuarkHeader(benchmark::State& state)
+ *     {
+ *         CBlockHeader header;
+ *         while (state.KeepRunning())
+ *             header.GetHash();
+ *     }
+ *     BENCHMARK(HashQuarkHeader);
+ *
+ * Iterations are timed in batches, so that reading the clock costs nothing
+ * next to them. Warming up doubles the batch until one takes the batch
+ * time; every sample is then a batch of that many iterations.
+ */
+namespace benchmark
+{
+class State
+{
+public:
+    //! Iterations timed together
+    uint64_t nBatchIterations;
+    //! Seconds per iteration of each batch timed
+    std::vector<double> vSamples;
+
+    State(int nSamplesIn, int64_t nBatchMicrosIn);
+
+    //! Whether to run one more iteration
+    bool KeepRunning()
+    {
+        if (nLeft > 0) {
+            nLeft--;
+            return true;
+        }
+        return NextBatch();
+    }
+
+private:
+    int nSamples;
+    int64_t nBatchMicros;
+    uint64_t nLeft;
+    int64_t nBatchStart;
+    bool fWarmedUp;
+
+    bool NextBatch();
+};
+
+typedef boost::function<void(State&)> BenchFunction;
+
+class BenchRunner
+{
+private:
+    typedef std::map<std::string, BenchFunction> BenchmarkMap;
+    static BenchmarkMap& Benchmarks();
+
+public:
+    BenchRunner(const std::string& name, BenchFunction func);
+
+    //! Run the benchmarks whose name contains strFilter, printing a line for each, or a JSON array
+    static void RunAll(const std::string& strFilter, int nSamples, int64_t nBatchMicros, bool fJson);
+    static void List();
+};
+}
+
+//! Register a benchmark function under its name
+#define BENCHMARK(n) \
+    benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif // BITCOIN_BENCH_BENCH_H
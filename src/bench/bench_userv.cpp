@@ -0,0 +1,61 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "chainparams.h"
+#include "key.h"
+#include "script/sigcache.h"
+#include "ui_interface.h"
+#include "util.h"
+
+#include <iostream>
+
+CClientUIInterface uiInterface;
+CWallet* pwalletMain;
+
+void StartShutdown()
+{
+    exit(0);
+}
+
+bool ShutdownRequested()
+{
+    return false;
+}
+
+static const int DEFAULT_BENCH_SAMPLES = 10;
+static const int DEFAULT_BENCH_BATCH_TIME = 10;
+
+int main(int argc, char** argv)
+{
+    ParseParameters(argc, argv);
+    if (mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help")) {
+        std::cout << "Usage: bench_userv [options]\n\n"
+                  << "Options:\n"
+                  << "  -filter=<str>     Only run the benchmarks whose name contains <str>\n"
+                  << "  -list             List the benchmarks and exit\n"
+                  << strprintf("  -samples=<n>      Time <n> batches of iterations (default: %d)\n", DEFAULT_BENCH_SAMPLES)
+                  << strprintf("  -batchtime=<ms>   Make a batch take at least <ms> milliseconds (default: %d)\n", DEFAULT_BENCH_BATCH_TIME)
+                  << "  -json             Print the results as a JSON array\n";
+        return 0;
+    }
+    if (GetBoolArg("-list", false)) {
+        benchmark::BenchRunner::List();
+        return 0;
+    }
+
+    SetupEnvironment();
+    fPrintToDebugLog = false;
+    SelectParams(CBaseChainParams::MAIN);
+    ECC_Start();
+    ECCVerifyHandle globalVerifyHandle;
+    InitSignatureCache();
+
+    benchmark::BenchRunner::RunAll(GetArg("-filter", ""), std::max(1, (int)GetArg("-samples", DEFAULT_BENCH_SAMPLES)),
+        std::max((int64_t)1, GetArg("-batchtime", DEFAULT_BENCH_BATCH_TIME)) * 1000, GetBoolArg("-json", false));
+
+    ECC_Stop();
+    return 0;
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+#include "bench/data.h"
+
+#include "bloom.h"
+#include "random.h"
+
+// Filling a filter with 1000 hashes and looking each of them up
+static void BloomFilterInsertContains(benchmark::State& state)
+{
+    seed_insecure_rand(true);
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 1000; i++)
+        vHashes.push_back(InsecureHash());
+    while (state.KeepRunning()) {
+        CBloomFilter filter(vHashes.size(), 0.0001, 0, BLOOM_UPDATE_NONE);
+        for (unsigned int i = 0; i < vHashes.size(); i++)
+            filter.insert(vHashes[i]);
+        for (unsigned int i = 0; i < vHashes.size(); i++)
+            filter.contains(vHashes[i]);
+    }
+}
+
+// Matching the transactions of a block of 500 against the filter of a light client watching 50 addresses
+static void BloomFilterRelevantTx(benchmark::State& state)
+{
+    CBlock block = SyntheticBlock(500);
+    CBloomFilter filter(50, 0.0001, 0, BLOOM_UPDATE_NONE);
+    for (unsigned int i = 0; i < block.vtx.size(); i += block.vtx.size() / 50) {
+        const CScript& script = block.vtx[i].vout[0].scriptPubKey;
+        filter.insert(std::vector<unsigned char>(script.begin() + 3, script.begin() + 23));
+    }
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < block.vtx.size(); i++)
+            filter.IsRelevantAndUpdate(block.vtx[i]);
+    }
+}
+
+BENCHMARK(BloomFilterInsertContains);
+BENCHMARK(BloomFilterRelevantTx);
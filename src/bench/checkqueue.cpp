@@ -0,0 +1,153 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "checkqueue.h"
+#include "crypto/sha256.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+/** A check costing two hashes, cheap enough for the queue itself to show */
+struct CBenchCheck {
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+
+    CBenchCheck() { memset(hash, 0, sizeof(hash)); }
+
+    bool operator()()
+    {
+        CSHA256().Write(hash, sizeof(hash)).Finalize(hash);
+        CSHA256().Write(hash, sizeof(hash)).Finalize(hash);
+        return true;
+    }
+
+    void swap(CBenchCheck& other) { std::swap_ranges(hash, hash + sizeof(hash), other.hash); }
+};
+
+/** The single mutex queue CCheckQueue replaced, kept here to compare it with */
+template <typename T>
+class CMutexCheckQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    boost::condition_variable condMaster;
+    std::vector<T> queue;
+    int nIdle;
+    int nTotal;
+    bool fAllOk;
+    unsigned int nTodo;
+    unsigned int nBatchSize;
+
+    bool Loop(bool fMaster)
+    {
+        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        unsigned int nNow = 0;
+        bool fOk = true;
+        do {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (nNow) {
+                    fAllOk &= fOk;
+                    nTodo -= nNow;
+                    if (nTodo == 0 && !fMaster)
+                        condMaster.notify_one();
+                } else {
+                    nTotal++;
+                }
+                while (queue.empty()) {
+                    if (fMaster && nTodo == 0) {
+                        nTotal--;
+                        bool fRet = fAllOk;
+                        fAllOk = true;
+                        return fRet;
+                    }
+                    nIdle++;
+                    cond.wait(lock);
+                    nIdle--;
+                }
+                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
+                vChecks.resize(nNow);
+                for (unsigned int i = 0; i < nNow; i++) {
+                    vChecks[i].swap(queue.back());
+                    queue.pop_back();
+                }
+                fOk = fAllOk;
+            }
+            BOOST_FOREACH (T& check, vChecks)
+                if (fOk)
+                    fOk = check();
+            vChecks.clear();
+        } while (true);
+    }
+
+public:
+    CMutexCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+
+    void Thread() { Loop(false); }
+    bool Wait() { return Loop(true); }
+
+    void Add(std::vector<T>& vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        BOOST_FOREACH (T& check, vChecks) {
+            queue.push_back(T());
+            check.swap(queue.back());
+        }
+        nTodo += vChecks.size();
+        if (vChecks.size() == 1)
+            condWorker.notify_one();
+        else if (vChecks.size() > 1)
+            condWorker.notify_all();
+    }
+};
+
+// Checking a block of 1000 transactions of 2 inputs each with nThreads threads, the master included
+template <typename Queue>
+static void CheckQueueBlock(benchmark::State& state, int nThreads)
+{
+    Queue queue(128);
+    boost::thread_group workers;
+    for (int i = 0; i < nThreads - 1; i++)
+        workers.create_thread(boost::bind(&Queue::Thread, &queue));
+
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            std::vector<CBenchCheck> vChecks(2);
+            queue.Add(vChecks);
+        }
+        bool fOk = queue.Wait();
+        assert(fOk);
+    }
+
+    workers.interrupt_all();
+    workers.join_all();
+}
+
+// The work stealing queue against the single mutex one, under the same load
+static void CheckQueue1Thread(benchmark::State& state) { CheckQueueBlock<CCheckQueue<CBenchCheck> >(state, 1); }
+static void CheckQueue2Threads(benchmark::State& state) { CheckQueueBlock<CCheckQueue<CBenchCheck> >(state, 2); }
+static void CheckQueue4Threads(benchmark::State& state) { CheckQueueBlock<CCheckQueue<CBenchCheck> >(state, 4); }
+static void CheckQueue8Threads(benchmark::State& state) { CheckQueueBlock<CCheckQueue<CBenchCheck> >(state, 8); }
+static void MutexCheckQueue1Thread(benchmark::State& state) { CheckQueueBlock<CMutexCheckQueue<CBenchCheck> >(state, 1); }
+static void MutexCheckQueue2Threads(benchmark::State& state) { CheckQueueBlock<CMutexCheckQueue<CBenchCheck> >(state, 2); }
+static void MutexCheckQueue4Threads(benchmark::State& state) { CheckQueueBlock<CMutexCheckQueue<CBenchCheck> >(state, 4); }
+static void MutexCheckQueue8Threads(benchmark::State& state) { CheckQueueBlock<CMutexCheckQueue<CBenchCheck> >(state, 8); }
+
+BENCHMARK(CheckQueue1Thread);
+BENCHMARK(CheckQueue2Threads);
+BENCHMARK(CheckQueue4Threads);
+BENCHMARK(CheckQueue8Threads);
+BENCHMARK(MutexCheckQueue1Thread);
+BENCHMARK(MutexCheckQueue2Threads);
+BENCHMARK(MutexCheckQueue4Threads);
+BENCHMARK(MutexCheckQueue8Threads);
@@ -0,0 +1,106 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+#include "bench/data.h"
+
+#include "chain.h"
+#include "coins.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "random.h"
+#include "script/sign.h"
+#include "script/standard.h"
+
+#include <assert.h>
+
+// Reading and spending the outputs of 100 transactions through a cache, as connecting a block does
+static void CoinsCacheAccessSpend(benchmark::State& state)
+{
+    seed_insecure_rand(true);
+    CCoinsView viewDummy;
+    CCoinsViewCache base(&viewDummy);
+    std::vector<uint256> vTxid;
+    for (int i = 0; i < 2000; i++) {
+        vTxid.push_back(InsecureHash());
+        CCoinsModifier coins = base.ModifyCoins(vTxid.back());
+        coins->nVersion = 1;
+        coins->nHeight = 1 + i / 10;
+        coins->vout.resize(10);
+        for (unsigned int n = 0; n < coins->vout.size(); n++) {
+            coins->vout[n].nValue = 1 + insecure_rand() % 100000000;
+            coins->vout[n].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(InsecureHash()) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+    }
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(&base);
+        for (unsigned int i = 0; i < 100; i++) {
+            const uint256& txid = vTxid[(i * 19) % vTxid.size()];
+            if (cache.AccessCoins(txid)->IsAvailable(i % 10))
+                cache.ModifyCoins(txid)->Spend(i % 10);
+        }
+    }
+}
+
+/** A transaction spending two pay to pubkey hash outputs of view, signed */
+static CTransaction SignedSpend(CCoinsViewCache& view)
+{
+    seed_insecure_rand(true);
+    uint256 secret = InsecureHash();
+    CKey key;
+    key.Set(secret.begin(), secret.end(), true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+
+    CMutableTransaction txFrom;
+    txFrom.vin.resize(1);
+    txFrom.vin[0].prevout = COutPoint(InsecureHash(), 0);
+    txFrom.vout.resize(2);
+    for (unsigned int n = 0; n < txFrom.vout.size(); n++) {
+        txFrom.vout[n].nValue = COIN;
+        txFrom.vout[n].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    }
+    *view.ModifyCoins(txFrom.GetHash()) = CCoins(txFrom, 1);
+    view.SetBestBlock(SyntheticChainTip()->GetBlockHash());
+
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+        tx.vin[i].prevout = COutPoint(txFrom.GetHash(), i);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = COIN;
+    tx.vout[0].scriptPubKey = txFrom.vout[0].scriptPubKey;
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+        assert(SignSignature(keystore, txFrom, tx, i));
+    return tx;
+}
+
+// Checking the inputs of a transaction, their signatures included, without the signature cache storing them
+static void CheckInputsScripts(benchmark::State& state)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    CTransaction tx = SignedSpend(view);
+    CValidationState stateCheck;
+    assert(CheckInputs(tx, stateCheck, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, false));
+    while (state.KeepRunning())
+        CheckInputs(tx, stateCheck, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, false);
+}
+
+// The same, but for the checks of amounts and maturity that come before the scripts
+static void CheckInputsNoScripts(benchmark::State& state)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    CTransaction tx = SignedSpend(view);
+    CValidationState stateCheck;
+    while (state.KeepRunning())
+        CheckInputs(tx, stateCheck, view, false, STANDARD_SCRIPT_VERIFY_FLAGS, false);
+}
+
+BENCHMARK(CoinsCacheAccessSpend);
+BENCHMARK(CheckInputsScripts);
+BENCHMARK(CheckInputsNoScripts);
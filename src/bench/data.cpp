@@ -0,0 +1,77 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/data.h"
+
+#include "main.h"
+#include "random.h"
+#include "script/script.h"
+
+static std::vector<unsigned char> InsecureBytes(size_t nSize)
+{
+    std::vector<unsigned char> vch(nSize);
+    for (size_t i = 0; i < nSize; i++)
+        vch[i] = insecure_rand();
+    return vch;
+}
+
+uint256 InsecureHash()
+{
+    uint256 hash;
+    for (unsigned char* p = hash.begin(); p != hash.end(); p++)
+        *p = insecure_rand();
+    return hash;
+}
+
+CBlockIndex* SyntheticChainTip()
+{
+    LOCK(cs_main);
+    if (chainActive.Tip() != NULL)
+        return chainActive.Tip();
+
+    seed_insecure_rand(true);
+    CBlockIndex* pindexPrev = NULL;
+    for (int nHeight = 0; nHeight <= SYNTHETIC_CHAIN_HEIGHT; nHeight++) {
+        CBlock block;
+        block.hashPrevBlock = pindexPrev ? pindexPrev->GetBlockHash() : uint256(0);
+        block.hashMerkleRoot = InsecureHash();
+        block.nTime = 1500000000 + nHeight * 60;
+        block.nBits = 0x1e0ffff0;
+        block.nNonce = insecure_rand();
+        CBlockIndex* pindex = new CBlockIndex(block);
+        pindex->phashBlock = &mapBlockIndex.insert(std::make_pair(block.GetHash(), pindex)).first->first;
+        pindex->pprev = pindexPrev;
+        pindex->nHeight = nHeight;
+        pindex->SetStakeModifier(((uint64_t)insecure_rand() << 32) | insecure_rand(), true);
+        pindex->BuildSkip();
+        pindexPrev = pindex;
+    }
+    chainActive.SetTip(pindexPrev);
+    return pindexPrev;
+}
+
+CBlock SyntheticBlock(unsigned int nTransactions)
+{
+    seed_insecure_rand(true);
+    CBlock block;
+    block.nTime = 1500000000;
+    block.nBits = 0x1e0ffff0;
+    for (unsigned int i = 0; i < nTransactions; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(2);
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            tx.vin[j].prevout = COutPoint(InsecureHash(), insecure_rand() % 4);
+            // The size of a signature and a compressed public key
+            tx.vin[j].scriptSig = CScript() << InsecureBytes(72) << InsecureBytes(33);
+        }
+        tx.vout.resize(2);
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            tx.vout[j].nValue = 1 + insecure_rand() % 100000000;
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << InsecureBytes(20) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
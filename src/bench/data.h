@@ -0,0 +1,33 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_DATA_H
+#define BITCOIN_BENCH_DATA_H
+
+#include "primitives/block.h"
+#include "uint256.h"
+
+class CBlockIndex;
+
+/**
+ * Synthetic data for the benchmarks, from insecure_rand seeded
+ * deterministically, so that every run measures the same work.
+ */
+
+//! Height of the chain SyntheticChainTip builds
+static const int SYNTHETIC_CHAIN_HEIGHT = 2000;
+
+//! A hash from insecure_rand
+uint256 InsecureHash();
+
+/**
+ * The tip of a chain of headers a minute apart, each generating a stake
+ * modifier, made the active chain and added to mapBlockIndex the first time.
+ */
+CBlockIndex* SyntheticChainTip();
+
+//! A block of nTransactions transactions, each spending 2 outputs into 2 pay to pubkey hash outputs
+CBlock SyntheticBlock(unsigned int nTransactions);
+
+#endif // BITCOIN_BENCH_DATA_H
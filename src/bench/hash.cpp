@@ -0,0 +1,18 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+#include "bench/data.h"
+
+#include "chain.h"
+
+// The proof of work hash of a block header
+static void HashQuarkHeader(benchmark::State& state)
+{
+    CBlockHeader header = SyntheticChainTip()->GetBlockHeader();
+    while (state.KeepRunning())
+        header.nNonce = header.GetHash().GetLow64();
+}
+
+BENCHMARK(HashQuarkHeader);
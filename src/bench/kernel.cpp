@@ -0,0 +1,53 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+#include "bench/data.h"
+
+#include "amount.h"
+#include "chain.h"
+#include "kernel.h"
+#include "random.h"
+
+#include <assert.h>
+
+/** The coin a synthetic stake spends, in a block far enough from the tip for its stake modifier to be known */
+static CBlockHeader StakeBlockFrom(CTxOut& txoutPrev, COutPoint& prevout)
+{
+    CBlockHeader blockFrom = SyntheticChainTip()->GetAncestor(SYNTHETIC_CHAIN_HEIGHT / 2)->GetBlockHeader();
+    seed_insecure_rand(true);
+    txoutPrev = CTxOut(1000 * COIN, CScript());
+    prevout = COutPoint(InsecureHash(), 1);
+    return blockFrom;
+}
+
+// Checking the kernel of a block's coinstake
+static void StakeKernelCheck(benchmark::State& state)
+{
+    CTxOut txoutPrev;
+    COutPoint prevout;
+    CBlockHeader blockFrom = StakeBlockFrom(txoutPrev, prevout);
+    unsigned int nTimeTx = blockFrom.nTime + 3600;
+    uint256 hashProofOfStake = 0;
+    CheckStakeKernelHash(blockFrom.nBits, blockFrom, txoutPrev, prevout, nTimeTx, 0, true, hashProofOfStake);
+    assert(hashProofOfStake != 0);
+    while (state.KeepRunning())
+        CheckStakeKernelHash(blockFrom.nBits, blockFrom, txoutPrev, prevout, nTimeTx, 0, true, hashProofOfStake);
+}
+
+// Looking for a kernel over a minute of timestamps, as staking does, against a target never hit
+static void StakeKernelSearch(benchmark::State& state)
+{
+    CTxOut txoutPrev;
+    COutPoint prevout;
+    CBlockHeader blockFrom = StakeBlockFrom(txoutPrev, prevout);
+    uint256 hashProofOfStake;
+    while (state.KeepRunning()) {
+        unsigned int nTimeTx = blockFrom.nTime + 3600;
+        CheckStakeKernelHash(0x03000001, blockFrom, txoutPrev, prevout, nTimeTx, 60, false, hashProofOfStake);
+    }
+}
+
+BENCHMARK(StakeKernelCheck);
+BENCHMARK(StakeKernelSearch);
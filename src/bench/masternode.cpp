@@ -0,0 +1,40 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+#include "bench/data.h"
+
+#include "chain.h"
+#include "masternodeman.h"
+#include "random.h"
+#include "timedata.h"
+
+/** The inputs of 500 masternodes added to mnodeman, old enough to be ranked */
+static std::vector<CTxIn> SyntheticMasternodes()
+{
+    static std::vector<CTxIn> vMasternodeIn;
+    if (!vMasternodeIn.empty())
+        return vMasternodeIn;
+    seed_insecure_rand(true);
+    for (int i = 0; i < 500; i++) {
+        CMasternode mn;
+        mn.vin = CTxIn(COutPoint(InsecureHash(), insecure_rand() % 4));
+        mn.sigTime = GetAdjustedTime() - 24 * 60 * 60;
+        if (mnodeman.Add(mn))
+            vMasternodeIn.push_back(mn.vin);
+    }
+    return vMasternodeIn;
+}
+
+// Ranking a masternode among 500 by their scores for the payment of a block
+static void MasternodeRank(benchmark::State& state)
+{
+    int nBlockHeight = SyntheticChainTip()->nHeight - 10;
+    std::vector<CTxIn> vMasternodeIn = SyntheticMasternodes();
+    unsigned int i = 0;
+    while (state.KeepRunning())
+        mnodeman.GetMasternodeRank(vMasternodeIn[i++ % vMasternodeIn.size()], nBlockHeight, 0, false);
+}
+
+BENCHMARK(MasternodeRank);
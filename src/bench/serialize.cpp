@@ -0,0 +1,63 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+#include "bench/data.h"
+
+#include "streams.h"
+#include "version.h"
+
+// Serializing a block of 500 transactions
+static void SerializeBlock(benchmark::State& state)
+{
+    CBlock block = SyntheticBlock(500);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    while (state.KeepRunning()) {
+        ss.clear();
+        ss << block;
+    }
+}
+
+// Deserializing it, the hashes of its transactions included
+static void DeserializeBlock(benchmark::State& state)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << SyntheticBlock(500);
+    size_t nSize = ss.size();
+    // A byte left unread keeps the stream from dropping what was read, so it can be rewound
+    ss << (unsigned char)0;
+    while (state.KeepRunning()) {
+        CBlock block;
+        ss >> block;
+        ss.Rewind(nSize);
+    }
+}
+
+static void SerializeTransaction(benchmark::State& state)
+{
+    CTransaction tx = SyntheticBlock(1).vtx[0];
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    while (state.KeepRunning()) {
+        ss.clear();
+        ss << tx;
+    }
+}
+
+static void DeserializeTransaction(benchmark::State& state)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << SyntheticBlock(1).vtx[0];
+    size_t nSize = ss.size();
+    ss << (unsigned char)0;
+    while (state.KeepRunning()) {
+        CTransaction tx;
+        ss >> tx;
+        ss.Rewind(nSize);
+    }
+}
+
+BENCHMARK(SerializeBlock);
+BENCHMARK(DeserializeBlock);
+BENCHMARK(SerializeTransaction);
+BENCHMARK(DeserializeTransaction);
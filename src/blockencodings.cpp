@@ -0,0 +1,144 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <map>
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) : nonce(GetRand(std::numeric_limits<uint64_t>::max())),
+                                                                             header(block.GetBlockHeader()),
+                                                                             vchBlockSig(block.vchBlockSig)
+{
+    FillShortTxIDSelector();
+
+    // The coinbase and the coinstake only exist inside the block
+    size_t nPrefilled = block.IsProofOfStake() ? 2 : 1;
+    nPrefilled = std::min(nPrefilled, block.vtx.size());
+    for (size_t i = 0; i < nPrefilled; i++)
+        prefilledtxn.push_back(PrefilledTransaction(i, block.vtx[i]));
+
+    shorttxids.reserve(block.vtx.size() - nPrefilled);
+    for (size_t i = nPrefilled; i < block.vtx.size(); i++)
+        shorttxids.push_back(GetShortID(block.vtx[i].GetHash()));
+}
+
+void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nonce;
+    uint256 shorttxidhash;
+    CSHA256().Write((const unsigned char*)&stream[0], stream.size()).Finalize(shorttxidhash.begin());
+    shorttxidk0 = ReadLE64(shorttxidhash.begin());
+    shorttxidk1 = ReadLE64(shorttxidhash.begin() + 8);
+}
+
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const
+{
+    return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
+}
+
+ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool)
+{
+    if (cmpctblock.header.IsNull() || cmpctblock.BlockTxCount() == 0)
+        return READ_STATUS_INVALID;
+    static const size_t nMinTxSize = ::GetSerializeSize(CTransaction(), SER_NETWORK, PROTOCOL_VERSION);
+    if (cmpctblock.BlockTxCount() > MAX_BLOCK_SIZE / nMinTxSize || cmpctblock.BlockTxCount() > MAX_COMPACT_BLOCK_TXS)
+        return READ_STATUS_INVALID;
+
+    assert(header.IsNull() && txn.empty());
+    header = cmpctblock.header;
+    vchBlockSig = cmpctblock.vchBlockSig;
+    txn.resize(cmpctblock.BlockTxCount());
+    vAvailable.assign(txn.size(), false);
+
+    for (size_t i = 0; i < cmpctblock.prefilledtxn.size(); i++) {
+        const PrefilledTransaction& prefilled = cmpctblock.prefilledtxn[i];
+        if (prefilled.tx.IsNull() || prefilled.index >= txn.size())
+            return READ_STATUS_INVALID;
+        txn[prefilled.index] = prefilled.tx;
+        vAvailable[prefilled.index] = true;
+    }
+    nPrefilled = cmpctblock.prefilledtxn.size();
+
+    // Short IDs fill the slots left between the prefilled transactions, in order
+    std::map<uint64_t, uint16_t> mapShortIDs;
+    size_t nIndex = 0;
+    for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++) {
+        while (nIndex < vAvailable.size() && vAvailable[nIndex])
+            nIndex++;
+        if (nIndex >= vAvailable.size())
+            return READ_STATUS_INVALID;
+        if (!mapShortIDs.insert(std::make_pair(cmpctblock.shorttxids[i], nIndex)).second) {
+            // Two transactions of the block share a short ID, the mempool cannot tell them apart
+            return READ_STATUS_FAILED;
+        }
+        nIndex++;
+    }
+
+    std::vector<bool> vCollided(txn.size(), false);
+    {
+        LOCK(pool.cs);
+        for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = pool.mapTx.begin(); it != pool.mapTx.end() && nFromMempool < mapShortIDs.size(); it++) {
+            std::map<uint64_t, uint16_t>::const_iterator itID = mapShortIDs.find(cmpctblock.GetShortID(it->first));
+            if (itID == mapShortIDs.end() || vCollided[itID->second])
+                continue;
+            if (!vAvailable[itID->second]) {
+                txn[itID->second] = it->second.GetTx();
+                vAvailable[itID->second] = true;
+                nFromMempool++;
+            } else {
+                // Two mempool transactions match this short ID: ask the peer which one it is
+                txn[itID->second] = CTransaction();
+                vAvailable[itID->second] = false;
+                vCollided[itID->second] = true;
+                nFromMempool--;
+            }
+        }
+    }
+
+    LogPrint("cmpctblock", "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu, %u prefilled, %u from mempool\n",
+        header.GetHash().ToString(), ::GetSerializeSize(cmpctblock, SER_NETWORK, PROTOCOL_VERSION), nPrefilled, nFromMempool);
+    return READ_STATUS_OK;
+}
+
+bool PartiallyDownloadedBlock::IsTxAvailable(size_t index) const
+{
+    assert(!header.IsNull());
+    assert(index < vAvailable.size());
+    return vAvailable[index];
+}
+
+ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing) const
+{
+    assert(!header.IsNull());
+    block = CBlock(header);
+    block.vtx = txn;
+    block.vchBlockSig = vchBlockSig;
+
+    size_t nMissing = 0;
+    for (size_t i = 0; i < txn.size(); i++) {
+        if (vAvailable[i])
+            continue;
+        if (nMissing >= vtx_missing.size())
+            return READ_STATUS_INVALID;
+        block.vtx[i] = vtx_missing[nMissing++];
+    }
+    if (nMissing != vtx_missing.size())
+        return READ_STATUS_INVALID;
+
+    // A short ID collision with a mempool transaction gives a different merkle root
+    bool fMutated = false;
+    if (block.BuildMerkleTree(&fMutated) != header.hashMerkleRoot || fMutated)
+        return READ_STATUS_FAILED;
+
+    return READ_STATUS_OK;
+}
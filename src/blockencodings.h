@@ -0,0 +1,261 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+class CTxMemPool;
+
+/** Number of bytes of a short transaction ID on the wire */
+static const int SHORTTXIDS_LENGTH = 6;
+
+/** Most transactions a compact block can carry, they are addressed with 16 bit indexes */
+static const size_t MAX_COMPACT_BLOCK_TXS = std::numeric_limits<uint16_t>::max();
+
+/** Write a list of ascending indexes as differences, each one the distance to the previous index plus one */
+template <typename Stream>
+void SerializeDifferentialIndexes(Stream& s, const std::vector<uint16_t>& indexes)
+{
+    WriteCompactSize(s, indexes.size());
+    for (size_t i = 0; i < indexes.size(); i++)
+        WriteCompactSize(s, indexes[i] - (i == 0 ? 0 : (indexes[i - 1] + 1)));
+}
+
+template <typename Stream>
+void UnserializeDifferentialIndexes(Stream& s, std::vector<uint16_t>& indexes)
+{
+    uint64_t nCount = ReadCompactSize(s);
+    indexes.clear();
+    uint64_t nOffset = 0;
+    for (uint64_t i = 0; i < nCount; i++) {
+        uint64_t nIndex = ReadCompactSize(s) + nOffset;
+        if (nIndex > std::numeric_limits<uint16_t>::max())
+            throw std::ios_base::failure("differential index overflowed 16 bits");
+        indexes.push_back(nIndex);
+        nOffset = nIndex + 1;
+    }
+}
+
+/** Ask a peer that sent a compact block for the transactions we could not find */
+class BlockTransactionsRequest
+{
+public:
+    uint256 blockhash;
+    std::vector<uint16_t> indexes;
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, blockhash, nType, nVersion);
+        SerializeDifferentialIndexes(s, indexes);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        ::Unserialize(s, blockhash, nType, nVersion);
+        UnserializeDifferentialIndexes(s, indexes);
+    }
+};
+
+/** Answer to a BlockTransactionsRequest, the transactions in the order they were asked for */
+class BlockTransactions
+{
+public:
+    uint256 blockhash;
+    std::vector<CTransaction> txn;
+
+    BlockTransactions() {}
+    explicit BlockTransactions(const BlockTransactionsRequest& req) : blockhash(req.blockhash), txn(req.indexes.size()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(blockhash);
+        READWRITE(txn);
+    }
+};
+
+/** A transaction sent in full inside a compact block, at its position in the block */
+struct PrefilledTransaction {
+    //! Differentially encoded on the wire, the absolute index in memory
+    uint16_t index;
+    CTransaction tx;
+
+    PrefilledTransaction() : index(0) {}
+    PrefilledTransaction(uint16_t indexIn, const CTransaction& txIn) : index(indexIn), tx(txIn) {}
+};
+
+/**
+ * A block announced as its header plus a 6 byte short ID per transaction.
+ * The receiver rebuilds it from its mempool and only asks for what it lacks.
+ * The coinbase and, on proof-of-stake blocks, the coinstake can never be in
+ * a mempool, so they are always sent in full. The block signature is carried
+ * along since it is not covered by the header.
+ *
+ * Short IDs are SipHash-2-4 keyed with a hash of the header and a random
+ * nonce, so a peer cannot precompute transactions whose IDs collide.
+ */
+class CBlockHeaderAndShortTxIDs
+{
+private:
+    mutable uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+    friend class PartiallyDownloadedBlock;
+
+protected:
+    std::vector<uint64_t> shorttxids;
+    std::vector<PrefilledTransaction> prefilledtxn;
+
+public:
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+
+    // Dummy for deserialization
+    CBlockHeaderAndShortTxIDs() {}
+
+    explicit CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    uint64_t GetShortID(const uint256& txhash) const;
+
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+    size_t PrefilledTxCount() const { return prefilledtxn.size(); }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, header, nType, nVersion);
+        ::Serialize(s, nonce, nType, nVersion);
+
+        WriteCompactSize(s, shorttxids.size());
+        for (size_t i = 0; i < shorttxids.size(); i++) {
+            uint32_t lsb = shorttxids[i] & 0xffffffff;
+            uint16_t msb = (shorttxids[i] >> 32) & 0xffff;
+            ::Serialize(s, lsb, nType, nVersion);
+            ::Serialize(s, msb, nType, nVersion);
+        }
+
+        std::vector<uint16_t> indexes;
+        for (size_t i = 0; i < prefilledtxn.size(); i++)
+            indexes.push_back(prefilledtxn[i].index);
+        SerializeDifferentialIndexes(s, indexes);
+        for (size_t i = 0; i < prefilledtxn.size(); i++)
+            ::Serialize(s, prefilledtxn[i].tx, nType, nVersion);
+
+        ::Serialize(s, vchBlockSig, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        ::Unserialize(s, header, nType, nVersion);
+        ::Unserialize(s, nonce, nType, nVersion);
+
+        uint64_t nShortIDs = ReadCompactSize(s);
+        shorttxids.clear();
+        while (shorttxids.size() < nShortIDs) {
+            // Grow in steps so a bogus count cannot make us allocate everything at once
+            size_t i = shorttxids.size();
+            shorttxids.resize(std::min((uint64_t)(1000 + shorttxids.size()), nShortIDs));
+            for (; i < shorttxids.size(); i++) {
+                uint32_t lsb = 0;
+                uint16_t msb = 0;
+                ::Unserialize(s, lsb, nType, nVersion);
+                ::Unserialize(s, msb, nType, nVersion);
+                shorttxids[i] = (uint64_t(msb) << 32) | uint64_t(lsb);
+            }
+        }
+
+        std::vector<uint16_t> indexes;
+        UnserializeDifferentialIndexes(s, indexes);
+        prefilledtxn.resize(indexes.size());
+        for (size_t i = 0; i < indexes.size(); i++) {
+            prefilledtxn[i].index = indexes[i];
+            ::Unserialize(s, prefilledtxn[i].tx, nType, nVersion);
+        }
+
+        ::Unserialize(s, vchBlockSig, nType, nVersion);
+
+        FillShortTxIDSelector();
+    }
+};
+
+/** How compact blocks announced to us were rebuilt, and how many we announced */
+struct CCompactBlockStats {
+    uint64_t nReceived;       //! compact blocks we tried to rebuild
+    uint64_t nFromMempool;    //! rebuilt from the prefilled transactions and the mempool alone
+    uint64_t nRoundTrip;      //! completed after a getblocktxn round trip
+    uint64_t nFailed;         //! fell back to downloading the full block
+    uint64_t nTxPrefilled;    //! transactions received in full inside compact blocks
+    uint64_t nTxMempool;      //! transactions found in the mempool
+    uint64_t nTxRequested;    //! transactions asked for with getblocktxn
+    uint64_t nSent;           //! compact blocks announced to peers
+    uint64_t nTxnServed;      //! getblocktxn requests answered
+
+    CCompactBlockStats() : nReceived(0), nFromMempool(0), nRoundTrip(0), nFailed(0), nTxPrefilled(0), nTxMempool(0), nTxRequested(0), nSent(0), nTxnServed(0) {}
+};
+
+enum ReadStatus {
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, //! Invalid object, peer is sending bogus data
+    READ_STATUS_FAILED,  //! Failed to reconstruct, e.g. a short ID collision: fetch the full block
+};
+
+/**
+ * A block being rebuilt from a compact block: the prefilled transactions and
+ * those matched in the mempool are in place, the rest is filled in from the
+ * peer's blocktxn answer.
+ */
+class PartiallyDownloadedBlock
+{
+private:
+    std::vector<CTransaction> txn;
+    std::vector<bool> vAvailable;
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+
+public:
+    size_t nPrefilled;
+    size_t nFromMempool;
+
+    PartiallyDownloadedBlock() : nPrefilled(0), nFromMempool(0) {}
+
+    /** Lay out the block and fill in what the compact block and the mempool provide */
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool);
+    bool IsTxAvailable(size_t index) const;
+    size_t TxCount() const { return txn.size(); }
+    const CBlockHeader& GetHeader() const { return header; }
+
+    /** Complete the block with the missing transactions, in block order, and check it against the header's merkle root */
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing) const;
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
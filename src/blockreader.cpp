@@ -0,0 +1,259 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockreader.h"
+
+#include "main.h"
+#include "util.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <limits>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/** Minimum amount read ahead from disk on each refill of a CBlockFileReader */
+static const size_t BLOCKFILE_READ_CHUNK = 64 * 1024;
+
+CBlockFileCache blockFileCache;
+
+#ifdef WIN32
+CBlockFileHandle::CBlockFileHandle(const std::string& strPath, bool fMap) : pMap(NULL), nMapSize(0)
+{
+    // Files are never mapped here, reads always go through stdio
+    file = fopen(strPath.c_str(), "rb");
+}
+
+CBlockFileHandle::~CBlockFileHandle()
+{
+    if (file)
+        fclose(file);
+}
+
+bool CBlockFileHandle::IsOpen() const
+{
+    return file != NULL;
+}
+
+size_t CBlockFileHandle::Read(uint64_t nOffset, char* pch, size_t nSize)
+{
+    // No pread() here: serialize the seek and the read on this handle instead
+    LOCK(cs);
+    if (_fseeki64(file, nOffset, SEEK_SET))
+        return 0;
+    return fread(pch, 1, nSize, file);
+}
+#else
+CBlockFileHandle::CBlockFileHandle(const std::string& strPath, bool fMap) : pMap(NULL), nMapSize(0)
+{
+    fd = open(strPath.c_str(), O_RDONLY);
+    if (fd < 0 || !fMap)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size > std::numeric_limits<size_t>::max())
+        return;
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        LogPrintf("Unable to map %s, falling back to regular reads\n", strPath);
+        return;
+    }
+    pMap = (const char*)p;
+    nMapSize = st.st_size;
+}
+
+CBlockFileHandle::~CBlockFileHandle()
+{
+    if (pMap)
+        munmap((void*)pMap, nMapSize);
+    if (fd >= 0)
+        close(fd);
+}
+
+bool CBlockFileHandle::IsOpen() const
+{
+    return fd >= 0;
+}
+
+size_t CBlockFileHandle::Read(uint64_t nOffset, char* pch, size_t nSize)
+{
+    const char* pMapped = GetMapped(nOffset, nSize);
+    if (pMapped) {
+        memcpy(pch, pMapped, nSize);
+        return nSize;
+    }
+
+    size_t nRead = 0;
+    while (nRead < nSize) {
+        ssize_t n = pread(fd, pch + nRead, nSize - nRead, nOffset + nRead);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        nRead += n;
+    }
+    return nRead;
+}
+#endif
+
+CBlockFileCache::CBlockFileCache(unsigned int nMaxHandlesIn, bool fMapFilesIn)
+    : nMaxHandles(std::max(nMaxHandlesIn, 1U)), fMapFiles(fMapFilesIn), nAppendFile(-1), nHits(0), nMisses(0)
+{
+}
+
+void CBlockFileCache::SetAppendFile(int nFile)
+{
+    LOCK(cs);
+    if (nFile == nAppendFile)
+        return;
+    // The old append file is finished: let the next reader map it. A mapping
+    // of the new one would not follow its growth, so drop that too.
+    CloseUnlocked(nAppendFile);
+    CloseUnlocked(nFile);
+    nAppendFile = nFile;
+}
+
+boost::shared_ptr<CBlockFileHandle> CBlockFileCache::Get(const CDiskBlockPos& pos, const char* prefix)
+{
+    if (pos.IsNull())
+        return boost::shared_ptr<CBlockFileHandle>();
+
+    FileKey key(prefix, pos.nFile);
+    LOCK(cs);
+    std::map<FileKey, std::pair<boost::shared_ptr<CBlockFileHandle>, LRUList::iterator> >::iterator it = mapHandles.find(key);
+    if (it != mapHandles.end()) {
+        nHits++;
+        listLRU.splice(listLRU.begin(), listLRU, it->second.second);
+        return it->second.first;
+    }
+    nMisses++;
+
+    bool fMap = fMapFiles && key.first == "blk" && pos.nFile != nAppendFile;
+    boost::filesystem::path path = GetBlockPosFilename(pos, prefix);
+    boost::shared_ptr<CBlockFileHandle> handle(new CBlockFileHandle(path.string(), fMap));
+    if (!handle->IsOpen()) {
+        LogPrintf("Unable to open file %s\n", path.string());
+        return boost::shared_ptr<CBlockFileHandle>();
+    }
+
+    listLRU.push_front(key);
+    mapHandles[key] = std::make_pair(handle, listLRU.begin());
+    while (mapHandles.size() > nMaxHandles) {
+        mapHandles.erase(listLRU.back());
+        listLRU.pop_back();
+    }
+    return handle;
+}
+
+void CBlockFileCache::Close(int nFile)
+{
+    LOCK(cs);
+    CloseUnlocked(nFile);
+}
+
+void CBlockFileCache::CloseUnlocked(int nFile)
+{
+    for (LRUList::iterator it = listLRU.begin(); it != listLRU.end();) {
+        if (it->second == nFile) {
+            mapHandles.erase(*it);
+            it = listLRU.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+void CBlockFileCache::Clear()
+{
+    LOCK(cs);
+    mapHandles.clear();
+    listLRU.clear();
+}
+
+size_t CBlockFileCache::Size()
+{
+    LOCK(cs);
+    return mapHandles.size();
+}
+
+void CBlockFileCache::GetStats(CBlockFileCacheStats& stats)
+{
+    LOCK(cs);
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    stats.nHandles = mapHandles.size();
+    stats.nMapped = 0;
+    stats.nMappedBytes = 0;
+    for (std::map<FileKey, std::pair<boost::shared_ptr<CBlockFileHandle>, LRUList::iterator> >::const_iterator it = mapHandles.begin(); it != mapHandles.end(); it++) {
+        if (it->second.first->IsMapped()) {
+            stats.nMapped++;
+            stats.nMappedBytes += it->second.first->GetMapSize();
+        }
+    }
+}
+
+CBlockFileReader::CBlockFileReader(const CDiskBlockPos& pos, const char* prefix, int nTypeIn, int nVersionIn, CBlockFileCache& cache)
+    : handle(cache.Get(pos, prefix)), nType(nTypeIn), nVersion(nVersionIn), nBufOffset(pos.nPos), nBufPos(0)
+{
+}
+
+void CBlockFileReader::Fill(size_t nMin)
+{
+    // Keep the unread tail and append at least nMin bytes after it
+    size_t nKeep = vchBuf.size() - nBufPos;
+    if (nBufPos > 0) {
+        vchBuf.erase(vchBuf.begin(), vchBuf.begin() + nBufPos);
+        nBufOffset += nBufPos;
+        nBufPos = 0;
+    }
+    size_t nWant = std::max(nMin - nKeep, BLOCKFILE_READ_CHUNK);
+    vchBuf.resize(nKeep + nWant);
+    size_t nRead = handle->Read(nBufOffset + nKeep, &vchBuf[nKeep], nWant);
+    vchBuf.resize(nKeep + nRead);
+    if (vchBuf.size() < nMin)
+        throw std::ios_base::failure("CBlockFileReader::read : end of file");
+}
+
+CBlockFileReader& CBlockFileReader::read(char* pch, size_t nSize)
+{
+    if (!handle)
+        throw std::ios_base::failure("CBlockFileReader::read : file handle is NULL");
+    if (nBufPos == vchBuf.size()) {
+        // Nothing buffered: on a mapped file copy straight from the mapping
+        const char* pMapped = handle->GetMapped(nBufOffset + nBufPos, nSize);
+        if (pMapped) {
+            memcpy(pch, pMapped, nSize);
+            nBufOffset += nBufPos + nSize;
+            vchBuf.clear();
+            nBufPos = 0;
+            return (*this);
+        }
+    }
+    if (vchBuf.size() - nBufPos < nSize)
+        Fill(nSize);
+    memcpy(pch, &vchBuf[nBufPos], nSize);
+    nBufPos += nSize;
+    return (*this);
+}
+
+CBlockFileReader& CBlockFileReader::ignore(size_t nSize)
+{
+    if (!handle)
+        throw std::ios_base::failure("CBlockFileReader::ignore : file handle is NULL");
+    if (vchBuf.size() - nBufPos >= nSize) {
+        nBufPos += nSize;
+    } else {
+        // Drop the buffer and continue reading further into the file
+        nBufOffset += nBufPos + nSize;
+        vchBuf.clear();
+        nBufPos = 0;
+    }
+    return (*this);
+}
@@ -0,0 +1,174 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKREADER_H
+#define BITCOIN_BLOCKREADER_H
+
+#include "chain.h"
+#include "serialize.h"
+#include "sync.h"
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+/** Number of blk/rev file descriptors kept open for readers */
+static const unsigned int DEFAULT_BLOCKFILE_HANDLES = 16;
+/** Whether finished blk files are memory mapped, only where address space is plentiful */
+static const bool DEFAULT_BLOCKFILE_MMAP = sizeof(void*) > 4;
+
+/**
+ * Read-only handle on a block or undo file. Reads take an explicit offset
+ * (pread) so one handle can be shared by any number of threads. A handle on
+ * a file that is no longer appended to can instead map it, in which case
+ * readers deserialize straight from the mapping.
+ */
+class CBlockFileHandle
+{
+private:
+    // Disallow copies
+    CBlockFileHandle(const CBlockFileHandle&);
+    CBlockFileHandle& operator=(const CBlockFileHandle&);
+
+#ifdef WIN32
+    CCriticalSection cs;
+    FILE* file;
+#else
+    int fd;
+#endif
+    const char* pMap;
+    size_t nMapSize;
+
+public:
+    CBlockFileHandle(const std::string& strPath, bool fMap);
+    ~CBlockFileHandle();
+
+    bool IsOpen() const;
+    bool IsMapped() const { return pMap != NULL; }
+    size_t GetMapSize() const { return nMapSize; }
+
+    /** Pointer to nSize mapped bytes at nOffset, or NULL if that range is not mapped */
+    const char* GetMapped(uint64_t nOffset, size_t nSize) const
+    {
+        if (!pMap || nOffset > nMapSize || nSize > nMapSize - nOffset)
+            return NULL;
+        return pMap + nOffset;
+    }
+
+    /** Read up to nSize bytes at nOffset, returns the number of bytes read (short at end of file) */
+    size_t Read(uint64_t nOffset, char* pch, size_t nSize);
+};
+
+struct CBlockFileCacheStats {
+    uint64_t nHits;
+    uint64_t nMisses;
+    unsigned int nHandles;
+    unsigned int nMapped;
+    uint64_t nMappedBytes;
+
+    CBlockFileCacheStats() : nHits(0), nMisses(0), nHandles(0), nMapped(0), nMappedBytes(0) {}
+};
+
+/**
+ * Small LRU cache of CBlockFileHandles, so a block read does not have to open
+ * and close the file. Evicted handles stay valid for readers still using them.
+ *
+ * Block files other than the one currently being appended are mapped; the
+ * append file and all undo files (undo data can be added to any of them) are
+ * read with pread, which always sees the latest writes.
+ */
+class CBlockFileCache
+{
+private:
+    // Disallow copies
+    CBlockFileCache(const CBlockFileCache&);
+    CBlockFileCache& operator=(const CBlockFileCache&);
+
+    typedef std::pair<std::string, int> FileKey;
+    typedef std::list<FileKey> LRUList;
+
+    CCriticalSection cs;
+    unsigned int nMaxHandles;
+    bool fMapFiles;
+    int nAppendFile;
+    LRUList listLRU;
+    std::map<FileKey, std::pair<boost::shared_ptr<CBlockFileHandle>, LRUList::iterator> > mapHandles;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    void CloseUnlocked(int nFile);
+
+public:
+    explicit CBlockFileCache(unsigned int nMaxHandlesIn = DEFAULT_BLOCKFILE_HANDLES, bool fMapFilesIn = DEFAULT_BLOCKFILE_MMAP);
+
+    /** Tell the cache which blk file new blocks are written to, it is never mapped */
+    void SetAppendFile(int nFile);
+
+    /** Get a handle on the file pos lives in, NULL if it cannot be opened */
+    boost::shared_ptr<CBlockFileHandle> Get(const CDiskBlockPos& pos, const char* prefix);
+
+    /** Forget the handles of file nFile, e.g. before it is removed */
+    void Close(int nFile);
+    void Clear();
+    size_t Size();
+    void GetStats(CBlockFileCacheStats& stats);
+};
+
+extern CBlockFileCache blockFileCache;
+
+/**
+ * Buffered deserialization stream over a block or undo file, starting at a
+ * CDiskBlockPos. It has its own read position, so unlike CAutoFile over a
+ * shared FILE* it needs no lock: callers only take cs_main to look up the
+ * position, and do the disk access and deserialization without it.
+ * On a mapped file it copies straight out of the mapping, without buffering.
+ */
+class CBlockFileReader
+{
+private:
+    // Disallow copies
+    CBlockFileReader(const CBlockFileReader&);
+    CBlockFileReader& operator=(const CBlockFileReader&);
+
+    boost::shared_ptr<CBlockFileHandle> handle;
+    int nType;
+    int nVersion;
+
+    uint64_t nBufOffset;         //! file offset of vchBuf[0] (or of the next read on a mapped file)
+    std::vector<char> vchBuf;
+    size_t nBufPos;              //! next byte to return from vchBuf
+
+    void Fill(size_t nMin);
+
+public:
+    CBlockFileReader(const CDiskBlockPos& pos, const char* prefix, int nTypeIn, int nVersionIn, CBlockFileCache& cache = blockFileCache);
+
+    bool IsNull() const { return !handle; }
+
+    //
+    // Stream subset
+    //
+    int GetType() { return nType; }
+    int GetVersion() { return nVersion; }
+
+    CBlockFileReader& read(char* pch, size_t nSize);
+
+    /** Skip nSize bytes forward */
+    CBlockFileReader& ignore(size_t nSize);
+
+    template <typename T>
+    CBlockFileReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        if (!handle)
+            throw std::ios_base::failure("CBlockFileReader::operator>> : file handle is NULL");
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
+#endif // BITCOIN_BLOCKREADER_H
@@ -154,6 +154,7 @@ public:
         BLOCK_PROOF_OF_STAKE = (1 << 0), // is proof-of-stake block
         BLOCK_STAKE_ENTROPY = (1 << 1),  // entropy bit for stake modifier
         BLOCK_STAKE_MODIFIER = (1 << 2), // regenerated stake modifier
+        BLOCK_STAKE_UNCHECKED = (1 << 3), // snapshot history or imported ahead of the tip, kernel checked on connect
     };
 
     // proof-of-stake specific fields
@@ -547,4 +548,53 @@ public:
     const CBlockIndex* FindFork(const CBlockIndex* pindex) const;
 };
 
+/**
+ * A chain known only by its tip, to read it without the lock that guards a
+ * CChain. Entries are reached through pprev and pskip, which, like the hash,
+ * height, header fields and chain work of an entry, do not change once it is
+ * linked in: every read from one snapshot sees the same chain, however the
+ * active chain moves meanwhile. Looking a height up costs O(log n) steps
+ * instead of one.
+ */
+class CChainSnapshot
+{
+private:
+    CBlockIndex* pindexTip;
+
+public:
+    explicit CChainSnapshot(CBlockIndex* pindexTipIn) : pindexTip(pindexTipIn) {}
+
+    CBlockIndex* Tip() const
+    {
+        return pindexTip;
+    }
+
+    int Height() const
+    {
+        return pindexTip ? pindexTip->nHeight : -1;
+    }
+
+    /** Returns the index entry at a particular height in this chain, or NULL if no such height exists. */
+    CBlockIndex* operator[](int nHeight) const
+    {
+        if (pindexTip == NULL)
+            return NULL;
+        return pindexTip->GetAncestor(nHeight);
+    }
+
+    bool Contains(const CBlockIndex* pindex) const
+    {
+        return (*this)[pindex->nHeight] == pindex;
+    }
+
+    /** Find the successor of a block in this chain, or NULL if the given index is not found or is the tip. */
+    CBlockIndex* Next(const CBlockIndex* pindex) const
+    {
+        if (Contains(pindex))
+            return (*this)[pindex->nHeight + 1];
+        else
+            return NULL;
+    }
+};
+
 #endif // BITCOIN_CHAIN_H
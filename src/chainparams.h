@@ -15,6 +15,7 @@
 #include "protocol.h"
 #include "uint256.h"
 
+#include <map>
 #include <vector>
 
 typedef unsigned char MessageStartChars[MESSAGE_START_SIZE];
@@ -24,6 +25,15 @@ struct CDNSSeedData {
     CDNSSeedData(const std::string& strName, const std::string& strHost) : name(strName), host(strHost) {}
 };
 
+/** A UTXO set snapshot a node can be started from: the block it is at and the hash of its unspent outputs */
+struct CAssumeUtxoData {
+    uint256 hashBlock;
+    uint256 hashOutputs;
+    CAssumeUtxoData(const uint256& hashBlockIn, const uint256& hashOutputsIn) : hashBlock(hashBlockIn), hashOutputs(hashOutputsIn) {}
+};
+
+typedef std::map<int, CAssumeUtxoData> MapAssumeUtxo;
+
 /**
  * CChainParams defines various tweakable parameters of a given instance of the
  * UserV system. There are three: the main network on which people trade goods
@@ -91,6 +101,8 @@ public:
     const std::vector<unsigned char>& Base58Prefix(Base58Type type) const { return base58Prefixes[type]; }
     const std::vector<CAddress>& FixedSeeds() const { return vFixedSeeds; }
     virtual const Checkpoints::CCheckpointData& Checkpoints() const = 0;
+    /** The UTXO set snapshots -loadutxosnapshot accepts, by height */
+    const MapAssumeUtxo& AssumeUtxo() const { return mapAssumeUtxo; }
     int PoolMaxTransactions() const { return nPoolMaxTransactions; }
     std::string SporkKey() const { return strSporkKey; }
     std::string MasternodePoolDummyAddress() const { return strMasternodePoolDummyAddress; }
@@ -126,6 +138,7 @@ protected:
     std::string strNetworkID;
     CBlock genesis;
     std::vector<CAddress> vFixedSeeds;
+    MapAssumeUtxo mapAssumeUtxo;
     bool fMiningRequiresPeers;
     bool fAllowMinDifficultyBlocks;
     bool fDefaultConsistencyChecks;
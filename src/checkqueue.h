@@ -6,9 +6,11 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
-#include <boost/foreach.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
@@ -25,136 +27,192 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has its own queue, and the master deals the checks out over
+  * all of them. A worker takes from the back of its own queue and, once that
+  * is empty, steals from the front of the others, so workers only contend
+  * when they touch the same queue. The shared mutex is only used to put
+  * workers to sleep when there is nothing left anywhere and to wake them up.
+  * After the first failed check the remaining ones are drained without
+  * being run.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
-    boost::mutex mutex;
+    //! A worker's share of the pending checks
+    struct WorkerQueue {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
 
-    //! Worker threads block on this when out of work
-    boost::condition_variable condWorker;
+    //! One queue per worker, the master's at index 0
+    std::unique_ptr<WorkerQueue[]> vQueues;
 
-    //! Master thread blocks on this when out of work
-    boost::condition_variable condMaster;
-
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The number of queues, workers beyond it share a queue
+    const unsigned int nQueues;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of worker threads that took a queue (not including the master).
+    std::atomic<unsigned int> nWorkers;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The queue the next Add starts at, so that small batches spread over all workers. Only used by the master.
+    unsigned int nNextQueue;
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! The number of checks sitting in a queue, not taken by a worker yet.
+    std::atomic<unsigned int> nQueued;
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are not anymore in queue, but still in
+     * This includes elements that are not anymore in a queue, but still in
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
+
+    //! The temporary evaluation result, cleared by the first failing check.
+    std::atomic<bool> fAllOk;
+
+    //! The number of workers that are asleep, or about to be.
+    std::atomic<int> nIdle;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! Mutex the sleeping threads wait with, never held while taking or running checks
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Master thread blocks on this when out of work
+    boost::condition_variable condMaster;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    unsigned int ActiveQueues() const
+    {
+        return std::min(nWorkers.load() + 1, nQueues);
+    }
+
+    /**
+     * Move a batch of checks out of queue nIndex: from the back when it is our
+     * own queue, from the front when stealing. Take at most half of what is
+     * there so the rest can still be stolen, but at least one and no more
+     * than nBatchSize.
+     */
+    bool Take(unsigned int nIndex, bool fSteal, std::vector<T>& vChecks)
+    {
+        WorkerQueue& q = vQueues[nIndex];
+        boost::unique_lock<boost::mutex> lock(q.mutex);
+        if (q.checks.empty())
+            return false;
+        unsigned int nNow = std::max(1U, std::min(nBatchSize, (unsigned int)q.checks.size() / 2));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // Swap instead of copying to keep the lock short
+            if (fSteal) {
+                vChecks[i].swap(q.checks.front());
+                q.checks.pop_front();
+            } else {
+                vChecks[i].swap(q.checks.back());
+                q.checks.pop_back();
+            }
+        }
+        nQueued -= nNow;
+        return true;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(bool fMaster, unsigned int nIndex)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master he can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+            // Our own queue first, then the others starting with the next one
+            unsigned int nActive = ActiveQueues();
+            bool fFound = Take(nIndex % nActive, false, vChecks);
+            for (unsigned int i = 1; !fFound && i < nActive; i++)
+                fFound = Take((nIndex + i) % nActive, true, vChecks);
+
+            if (fFound) {
+                // execute work, unless a check already failed
+                for (unsigned int i = 0; i < vChecks.size(); i++) {
+                    if (fAllOk.load(std::memory_order_relaxed) && !vChecks[i]())
+                        fAllOk = false;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                unsigned int nNow = vChecks.size();
+                vChecks.clear();
+                if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                    // We processed the last element; inform the master he can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                // Only the master adds checks, so the queues stay empty: wait for the batches still being run
+                while (nTodo != 0)
+                    condMaster.wait(lock);
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                fAllOk = true;
+                // return the current status
+                return fRet;
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            // Announce we are going to sleep before looking at nQueued, so that Add either
+            // sees us idle and wakes us up, or we see its checks
+            nIdle++;
+            while (nQueued == 0)
+                condWorker.wait(lock); // wait
+            nIdle--;
         } while (true);
     }
 
 public:
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    //! Create a new check queue, with room for nMaxWorkers worker threads to have a queue of their own
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nMaxWorkers = 16) : vQueues(new WorkerQueue[nMaxWorkers + 1]), nQueues(nMaxWorkers + 1), nWorkers(0), nNextQueue(0), nQueued(0), nTodo(0), fAllOk(true), nIdle(0), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        Loop(false, ++nWorkers);
     }
 
     //! Wait until execution finishes, and return whether all evaluations where successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(true, 0);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        // Once a check failed the block is invalid anyway, don't bother queueing more
+        if (vChecks.empty() || !fAllOk)
+            return;
+        // Count them before any worker can take and finish them
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+
+        // Deal the checks out in one run per queue
+        unsigned int nActive = ActiveQueues();
+        unsigned int nRun = (vChecks.size() + nActive - 1) / nActive;
+        for (unsigned int nStart = 0; nStart < vChecks.size(); nStart += nRun) {
+            unsigned int nEnd = std::min((unsigned int)vChecks.size(), nStart + nRun);
+            WorkerQueue& q = vQueues[nNextQueue++ % nActive];
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            for (unsigned int i = nStart; i < nEnd; i++) {
+                q.checks.push_back(T());
+                vChecks[i].swap(q.checks.back());
+            }
+            nQueued += nEnd - nStart;
+        }
+
+        if (nIdle > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
     }
 
     ~CCheckQueue()
@@ -163,8 +221,7 @@ public:
 
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return (nQueued == 0 && nTodo == 0 && fAllOk == true);
     }
 };
 
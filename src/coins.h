@@ -7,6 +7,7 @@
 #define BITCOIN_COINS_H
 
 #include "compressor.h"
+#include "memusage.h"
 #include "script/standard.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -283,6 +284,15 @@ public:
                 return false;
         return true;
     }
+
+    //! heap memory taken by the outputs and their scripts
+    size_t DynamicMemoryUsage() const
+    {
+        size_t ret = memusage::DynamicUsage(vout);
+        BOOST_FOREACH (const CTxOut& out, vout)
+            ret += memusage::DynamicUsage(out.scriptPubKey);
+        return ret;
+    }
 };
 
 class CCoinsKeyHasher
@@ -325,9 +335,10 @@ struct CCoinsStats {
     uint64_t nTransactionOutputs;
     uint64_t nSerializedSize;
     uint256 hashSerialized;
+    uint256 hashOutputs;
     CAmount nTotalAmount;
 
-    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0) {}
+    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), hashOutputs(0), nTotalAmount(0) {}
 };
 
 
@@ -352,6 +363,12 @@ public:
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats& stats) const;
 
+    //! GetStats along with hashSerialized, which takes hashing every unspent output in turn
+    virtual bool HashStats(CCoinsStats& stats) const;
+
+    //! Calculate them again from every unspent output, checking those GetStats gives
+    virtual bool ScanStats(CCoinsStats& stats) const;
+
     //! As we use CCoinsViews polymorphically, have a virtual destructor
     virtual ~CCoinsView() {}
 };
@@ -369,8 +386,11 @@ public:
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView& viewIn);
+    CCoinsView* GetBackend() const { return base; }
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+    bool HashStats(CCoinsStats& stats) const;
+    bool ScanStats(CCoinsStats& stats) const;
 };
 
 class CCoinsViewCache;
@@ -398,7 +418,8 @@ class CCoinsModifier
 private:
     CCoinsViewCache& cache;
     CCoinsMap::iterator it;
-    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_);
+    size_t cachedCoinUsage; // Cached memory usage of the CCoins object before modification
+    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
 
 public:
     CCoins* operator->() { return &it->second.coins; }
@@ -421,6 +442,9 @@ protected:
     mutable uint256 hashBlock;
     mutable CCoinsMap cacheCoins;
 
+    /* Cached dynamic memory usage for the inner CCoins objects. */
+    mutable size_t cachedCoinsUsage;
+
 public:
     CCoinsViewCache(CCoinsView* baseIn);
     ~CCoinsViewCache();
@@ -446,6 +470,16 @@ public:
      */
     CCoinsModifier ModifyCoins(const uint256& txid);
 
+    //! Whether this cache holds an entry for txid, without looking it up in the base
+    bool HaveCoinsInCache(const uint256& txid) const;
+
+    /**
+     * Cache coins that were read from the base elsewhere, as a lookup would
+     * have. Used to fill the cache from several threads reading the base at
+     * once. Does nothing when txid is cached already.
+     */
+    void AddFetchedCoins(const uint256& txid, CCoins& coins);
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
@@ -453,9 +487,32 @@ public:
      */
     bool Flush();
 
+    /**
+     * Move a copy of the entries modified since the last write into mapWrite,
+     * for the caller to write to the base, and mark them unmodified. They stay
+     * cached, and must not be removed by Trim until the write is done.
+     */
+    void GetDirtyCoins(CCoinsMap& mapWrite);
+
+    /**
+     * Write the modifications to the base like Flush, but keep the unspent
+     * entries cached. Returns false when the base could not be written to.
+     */
+    bool WriteBack();
+
+    /**
+     * Drop unmodified entries until the cache takes at most nTargetUsage
+     * bytes: spent ones first, then those created longest ago, which are the
+     * least likely to be spent soon.
+     */
+    void Trim(size_t nTargetUsage);
+
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
+    //! Calculate the size of the cache (in bytes)
+    size_t DynamicMemoryUsage() const;
+
     /**
      * Amount of UserV coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -0,0 +1,126 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+
+#include "util.h"
+
+#include <boost/thread/locks.hpp>
+
+/** Number of transactions a prefetch thread reads per round */
+static const size_t PREFETCH_READ_BATCH = 16;
+
+CCoinsPrefetcher coinsPrefetcher;
+
+CCoinsPrefetcher::CCoinsPrefetcher() : pbase(NULL), nGeneration(0)
+{
+}
+
+void CCoinsPrefetcher::SetBackend(const CCoinsView* pbaseIn)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    pbase = pbaseIn;
+}
+
+void CCoinsPrefetcher::Thread()
+{
+    RenameThread("userv-prefetch");
+    std::vector<uint256> vTxid;
+    std::vector<CCoins> vCoins;
+    std::vector<char> vFound;
+    while (true) {
+        const CCoinsView* pview;
+        uint64_t nReadGeneration;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty() || pbase == NULL)
+                cond.wait(lock);
+            vTxid.clear();
+            while (!queue.empty() && vTxid.size() < PREFETCH_READ_BATCH) {
+                vTxid.push_back(queue.front());
+                queue.pop_front();
+            }
+            pview = pbase;
+            nReadGeneration = nGeneration;
+        }
+
+        vCoins.assign(vTxid.size(), CCoins());
+        vFound.assign(vTxid.size(), 0);
+        for (size_t i = 0; i < vTxid.size(); i++)
+            vFound[i] = pview->GetCoins(vTxid[i], vCoins[i]);
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        stats.nRead += vTxid.size();
+        for (size_t i = 0; i < vTxid.size(); i++) {
+            setPending.erase(vTxid[i]);
+            if (!vFound[i])
+                continue;
+            // The database was written to while reading, what we have may be outdated
+            if (nReadGeneration != nGeneration) {
+                stats.nDropped++;
+                continue;
+            }
+            std::pair<std::map<uint256, CReady>::iterator, bool> ret = mapReady.insert(std::make_pair(vTxid[i], CReady()));
+            if (!ret.second)
+                continue;
+            vCoins[i].swap(ret.first->second.coins);
+            ret.first->second.itOrder = listReady.insert(listReady.end(), vTxid[i]);
+        }
+        while (mapReady.size() > MAX_PREFETCHED_COINS) {
+            mapReady.erase(listReady.front());
+            listReady.pop_front();
+            stats.nDropped++;
+        }
+    }
+}
+
+void CCoinsPrefetcher::Request(const std::vector<uint256>& vTxid)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (pbase == NULL)
+        return;
+    for (size_t i = 0; i < vTxid.size() && queue.size() < MAX_PREFETCHED_COINS; i++) {
+        if (mapReady.count(vTxid[i]) || !setPending.insert(vTxid[i]).second)
+            continue;
+        queue.push_back(vTxid[i]);
+        stats.nRequested++;
+    }
+    cond.notify_all();
+}
+
+void CCoinsPrefetcher::TakeInto(CCoinsViewCache& cache, std::vector<uint256>& vTxid)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    std::vector<uint256> vMissing;
+    for (size_t i = 0; i < vTxid.size(); i++) {
+        std::map<uint256, CReady>::iterator it = mapReady.find(vTxid[i]);
+        if (it == mapReady.end()) {
+            vMissing.push_back(vTxid[i]);
+            continue;
+        }
+        cache.AddFetchedCoins(it->first, it->second.coins);
+        listReady.erase(it->second.itOrder);
+        mapReady.erase(it);
+    }
+    stats.nHits += vTxid.size() - vMissing.size();
+    stats.nMisses += vMissing.size();
+    vTxid.swap(vMissing);
+}
+
+void CCoinsPrefetcher::Invalidate()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nGeneration++;
+    stats.nDropped += mapReady.size();
+    mapReady.clear();
+    listReady.clear();
+}
+
+void CCoinsPrefetcher::GetStats(CCoinsPrefetchStats& statsOut)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    statsOut = stats;
+    statsOut.nQueued = queue.size();
+    statsOut.nReady = mapReady.size();
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSPREFETCH_H
+#define BITCOIN_COINSPREFETCH_H
+
+#include "coins.h"
+#include "uint256.h"
+
+#include <deque>
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Default for -prefetchthreads, threads reading the coins spent by downloaded blocks ahead of connecting them */
+static const int DEFAULT_PREFETCH_THREADS = 4;
+/** Maximum number of prefetch threads */
+static const int MAX_PREFETCH_THREADS = 16;
+/** Number of transactions whose coins are kept aside at most, the oldest are dropped beyond that */
+static const size_t MAX_PREFETCHED_COINS = 100000;
+
+struct CCoinsPrefetchStats {
+    uint64_t nRequested; //! transactions queued for reading
+    uint64_t nRead;      //! database lookups done by the prefetch threads
+    uint64_t nHits;      //! transactions found prefetched when their spending block got connected
+    uint64_t nMisses;    //! transactions that had to be read when their spending block got connected
+    uint64_t nDropped;   //! coins read but thrown away, after a flush or beyond the limit
+    size_t nQueued;      //! transactions waiting to be read
+    size_t nReady;       //! transactions read and waiting for their block
+
+    CCoinsPrefetchStats() : nRequested(0), nRead(0), nHits(0), nMisses(0), nDropped(0), nQueued(0), nReady(0) {}
+};
+
+/**
+ * Background readers that look up the coins a block spends in the database
+ * as soon as the block is stored, so that they are at hand by the time it
+ * gets connected instead of being read one at a time then.
+ *
+ * Reads happen without cs_main. The coins are kept aside and only moved into
+ * the tip's cache by the thread connecting the block, and only into entries
+ * the cache does not have. Every database write must be followed by
+ * Invalidate(), which drops what was read so far as it may be outdated.
+ */
+class CCoinsPrefetcher
+{
+private:
+    // Disallow copies
+    CCoinsPrefetcher(const CCoinsPrefetcher&);
+    CCoinsPrefetcher& operator=(const CCoinsPrefetcher&);
+
+    struct CReady {
+        CCoins coins;
+        std::list<uint256>::iterator itOrder;
+    };
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    const CCoinsView* pbase;
+    //! Transactions to read, and those queued or being read
+    std::deque<uint256> queue;
+    std::set<uint256> setPending;
+    //! Coins read, oldest first in listReady
+    std::map<uint256, CReady> mapReady;
+    std::list<uint256> listReady;
+    //! Bumped by Invalidate, reads started before that are dropped
+    uint64_t nGeneration;
+    CCoinsPrefetchStats stats;
+
+public:
+    CCoinsPrefetcher();
+
+    /** Set the view to read from, which must allow concurrent reads. NULL stops queueing. */
+    void SetBackend(const CCoinsView* pbaseIn);
+
+    /** Reader thread, runs until interrupted */
+    void Thread();
+
+    /** Queue the coins of vTxid for reading */
+    void Request(const std::vector<uint256>& vTxid);
+
+    /**
+     * Move what was read of vTxid into cache, where it is missing, and leave
+     * the rest in vTxid. The caller holds whatever lock protects cache.
+     */
+    void TakeInto(CCoinsViewCache& cache, std::vector<uint256>& vTxid);
+
+    /** Drop everything read so far, to be called after writing to the database */
+    void Invalidate();
+
+    void GetStats(CCoinsPrefetchStats& statsOut);
+};
+
+extern CCoinsPrefetcher coinsPrefetcher;
+
+#endif // BITCOIN_COINSPREFETCH_H
@@ -0,0 +1,152 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/sha256.h"
+#include "crypto/sha512.h"
+
+#include <string.h>
+
+namespace
+{
+/** 2^3072 minus the prime, which is what 2^3072 is congruent to */
+const Num3072::limb_t MAX_PRIME_DIFF = 1103717;
+const Num3072::limb_t MAX_LIMB = (Num3072::limb_t)-1;
+}
+
+Num3072::Num3072()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; i++)
+        limbs[i] = 0;
+}
+
+Num3072::Num3072(const unsigned char data[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; i++) {
+        limbs[i] = 0;
+        for (size_t b = 0; b < sizeof(limb_t); b++)
+            limbs[i] |= (limb_t)data[i * sizeof(limb_t) + b] << (8 * b);
+    }
+}
+
+void Num3072::ToBytes(unsigned char out[BYTE_SIZE]) const
+{
+    Num3072 reduced(*this);
+    reduced.FullReduce();
+    for (int i = 0; i < LIMBS; i++) {
+        for (size_t b = 0; b < sizeof(limb_t); b++)
+            out[i * sizeof(limb_t) + b] = reduced.limbs[i] >> (8 * b);
+    }
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= MAX_LIMB - MAX_PRIME_DIFF)
+        return false;
+    for (int i = 1; i < LIMBS; i++) {
+        if (limbs[i] != MAX_LIMB)
+            return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the prime is adding MAX_PRIME_DIFF and dropping 2^3072
+    if (!IsOverflow())
+        return;
+    double_limb_t t = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; i++) {
+        t += limbs[i];
+        limbs[i] = (limb_t)t;
+        t >>= LIMB_SIZE;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    limb_t tmp[2 * LIMBS];
+    memset(tmp, 0, sizeof(tmp));
+    for (int i = 0; i < LIMBS; i++) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; j++) {
+            double_limb_t t = (double_limb_t)limbs[i] * a.limbs[j] + tmp[i + j] + carry;
+            tmp[i + j] = (limb_t)t;
+            carry = t >> LIMB_SIZE;
+        }
+        tmp[i + LIMBS] = carry;
+    }
+
+    // The high half counts MAX_PRIME_DIFF times each, folded onto the low one
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        double_limb_t t = (double_limb_t)tmp[i + LIMBS] * MAX_PRIME_DIFF + tmp[i] + carry;
+        limbs[i] = (limb_t)t;
+        carry = t >> LIMB_SIZE;
+    }
+    while (carry) {
+        double_limb_t t = (double_limb_t)carry * MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS && t; i++) {
+            t += limbs[i];
+            limbs[i] = (limb_t)t;
+            t >>= LIMB_SIZE;
+        }
+        carry = (limb_t)t;
+    }
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // a^(p-2) by square and multiply, where p-2 has every bit set but in its lowest limb
+    Num3072 result;
+    for (int i = LIMBS - 1; i >= 0; i--) {
+        limb_t exponent = i == 0 ? MAX_LIMB - MAX_PRIME_DIFF - 1 : MAX_LIMB;
+        for (int b = LIMB_SIZE - 1; b >= 0; b--) {
+            result.Multiply(result);
+            if ((exponent >> b) & 1)
+                result.Multiply(*this);
+        }
+    }
+    return result;
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+    unsigned char expanded[Num3072::BYTE_SIZE];
+    for (unsigned char i = 0; i < Num3072::BYTE_SIZE / CSHA512::OUTPUT_SIZE; i++)
+        CSHA512().Write(hash, sizeof(hash)).Write(&i, 1).Finalize(expanded + i * CSHA512::OUTPUT_SIZE);
+    return Num3072(expanded);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& other)
+{
+    numerator.Multiply(other.numerator);
+    denominator.Multiply(other.denominator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char hash[OUTPUT_SIZE]) const
+{
+    Num3072 result = denominator.GetInverse();
+    result.Multiply(numerator);
+    unsigned char data[Num3072::BYTE_SIZE];
+    result.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(hash);
+}
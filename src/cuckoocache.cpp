@@ -0,0 +1,125 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+
+#include "crypto/common.h"
+
+#include <algorithm>
+
+CCuckooCache::CCuckooCache() : nMaxDepth(0)
+{
+}
+
+size_t CCuckooCache::Setup(size_t nBytes)
+{
+    size_t nSlots = std::max(nBytes / (sizeof(CSlot) + sizeof(std::atomic<bool>)), (size_t)2);
+    // Value-initialized, so every slot starts zeroed
+    std::vector<CSlot>(nSlots).swap(vTable);
+    std::vector<std::atomic<bool> >(nSlots).swap(vCollectable);
+    for (size_t i = 0; i < nSlots; i++)
+        vCollectable[i].store(true, std::memory_order_relaxed);
+
+    nMaxDepth = 0;
+    while (((size_t)1 << nMaxDepth) < nSlots)
+        nMaxDepth++;
+    return nSlots;
+}
+
+void CCuckooCache::ComputeLocations(const uint64_t words[4], size_t locs[8]) const
+{
+    // Map each 32-bit word of the digest onto the table without a division
+    const uint64_t nSize = vTable.size();
+    for (int i = 0; i < 4; i++) {
+        locs[2 * i] = ((words[i] & 0xffffffff) * nSize) >> 32;
+        locs[2 * i + 1] = ((words[i] >> 32) * nSize) >> 32;
+    }
+}
+
+bool CCuckooCache::Matches(size_t loc, const uint64_t words[4]) const
+{
+    const CSlot& slot = vTable[loc];
+    for (int i = 0; i < 4; i++) {
+        if (slot.words[i].load(std::memory_order_relaxed) != words[i])
+            return false;
+    }
+    return true;
+}
+
+void CCuckooCache::Write(size_t loc, const uint64_t words[4])
+{
+    CSlot& slot = vTable[loc];
+    for (int i = 0; i < 4; i++)
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+}
+
+bool CCuckooCache::Contains(const uint256& digest, bool fErase)
+{
+    if (vTable.empty())
+        return false;
+
+    uint64_t words[4];
+    for (int i = 0; i < 4; i++)
+        words[i] = ReadLE64(digest.begin() + 8 * i);
+    size_t locs[8];
+    ComputeLocations(words, locs);
+    for (int i = 0; i < 8; i++) {
+        if (Matches(locs[i], words)) {
+            if (fErase)
+                vCollectable[locs[i]].store(true, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void CCuckooCache::Insert(const uint256& digest)
+{
+    if (vTable.empty())
+        return;
+
+    uint64_t words[4];
+    for (int i = 0; i < 4; i++)
+        words[i] = ReadLE64(digest.begin() + 8 * i);
+    size_t locs[8];
+    ComputeLocations(words, locs);
+    for (int i = 0; i < 8; i++) {
+        if (Matches(locs[i], words)) {
+            vCollectable[locs[i]].store(false, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    // The slot the current digest was moved out of, it is not put back there
+    size_t nLastLoc = locs[7];
+    for (unsigned int nDepth = 0; nDepth < nMaxDepth; nDepth++) {
+        for (int i = 0; i < 8; i++) {
+            if (vCollectable[locs[i]].load(std::memory_order_relaxed)) {
+                Write(locs[i], words);
+                vCollectable[locs[i]].store(false, std::memory_order_release);
+                return;
+            }
+        }
+
+        // All candidates are taken: swap with the occupant of the candidate after the
+        // last one used, and go on inserting the occupant
+        nLastLoc = locs[(1 + (std::find(locs, locs + 8, nLastLoc) - locs)) & 7];
+        uint64_t evicted[4];
+        for (int i = 0; i < 4; i++)
+            evicted[i] = vTable[nLastLoc].words[i].load(std::memory_order_relaxed);
+        Write(nLastLoc, words);
+        for (int i = 0; i < 4; i++)
+            words[i] = evicted[i];
+        ComputeLocations(words, locs);
+    }
+    // Out of depth: the digest in hand is dropped
+}
+
+size_t CCuckooCache::CountUsed() const
+{
+    size_t nUsed = 0;
+    for (size_t i = 0; i < vCollectable.size(); i++)
+        nUsed += !vCollectable[i].load(std::memory_order_relaxed);
+    return nUsed;
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CUCKOOCACHE_H
+#define BITCOIN_CUCKOOCACHE_H
+
+#include "uint256.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Fixed size set of 256-bit digests with cuckoo hashing, meant for caches
+ * that are read far more often than written, like the signature cache.
+ *
+ * A digest can live in one of 8 slots, picked by its eight 32-bit words, so
+ * digests must be uniformly distributed and unpredictable to peers (salted
+ * hashes). Inserting into a full neighbourhood moves an occupant to one of
+ * its other slots, up to a bounded depth after which the last one moved out
+ * is dropped. The memory used is fixed when the table is set up.
+ *
+ * Contains() takes no lock and may run concurrently with everything else.
+ * Slots are stored as atomic words, so a lookup racing an insert may read a
+ * mix of two digests, which cannot match a salted digest that is not in the
+ * table. It can miss a digest that is being moved, which costs a
+ * recomputation. Insert() calls have to be serialized by the caller.
+ */
+class CCuckooCache
+{
+private:
+    // Disallow copies
+    CCuckooCache(const CCuckooCache&);
+    CCuckooCache& operator=(const CCuckooCache&);
+
+    struct CSlot {
+        std::atomic<uint64_t> words[4];
+    };
+
+    std::vector<CSlot> vTable;
+    //! Whether a slot may be overwritten: it is empty, or its digest was erased
+    std::vector<std::atomic<bool> > vCollectable;
+    //! How many occupants one insert may move before giving up
+    unsigned int nMaxDepth;
+
+    void ComputeLocations(const uint64_t words[4], size_t locs[8]) const;
+    bool Matches(size_t loc, const uint64_t words[4]) const;
+    void Write(size_t loc, const uint64_t words[4]);
+
+public:
+    CCuckooCache();
+
+    /** Size the table to the number of slots that fit in nBytes, dropping its contents. Not thread safe. */
+    size_t Setup(size_t nBytes);
+
+    /** Whether digest is in the set. With fErase, its slot may be reused by a later insert. */
+    bool Contains(const uint256& digest, bool fErase);
+
+    /** Add digest to the set, possibly evicting another one. Inserts must not run concurrently. */
+    void Insert(const uint256& digest);
+
+    /** Number of slots */
+    size_t Size() const { return vTable.size(); }
+    /** Number of slots holding a digest that was not erased, by a scan of the table */
+    size_t CountUsed() const;
+    /** Bytes of memory taken by the table */
+    size_t DynamicMemoryUsage() const { return vTable.size() * (sizeof(CSlot) + sizeof(std::atomic<bool>)); }
+};
+
+#endif // BITCOIN_CUCKOOCACHE_H
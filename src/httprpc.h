@@ -0,0 +1,22 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_HTTPRPC_H
+#define BITCOIN_HTTPRPC_H
+
+/** Start the JSON-RPC handler of the HTTP server, at / */
+bool StartHTTPRPC();
+/** Interrupt the JSON-RPC handler */
+void InterruptHTTPRPC();
+/** Stop the JSON-RPC handler. Must come after the HTTP server is interrupted. */
+void StopHTTPRPC();
+
+/** Start the REST handlers of the HTTP server, at /rest/ */
+bool StartREST();
+/** Interrupt the REST handlers */
+void InterruptREST();
+/** Stop the REST handlers. Must come after the HTTP server is interrupted. */
+void StopREST();
+
+#endif // BITCOIN_HTTPRPC_H
@@ -0,0 +1,745 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "httpserver.h"
+
+#include "chainparamsbase.h"
+#include "netbase.h"
+#include "rpcprotocol.h" // For HTTP status codes
+#include "serialize.h"   // For MAX_SIZE
+#include "util.h"
+#include "utiltime.h"
+
+#include <deque>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+#include <event2/buffer.h>
+#include <event2/event.h>
+#include <event2/http.h>
+#include <event2/keyvalq_struct.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+/** Maximum size of the request line and headers of a request */
+static const size_t MAX_HEADERS_SIZE = 8192;
+
+/** A request waiting in the work queue for a worker, and the handler for it */
+class HTTPWorkItem
+{
+public:
+    HTTPWorkItem(HTTPRequest* reqIn, const std::string& pathIn, const HTTPRequestHandler& funcIn) : req(reqIn), path(pathIn), func(funcIn), nQueuedTime(GetTimeMillis())
+    {
+    }
+    ~HTTPWorkItem()
+    {
+        delete req;
+    }
+
+    HTTPRequest* req;
+    std::string path;
+    HTTPRequestHandler func;
+    int64_t nQueuedTime;
+};
+
+/** The requests waiting for a worker, and the workers taking them in turn */
+class HTTPWorkQueue
+{
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<HTTPWorkItem*> queue;
+    bool fRunning;
+    const size_t nMaxDepth;
+    const int64_t nTimeoutMillis;
+    int nThreads;
+    size_t nPeakDepth;
+    uint64_t nProcessed;
+    uint64_t nRejected;
+    uint64_t nTimedOut;
+
+public:
+    HTTPWorkQueue(size_t nMaxDepthIn, int64_t nTimeoutMillisIn) : fRunning(true), nMaxDepth(nMaxDepthIn), nTimeoutMillis(nTimeoutMillisIn), nThreads(0), nPeakDepth(0), nProcessed(0), nRejected(0), nTimedOut(0)
+    {
+    }
+
+    ~HTTPWorkQueue()
+    {
+        BOOST_FOREACH (HTTPWorkItem* item, queue)
+            delete item;
+    }
+
+    /** Queue a request for a worker, unless the queue is full. Takes ownership of item if it is queued. */
+    bool Enqueue(HTTPWorkItem* item)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (queue.size() >= nMaxDepth) {
+            nRejected++;
+            return false;
+        }
+        queue.push_back(item);
+        nPeakDepth = std::max(nPeakDepth, queue.size());
+        cond.notify_one();
+        return true;
+    }
+
+    /** Handle requests until interrupted */
+    void Run()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            nThreads++;
+        }
+        while (true) {
+            HTTPWorkItem* item = NULL;
+            bool fTimedOut = false;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (fRunning && queue.empty())
+                    cond.wait(lock);
+                if (!fRunning)
+                    break;
+                item = queue.front();
+                queue.pop_front();
+                // The client is likely to have given up on a request that waited this long
+                fTimedOut = GetTimeMillis() - item->nQueuedTime > nTimeoutMillis;
+                if (fTimedOut)
+                    nTimedOut++;
+                else
+                    nProcessed++;
+            }
+            if (fTimedOut)
+                item->req->WriteReply(HTTP_SERVICE_UNAVAILABLE, "Request timed out in the work queue");
+            else
+                item->func(item->req, item->path);
+            delete item;
+        }
+        boost::unique_lock<boost::mutex> lock(cs);
+        nThreads--;
+    }
+
+    /** Make the workers exit once they are done with the request they are handling */
+    void Interrupt()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fRunning = false;
+        cond.notify_all();
+    }
+
+    void GetStats(HTTPWorkQueueStats& stats)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        stats.nThreads = nThreads;
+        stats.nDepth = queue.size();
+        stats.nMaxDepth = nMaxDepth;
+        stats.nPeakDepth = nPeakDepth;
+        stats.nProcessed = nProcessed;
+        stats.nRejected = nRejected;
+        stats.nTimedOut = nTimedOut;
+    }
+};
+
+struct HTTPPathHandler {
+    HTTPPathHandler(std::string prefixIn, bool exactMatchIn, HTTPRequestHandler handlerIn) : prefix(prefixIn), exactMatch(exactMatchIn), handler(handlerIn)
+    {
+    }
+    std::string prefix;
+    bool exactMatch;
+    HTTPRequestHandler handler;
+};
+
+//! libevent event loop
+static struct event_base* eventBase = NULL;
+//! HTTP server
+static struct evhttp* eventHTTP = NULL;
+//! Subnets to allow requests from, besides the local host
+static std::vector<CSubNet> rpc_allow_subnets;
+//! Work queue for handling longer requests off the event loop thread
+static HTTPWorkQueue* workQueue = NULL;
+//! Handlers for (sub)paths
+static std::vector<HTTPPathHandler> pathHandlers;
+//! Bound listening sockets
+static std::vector<evhttp_bound_socket*> boundSockets;
+//! Whether to keep connections open for more requests (-rpckeepalive)
+static bool fHTTPKeepAlive = true;
+//! How long a client may take to read a piece of a chunked reply (-rpcservertimeout)
+static int64_t nChunkTimeoutMillis = DEFAULT_HTTP_SERVER_TIMEOUT * 1000;
+static boost::thread threadHTTP;
+static boost::thread_group* threadHTTPWorkers = NULL;
+
+/** Check if a network address is allowed to access the HTTP server */
+static bool ClientAllowed(const CNetAddr& netaddr)
+{
+    if (!netaddr.IsValid())
+        return false;
+    BOOST_FOREACH (const CSubNet& subnet, rpc_allow_subnets)
+        if (subnet.Match(netaddr))
+            return true;
+    return false;
+}
+
+/** Initialize the list of subnets allowed to access the RPC server */
+static bool InitHTTPAllowList()
+{
+    rpc_allow_subnets.clear();
+    rpc_allow_subnets.push_back(CSubNet("127.0.0.0/8")); // always allow IPv4 local subnet
+    rpc_allow_subnets.push_back(CSubNet("::1"));         // always allow IPv6 localhost
+    if (mapMultiArgs.count("-rpcallowip")) {
+        const std::vector<std::string>& vAllow = mapMultiArgs["-rpcallowip"];
+        BOOST_FOREACH (std::string strAllow, vAllow) {
+            CSubNet subnet(strAllow);
+            if (!subnet.IsValid()) {
+                LogPrintf("Invalid -rpcallowip subnet specification: %s. Valid are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24).\n", strAllow);
+                return false;
+            }
+            rpc_allow_subnets.push_back(subnet);
+        }
+    }
+    std::string strAllowed;
+    BOOST_FOREACH (const CSubNet& subnet, rpc_allow_subnets)
+        strAllowed += subnet.ToString() + " ";
+    LogPrint("http", "Allowing HTTP connections from: %s\n", strAllowed);
+    return true;
+}
+
+/** HTTP request method as string, for logging */
+static std::string RequestMethodString(HTTPRequest::RequestMethod m)
+{
+    switch (m) {
+    case HTTPRequest::GET:
+        return "GET";
+    case HTTPRequest::POST:
+        return "POST";
+    case HTTPRequest::HEAD:
+        return "HEAD";
+    case HTTPRequest::PUT:
+        return "PUT";
+    default:
+        return "unknown";
+    }
+}
+
+/** HTTP request callback */
+static void http_request_cb(struct evhttp_request* req, void* arg)
+{
+    HTTPRequest* hreq = new HTTPRequest(req);
+
+    LogPrint("http", "Received a %s request for %s from %s\n",
+        RequestMethodString(hreq->GetRequestMethod()), hreq->GetURI(), hreq->GetPeer().ToString());
+
+    // Early address-based allow check
+    if (!ClientAllowed(hreq->GetPeer())) {
+        hreq->WriteReply(HTTP_FORBIDDEN);
+        delete hreq;
+        return;
+    }
+
+    // Early reject unknown HTTP methods
+    if (hreq->GetRequestMethod() == HTTPRequest::UNKNOWN) {
+        hreq->WriteReply(HTTP_BAD_METHOD);
+        delete hreq;
+        return;
+    }
+
+    // Find registered handler for prefix
+    std::string strURI = hreq->GetURI();
+    std::string path;
+    std::vector<HTTPPathHandler>::const_iterator i = pathHandlers.begin();
+    std::vector<HTTPPathHandler>::const_iterator iend = pathHandlers.end();
+    for (; i != iend; ++i) {
+        bool match = false;
+        if (i->exactMatch)
+            match = (strURI == i->prefix);
+        else
+            match = (strURI.substr(0, i->prefix.size()) == i->prefix);
+        if (match) {
+            path = strURI.substr(i->prefix.size());
+            break;
+        }
+    }
+
+    if (i == iend) {
+        hreq->WriteReply(HTTP_NOT_FOUND);
+        delete hreq;
+        return;
+    }
+
+    // Dispatch to a worker thread
+    HTTPWorkItem* item = new HTTPWorkItem(hreq, path, i->handler);
+    if (!workQueue->Enqueue(item)) {
+        LogPrintf("WARNING: request rejected because the HTTP work queue is full, it may be worth raising -rpcworkqueue\n");
+        item->req->WriteReply(HTTP_SERVICE_UNAVAILABLE, "Work queue depth exceeded");
+        delete item;
+    }
+}
+
+/** Callback to reject HTTP requests after shutdown */
+static void http_reject_request_cb(struct evhttp_request* req, void*)
+{
+    LogPrint("http", "Rejecting request while shutting down\n");
+    evhttp_send_error(req, HTTP_SERVICE_UNAVAILABLE, NULL);
+}
+
+/** Event dispatcher thread */
+static void ThreadHTTP(struct event_base* base)
+{
+    RenameThread("userv-http");
+    LogPrint("http", "Entering http event loop\n");
+    event_base_dispatch(base);
+    // Event loop will be interrupted by InterruptHTTPServer()
+    LogPrint("http", "Exited http event loop\n");
+}
+
+static void HTTPWorkQueueRun(HTTPWorkQueue* queue)
+{
+    RenameThread("userv-httpworker");
+    queue->Run();
+}
+
+/** Bind HTTP server to specified addresses */
+static bool HTTPBindAddresses(struct evhttp* http)
+{
+    int defaultPort = GetArg("-rpcport", BaseParams().RPCPort());
+    std::vector<std::pair<std::string, uint16_t> > endpoints;
+
+    // Determine what addresses to bind to
+    if (!mapArgs.count("-rpcallowip")) { // Default to loopback if not allowing external IPs
+        endpoints.push_back(std::make_pair("::1", defaultPort));
+        endpoints.push_back(std::make_pair("127.0.0.1", defaultPort));
+        if (mapArgs.count("-rpcbind"))
+            LogPrintf("WARNING: option -rpcbind was ignored because -rpcallowip was not specified, refusing to allow everyone to connect\n");
+    } else if (mapArgs.count("-rpcbind")) { // Specific bind address
+        const std::vector<std::string>& vbind = mapMultiArgs["-rpcbind"];
+        for (std::vector<std::string>::const_iterator i = vbind.begin(); i != vbind.end(); ++i) {
+            int port = defaultPort;
+            std::string host;
+            SplitHostPort(*i, port, host);
+            endpoints.push_back(std::make_pair(host, port));
+        }
+    } else { // No specific bind address specified, bind to any
+        endpoints.push_back(std::make_pair("::", defaultPort));
+        endpoints.push_back(std::make_pair("0.0.0.0", defaultPort));
+    }
+
+    // Bind addresses
+    for (std::vector<std::pair<std::string, uint16_t> >::iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
+        LogPrint("http", "Binding RPC on address %s port %i\n", i->first, i->second);
+        evhttp_bound_socket* bind_handle = evhttp_bind_socket_with_handle(http, i->first.empty() ? NULL : i->first.c_str(), i->second);
+        if (bind_handle)
+            boundSockets.push_back(bind_handle);
+        else
+            LogPrintf("Binding RPC on address %s port %i failed.\n", i->first, i->second);
+    }
+    return !boundSockets.empty();
+}
+
+/** libevent event log callback */
+static void libevent_log_cb(int severity, const char* msg)
+{
+#ifndef EVENT_LOG_WARN
+// EVENT_LOG_WARN was added in 2.0.19; but before then _EVENT_LOG_WARN existed.
+#define EVENT_LOG_WARN _EVENT_LOG_WARN
+#endif
+    if (severity >= EVENT_LOG_WARN) // Log warn messages and higher without debug category
+        LogPrintf("libevent: %s\n", msg);
+    else
+        LogPrint("libevent", "libevent: %s\n", msg);
+}
+
+bool InitHTTPServer()
+{
+    struct evhttp* http = 0;
+    struct event_base* base = 0;
+
+    if (!InitHTTPAllowList())
+        return false;
+
+    // Redirect libevent's logging to our own log
+    event_set_log_callback(&libevent_log_cb);
+
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+
+    base = event_base_new();
+    if (!base) {
+        LogPrintf("Couldn't create an event_base: exiting\n");
+        return false;
+    }
+
+    /* Create a new evhttp object to handle requests. */
+    http = evhttp_new(base);
+    if (!http) {
+        LogPrintf("couldn't create evhttp. Exiting.\n");
+        event_base_free(base);
+        return false;
+    }
+
+    int nTimeout = GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT);
+    evhttp_set_timeout(http, nTimeout);
+    nChunkTimeoutMillis = std::max(nTimeout, 1) * 1000LL;
+    evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
+    evhttp_set_max_body_size(http, MAX_SIZE);
+    evhttp_set_gencb(http, http_request_cb, NULL);
+    fHTTPKeepAlive = GetBoolArg("-rpckeepalive", true);
+
+    if (!HTTPBindAddresses(http)) {
+        LogPrintf("Unable to bind any endpoint for RPC server\n");
+        evhttp_free(http);
+        event_base_free(base);
+        return false;
+    }
+
+    LogPrint("http", "Initialized HTTP server\n");
+    int workQueueDepth = std::max((int)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1);
+    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+
+    workQueue = new HTTPWorkQueue(workQueueDepth, std::max(nTimeout, 1) * 1000LL);
+    eventBase = base;
+    eventHTTP = http;
+    return true;
+}
+
+bool StartHTTPServer()
+{
+    LogPrint("http", "Starting HTTP server\n");
+    int rpcThreads = std::max((int)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1);
+    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
+    threadHTTP = boost::thread(boost::bind(&ThreadHTTP, eventBase));
+
+    threadHTTPWorkers = new boost::thread_group();
+    for (int i = 0; i < rpcThreads; i++)
+        threadHTTPWorkers->create_thread(boost::bind(&HTTPWorkQueueRun, workQueue));
+    return true;
+}
+
+void InterruptHTTPServer()
+{
+    LogPrint("http", "Interrupting HTTP server\n");
+    if (eventHTTP) {
+        // Unlisten sockets
+        BOOST_FOREACH (evhttp_bound_socket* socket, boundSockets)
+            evhttp_del_accept_socket(eventHTTP, socket);
+        boundSockets.clear();
+        // Reject requests on current connections
+        evhttp_set_gencb(eventHTTP, http_reject_request_cb, NULL);
+    }
+    if (workQueue)
+        workQueue->Interrupt();
+}
+
+void StopHTTPServer()
+{
+    LogPrint("http", "Stopping HTTP server\n");
+    if (threadHTTPWorkers) {
+        LogPrint("http", "Waiting for HTTP worker threads to exit\n");
+        threadHTTPWorkers->join_all();
+        delete threadHTTPWorkers;
+        threadHTTPWorkers = NULL;
+    }
+    delete workQueue;
+    workQueue = NULL;
+    if (eventBase) {
+        LogPrint("http", "Waiting for HTTP event thread to exit\n");
+        // Give the event loop a few seconds to send back the last replies; the
+        // connections kept alive would keep it running, so then break it
+        if (!threadHTTP.timed_join(boost::posix_time::milliseconds(2000))) {
+            LogPrintf("HTTP event loop did not exit within allotted time, sending loopbreak\n");
+            event_base_loopbreak(eventBase);
+            threadHTTP.join();
+        }
+    }
+    if (eventHTTP) {
+        evhttp_free(eventHTTP);
+        eventHTTP = NULL;
+    }
+    if (eventBase) {
+        event_base_free(eventBase);
+        eventBase = NULL;
+    }
+    LogPrint("http", "Stopped HTTP server\n");
+}
+
+struct event_base* EventBase()
+{
+    return eventBase;
+}
+
+bool GetHTTPWorkQueueStats(HTTPWorkQueueStats& stats)
+{
+    if (!workQueue)
+        return false;
+    workQueue->GetStats(stats);
+    return true;
+}
+
+static void httpevent_callback_fn(evutil_socket_t, short, void* data)
+{
+    // Static handler: simply call inner handler
+    HTTPEvent* self = ((HTTPEvent*)data);
+    self->handler();
+    if (self->deleteWhenTriggered)
+        delete self;
+}
+
+HTTPEvent::HTTPEvent(struct event_base* base, bool deleteWhenTriggeredIn, const boost::function<void(void)>& handlerIn) : deleteWhenTriggered(deleteWhenTriggeredIn), handler(handlerIn)
+{
+    ev = event_new(base, -1, 0, httpevent_callback_fn, this);
+    assert(ev);
+}
+
+HTTPEvent::~HTTPEvent()
+{
+    event_free(ev);
+}
+
+void HTTPEvent::trigger(struct timeval* tv)
+{
+    if (tv == NULL)
+        event_active(ev, 0, 0); // immediately trigger event in main thread
+    else
+        evtimer_add(ev, tv); // trigger after timeval passed
+}
+
+HTTPRequest::HTTPRequest(struct evhttp_request* reqIn) : req(reqIn), replySent(false), chunkedReply(NULL)
+{
+}
+
+HTTPRequest::~HTTPRequest()
+{
+    if (chunkedReply) {
+        // The client gets a truncated reply
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        EndChunkedReply();
+    }
+    if (!replySent) {
+        // Keep track of whether reply was sent to avoid request leaks
+        LogPrintf("%s: Unhandled request\n", __func__);
+        WriteReply(HTTP_INTERNAL_SERVER_ERROR, "Unhandled request");
+    }
+    // evhttpd cleans up the request, as long as a reply was sent.
+}
+
+std::pair<bool, std::string> HTTPRequest::GetHeader(const std::string& hdr)
+{
+    const struct evkeyvalq* headers = evhttp_request_get_input_headers(req);
+    assert(headers);
+    const char* val = evhttp_find_header(headers, hdr.c_str());
+    if (val)
+        return std::make_pair(true, std::string(val));
+    return std::make_pair(false, std::string());
+}
+
+std::string HTTPRequest::ReadBody()
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return "";
+    size_t size = evbuffer_get_length(buf);
+    /** Trivial implementation: if this is ever a performance bottleneck,
+     * internal copying can be avoided in multi-segment buffers by using
+     * evbuffer_peek and an awkward loop. Though in that case, it'd be even
+     * better to not copy into an intermediate string but use a stream
+     * abstraction to consume the evbuffer on the fly in the parsing algorithm.
+     */
+    const char* data = (const char*)evbuffer_pullup(buf, size);
+    if (!data) // returns NULL in case of empty buffer
+        return "";
+    std::string rv(data, size);
+    evbuffer_drain(buf, size);
+    return rv;
+}
+
+void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
+{
+    struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
+    assert(headers);
+    evhttp_add_header(headers, hdr.c_str(), value.c_str());
+}
+
+static void SendReply(struct evhttp_request* req, int nStatus)
+{
+    evhttp_send_reply(req, nStatus, NULL, NULL);
+}
+
+void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
+{
+    assert(!replySent && req);
+    if (!fHTTPKeepAlive)
+        WriteHeader("Connection", "close");
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    evbuffer_add(evb, strReply.data(), strReply.size());
+    // Only the event loop thread may touch the connection, so send from there
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(&SendReply, req, nStatus));
+    ev->trigger(NULL);
+    replySent = true;
+    req = NULL; // transferred back to main thread
+}
+
+/**
+ * A chunked reply, shared by the worker producing it and the event loop
+ * sending it. The event loop deletes it once the reply is finished.
+ */
+struct HTTPChunkedReply {
+    boost::mutex cs;
+    boost::condition_variable cond;
+    //! A piece was handed to the connection and is not written out yet
+    bool fWriting;
+    //! The connection closed
+    bool fClosed;
+
+    HTTPChunkedReply() : fWriting(false), fClosed(false) {}
+};
+
+static void http_chunk_written_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPChunkedReply* reply = (HTTPChunkedReply*)arg;
+    boost::unique_lock<boost::mutex> lock(reply->cs);
+    reply->fWriting = false;
+    reply->cond.notify_all();
+}
+
+static void http_chunked_close_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPChunkedReply* reply = (HTTPChunkedReply*)arg;
+    boost::unique_lock<boost::mutex> lock(reply->cs);
+    reply->fClosed = true;
+    reply->cond.notify_all();
+}
+
+static void SendReplyStart(struct evhttp_request* req, int nStatus, HTTPChunkedReply* reply)
+{
+    // A request whose connection failed is kept by libevent until the reply is ended
+    struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (evcon == NULL) {
+        http_chunked_close_cb(NULL, reply);
+        return;
+    }
+    evhttp_connection_set_closecb(evcon, http_chunked_close_cb, reply);
+    evhttp_send_reply_start(req, nStatus, NULL);
+}
+
+static void SendChunk(struct evhttp_request* req, struct evbuffer* evb, HTTPChunkedReply* reply)
+{
+    if (evhttp_request_get_connection(req) == NULL)
+        http_chunked_close_cb(NULL, reply);
+    else
+        evhttp_send_reply_chunk_with_cb(req, evb, http_chunk_written_cb, reply);
+    evbuffer_free(evb);
+}
+
+static void SendReplyEnd(struct evhttp_request* req, HTTPChunkedReply* reply)
+{
+    struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (evcon)
+        evhttp_connection_set_closecb(evcon, NULL, NULL);
+    evhttp_send_reply_end(req);
+    delete reply;
+}
+
+void HTTPRequest::StartChunkedReply(int nStatus)
+{
+    assert(!replySent && req);
+    if (!fHTTPKeepAlive)
+        WriteHeader("Connection", "close");
+    chunkedReply = new HTTPChunkedReply();
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(&SendReplyStart, req, nStatus, chunkedReply));
+    ev->trigger(NULL);
+    replySent = true;
+}
+
+bool HTTPRequest::WriteChunk(const std::string& strChunk)
+{
+    assert(chunkedReply);
+    if (strChunk.empty()) // An empty chunk would end the reply
+        return true;
+    {
+        boost::unique_lock<boost::mutex> lock(chunkedReply->cs);
+        boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(nChunkTimeoutMillis);
+        while (chunkedReply->fWriting && !chunkedReply->fClosed) {
+            if (!chunkedReply->cond.timed_wait(lock, deadline)) {
+                LogPrint("http", "Client stopped reading a chunked reply, dropping the rest of it\n");
+                chunkedReply->fClosed = true;
+            }
+        }
+        if (chunkedReply->fClosed)
+            return false;
+        chunkedReply->fWriting = true;
+    }
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(&SendChunk, req, evb, chunkedReply));
+    ev->trigger(NULL);
+    return true;
+}
+
+void HTTPRequest::EndChunkedReply()
+{
+    assert(chunkedReply);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(&SendReplyEnd, req, chunkedReply));
+    ev->trigger(NULL);
+    chunkedReply = NULL;
+    req = NULL; // transferred back to main thread
+}
+
+CService HTTPRequest::GetPeer()
+{
+    evhttp_connection* con = evhttp_request_get_connection(req);
+    CService peer;
+    if (con) {
+        // evhttp retains ownership over returned address string
+        const char* address = "";
+        uint16_t port = 0;
+        evhttp_connection_get_peer(con, (char**)&address, &port);
+        LookupNumeric(address, peer, port);
+    }
+    return peer;
+}
+
+std::string HTTPRequest::GetURI()
+{
+    return evhttp_request_get_uri(req);
+}
+
+HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
+{
+    switch (evhttp_request_get_command(req)) {
+    case EVHTTP_REQ_GET:
+        return GET;
+    case EVHTTP_REQ_POST:
+        return POST;
+    case EVHTTP_REQ_HEAD:
+        return HEAD;
+    case EVHTTP_REQ_PUT:
+        return PUT;
+    default:
+        return UNKNOWN;
+    }
+}
+
+void RegisterHTTPHandler(const std::string& prefix, bool exactMatch, const HTTPRequestHandler& handler)
+{
+    LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+}
+
+void UnregisterHTTPHandler(const std::string& prefix, bool exactMatch)
+{
+    std::vector<HTTPPathHandler>::iterator i = pathHandlers.begin();
+    std::vector<HTTPPathHandler>::iterator iend = pathHandlers.end();
+    for (; i != iend; ++i)
+        if (i->prefix == prefix && i->exactMatch == exactMatch)
+            break;
+    if (i != iend) {
+        LogPrint("http", "Unregistering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
+        pathHandlers.erase(i);
+    }
+}
@@ -0,0 +1,153 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_HTTPSERVER_H
+#define BITCOIN_HTTPSERVER_H
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+
+#include <boost/function.hpp>
+
+static const int DEFAULT_HTTP_THREADS = 4;
+static const int DEFAULT_HTTP_WORKQUEUE = 16;
+static const int DEFAULT_HTTP_SERVER_TIMEOUT = 30;
+
+struct evhttp_request;
+struct event_base;
+struct event;
+class CService;
+class HTTPRequest;
+struct HTTPChunkedReply;
+
+/**
+ * The HTTP server behind JSON-RPC and REST. One thread runs the libevent loop,
+ * which accepts connections, reads requests and writes replies without
+ * blocking, and keeps idle keep-alive connections open without a thread. Only
+ * complete requests are handed to the -rpcthreads workers, through a queue
+ * at most -rpcworkqueue deep; a request that finds the queue full, or waits
+ * in it longer than -rpcservertimeout, is answered with 503 straight away.
+ */
+
+/** Initialize the HTTP server: bind to the RPC addresses, limit what a request may be */
+bool InitHTTPServer();
+/** Start the event loop and the worker threads */
+bool StartHTTPServer();
+/** Stop accepting connections, and refuse the requests still coming in on open ones */
+void InterruptHTTPServer();
+/** Wait for the workers and the event loop to finish, and free the server */
+void StopHTTPServer();
+
+/** Handler for requests to a path. The path passed is what follows the prefix registered. */
+typedef boost::function<void(HTTPRequest* req, const std::string&)> HTTPRequestHandler;
+
+/** Register a handler for the paths starting with prefix, or equal to it if exactMatch */
+void RegisterHTTPHandler(const std::string& prefix, bool exactMatch, const HTTPRequestHandler& handler);
+void UnregisterHTTPHandler(const std::string& prefix, bool exactMatch);
+
+/** The event base of the HTTP server, to schedule events on, or NULL when it is not running */
+struct event_base* EventBase();
+
+/** What the work queue holds and has done since the server started */
+struct HTTPWorkQueueStats {
+    int nThreads;
+    size_t nDepth;
+    size_t nMaxDepth;
+    //! Deepest the queue has been
+    size_t nPeakDepth;
+    uint64_t nProcessed;
+    //! Requests refused because the queue was full
+    uint64_t nRejected;
+    //! Requests that waited in the queue until their timeout
+    uint64_t nTimedOut;
+};
+
+/** Get the work queue statistics, or false when the server is not running */
+bool GetHTTPWorkQueueStats(HTTPWorkQueueStats& stats);
+
+/** A request to the HTTP server, answered from the thread handling it */
+class HTTPRequest
+{
+private:
+    struct evhttp_request* req;
+    bool replySent;
+    //! The chunked reply started and not finished yet, if any
+    HTTPChunkedReply* chunkedReply;
+
+public:
+    HTTPRequest(struct evhttp_request* req);
+    ~HTTPRequest();
+
+    enum RequestMethod {
+        UNKNOWN,
+        GET,
+        POST,
+        HEAD,
+        PUT
+    };
+
+    std::string GetURI();
+    CService GetPeer();
+    RequestMethod GetRequestMethod();
+
+    /** Get a request header: whether it is there, and its value */
+    std::pair<bool, std::string> GetHeader(const std::string& hdr);
+
+    /** Read the request body. Reading it again returns nothing. */
+    std::string ReadBody();
+
+    /** Add a reply header. Must come before WriteReply. */
+    void WriteHeader(const std::string& hdr, const std::string& value);
+
+    /**
+     * Send the reply, from the event loop thread. Nothing else may be done
+     * with the request after this. A request not replied to before being
+     * destroyed is answered with 500.
+     */
+    void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a reply of a length not known yet, instead of WriteReply. Its
+     * body is sent in pieces with WriteChunk as it is produced, with
+     * Transfer-Encoding: chunked (or up to the closing of the connection,
+     * for HTTP/1.0 clients), and finished with EndChunkedReply.
+     */
+    void StartChunkedReply(int nStatus);
+
+    /**
+     * Send the next piece of a chunked reply. Waits until the client has
+     * taken the piece before, so that no more than one piece is buffered at
+     * a time. Returns false once the client has gone away, or has not read
+     * for -rpcservertimeout seconds: the rest of the reply is then dropped.
+     */
+    bool WriteChunk(const std::string& strChunk);
+
+    /** Finish a chunked reply. Nothing else may be done with the request after this. */
+    void EndChunkedReply();
+};
+
+/** An event run on the HTTP server's event loop, possibly after a delay */
+class HTTPEvent
+{
+public:
+    /**
+     * Create an event on base that calls handler when triggered. With
+     * deleteWhenTriggered the event deletes itself after running, so it
+     * must be created with new and triggered exactly once.
+     */
+    HTTPEvent(struct event_base* base, bool deleteWhenTriggered, const boost::function<void(void)>& handler);
+    ~HTTPEvent();
+
+    /** Trigger the event after tv, or right away if tv is NULL */
+    void trigger(struct timeval* tv);
+
+    bool deleteWhenTriggered;
+    boost::function<void(void)> handler;
+
+private:
+    struct event* ev;
+};
+
+#endif // BITCOIN_HTTPSERVER_H
@@ -0,0 +1,150 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonwriter.h"
+
+#include <assert.h>
+
+CUniValueWriter::CUniValueWriter(UniValue& rootIn) : root(rootIn), nDepth(0)
+{
+}
+
+UniValue& CUniValueWriter::Current()
+{
+    return vOpen.empty() ? root : vOpen.back();
+}
+
+void CUniValueWriter::Add(const UniValue& value)
+{
+    if (nDepth == 0) {
+        root = value;
+        return;
+    }
+    UniValue& current = Current();
+    if (current.isObject())
+        current.pushKV(strKey, value);
+    else
+        current.push_back(value);
+}
+
+void CUniValueWriter::Begin(UniValue::VType type)
+{
+    if (nDepth++ == 0) {
+        // The root is built in place, so the result is never copied whole
+        root = UniValue(type);
+        return;
+    }
+    vOpen.push_back(UniValue(type));
+    vOpenKeys.push_back(strKey);
+}
+
+void CUniValueWriter::BeginObject()
+{
+    Begin(UniValue::VOBJ);
+}
+
+void CUniValueWriter::BeginArray()
+{
+    Begin(UniValue::VARR);
+}
+
+void CUniValueWriter::End()
+{
+    assert(nDepth > 0);
+    if (--nDepth == 0)
+        return;
+    UniValue value = vOpen.back();
+    strKey = vOpenKeys.back();
+    vOpen.pop_back();
+    vOpenKeys.pop_back();
+    Add(value);
+}
+
+void CUniValueWriter::Key(const std::string& key)
+{
+    strKey = key;
+}
+
+void CUniValueWriter::Value(const UniValue& value)
+{
+    Add(value);
+}
+
+CJSONTextWriter::CJSONTextWriter(const Sink& sinkIn, size_t nFlushSizeIn) : sink(sinkIn), nFlushSize(nFlushSizeIn), fAfterKey(false), fFlushed(false), fFailed(false)
+{
+}
+
+void CJSONTextWriter::Separate()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (vEmpty.empty())
+        return;
+    if (!vEmpty.back())
+        strBuffer += ',';
+    vEmpty.back() = false;
+}
+
+void CJSONTextWriter::Begin(char cOpen, char cClose)
+{
+    Separate();
+    strBuffer += cOpen;
+    vClose.push_back(cClose);
+    vEmpty.push_back(true);
+}
+
+void CJSONTextWriter::BeginObject()
+{
+    Begin('{', '}');
+}
+
+void CJSONTextWriter::BeginArray()
+{
+    Begin('[', ']');
+}
+
+void CJSONTextWriter::End()
+{
+    assert(!vClose.empty());
+    strBuffer += vClose.back();
+    vClose.pop_back();
+    vEmpty.pop_back();
+    if (strBuffer.size() >= nFlushSize)
+        Flush();
+}
+
+void CJSONTextWriter::Key(const std::string& key)
+{
+    Separate();
+    strBuffer += UniValue(key).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void CJSONTextWriter::Value(const UniValue& value)
+{
+    Separate();
+    if (!fFailed)
+        strBuffer += value.write();
+    if (strBuffer.size() >= nFlushSize)
+        Flush();
+}
+
+void CJSONTextWriter::Write(const std::string& str)
+{
+    strBuffer += str;
+}
+
+bool CJSONTextWriter::Flush()
+{
+    if (!fFailed && !strBuffer.empty()) {
+        fFlushed = true;
+        if (!sink(strBuffer))
+            fFailed = true;
+    }
+    strBuffer.clear();
+    return !fFailed;
+}
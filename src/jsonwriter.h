@@ -0,0 +1,134 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_JSONWRITER_H
+#define BITCOIN_JSONWRITER_H
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include <univalue.h>
+
+/**
+ * Receives a JSON value a piece at a time: objects and arrays are opened and
+ * closed around their members, and the members themselves are small values
+ * written whole. Code producing large results writes them through this
+ * interface, so the same code can build a UniValue or stream JSON text
+ * without holding the whole result at once.
+ */
+class CJSONWriter
+{
+public:
+    virtual ~CJSONWriter() {}
+
+    virtual void BeginObject() = 0;
+    virtual void BeginArray() = 0;
+    /** Close the innermost object or array */
+    virtual void End() = 0;
+    /** Name the next value written into the current object */
+    virtual void Key(const std::string& key) = 0;
+    virtual void Value(const UniValue& value) = 0;
+
+    void Pair(const std::string& key, const UniValue& value)
+    {
+        Key(key);
+        Value(value);
+    }
+
+    /** Whether what is written is being dropped, e.g. because the client went away: writers may stop early */
+    virtual bool Failed() const
+    {
+        return false;
+    }
+};
+
+/** Builds the value written as a UniValue */
+class CUniValueWriter : public CJSONWriter
+{
+private:
+    UniValue& root;
+    //! The objects and arrays open below the root, and the keys to add them under when closed
+    std::vector<UniValue> vOpen;
+    std::vector<std::string> vOpenKeys;
+    std::string strKey;
+    int nDepth;
+
+    UniValue& Current();
+    void Add(const UniValue& value);
+    void Begin(UniValue::VType type);
+
+public:
+    /** Write into rootIn, which holds the value written once it is complete */
+    explicit CUniValueWriter(UniValue& rootIn);
+
+    void BeginObject();
+    void BeginArray();
+    void End();
+    void Key(const std::string& key);
+    void Value(const UniValue& value);
+};
+
+/**
+ * Writes the value as compact JSON text, the same as UniValue::write would.
+ * The text is collected in a buffer, which is handed to the sink whenever
+ * it grows past nFlushSize bytes, and by Flush. Once the sink fails the
+ * rest of the text is dropped.
+ */
+class CJSONTextWriter : public CJSONWriter
+{
+public:
+    /** Takes the next piece of text, returning false to refuse any more */
+    typedef boost::function<bool(const std::string&)> Sink;
+
+    static const size_t DEFAULT_FLUSH_SIZE = 256 * 1024;
+
+private:
+    Sink sink;
+    const size_t nFlushSize;
+    std::string strBuffer;
+    //! For each open object or array: the character closing it, and whether it has no members yet
+    std::vector<char> vClose;
+    std::vector<bool> vEmpty;
+    bool fAfterKey;
+    bool fFlushed;
+    bool fFailed;
+
+    void Separate();
+    void Begin(char cOpen, char cClose);
+
+public:
+    CJSONTextWriter(const Sink& sinkIn, size_t nFlushSizeIn = DEFAULT_FLUSH_SIZE);
+
+    void BeginObject();
+    void BeginArray();
+    void End();
+    void Key(const std::string& key);
+    void Value(const UniValue& value);
+    bool Failed() const
+    {
+        return fFailed;
+    }
+
+    /** Append text outside of the JSON value, e.g. a trailing newline */
+    void Write(const std::string& str);
+
+    /** Hand the buffered text to the sink. Returns false if the sink refused it, now or before. */
+    bool Flush();
+
+    /** Whether any text was handed to the sink yet */
+    bool Flushed() const
+    {
+        return fFlushed;
+    }
+
+    /** The text not handed to the sink yet */
+    const std::string& Buffered() const
+    {
+        return strBuffer;
+    }
+};
+
+#endif // BITCOIN_JSONWRITER_H
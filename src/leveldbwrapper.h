@@ -49,6 +49,18 @@ public:
         batch.Put(slKey, slValue);
     }
 
+    //! Queue a record already serialized
+    void Put(const leveldb::Slice& slKey, const leveldb::Slice& slValue)
+    {
+        batch.Put(slKey, slValue);
+    }
+
+    //! Queue the erasure of a record by its serialized key
+    void Delete(const leveldb::Slice& slKey)
+    {
+        batch.Delete(slKey);
+    }
+
     template <typename K>
     void Erase(const K& key)
     {
@@ -59,6 +71,11 @@ public:
 
         batch.Delete(slKey);
     }
+
+    void Clear()
+    {
+        batch.Clear();
+    }
 };
 
 class CLevelDBWrapper
@@ -90,15 +107,17 @@ public:
     ~CLevelDBWrapper();
 
     template <typename K, typename V>
-    bool Read(const K& key, V& value) const throw(leveldb_error)
+    bool Read(const K& key, V& value, const leveldb::Snapshot* snapshot = NULL) const throw(leveldb_error)
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(ssKey.GetSerializeSize(key));
         ssKey << key;
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
+        leveldb::ReadOptions options = readoptions;
+        options.snapshot = snapshot;
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -168,6 +187,31 @@ public:
     {
         return pdb->NewIterator(iteroptions);
     }
+
+    //! Iterator for short scans standing in for point reads, which fills the block cache like Read does
+    leveldb::Iterator* NewCachingIterator() const
+    {
+        return pdb->NewIterator(readoptions);
+    }
+
+    //! Consistent view of the database as it is now, for reads spanning several writes
+    const leveldb::Snapshot* GetSnapshot() const
+    {
+        return pdb->GetSnapshot();
+    }
+
+    void ReleaseSnapshot(const leveldb::Snapshot* snapshot) const
+    {
+        pdb->ReleaseSnapshot(snapshot);
+    }
+
+    //! Iterator over snapshot, which like NewIterator leaves the block cache alone
+    leveldb::Iterator* NewSnapshotIterator(const leveldb::Snapshot* snapshot) const
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot;
+        return pdb->NewIterator(options);
+    }
 };
 
 #endif // BITCOIN_LEVELDBWRAPPER_H
@@ -9,11 +9,15 @@
 
 #include "main.h"
 
+#include "addressindex.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockencodings.h"
+#include "blockreader.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinsprefetch.h"
 #include "init.h"
 #include "kernel.h"
 #include "masternode-budget.h"
@@ -31,17 +35,21 @@
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utxosnapshot.h"
 #include "validationinterface.h"
 
 #ifdef ENABLE_WALLET
 #include "wallet.h"
 #endif
 
+#include <atomic>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/function.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/thread.hpp>
 
@@ -63,7 +71,11 @@ map<uint256, uint256> mapProofOfStake;
 set<pair<COutPoint, unsigned int> > setStakeSeen;
 map<unsigned int, unsigned int> mapHashedBlocks;
 CChain chainActive;
+/** chainActive.Tip(), published for GetChainSnapshot after every change of chainActive */
+static std::atomic<CBlockIndex*> pindexTipPublished(NULL);
 CBlockIndex* pindexBestHeader = NULL;
+CBlockIndex* pindexSnapshotBase = NULL;
+CBlockIndex* pindexSnapshotHistory = NULL;
 int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
@@ -71,9 +83,16 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fAddressIndex = DEFAULT_ADDRESSINDEX;
+bool fSpentIndex = DEFAULT_SPENTINDEX;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
-unsigned int nCoinCacheSize = 5000;
+bool fHeadersFirst = true;
+bool fCompactBlocks = true;
+size_t nCoinCacheUsage = 5000 * 300;
+bool fHavePruned = false;
+bool fPruneMode = false;
+uint64_t nPruneTarget = 0;
 bool fAlerts = DEFAULT_ALERTS;
 
 unsigned int nStakeMinAge = 60 * 60;
@@ -168,6 +187,11 @@ struct QueuedBlock {
 };
 map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
+/** Proof-of-stake blocks of the best header chain received before their parent was connected. Their kernel
+ *  can only be checked against the active chain, so they are kept out of the block files until they extend
+ *  the tip. Protected by cs_main. */
+map<uint256, CBlock> mapBlocksStakeUnchecked;
+
 /** Number of blocks in flight with validated headers. */
 int nQueuedValidatedHeaders = 0;
 
@@ -179,6 +203,9 @@ set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 set<int> setDirtyFileInfo;
+
+/** Global flag to indicate we should check to see if there are block/undo files that should be deleted. Set on startup or if we allocate more file space when we're in prune mode. */
+bool fCheckForPruning = false;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -227,6 +254,14 @@ struct CNodeState {
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! The compact block from this peer waiting for its blocktxn answer, or 0.
+    uint256 hashPartialBlock;
+    //! That block, rebuilt as far as the mempool allowed.
+    PartiallyDownloadedBlock partialBlock;
+    //! Length of the current run of headers messages that did not connect to our block index.
+    int nUnconnectingHeaders;
+    //! The last header accepted from this peer before it sent some too far past the tip, to ask again from.
+    CBlockIndex* pindexHeadersPaused;
 
     CNodeState()
     {
@@ -240,6 +275,9 @@ struct CNodeState {
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
+        hashPartialBlock = uint256(0);
+        nUnconnectingHeaders = 0;
+        pindexHeadersPaused = NULL;
     }
 };
 
@@ -255,6 +293,16 @@ CNodeState* State(NodeId pnode)
     return &it->second;
 }
 
+/** Whether block sync with this peer goes through getheaders rather than getblocks inventories. */
+bool SyncHeadersFirst(const CNode* pnode)
+{
+    return fHeadersFirst && pnode->nVersion >= HEADERS_FIRST_VERSION;
+}
+
+/** How compact blocks were relayed and rebuilt, see getcompactblockinfo */
+CCriticalSection cs_compactBlockStats;
+CCompactBlockStats compactBlockStats;
+
 int GetHeight()
 {
     while (true) {
@@ -427,6 +475,9 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
     // download that next block if the window were 1 larger.
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
+    // Proof-of-stake blocks ahead of the tip wait in memory, fetch no more of them than can be held
+    if (nWindowEnd > Params().LAST_POW_BLOCK())
+        nWindowEnd = std::max<int>(Params().LAST_POW_BLOCK(), std::min<int>(nWindowEnd, chainActive.Height() + MAX_STAKE_UNCHECKED_BLOCKS));
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
     while (pindexWalk->nHeight < nMaxHeight) {
@@ -452,7 +503,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
             if (pindex->nStatus & BLOCK_HAVE_DATA) {
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
-            } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
+            } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0 && mapBlocksStakeUnchecked.count(pindex->GetBlockHash()) == 0) {
                 // The block is not already downloaded, and not yet in flight.
                 if (pindex->nHeight > nWindowEnd) {
                     // We reached the end of the window.
@@ -474,6 +525,36 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     }
 }
 
+/** Add to vBlocks up to count blocks of the history of pindexSnapshotBase that its validation needs next,
+ *  and that are neither downloaded nor in flight, if the peer has them. */
+void FindHistoryBlocksToDownload(NodeId nodeid, int nStartingHeight, unsigned int count, std::vector<CBlockIndex*>& vBlocks)
+{
+    if (count == 0 || pindexSnapshotBase == NULL)
+        return;
+
+    CNodeState* state = State(nodeid);
+    assert(state != NULL);
+
+    // A peer serving blocks has the whole chain it is on, which is only known
+    // from the height it started at if it announced nothing since
+    if (state->pindexBestKnownBlock != NULL ? state->pindexBestKnownBlock->GetAncestor(pindexSnapshotBase->nHeight) != pindexSnapshotBase : nStartingHeight < pindexSnapshotBase->nHeight)
+        return;
+
+    int nStart = pindexSnapshotHistory ? pindexSnapshotHistory->nHeight + 1 : 0;
+    int nEnd = std::min<int>(pindexSnapshotBase->nHeight, nStart + BLOCK_DOWNLOAD_WINDOW - 1);
+    std::vector<CBlockIndex*> vWindow;
+    for (CBlockIndex* pindex = pindexSnapshotBase->GetAncestor(nEnd); pindex && pindex->nHeight >= nStart; pindex = pindex->pprev)
+        vWindow.push_back(pindex);
+    for (std::vector<CBlockIndex*>::reverse_iterator it = vWindow.rbegin(); it != vWindow.rend(); it++) {
+        CBlockIndex* pindex = *it;
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) && mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
+            vBlocks.push_back(pindex);
+            if (vBlocks.size() == count)
+                return;
+        }
+    }
+}
+
 } // anon namespace
 
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
@@ -525,6 +606,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache* pcoinsTip = NULL;
+CCoinsViewDB* pcoinsdbview = NULL;
 CBlockTreeDB* pblocktree = NULL;
 CSporkDB* pSporkDB = NULL;
 
@@ -827,10 +909,7 @@ int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
     if (nResult < 0) nResult = 0;
 
     if (nResult < 6) {
-        std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-        if (i != mapTxLocks.end()) {
-            sigs = (*i).second.CountSignatures();
-        }
+        sigs = txLockManager.GetSignatures(nTXHash);
         if (sigs >= SWIFTTX_SIGNATURES_REQUIRED) {
             return nSwiftTXDepth + nResult;
         }
@@ -841,12 +920,7 @@ int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
 
 int GetIXConfirmations(uint256 nTXHash)
 {
-    int sigs = 0;
-
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-    if (i != mapTxLocks.end()) {
-        sigs = (*i).second.CountSignatures();
-    }
+    int sigs = txLockManager.GetSignatures(nTXHash);
     if (sigs >= SWIFTTX_SIGNATURES_REQUIRED) {
         return nSwiftTXDepth;
     }
@@ -868,18 +942,14 @@ bool GetCoinAge(const CTransaction& tx, const unsigned int nTxTime, uint64_t& nC
 
     CBlockIndex* pindex = NULL;
     BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-        // First try finding the previous transaction in database
-        CTransaction txPrev;
-        uint256 hashBlockPrev;
-        if (!GetTransaction(txin.prevout.hash, txPrev, hashBlockPrev, true)) {
+        // First try finding the previous output in database
+        CTxOut txoutPrev;
+        if (!GetPrevOut(txin.prevout, txoutPrev, pindex)) {
             LogPrintf("GetCoinAge: failed to find vin transaction \n");
             continue; // previous transaction not in main chain
         }
 
-        BlockMap::iterator it = mapBlockIndex.find(hashBlockPrev);
-        if (it != mapBlockIndex.end())
-            pindex = it->second;
-        else {
+        if (!pindex) {
             LogPrintf("GetCoinAge() failed to find block index \n");
             continue;
         }
@@ -895,7 +965,7 @@ bool GetCoinAge(const CTransaction& tx, const unsigned int nTxTime, uint64_t& nC
             return false; // Transaction timestamp violation
         }
 
-        int64_t nValueIn = txPrev.vout[txin.prevout.n].nValue;
+        int64_t nValueIn = txoutPrev.nValue;
         bnCentSecond += uint256(nValueIn) * (nTxTime - prevblock.nTime);
     }
 
@@ -1058,14 +1128,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
     // ----------- swiftTX transaction scanning -----------
 
-    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                return state.DoS(0,
-                    error("AcceptToMemoryPool : conflicts with existing transaction lock: %s", reason),
-                    REJECT_INVALID, "tx-lock-conflict");
-            }
-        }
+    uint256 hashLocked;
+    if (txLockManager.GetConflictingLock(tx, hashLocked)) {
+        return state.DoS(0,
+            error("AcceptToMemoryPool : conflicts with existing transaction lock: %s", reason),
+            REJECT_INVALID, "tx-lock-conflict");
     }
 
     // Check for conflicts with in-memory transactions
@@ -1243,14 +1310,11 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 
     // ----------- swiftTX transaction scanning -----------
 
-    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                return state.DoS(0,
-                    error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
-                    REJECT_INVALID, "tx-lock-conflict");
-            }
-        }
+    uint256 hashLocked;
+    if (txLockManager.GetConflictingLock(tx, hashLocked)) {
+        return state.DoS(0,
+            error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
+            REJECT_INVALID, "tx-lock-conflict");
     }
 
     // Check for conflicts with in-memory transactions
@@ -1405,7 +1469,10 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow)
 {
     CBlockIndex* pindexSlow = NULL;
+    CDiskTxPos postx;
     {
+        // Only look up where the transaction is while holding cs_main,
+        // the disk read below happens without it
         LOCK(cs_main);
         {
             if (mempool.lookup(hash, txOut)) {
@@ -1414,30 +1481,10 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         }
 
         if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut.GetHash() != hash)
-                    return error("%s : txid mismatch", __func__);
-                return true;
-            }
-
             // transaction not found in the index, nothing more can be done
-            return false;
-        }
-
-        if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
+            if (!pblocktree->ReadTxIndex(hash, postx))
+                return false;
+        } else if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
             int nHeight = -1;
             {
                 CCoinsViewCache& view = *pcoinsTip;
@@ -1450,6 +1497,24 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         }
     }
 
+    if (!postx.IsNull()) {
+        CBlockFileReader file(postx, "blk", SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            return error("%s: OpenBlockFile failed", __func__);
+        CBlockHeader header;
+        try {
+            file >> header;
+            file.ignore(postx.nTxOffset);
+            file >> txOut;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+        hashBlock = header.GetHash();
+        if (txOut.GetHash() != hash)
+            return error("%s : txid mismatch", __func__);
+        return true;
+    }
+
     if (pindexSlow) {
         CBlock block;
         if (ReadBlockFromDisk(block, pindexSlow)) {
@@ -1466,6 +1531,42 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
     return false;
 }
 
+bool GetPrevOut(const COutPoint& prevout, CTxOut& txoutRet, CBlockIndex*& pindexRet, const CCoinsViewCache* pcoins)
+{
+    LOCK(cs_main);
+    pindexRet = NULL;
+
+    // Unspent: the coins cache has both the output and its height
+    const CCoins* coins = (pcoins ? pcoins : pcoinsTip)->AccessCoins(prevout.hash);
+    if (coins && coins->IsAvailable(prevout.n)) {
+        txoutRet = coins->vout[prevout.n];
+        if (coins->nHeight > 0 && coins->nHeight <= chainActive.Height())
+            pindexRet = chainActive[coins->nHeight];
+        return true;
+    }
+
+    // Spent in the active chain: the spent index keeps a copy of the output
+    if (fSpentIndex) {
+        CSpentIndexValue spentValue;
+        if (pblocktree->ReadSpentIndex(prevout, spentValue)) {
+            txoutRet = spentValue.prevout;
+            if (spentValue.prevHeight <= chainActive.Height())
+                pindexRet = chainActive[spentValue.prevHeight];
+            return true;
+        }
+    }
+
+    CTransaction txPrev;
+    uint256 hashBlock;
+    if (!GetTransaction(prevout.hash, txPrev, hashBlock, true) || prevout.n >= txPrev.vout.size())
+        return false;
+    txoutRet = txPrev.vout[prevout.n];
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi != mapBlockIndex.end())
+        pindexRet = mi->second;
+    return true;
+}
+
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -1497,8 +1598,8 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    // Open history file to read, this needs no lock
+    CBlockFileReader filein(pos, "blk", SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("ReadBlockFromDisk : OpenBlockFile failed");
 
@@ -1794,107 +1895,148 @@ bool CScriptCheck::operator()()
     return true;
 }
 
+namespace
+{
+/** An output spent by a transaction input, with what the maturity rule needs to know about the transaction it came from */
+struct CSpentOutput {
+    const CTxOut* pout;
+    int nHeight;
+    bool fCoinBase;
+    bool fCoinStake;
+
+    CSpentOutput(const CTxOut& out, int nHeightIn, bool fCoinBaseIn, bool fCoinStakeIn) : pout(&out), nHeight(nHeightIn), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn) {}
+};
+} // anon namespace
+
+/** Look up the outputs the inputs of tx spend in inputs, false if one of them is missing or spent */
+static bool GetSpentOutputs(const CTransaction& tx, const CCoinsViewCache& inputs, std::vector<CSpentOutput>& vSpent)
+{
+    vSpent.clear();
+    vSpent.reserve(tx.vin.size());
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        const CCoins* coins = inputs.AccessCoins(txin.prevout.hash);
+        if (!coins || !coins->IsAvailable(txin.prevout.n))
+            return false;
+        vSpent.push_back(CSpentOutput(coins->vout[txin.prevout.n], coins->nHeight, coins->IsCoinBase(), coins->IsCoinStake()));
+    }
+    return true;
+}
+
+/** The inexpensive checks of CheckInputs: maturity, value ranges and fees, given the outputs spent by tx in input order */
+static bool CheckSpentOutputs(const CTransaction& tx, CValidationState& state, const std::vector<CSpentOutput>& vSpent, int nSpendHeight)
+{
+    CAmount nValueIn = 0;
+    CAmount nFees = 0;
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        const CSpentOutput& spent = vSpent[i];
+
+        // If prev is coinbase, check that it's matured
+        if (spent.fCoinBase || spent.fCoinStake) {
+            if (nSpendHeight - spent.nHeight < Params().COINBASE_MATURITY())
+                return state.Invalid(
+                    error("CheckInputs() : tried to spend coinbase at depth %d, coinstake=%d", nSpendHeight - spent.nHeight, spent.fCoinStake),
+                    REJECT_INVALID, "bad-txns-premature-spend-of-coinbase");
+        }
+
+        // Check for negative or overflow input values
+        nValueIn += spent.pout->nValue;
+        if (!MoneyRange(spent.pout->nValue) || !MoneyRange(nValueIn))
+            return state.DoS(100, error("CheckInputs() : txin values out of range"),
+                REJECT_INVALID, "bad-txns-inputvalues-outofrange");
+    }
+
+    if (!tx.IsCoinStake()) {
+        if (nValueIn < tx.GetValueOut())
+            return state.DoS(100, error("CheckInputs() : %s value in (%s) < value out (%s)",
+                                      tx.GetHash().ToString(), FormatMoney(nValueIn), FormatMoney(tx.GetValueOut())),
+                REJECT_INVALID, "bad-txns-in-belowout");
+
+        // Tally transaction fees
+        CAmount nTxFee = nValueIn - tx.GetValueOut();
+        if (nTxFee < 0)
+            return state.DoS(100, error("CheckInputs() : %s nTxFee < 0", tx.GetHash().ToString()),
+                REJECT_INVALID, "bad-txns-fee-negative");
+        nFees += nTxFee;
+        if (!MoneyRange(nFees))
+            return state.DoS(100, error("CheckInputs() : nFees out of range"),
+                REJECT_INVALID, "bad-txns-fee-outofrange");
+    }
+    return true;
+}
+
+/** The script checks of CheckInputs, on inputs that are known to be available */
+static bool CheckInputScripts(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks)
+{
+    if (pvChecks)
+        pvChecks->reserve(tx.vin.size());
+
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        const COutPoint& prevout = tx.vin[i].prevout;
+        const CCoins* coins = inputs.AccessCoins(prevout.hash);
+        assert(coins);
+
+        // Verify signature
+        CScriptCheck check(*coins, tx, i, flags, cacheStore);
+        if (pvChecks) {
+            pvChecks->push_back(CScriptCheck());
+            check.swap(pvChecks->back());
+        } else if (!check()) {
+            if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
+                // Check whether the failure was caused by a
+                // non-mandatory script verification check, such as
+                // non-standard DER encodings or non-null dummy
+                // arguments; if so, don't trigger DoS protection to
+                // avoid splitting the network between upgraded and
+                // non-upgraded nodes.
+                CScriptCheck check(*coins, tx, i,
+                    flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                if (check())
+                    return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
+            }
+            // Failures of other flags indicate a transaction that is
+            // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
+            // such nodes as they are not following the protocol. That
+            // said during an upgrade careful thought should be taken
+            // as to the correct behavior - we may want to continue
+            // peering with non-upgraded nodes even after a soft-fork
+            // super-majority vote has passed.
+            return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
+        }
+    }
+    return true;
+}
+
 bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks)
 {
     if (!tx.IsCoinBase()) {
-        if (pvChecks)
-            pvChecks->reserve(tx.vin.size());
-
         // This doesn't trigger the DoS code on purpose; if it did, it would make it easier
         // for an attacker to attempt to split the network.
-        if (!inputs.HaveInputs(tx))
+        std::vector<CSpentOutput> vSpent;
+        if (!GetSpentOutputs(tx, inputs, vSpent))
             return state.Invalid(error("CheckInputs() : %s inputs unavailable", tx.GetHash().ToString()));
 
         // While checking, GetBestBlock() refers to the parent block.
         // This is also true for mempool checks.
         CBlockIndex* pindexPrev = mapBlockIndex.find(inputs.GetBestBlock())->second;
         int nSpendHeight = pindexPrev->nHeight + 1;
-        CAmount nValueIn = 0;
-        CAmount nFees = 0;
-        for (unsigned int i = 0; i < tx.vin.size(); i++) {
-            const COutPoint& prevout = tx.vin[i].prevout;
-            const CCoins* coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
-
-            // If prev is coinbase, check that it's matured
-            if (coins->IsCoinBase() || coins->IsCoinStake()) {
-                if (nSpendHeight - coins->nHeight < Params().COINBASE_MATURITY())
-                    return state.Invalid(
-                        error("CheckInputs() : tried to spend coinbase at depth %d, coinstake=%d", nSpendHeight - coins->nHeight, coins->IsCoinStake()),
-                        REJECT_INVALID, "bad-txns-premature-spend-of-coinbase");
-            }
+        if (!CheckSpentOutputs(tx, state, vSpent, nSpendHeight))
+            return false;
 
-            // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
-                return state.DoS(100, error("CheckInputs() : txin values out of range"),
-                    REJECT_INVALID, "bad-txns-inputvalues-outofrange");
-        }
-
-        if (!tx.IsCoinStake()) {
-            if (nValueIn < tx.GetValueOut())
-                return state.DoS(100, error("CheckInputs() : %s value in (%s) < value out (%s)",
-                                          tx.GetHash().ToString(), FormatMoney(nValueIn), FormatMoney(tx.GetValueOut())),
-                    REJECT_INVALID, "bad-txns-in-belowout");
-
-            // Tally transaction fees
-            CAmount nTxFee = nValueIn - tx.GetValueOut();
-            if (nTxFee < 0)
-                return state.DoS(100, error("CheckInputs() : %s nTxFee < 0", tx.GetHash().ToString()),
-                    REJECT_INVALID, "bad-txns-fee-negative");
-            nFees += nTxFee;
-            if (!MoneyRange(nFees))
-                return state.DoS(100, error("CheckInputs() : nFees out of range"),
-                    REJECT_INVALID, "bad-txns-fee-outofrange");
-        }
-        // The first loop above does all the inexpensive checks.
+        // The checks above are the inexpensive ones.
         // Only if ALL inputs pass do we perform expensive ECDSA signature checks.
         // Helps prevent CPU exhaustion attacks.
 
         // Skip ECDSA signature verification when connecting blocks
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
-        if (fScriptChecks) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                const COutPoint& prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
-
-                // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
-                if (pvChecks) {
-                    pvChecks->push_back(CScriptCheck());
-                    check.swap(pvChecks->back());
-                } else if (!check()) {
-                    if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
-                        // Check whether the failure was caused by a
-                        // non-mandatory script verification check, such as
-                        // non-standard DER encodings or non-null dummy
-                        // arguments; if so, don't trigger DoS protection to
-                        // avoid splitting the network between upgraded and
-                        // non-upgraded nodes.
-                        CScriptCheck check(*coins, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
-                        if (check())
-                            return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
-                    }
-                    // Failures of other flags indicate a transaction that is
-                    // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
-                    // such nodes as they are not following the protocol. That
-                    // said during an upgrade careful thought should be taken
-                    // as to the correct behavior - we may want to continue
-                    // peering with non-upgraded nodes even after a soft-fork
-                    // super-majority vote has passed.
-                    return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
-                }
-            }
-        }
+        if (fScriptChecks && !CheckInputScripts(tx, state, inputs, flags, cacheStore, pvChecks))
+            return false;
     }
 
     return true;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, bool fUpdateIndexes)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
         LogPrintf("%s : pindex=%s view=%s\n", __func__, pindex->GetBlockHash().GetHex(), view.GetBestBlock().GetHex());
@@ -1905,6 +2047,10 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 
     bool fClean = true;
 
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<COutPoint, CSpentIndexValue> > spentIndex;
+
     CBlockUndo blockUndo;
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull())
@@ -1942,6 +2088,18 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             outs->Clear();
         }
 
+        if (fAddressIndex) {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                const CTxOut& out = tx.vout[k];
+                int nAddressType;
+                uint160 hashBytes;
+                if (GetAddressIndexKey(out.scriptPubKey, nAddressType, hashBytes)) {
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(nAddressType, hashBytes, pindex->nHeight, i, hash, k, false), out.nValue));
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(nAddressType, hashBytes, hash, k), CAddressUnspentValue()));
+                }
+            }
+        }
+
         // restore inputs
         if (!tx.IsCoinBase()) { // not coinbases because they dont have traditional inputs
             const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
@@ -1968,10 +2126,28 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 if (coins->vout.size() < out.n + 1)
                     coins->vout.resize(out.n + 1);
                 coins->vout[out.n] = undo.txout;
+
+                if (fSpentIndex)
+                    spentIndex.push_back(std::make_pair(out, CSpentIndexValue()));
+
+                if (fAddressIndex) {
+                    int nAddressType;
+                    uint160 hashBytes;
+                    if (GetAddressIndexKey(undo.txout.scriptPubKey, nAddressType, hashBytes)) {
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(nAddressType, hashBytes, pindex->nHeight, i, hash, j, true), -undo.txout.nValue));
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(nAddressType, hashBytes, out.hash, out.n), CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, coins->nHeight)));
+                    }
+                }
             }
         }
     }
 
+    if (fAddressIndex && fUpdateIndexes && !pblocktree->UpdateAddressIndex(pindex, addressIndex, addressUnspentIndex, true, boost::bind(ChainIncludesBlock, _1, pindex)))
+        return state.Abort("Failed to delete address index");
+
+    if (fSpentIndex && fUpdateIndexes && !pblocktree->UpdateSpentIndex(spentIndex))
+        return state.Abort("Failed to delete spent index");
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -2008,7 +2184,7 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128, MAX_SCRIPTCHECK_THREADS);
 
 void ThreadScriptCheck()
 {
@@ -2016,13 +2192,217 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+/**
+ * Work ConnectBlock spreads over threads besides the script checks: reading
+ * the coins a block spends and the inexpensive checks of its inputs.
+ */
+class CConnectCheck
+{
+private:
+    boost::function<void()> func;
+
+public:
+    CConnectCheck() {}
+    explicit CConnectCheck(const boost::function<void()>& funcIn) : func(funcIn) {}
+
+    bool operator()()
+    {
+        func();
+        return true;
+    }
+
+    void swap(CConnectCheck& check)
+    {
+        func.swap(check.func);
+    }
+};
+
+static CCheckQueue<CConnectCheck> connectcheckqueue(1, MAX_SCRIPTCHECK_THREADS);
+
+void ThreadConnectCheck()
+{
+    RenameThread("userv-connect");
+    connectcheckqueue.Thread();
+}
+
+/** Run vChecks on the connect check threads and this one, and return once they are all done */
+static void RunConnectChecks(std::vector<CConnectCheck>& vChecks)
+{
+    if (nScriptCheckThreads) {
+        CCheckQueueControl<CConnectCheck> control(&connectcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        BOOST_FOREACH (CConnectCheck& check, vChecks)
+            check();
+    }
+}
+
+/** Number of transactions whose coins one connect check reads */
+static const size_t PREFETCH_BATCH_SIZE = 16;
+/** Number of transactions whose inputs one connect check checks */
+static const size_t CHECK_INPUTS_BATCH_SIZE = 32;
+
+static void ReadCoins(const CCoinsView* pbase, const uint256* ptxid, CCoins* pcoins, char* pfFound, size_t nCount)
+{
+    for (size_t i = 0; i < nCount; i++)
+        pfFound[i] = pbase->GetCoins(ptxid[i], pcoins[i]);
+}
+
+/** The transactions the block spends from that the tip's cache does not have, other than its own */
+static void GetUncachedBlockInputs(const CBlock& block, std::vector<uint256>& vTxid)
+{
+    std::set<uint256> setBlockTx;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx)
+        setBlockTx.insert(tx.GetHash());
+    vTxid.clear();
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+            const uint256& hash = txin.prevout.hash;
+            if (!setBlockTx.count(hash) && !pcoinsTip->HaveCoinsInCache(hash))
+                vTxid.push_back(hash);
+        }
+    }
+    std::sort(vTxid.begin(), vTxid.end());
+    vTxid.erase(std::unique(vTxid.begin(), vTxid.end()), vTxid.end());
+}
+
+/**
+ * Read the coins spent by the block into the tip's cache before it is
+ * connected. What the prefetch threads already read when the block came in
+ * is taken from them, the rest is read with the database lookups spread over
+ * the connect check threads rather than done one at a time as each
+ * transaction is connected. Returns the number of transactions the cache
+ * missed, and sets nReadAhead to how many of those the prefetch threads had.
+ */
+static unsigned int PrefetchBlockInputs(const CBlock& block, const CCoinsViewCache& view, unsigned int& nReadAhead)
+{
+    nReadAhead = 0;
+    // Only done when connecting on top of the tip, whose cache sits on the database
+    if (view.GetBackend() != pcoinsTip)
+        return 0;
+
+    std::vector<uint256> vTxid;
+    GetUncachedBlockInputs(block, vTxid);
+    unsigned int nMissing = vTxid.size();
+    coinsPrefetcher.TakeInto(*pcoinsTip, vTxid);
+    nReadAhead = nMissing - vTxid.size();
+    if (vTxid.empty())
+        return nMissing;
+
+    // Only the database is read concurrently, the cache is filled in afterwards
+    std::vector<CCoins> vCoins(vTxid.size());
+    std::vector<char> vFound(vTxid.size(), 0);
+    std::vector<CConnectCheck> vChecks;
+    for (size_t i = 0; i < vTxid.size(); i += PREFETCH_BATCH_SIZE)
+        vChecks.push_back(CConnectCheck(boost::bind(&ReadCoins, pcoinsTip->GetBackend(), &vTxid[i], &vCoins[i], &vFound[i], std::min(PREFETCH_BATCH_SIZE, vTxid.size() - i))));
+    RunConnectChecks(vChecks);
+
+    for (size_t i = 0; i < vTxid.size(); i++) {
+        if (vFound[i])
+            pcoinsTip->AddFetchedCoins(vTxid[i], vCoins[i]);
+    }
+    return nMissing;
+}
+
+namespace
+{
+/** The inexpensive checks of a block transaction's inputs, done for all transactions at once before connecting them */
+struct CTxInputsCheck {
+    //! Whether the spent outputs were all found, if not the transaction is checked when it is connected
+    bool fFound;
+    std::vector<CSpentOutput> vSpent;
+
+    unsigned int nLegacySigOps;
+    unsigned int nP2SHSigOps;
+    CAmount nValueIn;
+    bool fOk;
+    CValidationState state;
+
+    CTxInputsCheck() : fFound(false), nLegacySigOps(0), nP2SHSigOps(0), nValueIn(0), fOk(true) {}
+};
+} // anon namespace
+
+/** Count the sigops of tx and check its inputs against the spent outputs found for it */
+static void CheckTxInputsAhead(const CTransaction& tx, CTxInputsCheck& check, int nSpendHeight)
+{
+    check.nLegacySigOps = GetLegacySigOpCount(tx);
+    if (tx.IsCoinBase() || !check.fFound)
+        return;
+
+    // Same as GetP2SHSigOpCount and GetValueIn, on the spent outputs
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        const CTxOut& prevout = *check.vSpent[i].pout;
+        if (prevout.scriptPubKey.IsPayToScriptHash())
+            check.nP2SHSigOps += prevout.scriptPubKey.GetSigOpCount(tx.vin[i].scriptSig);
+        check.nValueIn += prevout.nValue;
+    }
+    check.fOk = CheckSpentOutputs(tx, check.state, check.vSpent, nSpendHeight);
+}
+
+static void CheckBlockInputsRange(const CBlock* pblock, std::vector<CTxInputsCheck>* pvCheck, size_t nStart, size_t nEnd, int nSpendHeight)
+{
+    for (size_t i = nStart; i < nEnd; i++)
+        CheckTxInputsAhead(pblock->vtx[i], (*pvCheck)[i], nSpendHeight);
+}
+
+/**
+ * Find the outputs every transaction of the block spends, in the view as it
+ * is before the block or among the outputs of earlier transactions of the
+ * block, then run the inexpensive checks of all transactions in parallel.
+ * An output spent twice in the block is found for both spends, connecting
+ * the second one fails on HaveInputs before its results are used.
+ */
+static void CheckBlockInputsAhead(const CBlock& block, const CCoinsViewCache& view, int nHeight, std::vector<CTxInputsCheck>& vCheck)
+{
+    vCheck.resize(block.vtx.size());
+    std::map<uint256, unsigned int> mapBlockTx;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        CTxInputsCheck& check = vCheck[i];
+        if (!tx.IsCoinBase()) {
+            check.fFound = true;
+            check.vSpent.reserve(tx.vin.size());
+            BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+                std::map<uint256, unsigned int>::const_iterator it = mapBlockTx.find(txin.prevout.hash);
+                if (it != mapBlockTx.end()) {
+                    const CTransaction& txPrev = block.vtx[it->second];
+                    if (txin.prevout.n >= txPrev.vout.size() || txPrev.vout[txin.prevout.n].IsNull()) {
+                        check.fFound = false;
+                        break;
+                    }
+                    check.vSpent.push_back(CSpentOutput(txPrev.vout[txin.prevout.n], nHeight, txPrev.IsCoinBase(), txPrev.IsCoinStake()));
+                } else {
+                    const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+                    if (!coins || !coins->IsAvailable(txin.prevout.n)) {
+                        check.fFound = false;
+                        break;
+                    }
+                    check.vSpent.push_back(CSpentOutput(coins->vout[txin.prevout.n], coins->nHeight, coins->IsCoinBase(), coins->IsCoinStake()));
+                }
+            }
+        }
+        mapBlockTx[tx.GetHash()] = i;
+    }
+
+    // Nothing touches the view until all checks are done, so the spent outputs stay put
+    std::vector<CConnectCheck> vChecks;
+    for (size_t i = 0; i < block.vtx.size(); i += CHECK_INPUTS_BATCH_SIZE)
+        vChecks.push_back(CConnectCheck(boost::bind(&CheckBlockInputsRange, &block, &vCheck, i, std::min(i + CHECK_INPUTS_BATCH_SIZE, block.vtx.size()), nHeight)));
+    RunConnectChecks(vChecks);
+}
+
+static int64_t nTimePrefetch = 0;
+static int64_t nTimeCheckInputs = 0;
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked)
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked, bool fUpdateIndexes)
 {
     AssertLockHeld(cs_main);
     // Check it again in case a previous version let a bad block in
@@ -2050,6 +2430,21 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return state.DoS(100, error("ConnectBlock() : PoW period ended"),
             REJECT_INVALID, "PoW-ended");
 
+    // A PoS block that was stored before its parent was connected gets its kernel checked now,
+    // against the outputs of view, which is not on the tip for the history of a UTXO set snapshot
+    if (block.IsProofOfStake() && (pindex->nFlags & CBlockIndex::BLOCK_STAKE_UNCHECKED)) {
+        uint256 hashProofOfStake;
+        if (!CheckProofOfStake(block, hashProofOfStake, &view))
+            return state.DoS(100, error("ConnectBlock() : proof of stake check failed"),
+                REJECT_INVALID, "bad-stake");
+        if (!fJustCheck) {
+            mapProofOfStake.insert(make_pair(pindex->GetBlockHash(), hashProofOfStake));
+            pindex->hashProofOfStake = hashProofOfStake;
+            pindex->nFlags &= ~CBlockIndex::BLOCK_STAKE_UNCHECKED;
+            setDirtyBlockIndex.insert(pindex);
+        }
+    }
+
     bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
@@ -2077,6 +2472,18 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     int64_t nTimeStart = GetTimeMicros();
+    unsigned int nReadAhead = 0;
+    unsigned int nPrefetched = PrefetchBlockInputs(block, view, nReadAhead);
+    int64_t nTimePrefetched = GetTimeMicros();
+    nTimePrefetch += nTimePrefetched - nTimeStart;
+    LogPrint("bench", "      - Prefetch %u input transactions (%u read ahead): %.2fms [%.2fs]\n", nPrefetched, nReadAhead, 0.001 * (nTimePrefetched - nTimeStart), nTimePrefetch * 0.000001);
+
+    std::vector<CTxInputsCheck> vInputsCheck;
+    CheckBlockInputsAhead(block, view, pindex->nHeight, vInputsCheck);
+    int64_t nTimeInputsChecked = GetTimeMicros();
+    nTimeCheckInputs += nTimeInputsChecked - nTimePrefetched;
+    LogPrint("bench", "      - Check inputs: %.2fms [%.2fs]\n", 0.001 * (nTimeInputsChecked - nTimePrefetched), nTimeCheckInputs * 0.000001);
+
     CAmount nFees = 0;
     int nInputs = 0;
     unsigned int nSigOps = 0;
@@ -2085,14 +2492,20 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     vPos.reserve(block.vtx.size());
     CBlockUndo blockundo;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<COutPoint, CSpentIndexValue> > spentIndex;
     CAmount nValueOut = 0;
     CAmount nValueIn = 0;
     unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS;
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
         const CTransaction& tx = block.vtx[i];
+        const uint256& txhash = tx.GetHash();
+
+        CTxInputsCheck& check = vInputsCheck[i];
 
         nInputs += tx.vin.size();
-        nSigOps += GetLegacySigOpCount(tx);
+        nSigOps += check.nLegacySigOps;
         if (nSigOps > nMaxBlockSigOps)
             return state.DoS(100, error("ConnectBlock() : too many sigops"),
                 REJECT_INVALID, "bad-blk-sigops");
@@ -2102,33 +2515,71 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 return state.DoS(100, error("ConnectBlock() : inputs missing/spent"),
                     REJECT_INVALID, "bad-txns-inputs-missingorspent");
 
+            // Spent outputs not found ahead are available now, check them here
+            if (!check.fFound) {
+                check.fFound = GetSpentOutputs(tx, view, check.vSpent);
+                CheckTxInputsAhead(tx, check, pindex->nHeight);
+            }
+
             // Add in sigops done by pay-to-script-hash inputs;
             // this is to prevent a "rogue miner" from creating
             // an incredibly-expensive-to-validate block.
-            nSigOps += GetP2SHSigOpCount(tx, view);
+            nSigOps += check.nP2SHSigOps;
             if (nSigOps > nMaxBlockSigOps)
                 return state.DoS(100, error("ConnectBlock() : too many sigops"), REJECT_INVALID, "bad-blk-sigops");
 
             if (!tx.IsCoinStake())
-                nFees += view.GetValueIn(tx) - tx.GetValueOut();
-            nValueIn += view.GetValueIn(tx);
+                nFees += check.nValueIn - tx.GetValueOut();
+            nValueIn += check.nValueIn;
 
             std::vector<CScriptCheck> vChecks;
             unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
+            // The inexpensive checks were done ahead, only the scripts are left.
+            // Connecting for real uses up the cached signatures, a test connection keeps them
+            if (!check.fOk)
+                state = check.state;
+            if (!check.fOk || (fScriptChecks && !CheckInputScripts(tx, state, view, flags, fJustCheck, nScriptCheckThreads ? &vChecks : NULL)))
                 if (!Checkpoints::CheckBlock(pindex->nHeight, *pindex->phashBlock))
                     return false;
             control.Add(vChecks);
+
+            if (fAddressIndex || fSpentIndex) {
+                for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                    const CTxIn& input = tx.vin[j];
+                    const CCoins* coins = view.AccessCoins(input.prevout.hash);
+                    const CTxOut& prevout = coins->vout[input.prevout.n];
+                    if (fSpentIndex)
+                        spentIndex.push_back(std::make_pair(input.prevout, CSpentIndexValue(txhash, j, pindex->nHeight, coins->nHeight, prevout)));
+                    int nAddressType;
+                    uint160 hashBytes;
+                    if (fAddressIndex && GetAddressIndexKey(prevout.scriptPubKey, nAddressType, hashBytes)) {
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(nAddressType, hashBytes, pindex->nHeight, i, txhash, j, true), -prevout.nValue));
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(nAddressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
+                    }
+                }
+            }
         }
         nValueOut += tx.GetValueOut();
 
+        if (fAddressIndex) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                int nAddressType;
+                uint160 hashBytes;
+                if (GetAddressIndexKey(out.scriptPubKey, nAddressType, hashBytes)) {
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(nAddressType, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue));
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(nAddressType, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
+                }
+            }
+        }
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
         UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
 
-        vPos.push_back(std::make_pair(tx.GetHash(), pos));
+        vPos.push_back(std::make_pair(txhash, pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
 
@@ -2142,8 +2593,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime1 - nTimeStart), 0.001 * (nTime1 - nTimeStart) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime1 - nTimeStart) / (nInputs - 1), nTimeConnect * 0.000001);
 
     //PoW phase redistributed fees to miner. PoS stage destroys fees.
+    //The history of a UTXO set snapshot is connected with the tip at its base, so it is judged at the
+    //height the active chain had when connecting it normally
     CAmount nExpectedMint = GetBlockValue(pindex->pprev->nHeight);
-    if (block.IsProofOfWork() || Params().NetworkID() != CBaseChainParams::MAIN || chainActive.Height() >= SOFT_FORK_VERSION_110)
+    int nFeeHeight = IsSnapshotHistory(pindex->nHeight) ? pindex->pprev->nHeight : chainActive.Height();
+    if (block.IsProofOfWork() || Params().NetworkID() != CBaseChainParams::MAIN || nFeeHeight >= SOFT_FORK_VERSION_110)
         nExpectedMint += nFees;
 
     //Check that the block does not overmint
@@ -2185,6 +2639,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    if (fAddressIndex && fUpdateIndexes)
+        if (!pblocktree->UpdateAddressIndex(pindex, addressIndex, addressUnspentIndex, false, boost::bind(ChainIncludesBlock, _1, pindex)))
+            return state.Abort("Failed to write address index");
+
+    if (fSpentIndex && fUpdateIndexes)
+        if (!pblocktree->UpdateSpentIndex(spentIndex))
+            return state.Abort("Failed to write spent index");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2192,37 +2654,294 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     nTimeIndex += nTime3 - nTime2;
     LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime3 - nTime2), nTimeIndex * 0.000001);
 
-    // Watch for changes to the previous coinbase transaction.
-    static uint256 hashPrevBestCoinBase;
-    GetMainSignals().UpdatedTransaction(hashPrevBestCoinBase);
-    hashPrevBestCoinBase = block.vtx[0].GetHash();
+    // Watch for changes to the previous coinbase transaction.
+    static uint256 hashPrevBestCoinBase;
+    GetMainSignals().UpdatedTransaction(hashPrevBestCoinBase);
+    hashPrevBestCoinBase = block.vtx[0].GetHash();
+
+    int64_t nTime4 = GetTimeMicros();
+    nTimeCallbacks += nTime4 - nTime3;
+    LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime4 - nTime3), nTimeCallbacks * 0.000001);
+
+    return true;
+}
+
+enum FlushStateMode {
+    FLUSH_STATE_NONE,
+    FLUSH_STATE_IF_NEEDED,
+    FLUSH_STATE_PERIODIC,
+    FLUSH_STATE_ALWAYS
+};
+
+int GetPruneKeepBlocks()
+{
+    int nKeep = GetArg("-maxreorg", Params().MaxReorganizationDepth()) + 64 * getIntervalVersion(Params().NetworkID() != CBaseChainParams::MAIN) / Params().TargetSpacing();
+    // Regtest may keep less so pruning can be exercised on short test chains
+    if (Params().MineBlocksOnDemand())
+        return nKeep;
+    return std::max(nKeep, (int)MIN_BLOCKS_TO_KEEP);
+}
+
+uint64_t CalculateCurrentUsage()
+{
+    uint64_t retval = 0;
+    BOOST_FOREACH (const CBlockFileInfo& file, vinfoBlockFile) {
+        retval += file.nSize + file.nUndoSize;
+    }
+    return retval;
+}
+
+void PruneOneBlockFile(const int fileNumber)
+{
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (pindex->nFile == fileNumber) {
+            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nFile = 0;
+            pindex->nDataPos = 0;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+
+            // Prune from mapBlocksUnlinked -- any block we prune would have
+            // to be downloaded again in order to consider its chain, at which
+            // point it would be considered as a candidate for
+            // mapBlocksUnlinked or setBlockIndexCandidates.
+            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex->pprev);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex*, CBlockIndex*>::iterator itUnlinked = range.first;
+                range.first++;
+                if (itUnlinked->second == pindex) {
+                    mapBlocksUnlinked.erase(itUnlinked);
+                }
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+}
+
+void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
+{
+    for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
+        CDiskBlockPos pos(*it, 0);
+        // Readers still holding a handle keep working, new ones must not find it
+        blockFileCache.Close(*it);
+        boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+        boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
+    }
+}
+
+/**
+ * Calculate the block/rev files that should be deleted to remain under target,
+ * oldest first. Files holding a block within GetPruneKeepBlocks() of the tip
+ * are never pruned, nor is the file currently being written to.
+ */
+static void FindFilesToPrune(std::set<int>& setFilesToPrune)
+{
+    LOCK2(cs_main, cs_LastBlockFile);
+    if (chainActive.Tip() == NULL || nPruneTarget == 0) {
+        return;
+    }
+    if (chainActive.Tip()->nHeight <= GetPruneKeepBlocks()) {
+        return;
+    }
+
+    unsigned int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - GetPruneKeepBlocks();
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // We don't check to prune until after we've allocated new space for files,
+    // so leave a buffer under our target for another allocation before the next pruning.
+    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    int count = 0;
+
+    if (nCurrentUsage + nBuffer >= nPruneTarget) {
+        for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+            uint64_t nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
+
+            if (vinfoBlockFile[fileNumber].nSize == 0)
+                continue;
+
+            if (nCurrentUsage + nBuffer < nPruneTarget) // are we below our target?
+                break;
+
+            // don't prune files that could have a block within the keep window of the tip, but keep scanning
+            if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+                continue;
+
+            PruneOneBlockFile(fileNumber);
+            // Queue up the files for removal
+            setFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= nBytesToPrune;
+            count++;
+        }
+    }
+
+    LogPrint("prune", "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+        nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024,
+        ((int64_t)nPruneTarget - (int64_t)nCurrentUsage) / 1024 / 1024,
+        nLastBlockWeCanPrune, count);
+}
+
+/** Calculate the block/rev files holding only blocks up to nManualPruneHeight, within the same limits */
+static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight)
+{
+    assert(fPruneMode && nManualPruneHeight > 0);
+
+    LOCK2(cs_main, cs_LastBlockFile);
+    if (chainActive.Tip() == NULL || chainActive.Tip()->nHeight <= GetPruneKeepBlocks()) {
+        return;
+    }
+
+    // last block to prune is the lesser of (user-specified height, keep window from the tip)
+    unsigned int nLastBlockWeCanPrune = std::min(nManualPruneHeight, chainActive.Tip()->nHeight - GetPruneKeepBlocks());
+    int count = 0;
+    for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+        if (vinfoBlockFile[fileNumber].nSize == 0 || vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+            continue;
+        PruneOneBlockFile(fileNumber);
+        setFilesToPrune.insert(fileNumber);
+        count++;
+    }
+    LogPrintf("Prune (Manual): prune_height=%d removed %d blk/rev pairs\n", nLastBlockWeCanPrune, count);
+}
+
+/**
+ * Coins written to the database by ThreadCoinsWriteBack, so that connecting
+ * blocks goes on while they are written. At most one batch is in flight. Its
+ * entries stay in pcoinsTip, unmodified but not trimmed, until it is written,
+ * which keeps lookups that miss the cache consistent with it.
+ */
+static boost::mutex csCoinsWrite;
+static boost::condition_variable condCoinsWrite;
+static CCoinsView* pcoinsWriteView = NULL;
+static CCoinsMap* pcoinsWriteBatch = NULL;
+static uint256 hashCoinsWriteBlock;
+static bool fCoinsWriteStarted = false;
+static bool fCoinsWriteFailed = false;
+static int nCoinsWriteThreads = 0;
+
+/** Write the batch in flight, with csCoinsWrite released, and return it done */
+static void WriteCoinsBatch(boost::unique_lock<boost::mutex>& lock)
+{
+    fCoinsWriteStarted = true;
+    lock.unlock();
+    bool fOk = false;
+    try {
+        fOk = pcoinsWriteView->BatchWrite(*pcoinsWriteBatch, hashCoinsWriteBlock);
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    // Coins the prefetch threads read before the write may be outdated
+    coinsPrefetcher.Invalidate();
+    lock.lock();
+    delete pcoinsWriteBatch;
+    pcoinsWriteBatch = NULL;
+    fCoinsWriteStarted = false;
+    if (!fOk)
+        fCoinsWriteFailed = true;
+    condCoinsWrite.notify_all();
+}
+
+void ThreadCoinsWriteBack()
+{
+    RenameThread("userv-coinswr");
+    boost::unique_lock<boost::mutex> lock(csCoinsWrite);
+    nCoinsWriteThreads++;
+    try {
+        while (true) {
+            while (pcoinsWriteBatch == NULL || fCoinsWriteStarted)
+                condCoinsWrite.wait(lock);
+            WriteCoinsBatch(lock);
+        }
+    } catch (const boost::thread_interrupted&) {
+        nCoinsWriteThreads--;
+        throw;
+    }
+}
+
+/** Hand the entries of pcoinsTip modified since the last write to ThreadCoinsWriteBack */
+static void StartCoinsWrite()
+{
+    CCoinsMap* pmapWrite = new CCoinsMap();
+    pcoinsTip->GetDirtyCoins(*pmapWrite);
+    boost::unique_lock<boost::mutex> lock(csCoinsWrite);
+    assert(pcoinsWriteBatch == NULL);
+    pcoinsWriteView = pcoinsTip->GetBackend();
+    pcoinsWriteBatch = pmapWrite;
+    hashCoinsWriteBlock = pcoinsTip->GetBestBlock();
+    condCoinsWrite.notify_all();
+}
 
-    int64_t nTime4 = GetTimeMicros();
-    nTimeCallbacks += nTime4 - nTime3;
-    LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime4 - nTime3), nTimeCallbacks * 0.000001);
+static bool IsCoinsWriteInFlight()
+{
+    boost::unique_lock<boost::mutex> lock(csCoinsWrite);
+    return pcoinsWriteBatch != NULL;
+}
 
-    return true;
+static bool HaveCoinsWriteThread()
+{
+    boost::unique_lock<boost::mutex> lock(csCoinsWrite);
+    return nCoinsWriteThreads > 0;
 }
 
-enum FlushStateMode {
-    FLUSH_STATE_IF_NEEDED,
-    FLUSH_STATE_PERIODIC,
-    FLUSH_STATE_ALWAYS
-};
+/** Wait for the batch in flight to be written, writing it here if no thread took it. Returns false if a write failed. */
+static bool WaitForCoinsWrite()
+{
+    boost::this_thread::disable_interruption di;
+    boost::unique_lock<boost::mutex> lock(csCoinsWrite);
+    if (pcoinsWriteBatch != NULL && !fCoinsWriteStarted)
+        WriteCoinsBatch(lock);
+    while (pcoinsWriteBatch != NULL)
+        condCoinsWrite.wait(lock);
+    bool fOk = !fCoinsWriteFailed;
+    fCoinsWriteFailed = false;
+    return fOk;
+}
 
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
  * fast is not set and it's been a while since the last write.
+ * The coins cache is written back in the background once it takes three
+ * quarters of its budget, and here when it is over budget or a write is
+ * forced. Unmodified coins are then dropped down to half the budget,
+ * keeping those most likely to be spent soon.
+ * In prune mode block files are deleted when over the target, or up to
+ * nManualPruneHeight if it is set.
  */
-bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
+bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode, int nManualPruneHeight = 0)
 {
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try {
-        if ((mode == FLUSH_STATE_ALWAYS) ||
-            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
-            (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
+        if (fPruneMode && (fCheckForPruning || nManualPruneHeight > 0) && !fReindex) {
+            if (nManualPruneHeight > 0) {
+                FindFilesToPruneManual(setFilesToPrune, nManualPruneHeight);
+            } else {
+                FindFilesToPrune(setFilesToPrune);
+                fCheckForPruning = false;
+            }
+            if (!setFilesToPrune.empty()) {
+                fFlushForPrune = true;
+                if (!fHavePruned) {
+                    pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
+        // A background write that failed leaves the database behind the cache for good
+        bool fCoinsWriting = IsCoinsWriteInFlight();
+        if (!fCoinsWriting && !WaitForCoinsWrite())
+            return state.Abort("Failed to write to coin database");
+        size_t nCoinsUsage = pcoinsTip->DynamicMemoryUsage();
+        bool fCacheLarge = (mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && nCoinsUsage > nCoinCacheUsage / 4 * 3;
+        bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && nCoinsUsage > nCoinCacheUsage;
+        bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000;
+        if ((mode == FLUSH_STATE_ALWAYS) || fFlushForPrune || fCacheLarge || fCacheCritical || fPeriodicWrite) {
             // Typical CCoins structures on disk are around 100 bytes in size.
             // Pushing a new one to the database can cause it to be written
             // twice (once in the log, and once in the tables). This is already
@@ -2251,15 +2970,28 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                 setDirtyBlockIndex.erase(it++);
             }
             pblocktree->Sync();
-            // Finally flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
-                return state.Abort("Failed to write to coin database");
+            // Only delete the pruned files once the index no longer points into them
+            if (fFlushForPrune)
+                UnlinkPrunedFiles(setFilesToPrune);
+            // Finally write the chainstate back (which may refer to block index entries).
+            if (mode == FLUSH_STATE_ALWAYS || fFlushForPrune || fCacheCritical || !HaveCoinsWriteThread()) {
+                bool fCoinsWritten = WaitForCoinsWrite() && pcoinsTip->WriteBack();
+                // Coins the prefetch threads read before the write may be outdated
+                coinsPrefetcher.Invalidate();
+                if (!fCoinsWritten)
+                    return state.Abort("Failed to write to coin database");
+            } else if (!fCoinsWriting) {
+                StartCoinsWrite();
+            }
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
                 GetMainSignals().SetBestChain(chainActive.GetLocator());
             }
             nLastWrite = GetTimeMicros();
         }
+        // Entries written back can go once nothing is being written
+        if (pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage / 4 * 3 && !IsCoinsWriteInFlight())
+            pcoinsTip->Trim(nCoinCacheUsage / 2);
     } catch (const std::runtime_error& e) {
         return state.Abort(std::string("System error while flushing: ") + e.what());
     }
@@ -2272,19 +3004,50 @@ void FlushStateToDisk()
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush()
+{
+    CValidationState state;
+    fCheckForPruning = true;
+    FlushStateToDisk(state, FLUSH_STATE_NONE);
+}
+
+void PruneBlockFilesManual(int nManualPruneHeight)
+{
+    CValidationState state;
+    FlushStateToDisk(state, FLUSH_STATE_NONE, nManualPruneHeight);
+}
+
+CChainSnapshot GetChainSnapshot()
+{
+    return CChainSnapshot(pindexTipPublished.load(std::memory_order_acquire));
+}
+
+bool ChainIncludesBlock(const uint256& hashTip, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    BlockMap::const_iterator mi = mapBlockIndex.find(hashTip);
+    return mi != mapBlockIndex.end() && mi->second->GetAncestor(pindex->nHeight) == pindex;
+}
+
+bool IsSnapshotHistory(int nHeight)
+{
+    return pindexSnapshotBase != NULL && nHeight <= pindexSnapshotBase->nHeight;
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    pindexTipPublished.store(pindexNew, std::memory_order_release);
 
     // New best block
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
 
-    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%u\n",
+    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%.1fMiB(%utx)\n",
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(), log(chainActive.Tip()->nChainWork.getdouble()) / log(2.0), (unsigned long)chainActive.Tip()->nChainTx,
         DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
-        Checkpoints::GuessVerificationProgress(chainActive.Tip()), (unsigned int)pcoinsTip->GetCacheSize());
+        Checkpoints::GuessVerificationProgress(chainActive.Tip()), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1 << 20)), pcoinsTip->GetCacheSize());
 
     cvBlockChange.notify_all();
 
@@ -2592,6 +3355,28 @@ static void PruneBlockIndexCandidates()
     assert(!setBlockIndexCandidates.empty());
 }
 
+bool ActivateSnapshotBase(CBlockIndex* pindexBase, const CUtxoSnapshotMetadata& metadata)
+{
+    AssertLockHeld(cs_main);
+    assert(chainActive.Height() == 0);
+
+    // What connecting its history would have given it, until that is checked
+    pindexBase->nChainTx = metadata.nChainTx;
+    pindexBase->nMoneySupply = metadata.nMoneySupply;
+    pindexBase->RaiseValidity(BLOCK_VALID_SCRIPTS);
+    setDirtyBlockIndex.insert(pindexBase);
+    pindexSnapshotBase = pindexBase;
+    pindexSnapshotHistory = NULL;
+
+    pcoinsTip->SetBestBlock(pindexBase->GetBlockHash());
+    UpdateTip(pindexBase);
+    setBlockIndexCandidates.insert(pindexBase);
+    PruneBlockIndexCandidates();
+
+    CValidationState state;
+    return FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
+}
+
 /**
  * Try to make some progress towards making pindexMostWork the active block.
  * pblock is either NULL or a pointer to a CBlock corresponding to pindexMostWork.
@@ -2704,15 +3489,43 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
             // Relay inventory, but don't relay old inventory during initial block download.
             int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
             {
+                // Peers that understand compact blocks get the block itself, which saves them
+                // the getdata round trip and most of the transactions they already have
+                bool fCompact = fCompactBlocks && pblock && pblock->GetHash() == hashNewTip && pblock->vtx.size() <= MAX_COMPACT_BLOCK_TXS;
+                CBlockHeaderAndShortTxIDs cmpctblock;
+                if (fCompact)
+                    cmpctblock = CBlockHeaderAndShortTxIDs(*pblock);
+                CInv inv(MSG_BLOCK, hashNewTip);
+                unsigned int nSent = 0;
                 LOCK(cs_vNodes);
-                BOOST_FOREACH (CNode* pnode, vNodes)
-                    if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                        pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                BOOST_FOREACH (CNode* pnode, vNodes) {
+                    if (chainActive.Height() <= (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
+                        continue;
+                    if (!fCompact || pnode->nVersion < COMPACT_BLOCKS_VERSION) {
+                        pnode->PushInventory(inv);
+                        continue;
+                    }
+                    bool fKnown;
+                    {
+                        LOCK(pnode->cs_inventory);
+                        fKnown = !pnode->setInventoryKnown.insert(inv).second;
+                    }
+                    if (!fKnown) {
+                        pnode->PushMessage("cmpctblock", cmpctblock);
+                        nSent++;
+                    }
+                }
+                if (nSent > 0) {
+                    LogPrint("cmpctblock", "sent cmpctblock %s to %u peers\n", hashNewTip.ToString(), nSent);
+                    LOCK(cs_compactBlockStats);
+                    compactBlockStats.nSent += nSent;
+                }
             }
             // Notify external listeners about the new tip.
             // Note: uiInterface, should switch main signals.
             uiInterface.NotifyBlockTip(hashNewTip);
-            GetMainSignals().UpdatedBlockTip(pindexNewTip);
+            // The block is handed over when it is still in memory, so listeners need not read it back from disk
+            GetMainSignals().UpdatedBlockTip(pindexNewTip, pblock && pblock->GetHash() == hashNewTip ? pblock : NULL);
 
             unsigned size = 0;
             if (pblock)
@@ -2830,6 +3643,13 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
 
+        // A bare header from headers-first sync has no coinstake to tell PoS from PoW,
+        // but ConnectBlock only allows PoS past LAST_POW_BLOCK, so the height does.
+        // That is all the chain trust and the stake modifier need; the stake itself
+        // is filled in by ReceivedBlockTransactions once the block arrives.
+        if (block.vtx.empty() && pindexNew->nHeight > Params().LAST_POW_BLOCK())
+            pindexNew->SetProofOfStake();
+
         //update previous block pointer
         pindexNew->pprev->pnext = pindexNew;
 
@@ -2841,7 +3661,7 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
             LogPrintf("AddToBlockIndex() : SetStakeEntropyBit() failed \n");
 
         // ppcoin: record proof-of-stake hash value
-        if (pindexNew->IsProofOfStake()) {
+        if (block.IsProofOfStake()) {
             if (!mapProofOfStake.count(hash))
                 LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
             pindexNew->hashProofOfStake = mapProofOfStake[hash];
@@ -2874,16 +3694,30 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBlockIndex* pindexNew, const CDiskBlockPos& pos)
 {
-    if (block.IsProofOfStake())
+    if (block.IsProofOfStake()) {
         pindexNew->SetProofOfStake();
+        if (pindexNew->prevoutStake.IsNull()) {
+            // The index entry was made from the header alone
+            pindexNew->prevoutStake = block.vtx[1].vin[0].prevout;
+            pindexNew->nStakeTime = block.nTime;
+            setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+        }
+        std::map<uint256, uint256>::iterator itProof = mapProofOfStake.find(block.GetHash());
+        if (itProof != mapProofOfStake.end())
+            pindexNew->hashProofOfStake = itProof->second;
+    }
     pindexNew->nTx = block.vtx.size();
-    pindexNew->nChainTx = 0;
+    // The base of a UTXO set snapshot keeps the count it came with until its history is linked
+    if (pindexNew != pindexSnapshotBase)
+        pindexNew->nChainTx = 0;
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
     pindexNew->nUndoPos = 0;
     pindexNew->nStatus |= BLOCK_HAVE_DATA;
     pindexNew->RaiseValidity(BLOCK_VALID_TRANSACTIONS);
     setDirtyBlockIndex.insert(pindexNew);
+    if (IsSnapshotHistory(pindexNew->nHeight))
+        NotifySnapshotHistoryBlock();
 
     if (pindexNew->pprev == NULL || pindexNew->pprev->nChainTx) {
         // If pindexNew is the genesis block or all parents are BLOCK_VALID_TRANSACTIONS.
@@ -2919,6 +3753,12 @@ bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBl
     return true;
 }
 
+/** Size at which a new blk file is started, tiny with -fastprune so tests get many files */
+static unsigned int GetMaxBlockFileSize()
+{
+    return GetBoolArg("-fastprune", false) ? MAX_BLOCKFILE_SIZE_FASTPRUNE : MAX_BLOCKFILE_SIZE;
+}
+
 bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAddSize, unsigned int nHeight, uint64_t nTime, bool fKnown = false)
 {
     LOCK(cs_LastBlockFile);
@@ -2929,7 +3769,8 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
     }
 
     if (!fKnown) {
-        while (vinfoBlockFile[nFile].nSize + nAddSize >= MAX_BLOCKFILE_SIZE) {
+        unsigned int nMaxFileSize = GetMaxBlockFileSize();
+        while (vinfoBlockFile[nFile].nSize && vinfoBlockFile[nFile].nSize + nAddSize >= nMaxFileSize) {
             LogPrintf("Leaving block file %i: %s\n", nFile, vinfoBlockFile[nFile].ToString());
             FlushBlockFile(true);
             nFile++;
@@ -2942,6 +3783,7 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
     }
 
     nLastBlockFile = nFile;
+    blockFileCache.SetAppendFile(nFile);
     vinfoBlockFile[nFile].AddBlock(nHeight, nTime);
     if (fKnown)
         vinfoBlockFile[nFile].nSize = std::max(pos.nPos + nAddSize, vinfoBlockFile[nFile].nSize);
@@ -2952,6 +3794,8 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
         unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         if (nNewChunks > nOldChunks) {
+            if (fPruneMode)
+                fCheckForPruning = true;
             if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
                 FILE* file = OpenBlockFile(pos);
                 if (file) {
@@ -2982,6 +3826,8 @@ bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigne
     unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     if (nNewChunks > nOldChunks) {
+        if (fPruneMode)
+            fCheckForPruning = true;
         if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
             FILE* file = OpenUndoFile(pos);
             if (file) {
@@ -3075,15 +3921,12 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         BOOST_FOREACH (const CTransaction& tx, block.vtx) {
             if (!tx.IsCoinBase()) {
                 //only reject blocks when it's based on complete consensus
-                BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                    if (mapLockedInputs.count(in.prevout)) {
-                        if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                            mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
-                            LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", mapLockedInputs[in.prevout].ToString(), tx.GetHash().ToString());
-                            return state.DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"),
-                                REJECT_INVALID, "conflicting-tx-ix");
-                        }
-                    }
+                uint256 hashLocked;
+                if (txLockManager.GetConflictingLock(tx, hashLocked)) {
+                    mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
+                    LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", hashLocked.ToString(), tx.GetHash().ToString());
+                    return state.DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"),
+                        REJECT_INVALID, "conflicting-tx-ix");
                 }
             }
         }
@@ -3109,7 +3952,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         // but issue an initial reject message.
         // The case also exists that the sending peer could not have enough data to see
         // that this block is invalid, so don't issue an outright ban.
-        if (nHeight != 0 && !IsInitialBlockDownload()) {
+        if (nHeight != 0 && !IsInitialBlockDownload() && !IsSnapshotHistory(nHeight)) {
             if (!IsBlockPayeeValid(block, nHeight)) {
                 mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
                 return state.DoS(0, error("CheckBlock() : Couldn't find masternode/budget payment"),
@@ -3160,6 +4003,12 @@ bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
     return true;
 }
 
+/** Whether a proof-of-stake header at nHeight is further past the tip than its stake can be left unchecked */
+static bool IsStakeHeaderTooFarAhead(int nHeight)
+{
+    return nHeight > Params().LAST_POW_BLOCK() && nHeight > chainActive.Height() + MAX_STAKE_UNCHECKED_HEADERS;
+}
+
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* const pindexPrev)
 {
     uint256 hash = block.GetHash();
@@ -3176,6 +4025,21 @@ bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& sta
     if (chainActive.Height() - nHeight >= nMaxReorgDepth)
         return state.DoS(1, error("%s: forked chain older than max reorganization depth (height %d)", __func__, nHeight));
 
+    // A proof-of-stake header carries no proof until its block is connected, so a chain of them
+    // has to branch off the active chain within the same depth, however far ahead it reaches
+    if (nHeight > Params().LAST_POW_BLOCK() && !chainActive.Contains(pindexPrev)) {
+        const CBlockIndex* pindexFork = chainActive.FindFork(pindexPrev);
+        if (pindexFork == NULL || chainActive.Height() - pindexFork->nHeight >= nMaxReorgDepth)
+            return state.DoS(10, error("%s: proof-of-stake chain forks off deeper than max reorganization depth (height %d)", __func__, nHeight),
+                REJECT_INVALID, "bad-fork-depth");
+    }
+
+    // Nor can it reach further past the tip than the blocks checking it takes can be held, so that
+    // made up headers cannot pile up work, or steer the download, beyond that many blocks
+    if (IsStakeHeaderTooFarAhead(nHeight))
+        return state.DoS(0, error("%s: proof-of-stake header too far past the tip (height %d)", __func__, nHeight),
+            REJECT_INVALID, "stake-header-ahead");
+
     // Check timestamp against prev
     if (block.GetBlockTime() <= pindexPrev->GetMedianTimePast()) {
         LogPrintf("Block time = %d , GetMedianTimePast = %d \n", block.GetBlockTime(), pindexPrev->GetMedianTimePast());
@@ -3193,6 +4057,10 @@ bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& sta
     if (pcheckpoint && nHeight < pcheckpoint->nHeight)
         return state.DoS(0, error("%s : forked chain older than last checkpoint (height %d)", __func__, nHeight));
 
+    // Nor from the history of a UTXO set snapshot, which has no undo data to disconnect the snapshot base with
+    if (IsSnapshotHistory(nHeight))
+        return state.DoS(0, error("%s : forked chain older than the UTXO set snapshot (height %d)", __func__, nHeight));
+
     // Reject block.nVersion=1 blocks when 95% (75% on testnet) of the network has upgraded:
     if (block.nVersion < 2 &&
         CBlockIndex::IsSuperMajority(2, pindexPrev, Params().RejectBlockOutdatedMajority())) {
@@ -3294,6 +4162,31 @@ bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex
     return true;
 }
 
+bool AcceptBlockHeader(const CBlockHeader& header, CValidationState& state, CBlockIndex** ppindex)
+{
+    AssertLockHeld(cs_main);
+    uint256 hash = header.GetHash();
+    BlockMap::iterator mi = mapBlockIndex.find(header.hashPrevBlock);
+    if (hash != Params().HashGenesisBlock() && !mapBlockIndex.count(hash) && mi != mapBlockIndex.end()) {
+        // A header from headers-first sync. Do the checks AcceptBlock and CheckBlock do on
+        // a full block as far as they go without the transactions: a PoS kernel and block
+        // signature have to wait for the block.
+        CBlockIndex* pindexPrev = mi->second;
+        bool fProofOfStake = pindexPrev->nHeight + 1 > Params().LAST_POW_BLOCK();
+        if (!fProofOfStake && !CheckProofOfWork(hash, header.nBits))
+            return state.DoS(50, error("%s : proof of work failed", __func__),
+                REJECT_INVALID, "high-hash");
+        if (header.GetBlockTime() > GetAdjustedTime() + (fProofOfStake ? 180 : 7200))
+            return state.Invalid(error("%s : block timestamp too far in the future", __func__),
+                REJECT_INVALID, "time-too-new");
+        if (!CheckWork(CBlock(header), pindexPrev))
+            return state.DoS(100, error("%s : incorrect difficulty for header %s", __func__, hash.ToString()),
+                REJECT_INVALID, "bad-diffbits");
+    }
+
+    return AcceptBlockHeader(CBlock(header), state, ppindex);
+}
+
 bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex, CDiskBlockPos* dbp, bool fAlreadyCheckedBlock)
 {
     AssertLockHeld(cs_main);
@@ -3326,7 +4219,13 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
     if (block.GetHash() != Params().HashGenesisBlock() && !CheckWork(block, pindexPrev))
         return false;
 
-    if (block.IsProofOfStake()) {
+    // The kernel is checked against the active chain's UTXO set and stake modifiers,
+    // so a block downloaded ahead of its parent being connected has to wait until it extends the tip,
+    // and those of the history of a UTXO set snapshot, whose stakes the tip has spent, for ConnectBlock
+    bool fSnapshotHistory = pindexPrev && IsSnapshotHistory(pindexPrev->nHeight + 1);
+    bool fAheadOfTip = pindexPrev && !chainActive.Contains(pindexPrev) && pindexPrev->GetAncestor(chainActive.Height()) == chainActive.Tip();
+    bool fCheckStake = !fSnapshotHistory && !fAheadOfTip;
+    if (block.IsProofOfStake() && fCheckStake) {
         uint256 hashProofOfStake;
         uint256 hash = block.GetHash();
 
@@ -3346,6 +4245,10 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         return true;
     }
 
+    // A block of the active chain that was pruned is not needed again
+    if (pindex->nTx != 0 && chainActive.Contains(pindex))
+        return true;
+
     if ((!fAlreadyCheckedBlock && !CheckBlock(block, state)) || !ContextualCheckBlock(block, state, pindex->pprev)) {
         if (state.IsInvalid() && !state.CorruptionPossible()) {
             pindex->nStatus |= BLOCK_FAILED_VALID;
@@ -3354,6 +4257,32 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         return false;
     }
 
+    if (block.IsProofOfStake() && !fCheckStake && !fSnapshotHistory && dbp == NULL) {
+        // The best header may be made up, so blocks of any chain ahead of the tip are held. When there
+        // is no room left, those furthest from the tip make way, so the next block always gets in.
+        if (mapBlocksStakeUnchecked.size() >= MAX_STAKE_UNCHECKED_BLOCKS) {
+            map<uint256, CBlock>::iterator itFurthest = mapBlocksStakeUnchecked.end();
+            int nFurthest = pindex->nHeight;
+            for (map<uint256, CBlock>::iterator it = mapBlocksStakeUnchecked.begin(); it != mapBlocksStakeUnchecked.end(); it++) {
+                BlockMap::iterator mi = mapBlockIndex.find(it->first);
+                if (mi != mapBlockIndex.end() && mi->second->nHeight > nFurthest) {
+                    itFurthest = it;
+                    nFurthest = mi->second->nHeight;
+                }
+            }
+            if (itFurthest == mapBlocksStakeUnchecked.end())
+                return error("%s : not holding PoS block %s, %u blocks closer to the tip already wait for their parent", __func__, pindex->GetBlockHash().ToString(), mapBlocksStakeUnchecked.size());
+            mapBlocksStakeUnchecked.erase(itFurthest);
+        }
+        mapBlocksStakeUnchecked.insert(make_pair(pindex->GetBlockHash(), block));
+        return true;
+    }
+
+    // The history of a snapshot ends at its base and a block imported from a file is on disk already,
+    // so those are stored as they are and their kernel is checked by ConnectBlock
+    if (block.IsProofOfStake() && !fCheckStake)
+        pindex->nFlags |= CBlockIndex::BLOCK_STAKE_UNCHECKED;
+
     int nHeight = pindex->nHeight;
 
     // Write block to history file
@@ -3437,6 +4366,49 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+/** Store and connect, one after the other, the held proof-of-stake blocks that now extend the tip */
+void static ConnectStakeUncheckedBlocks()
+{
+    while (true) {
+        CBlock block;
+        {
+            LOCK(cs_main);
+            map<uint256, CBlock>::iterator it = mapBlocksStakeUnchecked.begin();
+            while (it != mapBlocksStakeUnchecked.end()) {
+                if (it->second.hashPrevBlock == chainActive.Tip()->GetBlockHash())
+                    break;
+                BlockMap::iterator mi = mapBlockIndex.find(it->first);
+                // Forget those the active chain went past or that no longer build on it
+                if (mi == mapBlockIndex.end() || mi->second->nHeight <= chainActive.Height() || mi->second->GetAncestor(chainActive.Height()) != chainActive.Tip())
+                    mapBlocksStakeUnchecked.erase(it++);
+                else
+                    it++;
+            }
+            if (it == mapBlocksStakeUnchecked.end())
+                return;
+            block = it->second;
+            mapBlocksStakeUnchecked.erase(it);
+
+            CValidationState state;
+            CBlockIndex* pindex = NULL;
+            if (!AcceptBlock(block, state, &pindex, NULL, true)) {
+                BlockMap::iterator mi = mapBlockIndex.find(block.GetHash());
+                if (state.IsInvalid() && mi != mapBlockIndex.end()) {
+                    mi->second->nStatus |= BLOCK_FAILED_VALID;
+                    setDirtyBlockIndex.insert(mi->second);
+                }
+                // Another held block may extend the tip instead, a made up one does not hold up the real one
+                error("%s : held block %s failed: %s", __func__, block.GetHash().ToString(), state.GetRejectReason());
+                continue;
+            }
+        }
+
+        CValidationState state;
+        if (!ActivateBestChain(state, &block, true))
+            return;
+    }
+}
+
 bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp)
 {
     // Preliminary checks
@@ -3457,7 +4429,13 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
         //if we get this far, check if the prev block is our prev block, if not then request sync and return false
         BlockMap::iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
         if (mi == mapBlockIndex.end()) {
-            pfrom->PushMessage("getblocks", chainActive.GetLocator(), uint256(0));
+            if (SyncHeadersFirst(pfrom)) {
+                LOCK(cs_main);
+                MarkBlockAsReceived(pblock->GetHash());
+                pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), pblock->GetHash());
+            } else {
+                pfrom->PushMessage("getblocks", chainActive.GetLocator(), uint256(0));
+            }
             return false;
         }
     }
@@ -3479,11 +4457,20 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
         CheckBlockIndex ();
         if (!ret)
             return error ("%s : AcceptBlock FAILED", __func__);
+
+        // Start reading the coins it spends, unless it is connected right away or not on the tip
+        if (pindex && pindex->pprev != chainActive.Tip() && !IsSnapshotHistory(pindex->nHeight)) {
+            std::vector<uint256> vTxid;
+            GetUncachedBlockInputs(*pblock, vTxid);
+            coinsPrefetcher.Request(vTxid);
+        }
     }
 
     if (!ActivateBestChain(state, pblock, checked))
         return error("%s : ActivateBestChain failed", __func__);
 
+    ConnectStakeUncheckedBlocks();
+
     if (!fLiteMode) {
         if (masternodeSync.RequestedMasternodeAssets > MASTERNODE_SYNC_LIST) {
             masternodePayments.ProcessBlock(GetHeight() + 10);
@@ -3625,6 +4612,17 @@ bool static LoadBlockIndexDB(string& strError)
 
     boost::this_thread::interruption_point();
 
+    // A UTXO set snapshot whose history is still being validated
+    CUtxoSnapshotMetadata snapshot;
+    if (pblocktree->ReadUtxoSnapshot(snapshot)) {
+        BlockMap::iterator mi = mapBlockIndex.find(snapshot.hashBlock);
+        if (mi == mapBlockIndex.end()) {
+            strError = "the block of the UTXO set snapshot is not in the block index";
+            return false;
+        }
+        pindexSnapshotBase = mi->second;
+    }
+
     // Calculate nChainWork
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
@@ -3636,7 +4634,8 @@ bool static LoadBlockIndexDB(string& strError)
     BOOST_FOREACH (const PAIRTYPE(int, CBlockIndex*) & item, vSortedByHeight) {
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        // nTx stays set for pruned blocks, so it tells whether the block was ever processed
+        if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3648,6 +4647,9 @@ bool static LoadBlockIndexDB(string& strError)
                 pindex->nChainTx = pindex->nTx;
             }
         }
+        // The base of a UTXO set snapshot may not have the blocks of its history yet
+        if (pindex == pindexSnapshotBase && pindex->nChainTx == 0)
+            pindex->nChainTx = snapshot.nChainTx;
         if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->nChainTx || pindex->pprev == NULL))
             setBlockIndexCandidates.insert(pindex);
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
@@ -3660,6 +4662,7 @@ bool static LoadBlockIndexDB(string& strError)
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
+    blockFileCache.SetAppendFile(nLastBlockFile);
     vinfoBlockFile.resize(nLastBlockFile + 1);
     LogPrintf("%s: last block file = %i\n", __func__, nLastBlockFile);
     for (int nFile = 0; nFile <= nLastBlockFile; nFile++) {
@@ -3696,6 +4699,11 @@ bool static LoadBlockIndexDB(string& strError)
     pblocktree->ReadFlag("shutdown", fLastShutdownWasPrepared);
     LogPrintf("%s: Last shutdown was prepared: %s\n", __func__, fLastShutdownWasPrepared);
 
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
@@ -3705,6 +4713,14 @@ bool static LoadBlockIndexDB(string& strError)
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have an address index
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddressIndex ? "enabled" : "disabled");
+
+    // Check whether we have a spent index
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("LoadBlockIndexDB(): spent index %s\n", fSpentIndex ? "enabled" : "disabled");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -3713,6 +4729,12 @@ bool static LoadBlockIndexDB(string& strError)
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    pindexTipPublished.store(it->second, std::memory_order_release);
+
+    if (pindexSnapshotBase && !chainActive.Contains(pindexSnapshotBase)) {
+        strError = "the loading of the UTXO set snapshot was interrupted";
+        return false;
+    }
 
     PruneBlockIndexCandidates();
 
@@ -3757,6 +4779,16 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight < chainActive.Height() - nCheckDepth)
             break;
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+            break;
+        }
+        if (IsSnapshotHistory(pindex->nHeight)) {
+            // The history of a UTXO set snapshot is verified as it is connected in the background
+            LogPrintf("VerifyDB(): block verification stopping at height %d (UTXO set snapshot)\n", pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex))
@@ -3774,9 +4806,9 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
+            if (!DisconnectBlock(block, state, pindex, coins, &fClean, false))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             pindexState = pindex->pprev;
             if (!fClean) {
@@ -3801,7 +4833,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             CBlock block;
             if (!ReadBlockFromDisk(block, pindex))
                 return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            if (!ConnectBlock(block, state, pindex, coins, false))
+            if (!ConnectBlock(block, state, pindex, coins, false, false, false))
                 return error("VerifyDB() : *** found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         }
     }
@@ -3813,10 +4845,13 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
 
 void UnloadBlockIndex()
 {
+    pindexTipPublished.store(NULL, std::memory_order_release);
     mapBlockIndex.clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
+    pindexSnapshotBase = NULL;
+    pindexSnapshotHistory = NULL;
 }
 
 bool LoadBlockIndex(string& strError)
@@ -3838,6 +4873,14 @@ bool InitBlockIndex()
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+
+    // Use the provided setting for -addressindex in the new database
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+
+    // Use the provided setting for -spentindex in the new database
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -3976,6 +5019,10 @@ void static CheckBlockIndex()
 
     LOCK(cs_main);
 
+    // The block tree lacks the history of a UTXO set snapshot until it is validated
+    if (pindexSnapshotBase)
+        return;
+
     // During a reindex, we read the genesis block and call CheckBlockIndex before ActivateBestChain,
     // so we have the genesis block in mapBlockIndex but no active chain.  (A few of the tests when
     // iterating the block tree require that chainActive has been initialized.)
@@ -4004,6 +5051,7 @@ void static CheckBlockIndex()
     int nHeight = 0;
     CBlockIndex* pindexFirstInvalid = NULL;         // Oldest ancestor of pindex which is invalid.
     CBlockIndex* pindexFirstMissing = NULL;         // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL;  // Oldest ancestor of pindex for which nTx == 0.
     CBlockIndex* pindexFirstNotTreeValid = NULL;    // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL;   // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
@@ -4011,6 +5059,7 @@ void static CheckBlockIndex()
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
@@ -4021,12 +5070,21 @@ void static CheckBlockIndex()
             assert(pindex->GetBlockHash() == Params().HashGenesisBlock()); // Genesis block's hash must match.
             assert(pindex == chainActive.Genesis());                       // The current active chain's genesis block must be this block.
         }
-        // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
-        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
+        // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
+        // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
+        if (!fHavePruned) {
+            // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        } else {
+            // If we have pruned, then we can only say that HAVE_DATA implies nTx > 0
+            if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
+        }
+        if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
+        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0)); // This is pruning-independent.
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
-        // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // All parents having had data (at some point) is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0));                                      // nChainTx != 0 is used to signal that all parent blocks have been processed (but may have been pruned).
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
@@ -4038,11 +5096,20 @@ void static CheckBlockIndex()
             // Checks for not-invalid blocks.
             assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
         }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstMissing == NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates.
-                assert(setBlockIndexCandidates.count(pindex));
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
+            if (pindexFirstInvalid == NULL) {
+                // If this block sorts at least as good as the current tip and
+                // is valid and we have all data for its parents, it must be in
+                // setBlockIndexCandidates. chainActive.Tip() must also be there
+                // even if some data has been pruned.
+                if (pindexFirstMissing == NULL || pindex == chainActive.Tip()) {
+                    assert(setBlockIndexCandidates.count(pindex));
+                }
+                // If some parent is missing, then it could be that this block was in
+                // setBlockIndexCandidates but had to be removed because of the missing data.
+                // In this case it must be in mapBlocksUnlinked -- see test below.
             }
-        } else { // If this block sorts worse than the current tip, it cannot be in setBlockIndexCandidates.
+        } else { // If this block sorts worse than the current tip or some ancestor's block has never been seen, it cannot be in setBlockIndexCandidates.
             assert(setBlockIndexCandidates.count(pindex) == 0);
         }
         // Check whether this block is in mapBlocksUnlinked.
@@ -4056,12 +5123,25 @@ void static CheckBlockIndex()
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstMissing != NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent doesn't, and has no invalid parents, it must be in mapBlocksUnlinked.
-                assert(foundInUnlinked);
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed != NULL && pindexFirstInvalid == NULL) {
+            // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
+            assert(foundInUnlinked);
+        }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) assert(!foundInUnlinked); // Can't be in mapBlocksUnlinked if we don't HAVE_DATA
+        if (pindexFirstMissing == NULL) assert(!foundInUnlinked);            // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed == NULL && pindexFirstMissing != NULL) {
+            // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently missing data for some parent.
+            assert(fHavePruned); // We must have pruned.
+            // This block may have entered mapBlocksUnlinked if it has a descendant
+            // that at some point had more work than the tip, and we tried
+            // switching to it but were missing data for some intermediate block.
+            // So if this block is itself better than chainActive.Tip() and it wasn't in
+            // setBlockIndexCandidates, then it must be in mapBlocksUnlinked.
+            if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && setBlockIndexCandidates.count(pindex) == 0) {
+                if (pindexFirstInvalid == NULL) {
+                    assert(foundInUnlinked);
+                }
             }
-        } else { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
-            assert(!foundInUnlinked);
         }
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
         // End: actual consistency checks.
@@ -4081,6 +5161,7 @@ void static CheckBlockIndex()
             // If pindex was the first with a certain property, unset the corresponding variable.
             if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
             if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
             if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
@@ -4181,10 +5262,9 @@ bool static AlreadyHave(const CInv& inv)
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash);
     case MSG_TXLOCK_REQUEST:
-        return mapTxLockReq.count(inv.hash) ||
-               mapTxLockReqRejected.count(inv.hash);
+        return txLockManager.HasRequest(inv.hash);
     case MSG_TXLOCK_VOTE:
-        return mapTxLockVote.count(inv.hash);
+        return txLockManager.HasVote(inv.hash);
     case MSG_SPORK:
         return mapSporks.count(inv.hash);
     case MSG_MASTERNODE_WINNER:
@@ -4335,19 +5415,21 @@ void static ProcessGetData(CNode* pfrom)
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
-                    if (mapTxLockVote.count(inv.hash)) {
+                    CConsensusVote vote;
+                    if (txLockManager.GetVote(inv.hash, vote)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
+                        ss << vote;
                         pfrom->PushMessage("txlvote", ss);
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
-                    if (mapTxLockReq.count(inv.hash)) {
+                    CTransaction txLockRequest;
+                    if (txLockManager.GetRequest(inv.hash, txLockRequest)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mapTxLockReq[inv.hash];
+                        ss << txLockRequest;
                         pfrom->PushMessage("ix", ss);
                         pushed = true;
                     }
@@ -4467,6 +5549,35 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
+/** Validate a block rebuilt from a compact block like one received in a "block" message */
+void static ProcessReconstructedBlock(CNode* pfrom, CBlock& block)
+{
+    CValidationState state;
+    ProcessNewBlock(state, pfrom, &block);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        pfrom->PushMessage("reject", string("block"), state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), block.GetHash());
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+}
+
+/** Download the full block behind a compact block we could not rebuild. Requires cs_main. */
+void static RequestFullBlock(CNode* pfrom, const uint256& hash, CBlockIndex* pindex)
+{
+    MarkBlockAsInFlight(pfrom->GetId(), hash, pindex);
+    pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hash)));
+}
+
+void GetCompactBlockStats(CCompactBlockStats& stats)
+{
+    LOCK(cs_compactBlockStats);
+    stats = compactBlockStats;
+}
+
 bool fRequestedSporksIDB = false;
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
@@ -4702,9 +5813,23 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
-                    // Add this to the list of blocks to request
-                    vToFetch.push_back(inv);
-                    LogPrint("net", "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    if (SyncHeadersFirst(pfrom)) {
+                        // First request the headers preceding the announced block. The block
+                        // download itself is driven by SendMessages, but when we are close to
+                        // synced the block can be fetched right away.
+                        pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), inv.hash);
+                        CNodeState* nodestate = State(pfrom->GetId());
+                        if (chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - Params().TargetSpacing() * 20 &&
+                            nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                            vToFetch.push_back(inv);
+                            MarkBlockAsInFlight(pfrom->GetId(), inv.hash);
+                        }
+                        LogPrint("net", "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    } else {
+                        // Add this to the list of blocks to request
+                        vToFetch.push_back(inv);
+                        LogPrint("net", "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    }
                 }
             }
 
@@ -4742,7 +5867,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
-    else if (strCommand == "getblocks" || strCommand == "getheaders") {
+    else if (strCommand == "getblocks") {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -4757,11 +5882,18 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             pindex = chainActive.Next(pindex);
         int nLimit = 500;
         LogPrint("net", "getblocks %d to %s limit %d from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop == uint256(0) ? "end" : hashStop.ToString(), nLimit, pfrom->id);
+        // If pruning, don't inv blocks unless we have them on disk and are likely to
+        // still have them for the hour or so block relay might take.
+        const int nPrunedBlocksLikelyToHave = GetPruneKeepBlocks() - 3600 / Params().TargetSpacing();
         for (; pindex; pindex = chainActive.Next(pindex)) {
             if (pindex->GetBlockHash() == hashStop) {
                 LogPrint("net", "  getblocks stopping at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
                 break;
             }
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA) || (fPruneMode && pindex->nHeight <= chainActive.Tip()->nHeight - nPrunedBlocksLikelyToHave)) {
+                LogPrint("net", " getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                break;
+            }
             pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
             if (--nLimit <= 0) {
                 // When this block is requested, we'll send an inv that'll make them
@@ -4774,7 +5906,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
-    else if (strCommand == "headers" && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == "getheaders") {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -4801,8 +5933,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
         vector<CBlock> vHeaders;
         int nLimit = MAX_HEADERS_RESULTS;
-        if (fDebug)
-            LogPrintf("getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
+        LogPrint("net", "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
         for (; pindex; pindex = chainActive.Next(pindex)) {
             vHeaders.push_back(pindex->GetBlockHeader());
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
@@ -4917,7 +6048,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
-    else if (strCommand == "headers" && Params().HeadersFirstSyncingActive() && !fImporting && !fReindex) // Ignore headers received while importing
+    else if (strCommand == "headers" && !fImporting && !fReindex) // Ignore headers received while importing
     {
         std::vector<CBlockHeader> headers;
 
@@ -4940,7 +6071,21 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
+
+        // Headers that do not connect are from a reorganization we missed, or made up: ask for
+        // the ones linking them up, and penalise a peer that keeps sending them
+        CNodeState* nodestate = State(pfrom->GetId());
+        if (!mapBlockIndex.count(headers[0].hashPrevBlock) && nCount < MAX_HEADERS_RESULTS) {
+            nodestate->nUnconnectingHeaders++;
+            pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256(0));
+            LogPrint("net", "received header %s that does not connect (%d in a row) peer=%d\n", headers[0].GetHash().ToString(), nodestate->nUnconnectingHeaders, pfrom->id);
+            if (nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0)
+                Misbehaving(pfrom->GetId(), 20);
+            return true;
+        }
+
         CBlockIndex* pindexLast = NULL;
+        bool fPaused = false;
         BOOST_FOREACH (const CBlockHeader& header, headers) {
             CValidationState state;
             if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
@@ -4948,10 +6093,17 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 return error("non-continuous headers sequence");
             }
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
-            if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
+            // Proof-of-stake headers too far past the tip are asked for again once it came closer
+            BlockMap::iterator mi = mapBlockIndex.find(header.hashPrevBlock);
+            CBlockIndex* pindexPrev = mi != mapBlockIndex.end() ? mi->second : NULL;
+            if (pindexPrev && IsStakeHeaderTooFarAhead(pindexPrev->nHeight + 1)) {
+                LogPrint("net", "pausing headers at %d, too far past the tip, peer=%d\n", pindexPrev->nHeight, pfrom->id);
+                nodestate->pindexHeadersPaused = pindexPrev;
+                fPaused = true;
+                break;
+            }
+
+            if (!AcceptBlockHeader(header, state, &pindexLast)) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
@@ -4962,10 +6114,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
         }
 
-        if (pindexLast)
+        if (pindexLast) {
+            nodestate->nUnconnectingHeaders = 0;
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
+        }
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
+        if (nCount == MAX_HEADERS_RESULTS && pindexLast && !fPaused) {
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
             // from there instead.
@@ -4986,7 +6140,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
         if (!mapBlockIndex.count(block.hashPrevBlock)) {
-            if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
+            if (SyncHeadersFirst(pfrom)) {
+                // Get the headers that connect it, the block is fetched again once they are in
+                LOCK(cs_main);
+                MarkBlockAsReceived(hashBlock);
+                pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), hashBlock);
+            } else if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 //we already asked for this block, so lets work backwards and ask for the previous block
                 pfrom->PushMessage("getblocks", chainActive.GetLocator(), block.hashPrevBlock);
                 pfrom->vBlockRequested.push_back(block.hashPrevBlock);
@@ -4999,7 +6158,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             pfrom->AddInventoryKnown(inv);
 
             CValidationState state;
-            if (!mapBlockIndex.count(block.GetHash())) {
+            bool fHaveData;
+            {
+                LOCK(cs_main);
+                BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+                // With headers-first sync the index usually has the header already
+                fHaveData = mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA);
+                if (fHaveData)
+                    MarkBlockAsReceived(hashBlock);
+            }
+            if (!fHaveData) {
                 ProcessNewBlock(state, pfrom, &block);
                 int nDoS;
                 if(state.IsInvalid(nDoS)) {
@@ -5019,6 +6187,184 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        uint256 hashBlock = cmpctblock.header.GetHash();
+        LogPrint("cmpctblock", "received cmpctblock %s (%u txs) peer=%d\n", hashBlock.ToString(), cmpctblock.BlockTxCount(), pfrom->id);
+        pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hashBlock));
+
+        CBlock block;
+        bool fBlockReconstructed = false;
+        {
+            LOCK2(cs_main, cs_compactBlockStats);
+
+            if (!mapBlockIndex.count(cmpctblock.header.hashPrevBlock)) {
+                // It does not connect to anything we know yet, get the headers in between first
+                if (SyncHeadersFirst(pfrom))
+                    pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), hashBlock);
+                else
+                    pfrom->PushMessage("getblocks", chainActive.GetLocator(), hashBlock);
+                return true;
+            }
+
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint("cmpctblock", "%s : Already processed block %s, skipping cmpctblock\n", __func__, hashBlock.ToString());
+                return true;
+            }
+
+            CBlockIndex* pindex = NULL;
+            CValidationState state;
+            if (!AcceptBlockHeader(cmpctblock.header, state, &pindex)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS)) {
+                    if (nDoS > 0)
+                        Misbehaving(pfrom->GetId(), nDoS);
+                    return error("invalid cmpctblock header received %s", hashBlock.ToString());
+                }
+                return true;
+            }
+            UpdateBlockAvailability(pfrom->GetId(), hashBlock);
+
+            // The mempool only matches blocks on top of our tip
+            if (pindex->pprev != chainActive.Tip()) {
+                if (!mapBlocksInFlight.count(hashBlock))
+                    RequestFullBlock(pfrom, hashBlock, pindex);
+                return true;
+            }
+
+            PartiallyDownloadedBlock partialBlock;
+            ReadStatus status = partialBlock.InitData(cmpctblock, mempool);
+            if (status == READ_STATUS_INVALID) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("invalid cmpctblock received %s peer=%d", hashBlock.ToString(), pfrom->id);
+            }
+
+            compactBlockStats.nReceived++;
+            if (status == READ_STATUS_FAILED) {
+                compactBlockStats.nFailed++;
+                RequestFullBlock(pfrom, hashBlock, pindex);
+                return true;
+            }
+            compactBlockStats.nTxPrefilled += partialBlock.nPrefilled;
+            compactBlockStats.nTxMempool += partialBlock.nFromMempool;
+
+            BlockTransactionsRequest req;
+            for (size_t i = 0; i < partialBlock.TxCount(); i++) {
+                if (!partialBlock.IsTxAvailable(i))
+                    req.indexes.push_back(i);
+            }
+            if (req.indexes.empty()) {
+                if (partialBlock.FillBlock(block, std::vector<CTransaction>()) == READ_STATUS_OK) {
+                    compactBlockStats.nFromMempool++;
+                    fBlockReconstructed = true;
+                } else {
+                    compactBlockStats.nFailed++;
+                    RequestFullBlock(pfrom, hashBlock, pindex);
+                }
+            } else {
+                // Ask for the rest and keep what we have until the answer arrives
+                CNodeState* nodestate = State(pfrom->GetId());
+                if (nodestate->hashPartialBlock != 0 && nodestate->hashPartialBlock != hashBlock)
+                    MarkBlockAsReceived(nodestate->hashPartialBlock);
+                nodestate->hashPartialBlock = hashBlock;
+                nodestate->partialBlock = partialBlock;
+                MarkBlockAsInFlight(pfrom->GetId(), hashBlock, pindex);
+                compactBlockStats.nTxRequested += req.indexes.size();
+                req.blockhash = hashBlock;
+                pfrom->PushMessage("getblocktxn", req);
+                LogPrint("cmpctblock", "getblocktxn %s: %u of %u txs missing peer=%d\n", hashBlock.ToString(), req.indexes.size(), partialBlock.TxCount(), pfrom->id);
+            }
+        }
+
+        if (fBlockReconstructed)
+            ProcessReconstructedBlock(pfrom, block);
+    }
+
+
+    else if (strCommand == "getblocktxn") {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        CDiskBlockPos pos;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint("cmpctblock", "peer=%d asked for transactions of block %s we do not have\n", pfrom->id, req.blockhash.ToString());
+                return true;
+            }
+            pos = mi->second->GetBlockPos();
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pos) || block.GetHash() != req.blockhash)
+            return error("getblocktxn : cannot load block %s from disk", req.blockhash.ToString());
+
+        // Blocks too large for 16 bit indexes are never announced compactly
+        if (block.vtx.size() > MAX_COMPACT_BLOCK_TXS || req.indexes.size() > block.vtx.size()) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
+            return error("getblocktxn : bogus request for %u txs of block %s from peer=%d", req.indexes.size(), req.blockhash.ToString(), pfrom->id);
+        }
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("getblocktxn : out of bounds tx index %u from peer=%d", req.indexes[i], pfrom->id);
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+
+        LOCK(cs_compactBlockStats);
+        compactBlockStats.nTxnServed++;
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        bool fBlockReconstructed = false;
+        {
+            LOCK2(cs_main, cs_compactBlockStats);
+            CNodeState* nodestate = State(pfrom->GetId());
+            if (nodestate->hashPartialBlock == 0 || nodestate->hashPartialBlock != resp.blockhash) {
+                LogPrint("cmpctblock", "peer=%d sent us transactions of block %s we were not expecting\n", pfrom->id, resp.blockhash.ToString());
+                return true;
+            }
+
+            ReadStatus status = resp.txn.size() > MAX_COMPACT_BLOCK_TXS ? READ_STATUS_INVALID : nodestate->partialBlock.FillBlock(block, resp.txn);
+            nodestate->hashPartialBlock = uint256(0);
+            nodestate->partialBlock = PartiallyDownloadedBlock();
+
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("invalid blocktxn received for %s peer=%d", resp.blockhash.ToString(), pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // Most likely a short ID collision with a mempool transaction
+                compactBlockStats.nFailed++;
+                BlockMap::iterator mi = mapBlockIndex.find(resp.blockhash);
+                RequestFullBlock(pfrom, resp.blockhash, mi == mapBlockIndex.end() ? NULL : mi->second);
+            } else {
+                compactBlockStats.nRoundTrip++;
+                fBlockReconstructed = true;
+            }
+        }
+
+        if (fBlockReconstructed)
+            ProcessReconstructedBlock(pfrom, block);
+    }
+
+
     // This asymmetric behavior for inbound and outbound connections was introduced
     // to prevent a fingerprinting attack: an attacker can send specific fake addresses
     // to users' AddrMan and later request them by sending getaddr messages.
@@ -5490,13 +6836,25 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             if (nSyncStarted == 0 || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                //pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
-                pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
+                if (SyncHeadersFirst(pto)) {
+                    // Start one back, so a peer that is on our best header still answers with it
+                    // and we learn it has that chain and can download from it.
+                    CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                    pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
+                } else {
+                    pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
+                }
             }
         }
 
+        // Ask again for the headers held back once the tip came close enough to them
+        if (state.pindexHeadersPaused != NULL && chainActive.Height() + MAX_STAKE_UNCHECKED_HEADERS / 2 >= state.pindexHeadersPaused->nHeight) {
+            LogPrint("net", "resuming getheaders (%d) to peer=%d\n", state.pindexHeadersPaused->nHeight, pto->id);
+            pto->PushMessage("getheaders", chainActive.GetLocator(state.pindexHeadersPaused), uint256(0));
+            state.pindexHeadersPaused = NULL;
+        }
+
         // Resend wallet transactions that haven't gotten in a block yet
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
@@ -5574,6 +6932,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
             FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            FindHistoryBlocksToDownload(pto->GetId(), pto->nStartingHeight, MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight - vToDownload.size(), vToDownload);
             BOOST_FOREACH (CBlockIndex* pindex, vToDownload) {
                 vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), pindex);
@@ -5641,7 +7000,7 @@ bool CBlockUndo::WriteToDisk(CDiskBlockPos& pos, const uint256& hashBlock)
 bool CBlockUndo::ReadFromDisk(const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    CBlockFileReader filein(pos, "rev", SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
 
@@ -46,14 +46,17 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewDB;
 class CSporkDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
 class CValidationInterface;
+class CUtxoSnapshotMetadata;
 class CValidationState;
 
 struct CBlockTemplate;
+struct CCompactBlockStats;
 struct CNodeStateStats;
 
 
@@ -64,6 +67,10 @@ static const unsigned int DEFAULT_BLOCK_MIN_SIZE = 0;
 static const unsigned int DEFAULT_BLOCK_PRIORITY_SIZE = 50000;
 /** Default for accepting alerts from the P2P network. */
 static const bool DEFAULT_ALERTS = true;
+/** Default for -addressindex, the script hash to outputs/spends/balance index */
+static const bool DEFAULT_ADDRESSINDEX = false;
+/** Default for -spentindex, the spent outpoint to spending input and prevout index */
+static const bool DEFAULT_SPENTINDEX = false;
 /** The maximum size for transactions we're willing to relay/mine */
 static const unsigned int MAX_STANDARD_TX_SIZE = 100000;
 /** The maximum allowed number of signature check operations in a block (network rule) */
@@ -80,6 +87,8 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** The maximum size of a blk?????.dat file with -fastprune (regtest only) */
+static const unsigned int MAX_BLOCKFILE_SIZE_FASTPRUNE = 0x4000; // 16 KiB
 /** Threshold for nLockTime: below this value it is interpreted as block number, otherwise as UNIX timestamp. */
 static const unsigned int LOCKTIME_THRESHOLD = 500000000; // Tue Nov  5 00:53:20 1985 UTC
 /** Maximum number of script-checking threads allowed */
@@ -98,6 +107,12 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Proof-of-stake blocks downloaded ahead of the tip that are held in memory until their kernel can be checked. */
+static const unsigned int MAX_STAKE_UNCHECKED_BLOCKS = 128;
+/** How far past the tip proof-of-stake headers are accepted, their stake is only checked once their block extends it. */
+static const int MAX_STAKE_UNCHECKED_HEADERS = 128;
+/** Headers messages not connecting to our block index a peer can send before it is penalised. */
+static const int MAX_UNCONNECTING_HEADERS = 10;
 /** Time to wait (in seconds) between writing blockchain state to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 3600;
 /** Maximum length of reject messages. */
@@ -135,9 +150,16 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
-extern unsigned int nCoinCacheSize;
+/** Sync blocks headers-first with peers that support it, instead of through getblocks inventories */
+extern bool fHeadersFirst;
+/** Announce new blocks to peers that support it as compact blocks rebuilt from their mempool */
+extern bool fCompactBlocks;
+/** Bytes of memory the coins cache may take */
+extern size_t nCoinCacheUsage;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
 
@@ -156,9 +178,26 @@ extern std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex* pindexBestHeader;
 
+/** Base of the UTXO set snapshot loaded with -loadutxosnapshot, until its history is validated (protected by cs_main) */
+extern CBlockIndex* pindexSnapshotBase;
+/** Last block of that history connected by ThreadValidateSnapshotHistory, NULL before the genesis block */
+extern CBlockIndex* pindexSnapshotHistory;
+
 /** Minimum disk space required - used in CheckDiskSpace() */
 static const uint64_t nMinDiskSpace = 52428800;
 
+/** Pruning-related variables and constants */
+/** True if any block files have ever been pruned. */
+extern bool fHavePruned;
+/** True if we're running in -prune mode. */
+extern bool fPruneMode;
+/** Number of MiB of block files that we're trying to stay below. */
+extern uint64_t nPruneTarget;
+/** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
+static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/** Minimum -prune target, leaves room for MIN_BLOCKS_TO_KEEP blocks plus the undo data and the file being written */
+static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
+
 /** Register a wallet to receive updates from core */
 void RegisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister a wallet from core */
@@ -212,8 +251,14 @@ bool ProcessMessages(CNode* pfrom);
  * @param[in]   fSendTrickle    When true send the trickled data, otherwise trickle the data until true.
  */
 bool SendMessages(CNode* pto, bool fSendTrickle);
+/** Counters of compact block relay */
+void GetCompactBlockStats(CCompactBlockStats& stats);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the thread that reads and checks block inputs ahead of ConnectBlock */
+void ThreadConnectCheck();
+/** Run the thread that writes the coins cache back to the database */
+void ThreadCoinsWriteBack();
 
 // ***TODO*** probably not the right place for these 2
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
@@ -225,6 +270,13 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(std::string strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransaction& tx, uint256& hashBlock, bool fAllowSlow = false);
+/**
+ * Retrieve the output an input refers to and the block that created it (NULL
+ * while unconfirmed): from the coins cache if it is unspent, from the spent
+ * index if enabled, and only otherwise by reading the transaction from disk.
+ * The coins cache is pcoins if given, pcoinsTip otherwise.
+ */
+bool GetPrevOut(const COutPoint& prevout, CTxOut& txoutRet, CBlockIndex*& pindexRet, const CCoinsViewCache* pcoins = NULL);
 /** Find the best known block, and make it the tip of the block chain */
 
 bool DisconnectBlocksAndReprocess(int blocks);
@@ -245,8 +297,35 @@ bool AbortNode(const std::string& msg, const std::string& userMessage = "");
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
+/**
+ * Number of blocks below the tip whose block and undo data is never pruned:
+ * enough to disconnect a maximum depth reorg and to revalidate the stakes of
+ * the new branch, whose stake modifiers are selected from the blocks up to 64
+ * modifier intervals before it.
+ */
+int GetPruneKeepBlocks();
+/** Calculate the amount of disk space the block & undo files currently use */
+uint64_t CalculateCurrentUsage();
+/** Mark one block file as pruned: its blocks lose their data and undo flags and its file info is reset */
+void PruneOneBlockFile(const int fileNumber);
+/** Actually unlink the specified files */
+void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
+/** Prune block files to stay below the -prune target and flush all state */
+void PruneAndFlush();
+/** Prune the block files holding only blocks up to nManualPruneHeight, as far as the keep window allows */
+void PruneBlockFilesManual(int nManualPruneHeight);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Whether the chain ending at block hashTip includes pindex, false if hashTip is unknown */
+bool ChainIncludesBlock(const uint256& hashTip, const CBlockIndex* pindex);
+/**
+ * Whether a block at nHeight is in the history of pindexSnapshotBase. Such
+ * blocks are checked when ThreadValidateSnapshotHistory connects them, not
+ * against the tip, and no fork from them is accepted.
+ */
+bool IsSnapshotHistory(int nHeight);
+/** Make pindexBase the tip, once pcoinsdbview has the unspent outputs of the UTXO set snapshot made at it */
+bool ActivateSnapshotBase(CBlockIndex* pindexBase, const CUtxoSnapshotMetadata& metadata);
 
 
 /** (try to) add transaction to memory pool **/
@@ -428,14 +507,15 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified. Without fUpdateIndexes the
+ *  address and spent indexes are left alone, for coins that are not the chainstate's. */
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL, bool fUpdateIndexes = true);
 
 /** Reprocess a number of blocks to try and get on the correct chain again **/
 bool DisconnectBlocksAndReprocess(int blocks);
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins */
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck, bool fAlreadyChecked = false);
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck, bool fAlreadyChecked = false, bool fUpdateIndexes = true);
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
@@ -606,9 +686,15 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex);
 /** The currently-connected chain of blocks. */
 extern CChain chainActive;
 
+/** chainActive as of its last update, readable without cs_main */
+CChainSnapshot GetChainSnapshot();
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
+/** The coins database pcoinsTip sits on */
+extern CCoinsViewDB* pcoinsdbview;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
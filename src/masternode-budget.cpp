@@ -78,13 +78,17 @@ bool IsBudgetCollateralValid(uint256 nTxCollateralHash, uint256 nExpectedHash, s
 
     int conf = GetIXConfirmations(nTxCollateralHash);
     if (nBlockHash != uint256(0)) {
-        BlockMap::iterator mi = mapBlockIndex.find(nBlockHash);
-        if (mi != mapBlockIndex.end() && (*mi).second) {
-            CBlockIndex* pindex = (*mi).second;
-            if (chainActive.Contains(pindex)) {
-                conf += chainActive.Height() - pindex->nHeight + 1;
-                nTime = pindex->nTime;
-            }
+        CBlockIndex* pindex = NULL;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(nBlockHash);
+            if (mi != mapBlockIndex.end())
+                pindex = (*mi).second;
+        }
+        CChainSnapshot chain = GetChainSnapshot();
+        if (pindex && chain.Contains(pindex)) {
+            conf += chain.Height() - pindex->nHeight + 1;
+            nTime = pindex->nTime;
         }
     }
 
@@ -1512,7 +1516,7 @@ bool CBudgetProposal::IsValid(std::string& strError, bool fCheckCollateral)
         return false;
     }
 
-    CBlockIndex* pindexPrev = chainActive.Tip();
+    CBlockIndex* pindexPrev = GetChainSnapshot().Tip();
     if (pindexPrev == NULL) {
         strError = "Proposal " + strProposalName + ": Tip is NULL";
         return true;
@@ -1559,6 +1563,7 @@ bool CBudgetProposal::AddOrUpdateVote(CBudgetVote& vote, std::string& strError)
 
     mapVotes[hash] = vote;
     LogPrint("mnbudget", "CBudgetProposal::AddOrUpdateVote - %s %s\n", strAction.c_str(), vote.GetHash().ToString().c_str());
+    GetMainSignals().BudgetVoteAccepted(vote);
 
     return true;
 }
@@ -1640,7 +1645,7 @@ int CBudgetProposal::GetBlockStartCycle()
 
 int CBudgetProposal::GetBlockCurrentCycle()
 {
-    CBlockIndex* pindexPrev = chainActive.Tip();
+    CBlockIndex* pindexPrev = GetChainSnapshot().Tip();
     if (pindexPrev == NULL) return -1;
 
     if (pindexPrev->nHeight >= GetBlockEndCycle()) return -1;
@@ -1827,6 +1832,7 @@ bool CFinalizedBudget::AddOrUpdateVote(CFinalizedBudgetVote& vote, std::string&
 
     mapVotes[hash] = vote;
     LogPrint("mnbudget", "CFinalizedBudget::AddOrUpdateVote - %s %s\n", strAction.c_str(), vote.GetHash().ToString().c_str());
+    GetMainSignals().FinalizedBudgetVoteAccepted(vote);
     return true;
 }
 
@@ -2041,11 +2047,11 @@ bool CFinalizedBudget::IsValid(std::string& strError, bool fCheckCollateral)
 
     // Remove obsolete finalized budgets after some time
 
-    CBlockIndex* pindexPrev = chainActive.Tip();
+    CBlockIndex* pindexPrev = GetChainSnapshot().Tip();
     if (pindexPrev == NULL) return true;
 
     // Get start of current budget-cycle
-    int nCurrentHeight = chainActive.Height();
+    int nCurrentHeight = pindexPrev->nHeight;
     int nBlockStart = nCurrentHeight - nCurrentHeight % GetBudgetPaymentCycleBlocks() + GetBudgetPaymentCycleBlocks();
 
     // Remove budgets where the last payment (from max. 100) ends before 2 budget-cycles before the current one
@@ -193,7 +193,8 @@ bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue, CAmount nMin
         LogPrint("masternode","IsBlockValueValid() : WARNING: Couldn't find previous block\n");
     }
 
-    if (!masternodeSync.IsSynced()) { //there is no budget data to use to check anything
+    // there is no budget data to use to check anything, nor for the history of a UTXO set snapshot
+    if (!masternodeSync.IsSynced() || IsSnapshotHistory(nHeight)) {
         //super blocks will always be on these blocks, max 100 per budgeting
         if (nHeight % GetBudgetPaymentCycleBlocks() < 100) {
             return true;
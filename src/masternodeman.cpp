@@ -210,6 +210,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        GetMainSignals().MasternodeUpdated(CMasternodeBroadcast(mn));
         return true;
     }
 
@@ -279,6 +280,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
                 }
             }
 
+            GetMainSignals().MasternodeRemoved((*it).vin);
             it = vMasternodes.erase(it);
         } else {
             ++it;
@@ -590,15 +592,14 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
     return winner;
 }
 
-int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+bool CMasternodeMan::GetMasternodeScores(std::vector<pair<int64_t, CTxIn> >& vecMasternodeScores, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
     int64_t nMasternode_Age = 0;
 
     //make sure we know about this block
     uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+    if (!GetBlockHash(hash, nBlockHeight)) return false;
 
     // scan for winner
     for (CMasternode& mn : vMasternodes) {
@@ -625,6 +626,13 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     }
 
     sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    return true;
+}
+
+int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    if (!GetMasternodeScores(vecMasternodeScores, nBlockHeight, minProtocol, fOnlyActive)) return -1;
 
     int rank = 0;
     for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeScores) {
@@ -636,6 +644,19 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     return -1;
 }
 
+bool CMasternodeMan::GetMasternodeRanks(std::map<COutPoint, int>& mapRanksRet, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    if (!GetMasternodeScores(vecMasternodeScores, nBlockHeight, minProtocol, fOnlyActive)) return false;
+
+    mapRanksRet.clear();
+    int rank = 0;
+    for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeScores)
+        mapRanksRet.insert(make_pair(s.second.prevout, ++rank));
+
+    return true;
+}
+
 std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
     std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
@@ -840,6 +861,7 @@ void CMasternodeMan::Remove(CTxIn vin)
     while (it != vMasternodes.end()) {
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
+            GetMainSignals().MasternodeRemoved((*it).vin);
             vMasternodes.erase(it);
             break;
         }
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "blockexplorer.h"
+#include "addressindex.h"
 #include "bitcoinunits.h"
 #include "chainparams.h"
 #include "clientmodel.h"
@@ -101,6 +102,18 @@ static std::string makeHTMLTable(const std::string* pCells, int nRows, int nColu
     return Table;
 }
 
+static bool IsHighlighted(const CScript& Script, const CScript& Highlight)
+{
+    if (Highlight.empty())
+        return false;
+    if (Script == Highlight)
+        return true;
+    int nType, nHighlightType;
+    uint160 hash, hashHighlight;
+    return GetAddressIndexKey(Script, nType, hash) && GetAddressIndexKey(Highlight, nHighlightType, hashHighlight) &&
+           nType == nHighlightType && hash == hashHighlight;
+}
+
 static std::string TxToRow(const CTransaction& tx, const CScript& Highlight = CScript(), const std::string& Prepend = std::string(), int64_t* pSum = NULL)
 {
     std::string InAmounts, InAddresses, OutAmounts, OutAddresses;
@@ -112,8 +125,9 @@ static std::string TxToRow(const CTransaction& tx, const CScript& Highlight = CS
         } else {
             CTxOut PrevOut = getPrevOut(tx.vin[j].prevout);
             InAmounts += ValueToString(PrevOut.nValue);
-            InAddresses += ScriptToString(PrevOut.scriptPubKey, false, PrevOut.scriptPubKey == Highlight).c_str();
-            if (PrevOut.scriptPubKey == Highlight)
+            bool fHighlight = IsHighlighted(PrevOut.scriptPubKey, Highlight);
+            InAddresses += ScriptToString(PrevOut.scriptPubKey, false, fHighlight).c_str();
+            if (fHighlight)
                 Delta -= PrevOut.nValue;
         }
         if (j + 1 != tx.vin.size()) {
@@ -124,8 +138,9 @@ static std::string TxToRow(const CTransaction& tx, const CScript& Highlight = CS
     for (unsigned int j = 0; j < tx.vout.size(); j++) {
         CTxOut Out = tx.vout[j];
         OutAmounts += ValueToString(Out.nValue);
-        OutAddresses += ScriptToString(Out.scriptPubKey, false, Out.scriptPubKey == Highlight);
-        if (Out.scriptPubKey == Highlight)
+        bool fHighlight = IsHighlighted(Out.scriptPubKey, Highlight);
+        OutAddresses += ScriptToString(Out.scriptPubKey, false, fHighlight);
+        if (fHighlight)
             Delta += Out.nValue;
         if (j + 1 != tx.vout.size()) {
             OutAmounts += "<br/>";
@@ -157,19 +172,22 @@ static std::string TxToRow(const CTransaction& tx, const CScript& Highlight = CS
 
 CTxOut getPrevOut(const COutPoint& out)
 {
-    CTransaction tx;
-    uint256 hashBlock;
-    if (GetTransaction(out.hash, tx, hashBlock, true))
-        return tx.vout[out.n];
+    CTxOut txout;
+    CBlockIndex* pindex;
+    if (GetPrevOut(out, txout, pindex))
+        return txout;
     return CTxOut();
 }
 
 void getNextIn(const COutPoint& Out, uint256& Hash, unsigned int& n)
 {
-    // Hash = 0;
-    // n = 0;
-    // if (paddressmap)
-    //    paddressmap->ReadNextIn(Out, Hash, n);
+    Hash = 0;
+    n = 0;
+    CSpentIndexValue spentValue;
+    if (fSpentIndex && pblocktree->ReadSpentIndex(Out, spentValue)) {
+        Hash = spentValue.txid;
+        n = spentValue.inputIndex;
+    }
 }
 
 const CBlockIndex* getexplorerBlockIndex(int64_t height)
@@ -330,7 +348,7 @@ std::string TxToString(uint256 BlockHash, const CTransaction& tx)
         const CTxOut& Out = tx.vout[i];
         uint256 HashNext = uint256S("0");
         unsigned int nNext = 0;
-        bool fAddrIndex = false;
+        bool fAddrIndex = fSpentIndex;
         getNextIn(COutPoint(TxHash, i), HashNext, nNext);
         std::string OutputsContentCells[] =
             {
@@ -392,37 +410,34 @@ std::string AddressToString(const CBitcoinAddress& Address)
             _("Balance")};
     std::string TxContent = table + makeHTMLTableRow(TxLabels, sizeof(TxLabels) / sizeof(std::string));
 
-    std::set<COutPoint> PrevOuts;
-    /*
-    CScript AddressScript;
-    AddressScript.SetDestination(Address.Get());
+    CScript AddressScript = GetScriptForDestination(Address.Get());
 
     CAmount Sum = 0;
-    bool fAddrIndex = false;
+    int nAddressType;
+    uint160 hashBytes;
 
-    if (!fAddrIndex)
+    if (!fAddressIndex || !GetAddressIndexKey(AddressScript, nAddressType, hashBytes))
         return ""; // it will take too long to find transactions by address
-    else
-    {
-        std::vector<CDiskTxPos> Txs;
-        paddressmap->GetTxs(Txs, AddressScript.GetID());
-        BOOST_FOREACH (const CDiskTxPos& pos, Txs)
-        {
+    else {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+        pblocktree->ReadAddressIndex(nAddressType, hashBytes, vAddressIndex);
+        uint256 hashLast = 0;
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vAddressIndex.begin(); it != vAddressIndex.end(); it++) {
+            // entries of one transaction are adjacent in the index
+            if (it->first.txhash == hashLast)
+                continue;
+            hashLast = it->first.txhash;
             CTransaction tx;
-            CBlock block;
-            uint256 bhash = block.GetHash();
-            GetTransaction(pos.nTxOffset, tx, bhash);
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
-            if (mi == mapBlockIndex.end())
+            uint256 hashBlock;
+            if (!GetTransaction(it->first.txhash, tx, hashBlock, true))
                 continue;
-            CBlockIndex* pindex = (*mi).second;
-            if (!pindex || !chainActive.Contains(pindex))
+            const CBlockIndex* pindex = chainActive[it->first.blockHeight];
+            if (!pindex)
                 continue;
             std::string Prepend = "<a href=\"" + itostr(pindex->nHeight) + "\">" + TimeToString(pindex->nTime) + "</a>";
             TxContent += TxToRow(tx, AddressScript, Prepend, &Sum);
         }
     }
-    */
     TxContent += "</table>";
 
     std::string Content;
@@ -45,6 +45,9 @@ static const bool DEFAULT_SPLASHSCREEN = true;
  */
 static const int TOOLTIP_WRAP_THRESHOLD = 80;
 
+/* Transaction list -- number of wallet transactions loaded at a time */
+static const int TRANSACTION_TABLE_PAGE_SIZE = 1000;
+
 /* Maximum allowed URI length */
 static const int MAX_URI_LENGTH = 255;
 
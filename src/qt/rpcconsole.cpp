@@ -32,6 +32,7 @@
 #include <QThread>
 #include <QTime>
 #include <QStringList>
+#include <QTimer>
 
 // TODO: add a scrollback limit, as there is currently none
 // TODO: make it possible to filter out categories (esp debug messages when implemented)
@@ -80,6 +81,43 @@ private:
     std::map<std::string, int> warningHistory; /*  Number of times each command was executed */
 };
 
+/** Class for handling RPC timers
+ * (used for e.g. re-locking the wallet after a timeout)
+ */
+class QtRPCTimerBase : public QObject, public RPCTimerBase
+{
+    Q_OBJECT
+public:
+    QtRPCTimerBase(boost::function<void(void)>& func, int64_t millis) : func(func)
+    {
+        timer.setSingleShot(true);
+        connect(&timer, SIGNAL(timeout()), this, SLOT(timeout()));
+        timer.start(millis);
+    }
+    ~QtRPCTimerBase() {}
+private slots:
+    void timeout() { func(); }
+
+private:
+    QTimer timer;
+    boost::function<void(void)> func;
+};
+
+/** Timers for the commands run from the console when there is no RPC server.
+ * They fire in the console's executor thread, which has a Qt event loop; the
+ * HTTP server's timers, registered after these, serve the other threads.
+ */
+class QtRPCTimerInterface : public RPCTimerInterface
+{
+public:
+    ~QtRPCTimerInterface() {}
+    const char* Name() { return "Qt"; }
+    RPCTimerBase* NewTimer(boost::function<void(void)>& func, int64_t millis)
+    {
+        return new QtRPCTimerBase(func, millis);
+    }
+};
+
 #include "rpcconsole.moc"
 
 /**
@@ -296,6 +334,10 @@ RPCConsole::RPCConsole(QWidget* parent) : QDialog(parent, Qt::WindowSystemMenuHi
     ui->berkeleyDBVersion->hide();
 #endif
 
+    // Register RPC timer interface
+    rpcTimerInterface = new QtRPCTimerInterface();
+    RPCRegisterTimerInterface(rpcTimerInterface);
+
     startExecutor();
     setTrafficGraphRange(INITIAL_TRAFFIC_GRAPH_MINS);
 
@@ -308,6 +350,8 @@ RPCConsole::~RPCConsole()
 {
     GUIUtil::saveWindowGeometry("nRPCConsoleWindow", this);
     emit stopExecutor();
+    RPCUnregisterTimerInterface(rpcTimerInterface);
+    delete rpcTimerInterface;
     delete ui;
 }
 
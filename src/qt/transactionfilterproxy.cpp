@@ -62,31 +62,31 @@ void TransactionFilterProxy::setDateRange(const QDateTime& from, const QDateTime
 {
     this->dateFrom = from;
     this->dateTo = to;
-    invalidateFilter();
+    updateFilter();
 }
 
 void TransactionFilterProxy::setAddressPrefix(const QString& addrPrefix)
 {
     this->addrPrefix = addrPrefix;
-    invalidateFilter();
+    updateFilter();
 }
 
 void TransactionFilterProxy::setTypeFilter(quint32 modes)
 {
     this->typeFilter = modes;
-    invalidateFilter();
+    updateFilter();
 }
 
 void TransactionFilterProxy::setMinAmount(const CAmount& minimum)
 {
     this->minAmount = minimum;
-    invalidateFilter();
+    updateFilter();
 }
 
 void TransactionFilterProxy::setWatchOnlyFilter(WatchOnlyFilter filter)
 {
     this->watchOnlyFilter = filter;
-    invalidateFilter();
+    updateFilter();
 }
 
 void TransactionFilterProxy::setLimit(int limit)
@@ -100,6 +100,24 @@ void TransactionFilterProxy::setShowInactive(bool showInactive)
     invalidateFilter();
 }
 
+bool TransactionFilterProxy::isFiltering() const
+{
+    return dateFrom != MIN_DATE || dateTo != MAX_DATE || !addrPrefix.isEmpty() ||
+           (typeFilter & COMMON_TYPES) != COMMON_TYPES || watchOnlyFilter != WatchOnlyFilter_All || minAmount > 0;
+}
+
+void TransactionFilterProxy::updateFilter()
+{
+    // Views only ask the source for more rows once the last row they show comes into
+    // sight, which it may never do when these filters leave out most of the rows
+    if (isFiltering()) {
+        TransactionTableModel* model = qobject_cast<TransactionTableModel*>(sourceModel());
+        if (model)
+            model->fetchAll();
+    }
+    invalidateFilter();
+}
+
 int TransactionFilterProxy::rowCount(const QModelIndex& parent) const
 {
     if (limitRows != -1) {
@@ -56,6 +56,11 @@ protected:
     bool filterAcceptsRow(int source_row, const QModelIndex& source_parent) const;
 
 private:
+    /** Whether the filter leaves out rows other than inactive ones */
+    bool isFiltering() const;
+    /** Apply a changed filter, loading every row of the source if it is filtering */
+    void updateFilter();
+
     QDateTime dateFrom;
     QDateTime dateTo;
     QString addrPrefix;
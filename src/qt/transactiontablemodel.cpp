@@ -21,6 +21,9 @@
 #include "util.h"
 #include "wallet.h"
 
+#include <limits>
+#include <set>
+
 #include <QColor>
 #include <QDateTime>
 #include <QDebug>
@@ -37,28 +40,14 @@ static int column_alignments[] = {
     Qt::AlignRight | Qt::AlignVCenter /* amount */
 };
 
-// Comparison operator for sort/binary search of model tx list
-struct TxLessThan {
-    bool operator()(const TransactionRecord& a, const TransactionRecord& b) const
-    {
-        return a.hash < b.hash;
-    }
-    bool operator()(const TransactionRecord& a, const uint256& b) const
-    {
-        return a.hash < b;
-    }
-    bool operator()(const uint256& a, const TransactionRecord& b) const
-    {
-        return a < b.hash;
-    }
-};
-
 // Private implementation
 class TransactionTablePriv
 {
 public:
     TransactionTablePriv(CWallet* wallet, TransactionTableModel* parent) : wallet(wallet),
-                                                                           parent(parent)
+                                                                           parent(parent),
+                                                                           nOrderPosLoaded(std::numeric_limits<int64_t>::max()),
+                                                                           fAllLoaded(false)
     {
     }
 
@@ -66,24 +55,108 @@ public:
     TransactionTableModel* parent;
 
     /* Local cache of wallet.
-     * As it is in the same order as the CWallet, by definition
-     * this is sorted by sha256.
+     * Filled from the newest wallet transaction back, a page at a time as the
+     * view scrolls down to older ones; new transactions are appended.
      */
     QList<TransactionRecord> cachedWallet;
 
-    /* Query entire wallet anew from core.
+    /* First row and number of rows of each transaction in cachedWallet */
+    std::map<uint256, std::pair<int, int> > mapRows;
+
+    /* Transactions whose status was not final when last computed */
+    std::set<uint256> setPending;
+
+    /* Order position of the oldest wallet transaction loaded so far */
+    int64_t nOrderPosLoaded;
+    bool fAllLoaded;
+
+    /* Query the newest page of the wallet anew from core.
      */
     void refreshWallet()
     {
         qDebug() << "TransactionTablePriv::refreshWallet";
         cachedWallet.clear();
+        mapRows.clear();
+        setPending.clear();
+        nOrderPosLoaded = std::numeric_limits<int64_t>::max();
+        fAllLoaded = false;
+        fetchMore(TRANSACTION_TABLE_PAGE_SIZE);
+    }
+
+    /* Load wallet transactions older than those in the model, at least nMaxTx
+       of them unless the wallet runs out first, or all of them if nMaxTx is 0.
+     */
+    void fetchMore(int nMaxTx)
+    {
+        QList<TransactionRecord> toInsert;
         {
             LOCK2(cs_main, wallet->cs_wallet);
-            for (std::map<uint256, CWalletTx>::iterator it = wallet->mapWallet.begin(); it != wallet->mapWallet.end(); ++it) {
-                if (TransactionRecord::showTransaction(it->second))
-                    cachedWallet.append(TransactionRecord::decomposeTransaction(wallet, it->second));
+            CWallet::TxItems::reverse_iterator it(wallet->wtxOrdered.lower_bound(nOrderPosLoaded));
+            int nTx = 0;
+            for (; it != wallet->wtxOrdered.rend(); ++it) {
+                // Transactions sharing an order position are loaded together, so
+                // the position alone tells which ones are in the model
+                if (nMaxTx > 0 && nTx >= nMaxTx && it->first != nOrderPosLoaded)
+                    break;
+                nOrderPosLoaded = it->first;
+                const CWalletTx* pwtx = it->second.first;
+                if (!pwtx)
+                    continue;
+                nTx++;
+                if (TransactionRecord::showTransaction(*pwtx) && !mapRows.count(pwtx->GetHash()))
+                    toInsert.append(TransactionRecord::decomposeTransaction(wallet, *pwtx));
             }
+            fAllLoaded = (it == wallet->wtxOrdered.rend());
+        }
+        insertRows(toInsert);
+    }
+
+    /* Append records at the end of the model, those of a transaction next to each other */
+    void insertRows(const QList<TransactionRecord>& toInsert)
+    {
+        if (toInsert.isEmpty())
+            return;
+        int first = cachedWallet.size();
+        parent->beginInsertRows(QModelIndex(), first, first + toInsert.size() - 1);
+        for (int row = first; row < first + toInsert.size(); row++) {
+            const TransactionRecord& rec = toInsert[row - first];
+            cachedWallet.append(rec);
+            std::map<uint256, std::pair<int, int> >::iterator mi = mapRows.find(rec.hash);
+            if (mi == mapRows.end())
+                mapRows.insert(std::make_pair(rec.hash, std::make_pair(row, 1)));
+            else
+                mi->second.second++;
         }
+        parent->endInsertRows();
+    }
+
+    /* Whether the status of a record can only change if its transaction does */
+    static bool statusFinal(const TransactionRecord* rec)
+    {
+        switch (rec->status.status) {
+        case TransactionStatus::Confirmed:
+        case TransactionStatus::Conflicted:
+        case TransactionStatus::NotAccepted:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /* Rows of transactions whose status may have changed with new blocks */
+    std::vector<std::pair<int, int> > pendingRows()
+    {
+        std::vector<std::pair<int, int> > vRows;
+        for (std::set<uint256>::iterator it = setPending.begin(); it != setPending.end();) {
+            std::map<uint256, std::pair<int, int> >::const_iterator mi = mapRows.find(*it);
+            if (mi == mapRows.end()) {
+                setPending.erase(it++);
+                continue;
+            }
+            vRows.push_back(mi->second);
+            ++it;
+        }
+        return vRows;
     }
 
     /* Update our model of the wallet incrementally, to synchronize our model of the wallet
@@ -95,14 +168,11 @@ public:
     {
         qDebug() << "TransactionTablePriv::updateWallet : " + QString::fromStdString(hash.ToString()) + " " + QString::number(status);
 
-        // Find bounds of this transaction in model
-        QList<TransactionRecord>::iterator lower = qLowerBound(
-            cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-        QList<TransactionRecord>::iterator upper = qUpperBound(
-            cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-        int lowerIndex = (lower - cachedWallet.begin());
-        int upperIndex = (upper - cachedWallet.begin());
-        bool inModel = (lower != upper);
+        // Find rows of this transaction in model
+        std::map<uint256, std::pair<int, int> >::iterator itRows = mapRows.find(hash);
+        bool inModel = (itRows != mapRows.end());
+        int lowerIndex = inModel ? itRows->second.first : cachedWallet.size();
+        int upperIndex = inModel ? lowerIndex + itRows->second.second : lowerIndex;
 
         if (status == CT_UPDATED) {
             if (showTransaction && !inModel)
@@ -122,26 +192,22 @@ public:
                 break;
             }
             if (showTransaction) {
-                LOCK2(cs_main, wallet->cs_wallet);
-                // Find transaction in wallet
-                std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(hash);
-                if (mi == wallet->mapWallet.end()) {
-                    qWarning() << "TransactionTablePriv::updateWallet : Warning: Got CT_NEW, but transaction is not in wallet";
-                    break;
-                }
-                // Added -- insert at the right position
-                QList<TransactionRecord> toInsert =
-                    TransactionRecord::decomposeTransaction(wallet, mi->second);
-                if (!toInsert.isEmpty()) /* only if something to insert */
+                QList<TransactionRecord> toInsert;
                 {
-                    parent->beginInsertRows(QModelIndex(), lowerIndex, lowerIndex + toInsert.size() - 1);
-                    int insert_idx = lowerIndex;
-                    foreach (const TransactionRecord& rec, toInsert) {
-                        cachedWallet.insert(insert_idx, rec);
-                        insert_idx += 1;
+                    LOCK2(cs_main, wallet->cs_wallet);
+                    // Find transaction in wallet
+                    std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(hash);
+                    if (mi == wallet->mapWallet.end()) {
+                        qWarning() << "TransactionTablePriv::updateWallet : Warning: Got CT_NEW, but transaction is not in wallet";
+                        break;
                     }
-                    parent->endInsertRows();
+                    // Older than the transactions loaded so far -- it comes with its page
+                    if (!fAllLoaded && mi->second.nOrderPos < nOrderPosLoaded)
+                        break;
+                    toInsert = TransactionRecord::decomposeTransaction(wallet, mi->second);
                 }
+                // Added -- append to the end, the views sort it into place
+                insertRows(toInsert);
             }
             break;
         case CT_DELETED:
@@ -151,12 +217,24 @@ public:
             }
             // Removed -- remove entire transaction from table
             parent->beginRemoveRows(QModelIndex(), lowerIndex, upperIndex - 1);
-            cachedWallet.erase(lower, upper);
+            cachedWallet.erase(cachedWallet.begin() + lowerIndex, cachedWallet.begin() + upperIndex);
+            mapRows.erase(itRows);
+            setPending.erase(hash);
+            for (itRows = mapRows.begin(); itRows != mapRows.end(); ++itRows) {
+                if (itRows->second.first > lowerIndex)
+                    itRows->second.first -= upperIndex - lowerIndex;
+            }
             parent->endRemoveRows();
             break;
         case CT_UPDATED:
-            // Miscellaneous updates -- nothing to do, status update will take care of this, and is only computed for
-            // visible transactions.
+            if (!inModel)
+                break;
+            // Miscellaneous updates -- recompute the status of this transaction when it is
+            // next shown, and have the views show it again
+            for (int row = lowerIndex; row < upperIndex; row++)
+                cachedWallet[row].status.cur_num_blocks = -1;
+            emit parent->dataChanged(parent->index(lowerIndex, TransactionTableModel::Status),
+                parent->index(upperIndex - 1, TransactionTableModel::Amount));
             break;
         }
     }
@@ -186,6 +264,10 @@ public:
 
                     if (mi != wallet->mapWallet.end()) {
                         rec->updateStatus(mi->second);
+                        if (statusFinal(rec))
+                            setPending.erase(rec->hash);
+                        else
+                            setPending.insert(rec->hash);
                     }
                 }
             }
@@ -246,10 +328,41 @@ void TransactionTableModel::updateConfirmations()
 {
     // Blocks came in since last poll.
     // Invalidate status (number of confirmations) and (possibly) description
-    //  for all rows. Qt is smart enough to only actually request the data for the
-    //  visible rows.
-    emit dataChanged(index(0, Status), index(priv->size() - 1, Status));
-    emit dataChanged(index(0, ToAddress), index(priv->size() - 1, ToAddress));
+    //  for the rows whose status was still changing. The others get theirs
+    //  recomputed when they are next requested, or are told about by the wallet
+    //  when their transaction changes.
+    std::vector<std::pair<int, int> > vRows = priv->pendingRows();
+    for (unsigned int i = 0; i < vRows.size(); i++) {
+        int first = vRows[i].first;
+        int last = vRows[i].first + vRows[i].second - 1;
+        emit dataChanged(index(first, Status), index(last, Status));
+        emit dataChanged(index(first, ToAddress), index(last, ToAddress));
+    }
+}
+
+bool TransactionTableModel::canFetchMore(const QModelIndex& parent) const
+{
+    return !parent.isValid() && !priv->fAllLoaded;
+}
+
+void TransactionTableModel::fetchMore(const QModelIndex& parent)
+{
+    if (parent.isValid())
+        return;
+    // Older transactions coming into view are no news, so they raise no notifications
+    bool fWasProcessingQueuedTransactions = fProcessingQueuedTransactions;
+    fProcessingQueuedTransactions = true;
+    priv->fetchMore(TRANSACTION_TABLE_PAGE_SIZE);
+    fProcessingQueuedTransactions = fWasProcessingQueuedTransactions;
+}
+
+void TransactionTableModel::fetchAll()
+{
+    bool fWasProcessingQueuedTransactions = fProcessingQueuedTransactions;
+    fProcessingQueuedTransactions = true;
+    if (!priv->fAllLoaded)
+        priv->fetchMore(0);
+    fProcessingQueuedTransactions = fWasProcessingQueuedTransactions;
 }
 
 int TransactionTableModel::rowCount(const QModelIndex& parent) const
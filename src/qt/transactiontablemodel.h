@@ -72,6 +72,11 @@ public:
     QVariant data(const QModelIndex& index, int role) const;
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
     QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const;
+    /** Transactions are loaded newest first, a page at a time as views scroll down to them */
+    bool canFetchMore(const QModelIndex& parent) const;
+    void fetchMore(const QModelIndex& parent);
+    /** Load all transactions not loaded yet, for views that need every row */
+    void fetchAll();
     bool processingQueuedTransactions() { return fProcessingQueuedTransactions; }
 
 private:
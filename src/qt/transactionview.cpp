@@ -346,6 +346,9 @@ void TransactionView::exportClicked()
     bool fExport = false;
 
     if (model) {
+        // The history is exported in full, not just the part that was scrolled through
+        model->getTransactionTableModel()->fetchAll();
+
         // name, column, role
         writer.setModel(transactionProxyModel);
         writer.addColumn(tr("Confirmed"), 0, TransactionTableModel::ConfirmedRole);
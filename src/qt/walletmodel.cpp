@@ -33,8 +33,10 @@ WalletModel::WalletModel(CWallet* wallet, OptionsModel* optionsModel, QObject* p
                                                                                          transactionTableModel(0),
                                                                                          recentRequestsTableModel(0),
                                                                                          cachedBalance(0), cachedUnconfirmedBalance(0), cachedImmatureBalance(0),
+                                                                                         cachedWatchOnlyBalance(0), cachedWatchUnconfBalance(0), cachedWatchImmatureBalance(0),
                                                                                          cachedEncryptionStatus(Unencrypted),
-                                                                                         cachedNumBlocks(0)
+                                                                                         cachedNumBlocks(0),
+                                                                                         cachedTxLocks(0)
 {
     fHaveWatchOnly = wallet->HaveWatchOnly();
     fHaveMultiSig = wallet->HaveMultiSig();
@@ -131,7 +133,8 @@ void WalletModel::pollBalanceChanged()
     if (fForceCheckBalanceChanged || chainActive.Height() != cachedNumBlocks || cachedTxLocks != nCompleteTXLocks) {
         fForceCheckBalanceChanged = false;
 
-        // Balance and number of transactions might have changed
+        // Balance and number of transactions might have changed; GetBalances only
+        // sums again the transactions that are not confirmed or mature yet
         cachedNumBlocks = chainActive.Height();
 
         checkBalanceChanged();
@@ -153,16 +156,18 @@ void WalletModel::checkBalanceChanged()
     TRY_LOCK(cs_main, lockMain);
     if (!lockMain) return;
 
-    CAmount newBalance = getBalance();
-    CAmount newUnconfirmedBalance = getUnconfirmedBalance();
-    CAmount newImmatureBalance = getImmatureBalance();
+    CAmount newBalance = 0;
+    CAmount newUnconfirmedBalance = 0;
+    CAmount newImmatureBalance = 0;
     CAmount newWatchOnlyBalance = 0;
     CAmount newWatchUnconfBalance = 0;
     CAmount newWatchImmatureBalance = 0;
-    if (haveWatchOnly()) {
-        newWatchOnlyBalance = getWatchBalance();
-        newWatchUnconfBalance = getWatchUnconfirmedBalance();
-        newWatchImmatureBalance = getWatchImmatureBalance();
+    wallet->GetBalances(newBalance, newUnconfirmedBalance, newImmatureBalance,
+        newWatchOnlyBalance, newWatchUnconfBalance, newWatchImmatureBalance);
+    if (!haveWatchOnly()) {
+        newWatchOnlyBalance = 0;
+        newWatchUnconfBalance = 0;
+        newWatchImmatureBalance = 0;
     }
 
     if (cachedBalance != newBalance || cachedUnconfirmedBalance != newUnconfirmedBalance || cachedImmatureBalance != newImmatureBalance ||
@@ -6,14 +6,19 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "blockreader.h"
 #include "checkpoints.h"
 #include "clientversion.h"
+#include "coinsprefetch.h"
+#include "jsonwriter.h"
 #include "main.h"
 #include "rpcserver.h"
+#include "script/sigcache.h"
 #include "sync.h"
 #include "txdb.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utxosnapshot.h"
 
 #include <stdint.h>
 #include <univalue.h>
@@ -28,10 +33,9 @@ double GetDifficulty(const CBlockIndex* blockindex)
     // Floating point number that is a multiple of the minimum difficulty,
     // minimum difficulty = 1.0.
     if (blockindex == NULL) {
-        if (chainActive.Tip() == NULL)
+        blockindex = GetChainSnapshot().Tip();
+        if (blockindex == NULL)
             return 1.0;
-        else
-            blockindex = chainActive.Tip();
     }
 
     int nShift = (blockindex->nBits >> 24) & 0xff;
@@ -52,40 +56,55 @@ double GetDifficulty(const CBlockIndex* blockindex)
 }
 
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, CJSONWriter& writer)
 {
-    UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("hash", block.GetHash().GetHex()));
+    // Confirmations and the next block come from one snapshot of the chain, not under cs_main
+    CChainSnapshot chain = GetChainSnapshot();
+
+    writer.BeginObject();
+    writer.Pair("hash", block.GetHash().GetHex());
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    UniValue txs(UniValue::VARR);
+    if (chain.Contains(blockindex))
+        confirmations = chain.Height() - blockindex->nHeight + 1;
+    writer.Pair("confirmations", confirmations);
+    writer.Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    writer.Pair("height", blockindex->nHeight);
+    writer.Pair("version", block.nVersion);
+    writer.Pair("merkleroot", block.hashMerkleRoot.GetHex());
+    // The transactions are written one at a time, so their JSON is never held all at once
+    writer.Key("tx");
+    writer.BeginArray();
     BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        if (writer.Failed())
+            break;
         if (txDetails) {
             UniValue objTx(UniValue::VOBJ);
             TxToJSON(tx, uint256(0), objTx);
-            txs.push_back(objTx);
+            writer.Value(objTx);
         } else
-            txs.push_back(tx.GetHash().GetHex());
+            writer.Value(tx.GetHash().GetHex());
     }
-    result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    writer.End();
+    writer.Pair("time", block.GetBlockTime());
+    writer.Pair("nonce", (uint64_t)block.nNonce);
+    writer.Pair("bits", strprintf("%08x", block.nBits));
+    writer.Pair("difficulty", GetDifficulty(blockindex));
+    writer.Pair("chainwork", blockindex->nChainWork.GetHex());
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex* pnext = chainActive.Next(blockindex);
+        writer.Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
+    CBlockIndex* pnext = chain.Next(blockindex);
     if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+        writer.Pair("nextblockhash", pnext->GetBlockHash().GetHex());
+    writer.End();
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    UniValue result;
+    CUniValueWriter writer(result);
+    blockToJSON(block, blockindex, txDetails, writer);
     return result;
 }
 
@@ -115,7 +134,7 @@ UniValue getblockcount(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockcount", "") + HelpExampleRpc("getblockcount", ""));
 
-    return chainActive.Height();
+    return GetChainSnapshot().Height();
 }
 
 UniValue getbestblockhash(const UniValue& params, bool fHelp)
@@ -129,7 +148,10 @@ UniValue getbestblockhash(const UniValue& params, bool fHelp)
             "\nExamples\n" +
             HelpExampleCli("getbestblockhash", "") + HelpExampleRpc("getbestblockhash", ""));
 
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    CBlockIndex* pindexTip = GetChainSnapshot().Tip();
+    if (pindexTip == NULL)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "No blocks yet");
+    return pindexTip->GetBlockHash().GetHex();
 }
 
 UniValue getdifficulty(const UniValue& params, bool fHelp)
@@ -147,7 +169,41 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
 }
 
 
+static UniValue MempoolEntryToJSON(const CTxMemPoolEntry& e, int nTipHeight)
+{
+    AssertLockHeld(mempool.cs);
+    UniValue info(UniValue::VOBJ);
+    info.push_back(Pair("size", (int)e.GetTxSize()));
+    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+    info.push_back(Pair("time", e.GetTime()));
+    info.push_back(Pair("height", (int)e.GetHeight()));
+    info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+    info.push_back(Pair("currentpriority", e.GetPriority(nTipHeight)));
+    const CTransaction& tx = e.GetTx();
+    set<string> setDepends;
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+
+    UniValue depends(UniValue::VARR);
+    BOOST_FOREACH(const string& dep, setDepends) {
+        depends.push_back(dep);
+    }
+
+    info.push_back(Pair("depends", depends));
+    return info;
+}
+
 UniValue getrawmempool(const UniValue& params, bool fHelp)
+{
+    return RPCWriteToUniValue(&getrawmempool_write, params, fHelp);
+}
+
+/** How many mempool entries getrawmempool describes per hold of mempool.cs */
+static const unsigned int RAWMEMPOOL_BATCH_SIZE = 1000;
+
+void getrawmempool_write(const UniValue& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() > 1)
         throw runtime_error(
@@ -181,44 +237,34 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     if (params.size() > 0)
         fVerbose = params[0].get_bool();
 
-    if (fVerbose) {
-        LOCK(mempool.cs);
-        UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry, mempool.mapTx) {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
-            UniValue info(UniValue::VOBJ);
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
+    vector<uint256> vtxid;
+    mempool.queryHashes(vtxid);
 
-            UniValue depends(UniValue::VARR);
-            BOOST_FOREACH(const string& dep, setDepends) {
-                depends.push_back(dep);
+    if (fVerbose) {
+        int nTipHeight = GetChainSnapshot().Height();
+        // Describe the entries a batch at a time, and write each batch with
+        // mempool.cs released, so a slow client does not hold the mempool up.
+        // Entries removed meanwhile are left out.
+        writer.BeginObject();
+        for (size_t nBatch = 0; nBatch < vtxid.size() && !writer.Failed(); nBatch += RAWMEMPOOL_BATCH_SIZE) {
+            vector<pair<uint256, UniValue> > vInfo;
+            {
+                LOCK(mempool.cs);
+                for (size_t i = nBatch; i < vtxid.size() && i < nBatch + RAWMEMPOOL_BATCH_SIZE; i++) {
+                    map<uint256, CTxMemPoolEntry>::const_iterator it = mempool.mapTx.find(vtxid[i]);
+                    if (it != mempool.mapTx.end())
+                        vInfo.push_back(make_pair(it->first, MempoolEntryToJSON(it->second, nTipHeight)));
+                }
             }
-
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
+            for (size_t i = 0; i < vInfo.size(); i++)
+                writer.Pair(vInfo[i].first.ToString(), vInfo[i].second);
         }
-        return o;
+        writer.End();
     } else {
-        vector<uint256> vtxid;
-        mempool.queryHashes(vtxid);
-
-        UniValue a(UniValue::VARR);
+        writer.BeginArray();
         BOOST_FOREACH (const uint256& hash, vtxid)
-            a.push_back(hash.ToString());
-
-        return a;
+            writer.Value(hash.ToString());
+        writer.End();
     }
 }
 
@@ -236,14 +282,20 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
             HelpExampleCli("getblockhash", "1000") + HelpExampleRpc("getblockhash", "1000"));
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    CChainSnapshot chain = GetChainSnapshot();
+    if (nHeight < 0 || nHeight > chain.Height())
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
+    CBlockIndex* pblockindex = chain[nHeight];
     return pblockindex->GetBlockHash().GetHex();
 }
 
 UniValue getblock(const UniValue& params, bool fHelp)
+{
+    return RPCWriteToUniValue(&getblock_write, params, fHelp);
+}
+
+void getblock_write(const UniValue& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
@@ -285,23 +337,33 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    CBlockIndex* pblockindex = NULL;
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+        pblockindex = mapBlockIndex[hash];
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+        pos = pblockindex->GetBlockPos();
+    }
 
-    if (!ReadBlockFromDisk(block, pblockindex))
+    // Read the block without holding cs_main, so validation can go on meanwhile
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pos) || block.GetHash() != hash)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
     if (!fVerbose) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
         ssBlock << block;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        writer.Value(strHex);
+        return;
     }
 
-    return blockToJSON(block, pblockindex);
+    blockToJSON(block, pblockindex, false, writer);
 }
 
 UniValue getblockheader(const UniValue& params, bool fHelp)
@@ -335,14 +397,16 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    // The header is in the block index, no need to read the block
+    CBlockIndex* pblockindex = NULL;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mi->second;
+    }
+    CBlock block = pblockindex->GetBlockHeader();
 
     if (!fVerbose) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
@@ -356,11 +420,17 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 2)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( scan hash_serialized )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "They are kept up to date as blocks are connected, so by default they are returned at once. hash_serialized\n"
+            "cannot be kept, it takes going over every unspent output, and is only returned if scan or hash_serialized\n"
+            "is true. If scan is true, all of them are computed again from every unspent output and those kept are\n"
+            "checked. Both may take some time.\n"
+            "\nArguments:\n"
+            "1. scan            (boolean, optional, default=false) Scan the unspent outputs\n"
+            "2. hash_serialized (boolean, optional, default=false) Also compute hash_serialized, without checking the rest\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
@@ -368,28 +438,90 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash, if scan or hash_serialized is true\n"
+            "  \"hash_outputs\": \"hash\",   (string) The MuHash of the database records of the unspent outputs\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "true") + HelpExampleCli("gettxoutsetinfo", "false true") +
+            HelpExampleRpc("gettxoutsetinfo", ""));
+
+    bool fScan = params.size() > 0 && params[0].get_bool();
+    bool fHashSerialized = fScan || (params.size() > 1 && params[1].get_bool());
 
     UniValue ret(UniValue::VOBJ);
 
+    // The statistics kept are those of the database once flushed
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
+    bool fStats = false;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        if (!fHashSerialized)
+            fStats = pcoinsTip->GetStats(stats);
+    }
+
+    // Both read a snapshot of the database, so the chain can move on meanwhile.
+    // The serialized hash cannot be kept up to date, it takes going over every output in turn.
+    if (fScan) {
+        fStats = pcoinsTip->ScanStats(stats);
+        if (!fStats)
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Scanning the unspent outputs failed or found other statistics than those kept, see debug.log");
+    } else if (fHashSerialized) {
+        fStats = pcoinsTip->HashStats(stats);
+    }
+    if (fStats) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        if (fHashSerialized)
+            ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        ret.push_back(Pair("hash_outputs", stats.hashOutputs.GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     }
     return ret;
 }
 
+UniValue dumptxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the unspent transaction outputs of the tip, and the headers of its chain, to a UTXO set\n"
+            "snapshot file that a node started with -loadutxosnapshot begins from. Blocks keep being connected meanwhile.\n"
+            "\nArguments:\n"
+            "1. \"path\"         (string, required) The file to create, relative to the data directory unless absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"path\": \"path\",        (string) The absolute path of the file written\n"
+            "  \"height\":n,            (numeric) The height of the block the outputs are those of\n"
+            "  \"bestblock\": \"hex\",    (string) The hash of that block\n"
+            "  \"txouts\": n,           (numeric) The number of outputs written\n"
+            "  \"hash_outputs\": \"hash\", (string) The MuHash of the database records of the outputs\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "\"utxo.dat\"") + HelpExampleRpc("dumptxoutset", "\"utxo.dat\""));
+
+    boost::filesystem::path path(params[0].get_str());
+    if (!path.is_complete())
+        path = GetDataDir() / path;
+
+    CUtxoSnapshotMetadata metadata;
+    std::string strError;
+    if (!DumpUtxoSnapshot(path, metadata, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("path", path.string()));
+    ret.push_back(Pair("height", metadata.nHeight));
+    ret.push_back(Pair("bestblock", metadata.hashBlock.GetHex()));
+    ret.push_back(Pair("txouts", (int64_t)metadata.nTransactionOutputs));
+    ret.push_back(Pair("hash_outputs", metadata.hashOutputs.GetHex()));
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -465,6 +597,51 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     return ret;
 }
 
+/** Height of the lowest block of the active chain from which on all block data is stored */
+static int GetPruneHeight()
+{
+    AssertLockHeld(cs_main);
+    CBlockIndex* block = chainActive.Tip();
+    while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA))
+        block = block->pprev;
+    return block ? block->nHeight : 0;
+}
+
+UniValue pruneblockchain(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "pruneblockchain height\n"
+            "\nDelete the block and undo files holding only blocks up to the given height.\n"
+            "The most recent blocks needed for reorganisations and stake validation are always kept.\n"
+            "\nArguments:\n"
+            "1. \"height\"       (numeric, required) The block height to prune up to.\n"
+            "\nResult:\n"
+            "n    (numeric) Height of the last block pruned.\n"
+            "\nExamples:\n" +
+            HelpExampleCli("pruneblockchain", "1000") + HelpExampleRpc("pruneblockchain", "1000"));
+
+    if (!fPruneMode)
+        throw JSONRPCError(RPC_MISC_ERROR, "Cannot prune blocks because node is not in prune mode.");
+
+    int nHeight = params[0].get_int();
+    if (nHeight < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative block height.");
+
+    int nChainHeight = chainActive.Height();
+    if (nChainHeight <= GetPruneKeepBlocks())
+        throw JSONRPCError(RPC_MISC_ERROR, "Blockchain is too short for pruning.");
+    else if (nHeight > nChainHeight)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Blockchain is shorter than the attempted prune height.");
+    else if (nHeight > nChainHeight - GetPruneKeepBlocks()) {
+        LogPrint("rpc", "Attempt to prune blocks close to the tip. Retaining the minimum number of blocks.\n");
+        nHeight = nChainHeight - GetPruneKeepBlocks();
+    }
+
+    PruneBlockFilesManual(nHeight);
+    return GetPruneHeight() - 1;
+}
+
 UniValue verifychain(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 2)
@@ -504,6 +681,8 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
+            "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getblockchaininfo", "") + HelpExampleRpc("getblockchaininfo", ""));
@@ -516,6 +695,9 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("pruned", fPruneMode));
+    if (fPruneMode)
+        obj.push_back(Pair("pruneheight", GetPruneHeight()));
     return obj;
 }
 
@@ -659,12 +841,11 @@ UniValue getfeeinfo(const UniValue& params, bool fHelp)
                 continue;
 
             for (unsigned int j = 0; j < tx.vin.size(); j++) {
-                COutPoint prevout = tx.vin[j].prevout;
-                CTransaction txPrev;
-                uint256 hashBlock;
-                if(!GetTransaction(prevout.hash, txPrev, hashBlock, true))
+                CTxOut txoutPrev;
+                CBlockIndex* pindexPrev;
+                if (!GetPrevOut(tx.vin[j].prevout, txoutPrev, pindexPrev))
                     throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read tx from disk");
-                nValueIn += txPrev.vout[prevout.n].nValue;
+                nValueIn += txoutPrev.nValue;
             }
 
             for (unsigned int j = 0; j < tx.vout.size(); j++) {
@@ -713,6 +894,103 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue getblockfilecacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getblockfilecacheinfo\n"
+            "\nReturns statistics of the cache of open (and memory mapped) block files used for block reads.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"hits\": xxxxx                (numeric) Reads served by an already open file\n"
+            "  \"misses\": xxxxx              (numeric) Reads that had to open the file\n"
+            "  \"files\": xxxxx               (numeric) Number of files currently open\n"
+            "  \"mapped\": xxxxx              (numeric) Number of those that are memory mapped\n"
+            "  \"mappedbytes\": xxxxx         (numeric) Total size of the mapped files\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilecacheinfo", "") + HelpExampleRpc("getblockfilecacheinfo", ""));
+
+    CBlockFileCacheStats stats;
+    blockFileCache.GetStats(stats);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("hits", (uint64_t)stats.nHits));
+    ret.push_back(Pair("misses", (uint64_t)stats.nMisses));
+    ret.push_back(Pair("files", (int)stats.nHandles));
+    ret.push_back(Pair("mapped", (int)stats.nMapped));
+    ret.push_back(Pair("mappedbytes", (uint64_t)stats.nMappedBytes));
+    return ret;
+}
+
+UniValue getsigcacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getsigcacheinfo\n"
+            "\nReturns statistics of the cache of verified signatures.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"hits\": xxxxx                (numeric) Signature checks answered by the cache\n"
+            "  \"misses\": xxxxx              (numeric) Signature checks that had to verify the signature\n"
+            "  \"hitrate\": x.xxx             (numeric) Share of the checks answered by the cache\n"
+            "  \"inserts\": xxxxx             (numeric) Signatures added to the cache\n"
+            "  \"entries\": xxxxx             (numeric) Signatures currently cached\n"
+            "  \"capacity\": xxxxx            (numeric) Number of signatures the cache can hold\n"
+            "  \"bytes\": xxxxx               (numeric) Memory taken by the cache\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getsigcacheinfo", "") + HelpExampleRpc("getsigcacheinfo", ""));
+
+    CSignatureCacheStats stats;
+    GetSignatureCacheStats(stats);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("hits", (uint64_t)stats.nHits));
+    ret.push_back(Pair("misses", (uint64_t)stats.nMisses));
+    ret.push_back(Pair("hitrate", stats.nHits + stats.nMisses > 0 ? (double)stats.nHits / (stats.nHits + stats.nMisses) : 0.0));
+    ret.push_back(Pair("inserts", (uint64_t)stats.nInserts));
+    ret.push_back(Pair("entries", (uint64_t)stats.nUsed));
+    ret.push_back(Pair("capacity", (uint64_t)stats.nSlots));
+    ret.push_back(Pair("bytes", (uint64_t)stats.nBytes));
+    return ret;
+}
+
+UniValue getprefetchinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getprefetchinfo\n"
+            "\nReturns statistics of the threads reading the coins spent by downloaded blocks before they are connected.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"requested\": xxxxx           (numeric) Transactions queued for reading\n"
+            "  \"read\": xxxxx                (numeric) Database lookups done ahead\n"
+            "  \"hits\": xxxxx                (numeric) Transactions already read when their spending block got connected\n"
+            "  \"misses\": xxxxx              (numeric) Transactions that had to be read when their spending block got connected\n"
+            "  \"hitrate\": x.xxx             (numeric) Share of the lookups at connect time answered ahead\n"
+            "  \"dropped\": xxxxx             (numeric) Coins read but thrown away, after a flush or beyond the limit\n"
+            "  \"queued\": xxxxx              (numeric) Transactions waiting to be read\n"
+            "  \"ready\": xxxxx               (numeric) Transactions read and waiting for their block\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getprefetchinfo", "") + HelpExampleRpc("getprefetchinfo", ""));
+
+    CCoinsPrefetchStats stats;
+    coinsPrefetcher.GetStats(stats);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("requested", (uint64_t)stats.nRequested));
+    ret.push_back(Pair("read", (uint64_t)stats.nRead));
+    ret.push_back(Pair("hits", (uint64_t)stats.nHits));
+    ret.push_back(Pair("misses", (uint64_t)stats.nMisses));
+    ret.push_back(Pair("hitrate", stats.nHits + stats.nMisses > 0 ? (double)stats.nHits / (stats.nHits + stats.nMisses) : 0.0));
+    ret.push_back(Pair("dropped", (uint64_t)stats.nDropped));
+    ret.push_back(Pair("queued", (uint64_t)stats.nQueued));
+    ret.push_back(Pair("ready", (uint64_t)stats.nReady));
+    return ret;
+}
+
 UniValue invalidateblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
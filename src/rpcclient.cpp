@@ -30,6 +30,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     {
         {"stop", 0},
         {"setmocktime", 0},
+        {"getlockstats", 0},
+        {"getlockstats", 1},
+        {"getrpcstats", 0},
         {"getaddednodeinfo", 0},
         {"setgenerate", 0},
         {"setgenerate", 1},
@@ -83,12 +86,15 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"signrawtransaction", 2},
         {"sendrawtransaction", 1},
         {"sendrawtransaction", 2},
+        {"gettxoutsetinfo", 0},
+        {"gettxoutsetinfo", 1},
         {"gettxout", 1},
         {"gettxout", 2},
         {"lockunspent", 0},
         {"lockunspent", 1},
         {"importprivkey", 2},
         {"importaddress", 2},
+        {"pruneblockchain", 0},
         {"verifychain", 0},
         {"verifychain", 1},
         {"keypoolrefill", 0},
@@ -121,20 +127,32 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"autocombinerewards", 0},
         {"autocombinerewards", 1},
         {"getfeeinfo", 0},
+        {"getaddresshistory", 1},
+        {"getaddresshistory", 2},
+        {"getspentinfo", 0},
         {"preparecommunityproposal", 2},
         {"submitcommunityproposal", 2},
     };
 
+/** Params taking an address or an object of addresses, only converted when given an object */
+static const CRPCConvertParam vRPCConvertObjectParams[] =
+    {
+        {"getaddresshistory", 0},
+    };
+
 class CRPCConvertTable
 {
 private:
     std::set<std::pair<std::string, int> > members;
+    std::set<std::pair<std::string, int> > membersObject;
 
 public:
     CRPCConvertTable();
 
-    bool convert(const std::string& method, int idx)
+    bool convert(const std::string& method, int idx, const std::string& strVal)
     {
+        if (membersObject.count(std::make_pair(method, idx)) > 0)
+            return !strVal.empty() && strVal[0] == '{';
         return (members.count(std::make_pair(method, idx)) > 0);
     }
 };
@@ -148,6 +166,11 @@ CRPCConvertTable::CRPCConvertTable()
         members.insert(std::make_pair(vRPCConvertParams[i].methodName,
             vRPCConvertParams[i].paramIdx));
     }
+
+    for (unsigned int i = 0; i < sizeof(vRPCConvertObjectParams) / sizeof(vRPCConvertObjectParams[0]); i++) {
+        membersObject.insert(std::make_pair(vRPCConvertObjectParams[i].methodName,
+            vRPCConvertObjectParams[i].paramIdx));
+    }
 }
 
 static CRPCConvertTable rpcCvtTable;
@@ -172,7 +195,7 @@ UniValue RPCConvertValues(const std::string &strMethod, const std::vector<std::s
     for (unsigned int idx = 0; idx < strParams.size(); idx++) {
         const std::string& strVal = strParams[idx];
 
-        if (!rpcCvtTable.convert(strMethod, idx)) {
+        if (!rpcCvtTable.convert(strMethod, idx, strVal)) {
             // insert string value directly
             params.push_back(strVal);
         } else {
@@ -658,7 +658,7 @@ UniValue getnextsuperblock(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getnextsuperblock", "") + HelpExampleRpc("getnextsuperblock", ""));
 
-    CBlockIndex* pindexPrev = chainActive.Tip();
+    CBlockIndex* pindexPrev = GetChainSnapshot().Tip();
     if (!pindexPrev) return "unknown";
 
     int nNext = pindexPrev->nHeight - pindexPrev->nHeight % GetBudgetPaymentCycleBlocks() + GetBudgetPaymentCycleBlocks();
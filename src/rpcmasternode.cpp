@@ -6,6 +6,7 @@
 #include "activemasternode.h"
 #include "db.h"
 #include "init.h"
+#include "jsonwriter.h"
 #include "main.h"
 #include "masternode-budget.h"
 #include "masternode-payments.h"
@@ -216,6 +217,11 @@ UniValue masternode(const UniValue& params, bool fHelp)
 }
 
 UniValue listmasternodes(const UniValue& params, bool fHelp)
+{
+    return RPCWriteToUniValue(&listmasternodes_write, params, fHelp);
+}
+
+void listmasternodes_write(const UniValue& params, bool fHelp, CJSONWriter& writer)
 {
     std::string strFilter = "";
 
@@ -247,16 +253,17 @@ UniValue listmasternodes(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("listmasternodes", "") + HelpExampleRpc("listmasternodes", ""));
 
-    UniValue ret(UniValue::VARR);
-    int nHeight;
-    {
-        LOCK(cs_main);
-        CBlockIndex* pindex = chainActive.Tip();
-        if(!pindex) return 0;
-        nHeight = pindex->nHeight;
+    CBlockIndex* pindex = GetChainSnapshot().Tip();
+    if(!pindex) {
+        writer.Value(0);
+        return;
     }
+    int nHeight = pindex->nHeight;
     std::vector<pair<int, CMasternode> > vMasternodeRanks = mnodeman.GetMasternodeRanks(nHeight);
+    writer.BeginArray();
     BOOST_FOREACH (PAIRTYPE(int, CMasternode) & s, vMasternodeRanks) {
+        if (writer.Failed())
+            break;
         UniValue obj(UniValue::VOBJ);
         std::string strVin = s.second.vin.prevout.ToStringShort();
         std::string strTxHash = s.second.vin.prevout.hash.ToString();
@@ -287,11 +294,10 @@ UniValue listmasternodes(const UniValue& params, bool fHelp)
             obj.push_back(Pair("activetime", (int64_t)(mn->lastPing.sigTime - mn->sigTime)));
             obj.push_back(Pair("lastpaid", (int64_t)mn->GetLastPaid()));
 
-            ret.push_back(obj);
+            writer.Value(obj);
         }
     }
-
-    return ret;
+    writer.End();
 }
 
 UniValue masternodeconnect(const UniValue& params, bool fHelp)
@@ -341,8 +347,9 @@ UniValue getmasternodecount (const UniValue& params, bool fHelp)
     int nCount = 0;
     int ipv4 = 0, ipv6 = 0, onion = 0;
 
-    if (chainActive.Tip())
-        mnodeman.GetNextMasternodeInQueueForPayment(chainActive.Tip()->nHeight, true, nCount);
+    CBlockIndex* pindexTip = GetChainSnapshot().Tip();
+    if (pindexTip)
+        mnodeman.GetNextMasternodeInQueueForPayment(pindexTip->nHeight, true, nCount);
 
     mnodeman.CountNetworks(ActiveProtocol(), ipv4, ipv6, onion);
 
@@ -740,6 +747,11 @@ UniValue getmasternodestatus (const UniValue& params, bool fHelp)
 }
 
 UniValue getmasternodewinners (const UniValue& params, bool fHelp)
+{
+    return RPCWriteToUniValue(&getmasternodewinners_write, params, fHelp);
+}
+
+void getmasternodewinners_write(const UniValue& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() > 3)
         throw runtime_error(
@@ -779,13 +791,12 @@ UniValue getmasternodewinners (const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getmasternodewinners", "") + HelpExampleRpc("getmasternodewinners", ""));
 
-    int nHeight;
-    {
-        LOCK(cs_main);
-        CBlockIndex* pindex = chainActive.Tip();
-        if(!pindex) return 0;
-        nHeight = pindex->nHeight;
+    CBlockIndex* pindex = GetChainSnapshot().Tip();
+    if(!pindex) {
+        writer.Value(0);
+        return;
     }
+    int nHeight = pindex->nHeight;
 
     int nLast = 10;
     std::string strFilter = "";
@@ -796,9 +807,8 @@ UniValue getmasternodewinners (const UniValue& params, bool fHelp)
     if (params.size() == 2)
         strFilter = params[1].get_str();
 
-    UniValue ret(UniValue::VARR);
-
-    for (int i = nHeight - nLast; i < nHeight + 20; i++) {
+    writer.BeginArray();
+    for (int i = nHeight - nLast; i < nHeight + 20 && !writer.Failed(); i++) {
         UniValue obj(UniValue::VOBJ);
         obj.push_back(Pair("nHeight", i));
 
@@ -834,10 +844,9 @@ UniValue getmasternodewinners (const UniValue& params, bool fHelp)
             obj.push_back(Pair("winner", winner));
         }
 
-        ret.push_back(obj);
+        writer.Value(obj);
     }
-
-    return ret;
+    writer.End();
 }
 
 UniValue getmasternodescores (const UniValue& params, bool fHelp)
@@ -870,7 +879,8 @@ UniValue getmasternodescores (const UniValue& params, bool fHelp)
     UniValue obj(UniValue::VOBJ);
 
     std::vector<CMasternode> vMasternodes = mnodeman.GetFullMasternodeVector();
-    for (int nHeight = chainActive.Tip()->nHeight - nLast; nHeight < chainActive.Tip()->nHeight + 20; nHeight++) {
+    int nTipHeight = GetChainSnapshot().Height();
+    for (int nHeight = nTipHeight - nLast; nHeight < nTipHeight + 20; nHeight++) {
         uint256 nHigh = 0;
         CMasternode* pBestMasternode = NULL;
         BOOST_FOREACH (CMasternode& mn, vMasternodes) {
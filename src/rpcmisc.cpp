@@ -5,8 +5,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "base58.h"
 #include "clientversion.h"
+#include "httpserver.h"
 #include "init.h"
 #include "main.h"
 #include "masternode-sync.h"
@@ -15,12 +17,14 @@
 #include "rpcserver.h"
 #include "spork.h"
 #include "timedata.h"
+#include "txdb.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
 #include "wallet.h"
 #include "walletdb.h"
 #endif
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <boost/assign/list_of.hpp>
@@ -496,6 +500,451 @@ UniValue setmocktime(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+static bool CompareLockSiteWait(const CLockSite* a, const CLockSite* b)
+{
+    return a->nWaitNanos.load() > b->nWaitNanos.load();
+}
+
+static UniValue LockHistogramToJSON(const std::atomic<uint64_t>* vHistogram)
+{
+    int nBuckets = CLockSite::HISTOGRAM_BUCKETS;
+    while (nBuckets > 0 && vHistogram[nBuckets - 1].load() == 0)
+        nBuckets--;
+    UniValue result(UniValue::VARR);
+    for (int i = 0; i < nBuckets; i++)
+        result.push_back((int64_t)vHistogram[i].load());
+    return result;
+}
+
+UniValue getlockstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 2)
+        throw runtime_error(
+            "getlockstats ( reset enable )\n"
+            "\nReturns how often each lock was taken at each place in the code, and how long threads waited\n"
+            "for it and held it, since lock statistics were enabled (-lockstats) or last reset.\n"
+            "\nArguments:\n"
+            "1. reset     (boolean, optional, default=false) Reset the statistics after returning them\n"
+            "2. enable    (boolean, optional) Turn the collection of lock statistics on or off\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,      (boolean) Whether lock statistics are being collected\n"
+            "  \"locks\": {                  (object) The totals of every lock, by name\n"
+            "    \"name\": {\n"
+            "      \"acquired\": n,          (numeric) Times the lock was acquired\n"
+            "      \"contended\": n,         (numeric) Times a thread had to wait for it\n"
+            "      \"wait_us\": n,           (numeric) Microseconds spent waiting for it\n"
+            "      \"hold_us\": n            (numeric) Microseconds it was held\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"sites\": [                  (array) The places locks were taken, longest waited for first\n"
+            "    {\n"
+            "      \"lock\": \"name\",         (string) The lock\n"
+            "      \"location\": \"file:line\", (string) Where it was taken\n"
+            "      \"acquired\": n,          (numeric) Times it was acquired there\n"
+            "      \"contended\": n,         (numeric) Times a thread had to wait for it there\n"
+            "      \"tries_failed\": n,      (numeric) Times TRY_LOCK did not get it there\n"
+            "      \"waiting\": n,           (numeric) Threads waiting for it there right now\n"
+            "      \"wait_us\": n,           (numeric) Microseconds spent waiting for it there\n"
+            "      \"hold_us\": n,           (numeric) Microseconds it was held from there\n"
+            "      \"wait_histogram\": [n,...], (array) Acquisitions by wait: under 1us, then 1-2us, 2-4us, and so on\n"
+            "      \"hold_histogram\": [n,...]  (array) Acquisitions by hold time, in the same buckets\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getlockstats", "") + HelpExampleCli("getlockstats", "true true") + HelpExampleRpc("getlockstats", "true, true"));
+
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VBOOL)(UniValue::VBOOL));
+
+    std::vector<CLockSite*> vSites = GetLockSites();
+    std::sort(vSites.begin(), vSites.end(), CompareLockSiteWait);
+
+    UniValue locks(UniValue::VOBJ);
+    std::map<std::string, std::vector<uint64_t> > mapLockTotals;
+    UniValue sites(UniValue::VARR);
+    BOOST_FOREACH (const CLockSite* psite, vSites) {
+        uint64_t nAcquired = psite->nAcquired.load();
+        uint64_t nTriesFailed = psite->nTriesFailed.load();
+        uint64_t nWaiting = psite->nWaiting.load();
+        if (nAcquired == 0 && nTriesFailed == 0 && nWaiting == 0)
+            continue;
+        uint64_t nContended = psite->nContended.load();
+        uint64_t nWaitMicros = psite->nWaitNanos.load() / 1000;
+        uint64_t nHoldMicros = psite->nHoldNanos.load() / 1000;
+
+        std::vector<uint64_t>& vTotals = mapLockTotals[psite->pszName];
+        vTotals.resize(4);
+        vTotals[0] += nAcquired;
+        vTotals[1] += nContended;
+        vTotals[2] += nWaitMicros;
+        vTotals[3] += nHoldMicros;
+
+        UniValue site(UniValue::VOBJ);
+        site.push_back(Pair("lock", psite->pszName));
+        site.push_back(Pair("location", strprintf("%s:%d", psite->pszFile, psite->nLine)));
+        site.push_back(Pair("acquired", nAcquired));
+        site.push_back(Pair("contended", nContended));
+        site.push_back(Pair("tries_failed", nTriesFailed));
+        site.push_back(Pair("waiting", nWaiting));
+        site.push_back(Pair("wait_us", nWaitMicros));
+        site.push_back(Pair("hold_us", nHoldMicros));
+        site.push_back(Pair("wait_histogram", LockHistogramToJSON(psite->vWaitHistogram)));
+        site.push_back(Pair("hold_histogram", LockHistogramToJSON(psite->vHoldHistogram)));
+        sites.push_back(site);
+    }
+    for (std::map<std::string, std::vector<uint64_t> >::const_iterator it = mapLockTotals.begin(); it != mapLockTotals.end(); it++) {
+        UniValue lock(UniValue::VOBJ);
+        lock.push_back(Pair("acquired", it->second[0]));
+        lock.push_back(Pair("contended", it->second[1]));
+        lock.push_back(Pair("wait_us", it->second[2]));
+        lock.push_back(Pair("hold_us", it->second[3]));
+        locks.push_back(Pair(it->first, lock));
+    }
+
+    if (params.size() > 0 && params[0].get_bool())
+        ResetLockStats();
+    if (params.size() > 1)
+        fLockStats = params[1].get_bool();
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("enabled", fLockStats.load()));
+    result.push_back(Pair("locks", locks));
+    result.push_back(Pair("sites", sites));
+    return result;
+}
+
+UniValue getrpcstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getrpcstats ( reset )\n"
+            "\nReturns statistics about the HTTP server handling RPC and REST requests, and about the RPC\n"
+            "commands called since the node started or the statistics were last reset.\n"
+            "\nArguments:\n"
+            "1. reset     (boolean, optional, default=false) Reset the command statistics after returning them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"workqueue\": {           (object) The requests waiting for a worker thread\n"
+            "    \"threads\": n,          (numeric) Worker threads running (-rpcthreads)\n"
+            "    \"depth\": n,            (numeric) Requests waiting now\n"
+            "    \"max_depth\": n,        (numeric) Requests that may wait at once (-rpcworkqueue)\n"
+            "    \"peak_depth\": n,       (numeric) Most requests that waited at once\n"
+            "    \"processed\": n,        (numeric) Requests handed to a worker\n"
+            "    \"rejected\": n,         (numeric) Requests refused because the queue was full\n"
+            "    \"timed_out\": n         (numeric) Requests that waited longer than -rpcservertimeout\n"
+            "  },\n"
+            "  \"commands\": {            (object) The commands called, by name\n"
+            "    \"name\": {\n"
+            "      \"threadsafe\": true|false, (boolean) Whether the command runs without cs_main held for it\n"
+            "      \"calls\": n,          (numeric) Times the command was called\n"
+            "      \"errors\": n,         (numeric) Calls that returned an error\n"
+            "      \"time_us\": n,        (numeric) Microseconds the calls took\n"
+            "      \"max_us\": n,         (numeric) Microseconds the longest call took\n"
+            "      \"lock_wait_us\": n,   (numeric) Microseconds waited for cs_main (and cs_wallet) before running\n"
+            "      \"lock_hold_us\": n,   (numeric) Microseconds cs_main (and cs_wallet) were held while running\n"
+            "      \"latency_histogram\": [n,...],   (array) Calls by time taken: under 1us, then 1-2us, 2-4us, and so on\n"
+            "      \"lock_hold_histogram\": [n,...]  (array) Calls run under cs_main by time it was held, in the same buckets\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getrpcstats", "") + HelpExampleCli("getrpcstats", "true") + HelpExampleRpc("getrpcstats", "true"));
+
+    bool fReset = params.size() > 0 && params[0].get_bool();
+
+    UniValue result(UniValue::VOBJ);
+    HTTPWorkQueueStats stats;
+    if (GetHTTPWorkQueueStats(stats)) {
+        UniValue workqueue(UniValue::VOBJ);
+        workqueue.push_back(Pair("threads", stats.nThreads));
+        workqueue.push_back(Pair("depth", (uint64_t)stats.nDepth));
+        workqueue.push_back(Pair("max_depth", (uint64_t)stats.nMaxDepth));
+        workqueue.push_back(Pair("peak_depth", (uint64_t)stats.nPeakDepth));
+        workqueue.push_back(Pair("processed", stats.nProcessed));
+        workqueue.push_back(Pair("rejected", stats.nRejected));
+        workqueue.push_back(Pair("timed_out", stats.nTimedOut));
+        result.push_back(Pair("workqueue", workqueue));
+    }
+
+    UniValue commands(UniValue::VOBJ);
+    BOOST_FOREACH (const std::string& strCommand, tableRPC.listCommands()) {
+        CRPCCommandStats* pstats = tableRPC.GetCommandStats(strCommand);
+        if (pstats->nCalls.load() == 0)
+            continue;
+        UniValue command(UniValue::VOBJ);
+        command.push_back(Pair("threadsafe", tableRPC[strCommand]->threadSafe));
+        command.push_back(Pair("calls", (int64_t)pstats->nCalls.load()));
+        command.push_back(Pair("errors", (int64_t)pstats->nErrors.load()));
+        command.push_back(Pair("time_us", (int64_t)(pstats->nNanos.load() / 1000)));
+        command.push_back(Pair("max_us", (int64_t)(pstats->nMaxNanos.load() / 1000)));
+        command.push_back(Pair("lock_wait_us", (int64_t)(pstats->nLockWaitNanos.load() / 1000)));
+        command.push_back(Pair("lock_hold_us", (int64_t)(pstats->nLockHoldNanos.load() / 1000)));
+        command.push_back(Pair("latency_histogram", LockHistogramToJSON(pstats->vLatencyHistogram)));
+        command.push_back(Pair("lock_hold_histogram", LockHistogramToJSON(pstats->vLockHoldHistogram)));
+        commands.push_back(Pair(strCommand, command));
+        if (fReset)
+            pstats->Reset();
+    }
+    result.push_back(Pair("commands", commands));
+    return result;
+}
+
+static void AddressIndexArgs(const UniValue& param, std::vector<std::pair<int, uint160> >& vAddresses)
+{
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, restart with -addressindex -reindex");
+
+    std::vector<std::string> vStrAddresses;
+    if (param.isStr()) {
+        vStrAddresses.push_back(param.get_str());
+    } else if (param.isObject()) {
+        UniValue addressValues = find_value(param.get_obj(), "addresses");
+        if (!addressValues.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        for (unsigned int i = 0; i < addressValues.size(); i++)
+            vStrAddresses.push_back(addressValues[i].get_str());
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected an address or an object with an addresses array");
+    }
+
+    BOOST_FOREACH (const std::string& strAddress, vStrAddresses) {
+        CBitcoinAddress address(strAddress);
+        CKeyID keyID;
+        if (!address.IsValid())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid UserV address: " + strAddress);
+        if (address.IsScript())
+            vAddresses.push_back(std::make_pair((int)ADDRESS_INDEX_SCRIPTHASH, uint160(boost::get<CScriptID>(address.Get()))));
+        else if (address.GetKeyID(keyID))
+            vAddresses.push_back(std::make_pair((int)ADDRESS_INDEX_PUBKEYHASH, uint160(keyID)));
+    }
+}
+
+static std::string AddressIndexToString(int type, const uint160& hashBytes)
+{
+    if (type == ADDRESS_INDEX_SCRIPTHASH)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+}
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"uservaddress\"|{\"addresses\":[\"uservaddress\",...]}\n"
+            "\nReturns the confirmed balance of one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"uservaddress\"     (string, required) The userv address, or an object with an \"addresses\" array\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": x.xxx,     (numeric) The current balance in USERV\n"
+            "  \"received\": x.xxx,    (numeric) The total amount received in USERV (including change)\n"
+            "  \"entries\": n          (numeric) The number of history entries (credits and debits)\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"") + HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"]}"));
+
+    std::vector<std::pair<int, uint160> > vAddresses;
+    AddressIndexArgs(params[0], vAddresses);
+
+    CAddressBalance total;
+    for (std::vector<std::pair<int, uint160> >::const_iterator it = vAddresses.begin(); it != vAddresses.end(); it++) {
+        CAddressBalance balance;
+        if (!pblocktree->ReadAddressBalance(it->first, it->second, balance))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        total += balance;
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", ValueFromAmount(total.nBalance)));
+    result.push_back(Pair("received", ValueFromAmount(total.nReceived)));
+    result.push_back(Pair("entries", total.nEntries));
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos \"uservaddress\"|{\"addresses\":[\"uservaddress\",...]}\n"
+            "\nReturns all confirmed unspent outputs of one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"uservaddress\"     (string, required) The userv address, or an object with an \"addresses\" array\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\",  (string) The address\n"
+            "    \"txid\": \"hash\",        (string) The output txid\n"
+            "    \"vout\": n,             (numeric) The output index\n"
+            "    \"script\": \"hex\",       (string) The script hex\n"
+            "    \"amount\": x.xxx,       (numeric) The output value in USERV\n"
+            "    \"height\": n            (numeric) The block height\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"") + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"]}"));
+
+    std::vector<std::pair<int, uint160> > vAddresses;
+    AddressIndexArgs(params[0], vAddresses);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    for (std::vector<std::pair<int, uint160> >::const_iterator it = vAddresses.begin(); it != vAddresses.end(); it++) {
+        if (!pblocktree->ReadAddressUnspentIndex(it->first, it->second, vUnspent))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vUnspent.begin(); it != vUnspent.end(); it++) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", AddressIndexToString(it->first.type, it->first.hashBytes)));
+        output.push_back(Pair("txid", it->first.txhash.GetHex()));
+        output.push_back(Pair("vout", (int)it->first.index));
+        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
+        output.push_back(Pair("amount", ValueFromAmount(it->second.satoshis)));
+        output.push_back(Pair("height", it->second.blockHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
+/** Orders address index entries newest first, as ReadAddressIndexReverse does for a single address */
+static bool AddressHistoryNewerThan(const std::pair<CAddressIndexKey, CAmount>& a, const std::pair<CAddressIndexKey, CAmount>& b)
+{
+    if (a.first.blockHeight != b.first.blockHeight)
+        return a.first.blockHeight > b.first.blockHeight;
+    if (a.first.txindex != b.first.txindex)
+        return a.first.txindex > b.first.txindex;
+    if (a.first.index != b.first.index)
+        return a.first.index > b.first.index;
+    return a.first.spending > b.first.spending;
+}
+
+UniValue getaddresshistory(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "getaddresshistory \"uservaddress\"|{\"addresses\":[\"uservaddress\",...]} ( count from )\n"
+            "\nReturns up to 'count' most recent credits and debits of one or more addresses, skipping the first 'from' (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"uservaddress\"   (string, required) The userv address, or an object with an \"addresses\" array\n"
+            "2. count            (numeric, optional, default=100) The number of entries to return\n"
+            "3. from             (numeric, optional, default=0) The number of entries to skip\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\",  (string) The address\n"
+            "    \"txid\": \"hash\",        (string) The transaction id\n"
+            "    \"index\": n,            (numeric) The input index when spending, the output index otherwise\n"
+            "    \"spending\": true|false (boolean) Whether this entry spends from the address\n"
+            "    \"amount\": x.xxx,       (numeric) The signed amount in USERV\n"
+            "    \"height\": n,           (numeric) The block height\n"
+            "    \"blockhash\": \"hash\",   (string) The block hash\n"
+            "    \"time\": ttt            (numeric) The block time in seconds since epoch\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresshistory", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\" 20 100") + HelpExampleRpc("getaddresshistory", "{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"]}, 20, 100"));
+
+    std::vector<std::pair<int, uint160> > vAddresses;
+    AddressIndexArgs(params[0], vAddresses);
+
+    int nCount = 100;
+    if (params.size() > 1)
+        nCount = params[1].get_int();
+    int nFrom = 0;
+    if (params.size() > 2)
+        nFrom = params[2].get_int();
+    if (nCount < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+    if (nFrom < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
+
+    // A single address is paged by the index itself, several are merged from
+    // the newest entries of each
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+    for (std::vector<std::pair<int, uint160> >::const_iterator it = vAddresses.begin(); it != vAddresses.end(); it++) {
+        bool fRead = vAddresses.size() == 1 ? pblocktree->ReadAddressIndexReverse(it->first, it->second, vAddressIndex, nFrom, nCount) :
+                                              pblocktree->ReadAddressIndexReverse(it->first, it->second, vAddressIndex, 0, nFrom + nCount);
+        if (!fRead)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+    if (vAddresses.size() > 1) {
+        std::stable_sort(vAddressIndex.begin(), vAddressIndex.end(), AddressHistoryNewerThan);
+        vAddressIndex.erase(vAddressIndex.begin(), vAddressIndex.begin() + std::min((size_t)nFrom, vAddressIndex.size()));
+        if (vAddressIndex.size() > (size_t)nCount)
+            vAddressIndex.resize(nCount);
+    }
+
+    UniValue result(UniValue::VARR);
+    LOCK(cs_main);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vAddressIndex.begin(); it != vAddressIndex.end(); it++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("address", AddressIndexToString(it->first.type, it->first.hashBytes)));
+        entry.push_back(Pair("txid", it->first.txhash.GetHex()));
+        entry.push_back(Pair("index", (int)it->first.index));
+        entry.push_back(Pair("spending", it->first.spending));
+        entry.push_back(Pair("amount", ValueFromAmount(it->second)));
+        entry.push_back(Pair("height", it->first.blockHeight));
+        const CBlockIndex* pindex = chainActive[it->first.blockHeight];
+        if (pindex) {
+            entry.push_back(Pair("blockhash", pindex->GetBlockHash().GetHex()));
+            entry.push_back(Pair("time", pindex->GetBlockTime()));
+        }
+        result.push_back(entry);
+    }
+    return result;
+}
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getspentinfo {\"txid\":\"hash\",\"index\":n}\n"
+            "\nReturns the input spending an output and the output itself (requires -spentindex).\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "     \"txid\": \"hash\",  (string, required) The transaction id of the output\n"
+            "     \"index\": n       (numeric, required) The output index\n"
+            "   }\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"hash\",        (string) The transaction spending the output\n"
+            "  \"index\": n,            (numeric) The input index in that transaction\n"
+            "  \"height\": n,           (numeric) The height of the block spending the output\n"
+            "  \"prevheight\": n,       (numeric) The height of the block that created the output\n"
+            "  \"value\": x.xxx,        (numeric) The output value in USERV\n"
+            "  \"address\": \"address\"  (string, optional) The address the output paid to\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'") +
+            HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}"));
+
+    if (!fSpentIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index not enabled, restart with -spentindex and -reindex");
+
+    uint256 txid = ParseHashO(params[0].get_obj(), "txid");
+    const UniValue& indexValue = find_value(params[0].get_obj(), "index");
+    if (!indexValue.isNum() || indexValue.get_int() < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid index");
+
+    CSpentIndexValue value;
+    if (!pblocktree->ReadSpentIndex(COutPoint(txid, indexValue.get_int()), value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("index", (int)value.inputIndex));
+    result.push_back(Pair("height", value.blockHeight));
+    result.push_back(Pair("prevheight", value.prevHeight));
+    result.push_back(Pair("value", ValueFromAmount(value.prevout.nValue)));
+    CTxDestination dest;
+    if (ExtractDestination(value.prevout.scriptPubKey, dest))
+        result.push_back(Pair("address", CBitcoinAddress(dest).ToString()));
+    return result;
+}
+
 #ifdef ENABLE_WALLET
 UniValue getstakingstatus(const UniValue& params, bool fHelp)
 {
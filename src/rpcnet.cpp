@@ -6,6 +6,7 @@
 
 #include "rpcserver.h"
 
+#include "blockencodings.h"
 #include "clientversion.h"
 #include "main.h"
 #include "net.h"
@@ -348,6 +349,46 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     return obj;
 }
 
+UniValue getcompactblockinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getcompactblockinfo\n"
+            "\nReturns statistics of compact block relay: how the compact blocks announced to us were rebuilt\n"
+            "and how many we announced.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"received\": xxxxx          (numeric) Compact blocks we tried to rebuild\n"
+            "  \"frommempool\": xxxxx       (numeric) Rebuilt from the mempool alone\n"
+            "  \"roundtrip\": xxxxx         (numeric) Completed after asking the peer for missing transactions\n"
+            "  \"failed\": xxxxx            (numeric) Fell back to downloading the full block\n"
+            "  \"hitrate\": x.xxx           (numeric) Share of the received compact blocks rebuilt without a round trip\n"
+            "  \"txprefilled\": xxxxx       (numeric) Transactions received in full inside compact blocks\n"
+            "  \"txmempool\": xxxxx         (numeric) Transactions found in the mempool\n"
+            "  \"txrequested\": xxxxx       (numeric) Transactions asked for with getblocktxn\n"
+            "  \"sent\": xxxxx              (numeric) Compact blocks announced to peers\n"
+            "  \"txnserved\": xxxxx         (numeric) getblocktxn requests answered\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getcompactblockinfo", "") + HelpExampleRpc("getcompactblockinfo", ""));
+
+    CCompactBlockStats stats;
+    GetCompactBlockStats(stats);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("received", (uint64_t)stats.nReceived));
+    ret.push_back(Pair("frommempool", (uint64_t)stats.nFromMempool));
+    ret.push_back(Pair("roundtrip", (uint64_t)stats.nRoundTrip));
+    ret.push_back(Pair("failed", (uint64_t)stats.nFailed));
+    ret.push_back(Pair("hitrate", stats.nReceived > 0 ? (double)stats.nFromMempool / stats.nReceived : 0.0));
+    ret.push_back(Pair("txprefilled", (uint64_t)stats.nTxPrefilled));
+    ret.push_back(Pair("txmempool", (uint64_t)stats.nTxMempool));
+    ret.push_back(Pair("txrequested", (uint64_t)stats.nTxRequested));
+    ret.push_back(Pair("sent", (uint64_t)stats.nSent));
+    ret.push_back(Pair("txnserved", (uint64_t)stats.nTxnServed));
+    return ret;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -17,6 +17,7 @@
 #include "script/sign.h"
 #include "script/standard.h"
 #include "swifttx.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "utilmoneystr.h"
 #ifdef ENABLE_WALLET
@@ -74,6 +75,15 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
             o.push_back(Pair("asm", txin.scriptSig.ToString()));
             o.push_back(Pair("hex", HexStr(txin.scriptSig.begin(), txin.scriptSig.end())));
             in.push_back(Pair("scriptSig", o));
+
+            // With the spent index the spent output is a single key lookup away
+            CSpentIndexValue spentInfo;
+            if (fSpentIndex && pblocktree->ReadSpentIndex(txin.prevout, spentInfo)) {
+                in.push_back(Pair("value", ValueFromAmount(spentInfo.prevout.nValue)));
+                CTxDestination dest;
+                if (ExtractDestination(spentInfo.prevout.scriptPubKey, dest))
+                    in.push_back(Pair("address", CBitcoinAddress(dest).ToString()));
+            }
         }
         in.push_back(Pair("sequence", (int64_t)txin.nSequence));
         vin.push_back(in);
@@ -88,6 +98,13 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
         UniValue o(UniValue::VOBJ);
         ScriptPubKeyToJSON(txout.scriptPubKey, o, true);
         out.push_back(Pair("scriptPubKey", o));
+
+        CSpentIndexValue spentInfo;
+        if (fSpentIndex && pblocktree->ReadSpentIndex(COutPoint(tx.GetHash(), i), spentInfo)) {
+            out.push_back(Pair("spentTxId", spentInfo.txid.GetHex()));
+            out.push_back(Pair("spentIndex", (int64_t)spentInfo.inputIndex));
+            out.push_back(Pair("spentHeight", spentInfo.blockHeight));
+        }
         vout.push_back(out);
     }
     entry.push_back(Pair("vout", vout));
@@ -141,6 +158,8 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
             "         \"hex\": \"hex\"   (string) hex\n"
             "       },\n"
             "       \"sequence\": n      (numeric) The script sequence number\n"
+            "       \"value\": x.xxx,    (numeric, -spentindex only) The value of the spent output in userv\n"
+            "       \"address\": \"addr\" (string, -spentindex only) The address of the spent output\n"
             "     }\n"
             "     ,...\n"
             "  ],\n"
@@ -157,7 +176,10 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
             "           \"uservaddress\"        (string) userv address\n"
             "           ,...\n"
             "         ]\n"
-            "       }\n"
+            "       },\n"
+            "       \"spentTxId\" : \"id\",     (string, -spentindex only) The transaction spending this output\n"
+            "       \"spentIndex\" : n,         (numeric, -spentindex only) The input index in that transaction\n"
+            "       \"spentHeight\" : n         (numeric, -spentindex only) The height it was spent at\n"
             "     }\n"
             "     ,...\n"
             "  ],\n"
@@ -188,6 +210,7 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
 
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hex", strHex));
+    LOCK(cs_main);
     TxToJSON(tx, hashBlock, result);
     return result;
 }
@@ -737,7 +760,7 @@ UniValue sendrawtransaction(const UniValue& params, bool fHelp)
     if (!fHaveMempool && !fHaveChain) {
         // push to local node and sync with wallets
         if (fSwiftTX) {
-            mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+            txLockManager.AddRequest(tx);
             CreateNewLock(tx);
             RelayTransactionLockReq(tx, true);
         }
@@ -9,8 +9,10 @@
 
 #include "amount.h"
 #include "rpcprotocol.h"
+#include "sync.h"
 #include "uint256.h"
 
+#include <atomic>
 #include <list>
 #include <map>
 #include <stdint.h>
@@ -22,28 +24,24 @@
 
 
 class CBlockIndex;
-class CNetAddr;
+class CJSONWriter;
 
-class AcceptedConnection
+class JSONRequest
 {
 public:
-    virtual ~AcceptedConnection() {}
+    UniValue id;
+    std::string strMethod;
+    UniValue params;
 
-    virtual std::iostream& stream() = 0;
-    virtual std::string peer_address_to_string() const = 0;
-    virtual void close() = 0;
+    JSONRequest() { id = NullUniValue; }
+    void parse(const UniValue& valRequest);
 };
 
-/** Start RPC threads */
-void StartRPCThreads();
-/**
- * Alternative to StartRPCThreads for the GUI, when no server is
- * used. The RPC thread in this case is only used to handle timeouts.
- * If real RPC threads have already been started this is a no-op.
- */
-void StartDummyRPCThread();
-/** Stop RPC threads */
-void StopRPCThreads();
+/** Start the RPC server: commands are served over HTTP by httprpc.cpp */
+bool StartRPC();
+/** Wake the commands waiting for the chain to change, so they see that RPC is stopping */
+void InterruptRPC();
+void StopRPC();
 /** Query whether RPC is running */
 bool IsRPCRunning();
 
@@ -73,17 +71,58 @@ void RPCTypeCheck(const UniValue& params,
 void RPCTypeCheckObj(const UniValue& o,
                   const std::map<std::string, UniValue::VType>& typesExpected, bool fAllowNull=false);
 
+/** Opaque base class for timers returned by NewTimerFunc.
+ * This provides no methods at the moment, but makes sure that delete
+ * cleans up the whole state.
+ */
+class RPCTimerBase
+{
+public:
+    virtual ~RPCTimerBase() {}
+};
+
 /**
- * Run func nSeconds from now. Uses boost deadline timers.
+ * RPC timer "driver".
+ */
+class RPCTimerInterface
+{
+public:
+    virtual ~RPCTimerInterface() {}
+    /** Implementation name */
+    virtual const char* Name() = 0;
+    /** Factory function for timers.
+     * RPC will call the function to create a timer that will call func in *millis* milliseconds.
+     * @note As the RPC mechanism is backend-neutral, it can use different implementations of timers.
+     * This is needed to cope with the case in which there is no HTTP server, but
+     * only GUI RPC console, and to break the dependency of rpcserver on httprpc.
+     */
+    virtual RPCTimerBase* NewTimer(boost::function<void(void)>& func, int64_t millis) = 0;
+};
+
+/** Register factory function for timers */
+void RPCRegisterTimerInterface(RPCTimerInterface* iface);
+/** Unregister factory function for timers */
+void RPCUnregisterTimerInterface(RPCTimerInterface* iface);
+
+/**
+ * Run func nSeconds from now, with the timer interface registered last.
  * Overrides previous timer <name> (if any).
  */
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds);
 
-//! Convert boost::asio address to CNetAddr
-extern CNetAddr BoostAsioToCNetAddr(boost::asio::ip::address address);
-
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
 
+/**
+ * A command writing its result into a CJSONWriter, for results too large to
+ * build whole: over HTTP they are streamed to the client as they are
+ * written. Such commands must be threadSafe, and must not hold cs_main or
+ * another busy lock while writing, since writing may wait for the client.
+ */
+typedef void (*rpcwritefn_type)(const UniValue& params, bool fHelp, CJSONWriter& writer);
+
+/** Call a writing command for its result as a UniValue, as the rpcfn_type actor of the same command does */
+UniValue RPCWriteToUniValue(rpcwritefn_type writer, const UniValue& params, bool fHelp);
+
 class CRPCCommand
 {
 public:
@@ -95,6 +134,32 @@ public:
     bool reqWallet;
 };
 
+/**
+ * What the calls to a command cost, as counted by CRPCTable::execute: how
+ * long they took, and for the commands that are not threadSafe, how long
+ * they waited for cs_main (and cs_wallet) and then held them. The
+ * histograms use the buckets of CLockSite.
+ */
+class CRPCCommandStats
+{
+public:
+    std::atomic<uint64_t> nCalls;
+    //! Calls that threw an error
+    std::atomic<uint64_t> nErrors;
+    std::atomic<uint64_t> nNanos;
+    std::atomic<uint64_t> nMaxNanos;
+    std::atomic<uint64_t> nLockWaitNanos;
+    std::atomic<uint64_t> nLockHoldNanos;
+    std::atomic<uint64_t> vLatencyHistogram[CLockSite::HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> vLockHoldHistogram[CLockSite::HISTOGRAM_BUCKETS];
+
+    CRPCCommandStats();
+
+    void AddCall(int64_t nNanosIn, bool fError);
+    void AddLocked(int64_t nWaitNanos, int64_t nHoldNanos);
+    void Reset();
+};
+
 /**
  * UserV RPC command dispatcher.
  */
@@ -102,10 +167,17 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    std::map<std::string, CRPCCommandStats*> mapCommandStats;
+    std::map<std::string, rpcwritefn_type> mapWriters;
+
+    const CRPCCommand* Prepare(const std::string& method) const;
 
 public:
     CRPCTable();
+    ~CRPCTable();
     const CRPCCommand* operator[](std::string name) const;
+    /** The statistics of a command, or NULL if there is no such command */
+    CRPCCommandStats* GetCommandStats(const std::string& name) const;
     std::string help(std::string name) const;
 
     /**
@@ -117,6 +189,17 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /** Whether a method can write its result with executeWriting */
+    bool CanWrite(const std::string& method) const;
+
+    /**
+     * Execute a method that CanWrite, writing its result into writer as it
+     * is produced instead of returning it.
+     * @throws an exception (UniValue) when an error happens, possibly after
+     * part of the result was written.
+     */
+    void executeWriting(const std::string& method, const UniValue& params, CJSONWriter& writer) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -126,6 +209,9 @@ public:
 
 extern const CRPCTable tableRPC;
 
+/** Execute an array of JSON-RPC requests, and return the array of replies */
+std::string JSONRPCExecBatch(const UniValue& vReq);
+
 /**
  * Utilities: convert hex-encoded Values
  * (throws error if not hex).
@@ -157,6 +243,7 @@ extern UniValue addnode(const UniValue& params, bool fHelp);
 extern UniValue disconnectnode(const UniValue& params, bool fHelp);
 extern UniValue getaddednodeinfo(const UniValue& params, bool fHelp);
 extern UniValue getnettotals(const UniValue& params, bool fHelp);
+extern UniValue getcompactblockinfo(const UniValue& params, bool fHelp);
 extern UniValue setban(const UniValue& params, bool fHelp);
 extern UniValue listbanned(const UniValue& params, bool fHelp);
 extern UniValue clearbanned(const UniValue& params, bool fHelp);
@@ -235,12 +322,19 @@ extern UniValue getdifficulty(const UniValue& params, bool fHelp);
 extern UniValue settxfee(const UniValue& params, bool fHelp);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp);
+extern void getrawmempool_write(const UniValue& params, bool fHelp, CJSONWriter& writer);
 extern UniValue getblockhash(const UniValue& params, bool fHelp);
 extern UniValue getblock(const UniValue& params, bool fHelp);
+extern void getblock_write(const UniValue& params, bool fHelp, CJSONWriter& writer);
 extern UniValue getblockheader(const UniValue& params, bool fHelp);
+extern UniValue getblockfilecacheinfo(const UniValue& params, bool fHelp);
+extern UniValue getsigcacheinfo(const UniValue& params, bool fHelp);
+extern UniValue getprefetchinfo(const UniValue& params, bool fHelp);
 extern UniValue getfeeinfo(const UniValue& params, bool fHelp);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp);
+extern UniValue dumptxoutset(const UniValue& params, bool fHelp);
 extern UniValue gettxout(const UniValue& params, bool fHelp);
+extern UniValue pruneblockchain(const UniValue& params, bool fHelp);
 extern UniValue verifychain(const UniValue& params, bool fHelp);
 extern UniValue getchaintips(const UniValue& params, bool fHelp);
 extern UniValue invalidateblock(const UniValue& params, bool fHelp);
@@ -248,6 +342,7 @@ extern UniValue reconsiderblock(const UniValue& params, bool fHelp);
 
 extern UniValue masternode(const UniValue& params, bool fHelp); // in rpcmasternode.cpp
 extern UniValue listmasternodes(const UniValue& params, bool fHelp);
+extern void listmasternodes_write(const UniValue& params, bool fHelp, CJSONWriter& writer);
 extern UniValue getmasternodecount(const UniValue& params, bool fHelp);
 extern UniValue masternodeconnect(const UniValue& params, bool fHelp);
 extern UniValue masternodecurrent(const UniValue& params, bool fHelp);
@@ -258,6 +353,7 @@ extern UniValue getmasternodeoutputs(const UniValue& params, bool fHelp);
 extern UniValue listmasternodeconf(const UniValue& params, bool fHelp);
 extern UniValue getmasternodestatus(const UniValue& params, bool fHelp);
 extern UniValue getmasternodewinners(const UniValue& params, bool fHelp);
+extern void getmasternodewinners_write(const UniValue& params, bool fHelp, CJSONWriter& writer);
 extern UniValue getmasternodescores(const UniValue& params, bool fHelp);
 
 extern UniValue mnbudget(const UniValue& params, bool fHelp); // in rpcmasternode-budget.cpp
@@ -286,12 +382,12 @@ extern UniValue validateaddress(const UniValue& params, bool fHelp);
 extern UniValue createmultisig(const UniValue& params, bool fHelp);
 extern UniValue verifymessage(const UniValue& params, bool fHelp);
 extern UniValue setmocktime(const UniValue& params, bool fHelp);
+extern UniValue getlockstats(const UniValue& params, bool fHelp);
+extern UniValue getrpcstats(const UniValue& params, bool fHelp);
+extern UniValue getaddressbalance(const UniValue& params, bool fHelp);
+extern UniValue getaddressutxos(const UniValue& params, bool fHelp);
+extern UniValue getaddresshistory(const UniValue& params, bool fHelp);
+extern UniValue getspentinfo(const UniValue& params, bool fHelp);
 extern UniValue getstakingstatus(const UniValue& params, bool fHelp);
 
-// in rest.cpp
-extern bool HTTPReq_REST(AcceptedConnection* conn,
-    std::string& strURI,
-    std::map<std::string, std::string>& mapHeaders,
-    bool fRun);
-
 #endif // BITCOIN_RPCSERVER_H
@@ -16,9 +16,11 @@
 #include "timedata.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utilstrencodings.h"
 #include "wallet.h"
 #include "walletdb.h"
 
+#include <limits>
 #include <stdint.h>
 
 #include "spork.h"
@@ -1263,11 +1265,38 @@ void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, Un
     }
 }
 
+/** Append the entries of the wallet transactions and accounting entries at an order position, newest first */
+static void ListOrderPos(int64_t nOrderPos, const string& strAccount, const isminefilter& filter, UniValue& ret)
+{
+    std::pair<CWallet::TxItems::const_iterator, CWallet::TxItems::const_iterator> range = pwalletMain->wtxOrdered.equal_range(nOrderPos);
+    for (CWallet::TxItems::const_reverse_iterator it(range.second); it != CWallet::TxItems::const_reverse_iterator(range.first); ++it) {
+        CWalletTx* const pwtx = (*it).second.first;
+        if (pwtx != 0)
+            ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
+        CAccountingEntry* const pacentry = (*it).second.second;
+        if (pacentry != 0)
+            AcentryToJSON(*pacentry, strAccount, ret);
+    }
+}
+
+/** A listtransactions cursor names an entry by the order position of its transaction and its number among the entries there */
+static bool ParseListCursor(const string& strCursor, int64_t& nOrderPos, int& nEntry)
+{
+    size_t nSep = strCursor.find(':');
+    if (nSep == string::npos)
+        return false;
+    int32_t n;
+    if (!ParseInt64(strCursor.substr(0, nSep), &nOrderPos) || !ParseInt32(strCursor.substr(nSep + 1), &n) || n < 0)
+        return false;
+    nEntry = n;
+    return true;
+}
+
 UniValue listtransactions(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() > 4)
+    if (fHelp || params.size() > 5)
         throw runtime_error(
-            "listtransactions ( \"account\" count from includeWatchonly)\n"
+            "listtransactions ( \"account\" count from includeWatchonly \"cursor\")\n"
             "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions for account 'account'.\n"
             "\nArguments:\n"
             "1. \"account\"    (string, optional) The account name. If not included, it will list all transactions for all accounts.\n"
@@ -1275,6 +1304,9 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
             "2. count          (numeric, optional, default=10) The number of transactions to return\n"
             "3. from           (numeric, optional, default=0) The number of transactions to skip\n"
             "4. includeWatchonly (bool, optional, default=false) Include transactions to watchonly addresses (see 'importaddress')\n"
+            "5. \"cursor\"     (string, optional) Only list transactions older than the one with this cursor. To page through\n"
+            "                                     the history, pass the cursor of the first (oldest) transaction of the previous\n"
+            "                                     call; unlike 'from', this costs the same however far back the page is.\n"
             "\nResult:\n"
             "[\n"
             "  {\n"
@@ -1308,6 +1340,7 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
             "    \"otheraccount\": \"accountname\",  (string) For the 'move' category of transactions, the account the funds came \n"
             "                                          from (for receiving funds, positive amounts), or went to (for sending funds,\n"
             "                                          negative amounts).\n"
+            "    \"cursor\": \"cursor\",     (string) Where this transaction is in the wallet history, to list older ones with.\n"
             "  }\n"
             "]\n"
 
@@ -1316,6 +1349,7 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
             HelpExampleCli("listtransactions", "") +
             "\nList the most recent 10 transactions for the tabby account\n" + HelpExampleCli("listtransactions", "\"tabby\"") +
             "\nList transactions 100 to 120 from the tabby account\n" + HelpExampleCli("listtransactions", "\"tabby\" 20 100") +
+            "\nList the 20 transactions of the tabby account before the one with cursor \"1234:0\"\n" + HelpExampleCli("listtransactions", "\"tabby\" 20 0 false \"1234:0\"") +
             "\nAs a json rpc call\n" + HelpExampleRpc("listtransactions", "\"tabby\", 20, 100"));
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
@@ -1334,6 +1368,12 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
         if (params[3].get_bool())
             filter = filter | ISMINE_WATCH_ONLY;
 
+    // Start after the entry named by the cursor, or with the newest one
+    int64_t nCursorPos = std::numeric_limits<int64_t>::max();
+    int nCursorEntry = -1;
+    if (params.size() > 4 && !ParseListCursor(params[4].get_str(), nCursorPos, nCursorEntry))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+
     if (nCount < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
     if (nFrom < 0)
@@ -1342,17 +1382,43 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
     UniValue ret(UniValue::VARR);
 
     const CWallet::TxItems & txOrdered = pwalletMain->wtxOrdered;
+    // An account only needs the order positions filed under it visited
+    const std::set<int64_t>* psetOrderPos = NULL;
+    if (strAccount != "*") {
+        static const std::set<int64_t> setNone;
+        std::map<std::string, std::set<int64_t> >::const_iterator mi = pwalletMain->mapAccountOrderPos.find(strAccount);
+        psetOrderPos = (mi != pwalletMain->mapAccountOrderPos.end()) ? &mi->second : &setNone;
+    }
 
     // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
-        CWalletTx* const pwtx = (*it).second.first;
-        if (pwtx != 0)
-            ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
-        CAccountingEntry* const pacentry = (*it).second.second;
-        if (pacentry != 0)
-            AcentryToJSON(*pacentry, strAccount, ret);
+    int64_t nOrderPos = nCursorPos;
+    while ((int)ret.size() < (nCount + nFrom)) {
+        // Next order position at or before nOrderPos
+        if (psetOrderPos) {
+            std::set<int64_t>::const_iterator it = psetOrderPos->upper_bound(nOrderPos);
+            if (it == psetOrderPos->begin())
+                break;
+            nOrderPos = *(--it);
+        } else {
+            CWallet::TxItems::const_iterator it = txOrdered.upper_bound(nOrderPos);
+            if (it == txOrdered.begin())
+                break;
+            nOrderPos = (--it)->first;
+        }
 
-        if ((int)ret.size() >= (nCount + nFrom)) break;
+        UniValue entries(UniValue::VARR);
+        ListOrderPos(nOrderPos, strAccount, filter, entries);
+        for (unsigned int i = 0; i < entries.size(); i++) {
+            if (nOrderPos == nCursorPos && (int)i <= nCursorEntry)
+                continue;
+            UniValue entry = entries[i];
+            entry.push_back(Pair("cursor", strprintf("%d:%u", nOrderPos, i)));
+            ret.push_back(entry);
+        }
+
+        if (nOrderPos == std::numeric_limits<int64_t>::min())
+            break;
+        nOrderPos--;
     }
     // ret is newest to oldest
 
@@ -1521,11 +1587,25 @@ UniValue listsinceblock(const UniValue& params, bool fHelp)
 
     UniValue transactions(UniValue::VARR);
 
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); it++) {
-        CWalletTx tx = (*it).second;
-
-        if (depth == -1 || tx.GetDepthInMainChain(false) < depth)
-            ListTransactions(tx, "*", 0, true, transactions, filter);
+    if (depth == -1) {
+        for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); it++)
+            ListTransactions((*it).second, "*", 0, true, transactions, filter);
+    } else {
+        // Only transactions in no block of the active chain (filed under height -1), or in
+        // one after the given block, can have fewer confirmations than it
+        const std::set<std::pair<int, uint256> >& setHeights = pwalletMain->setWalletTxHeights;
+        std::vector<uint256> vHashes;
+        std::set<std::pair<int, uint256> >::const_iterator it;
+        for (it = setHeights.begin(); it != setHeights.end() && it->first < 0; ++it)
+            vHashes.push_back(it->second);
+        for (it = setHeights.lower_bound(std::make_pair(pindex->nHeight + 1, uint256(0))); it != setHeights.end(); ++it)
+            vHashes.push_back(it->second);
+
+        BOOST_FOREACH (const uint256& hash, vHashes) {
+            map<uint256, CWalletTx>::const_iterator mi = pwalletMain->mapWallet.find(hash);
+            if (mi != pwalletMain->mapWallet.end() && mi->second.GetDepthInMainChain(false) < depth)
+                ListTransactions(mi->second, "*", 0, true, transactions, filter);
+        }
     }
 
     CBlockIndex* pblockLast = chainActive[chainActive.Height() + 1 - target_confirms];
@@ -10,8 +10,24 @@
 
 #include <vector>
 
+/** Default signature cache size, in MiB */
+static const int64_t DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+/** Largest allowed -maxsigcachesize, in MiB */
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+
 class CPubKey;
 
+struct CSignatureCacheStats {
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nInserts;
+    size_t nSlots;
+    size_t nUsed;
+    size_t nBytes;
+
+    CSignatureCacheStats() : nHits(0), nMisses(0), nInserts(0), nSlots(0), nUsed(0), nBytes(0) {}
+};
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -23,4 +39,8 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/** Size the signature cache from -maxsigcachesize */
+void InitSignatureCache();
+void GetSignatureCacheStats(CSignatureCacheStats& stats);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -0,0 +1,69 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SPENTINDEX_H
+#define BITCOIN_SPENTINDEX_H
+
+#include "compressor.h"
+#include "primitives/transaction.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/**
+ * Value of the 'p' records in the block tree database, keyed by the spent
+ * COutPoint. Besides the spending input it keeps a compressed copy of the
+ * spent output and the height it was created at, so resolving the value or
+ * script of a historical input is a single key lookup instead of a seek into
+ * the block files.
+ */
+struct CSpentIndexValue {
+    uint256 txid;          //! transaction that spends the output
+    unsigned int inputIndex;
+    int blockHeight;       //! height of the spending block
+    int prevHeight;        //! height of the block that created the output
+    CTxOut prevout;        //! the spent output itself
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(VARINT(inputIndex));
+        READWRITE(VARINT(blockHeight));
+        READWRITE(VARINT(prevHeight));
+        READWRITE(REF(CTxOutCompressor(REF(prevout))));
+    }
+
+    CSpentIndexValue(const uint256& txidIn, unsigned int inputIndexIn, int heightIn, int prevHeightIn, const CTxOut& prevoutIn)
+    {
+        txid = txidIn;
+        inputIndex = inputIndexIn;
+        blockHeight = heightIn;
+        prevHeight = prevHeightIn;
+        prevout = prevoutIn;
+    }
+
+    CSpentIndexValue()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        txid = 0;
+        inputIndex = 0;
+        blockHeight = 0;
+        prevHeight = 0;
+        prevout.SetNull();
+    }
+
+    //! A null value in an update erases the record
+    bool IsNull() const
+    {
+        return txid == 0;
+    }
+};
+
+#endif // BITCOIN_SPENTINDEX_H
@@ -96,6 +96,7 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
         mapSporks[hash] = spork;
         mapSporksActive[spork.nSporkID] = spork;
         sporkManager.Relay(spork);
+        GetMainSignals().SporkUpdated(spork);
 
         // does a task if needed
         ExecuteSpork(spork.nSporkID, spork.nValue);
@@ -238,6 +239,7 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue)
         Relay(msg);
         mapSporks[msg.GetHash()] = msg;
         mapSporksActive[nSporkID] = msg;
+        GetMainSignals().SporkUpdated(msg);
         return true;
     }
 
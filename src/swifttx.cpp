@@ -12,20 +12,18 @@
 #include "masternodeconfig.h"
 #include "net.h"
 #include "protocol.h"
+#include "random.h"
 #include "spork.h"
 #include "sync.h"
 #include "util.h"
+#include <limits>
+
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
 using namespace boost;
 
-std::map<uint256, CTransaction> mapTxLockReq;
-std::map<uint256, CTransaction> mapTxLockReqRejected;
-std::map<uint256, CConsensusVote> mapTxLockVote;
-std::map<uint256, CTransactionLock> mapTxLocks;
-std::map<COutPoint, uint256> mapLockedInputs;
-std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
+CTxLockManager txLockManager;
 int nCompleteTXLocks;
 
 //txlock - Locks transaction
@@ -50,7 +48,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())) {
+        if (txLockManager.HasRequest(tx.GetHash())) {
             return;
         }
 
@@ -82,7 +80,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
 
             DoConsensusVote(tx, nBlockHeight);
 
-            mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+            txLockManager.AddRequest(tx);
 
             LogPrintf("ProcessMessageSwiftTX::ix - Transaction Lock Request: %s %s : accepted %s\n",
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
@@ -91,7 +89,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
             return;
 
         } else {
-            mapTxLockReqRejected.insert(make_pair(tx.GetHash(), tx));
+            txLockManager.AddRejectedRequest(tx);
 
             // can we get the conflicting transaction as proof?
 
@@ -99,24 +97,17 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
                 tx.GetHash().ToString().c_str());
 
-            BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                if (!mapLockedInputs.count(in.prevout)) {
-                    mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash()));
-                }
-            }
+            txLockManager.LockInputs(tx);
 
             // resolve conflicts
-            std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(tx.GetHash());
-            if (i != mapTxLocks.end()) {
-                //we only care if we have a complete tx lock
-                if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
-                    if (!CheckForConflictingLocks(tx)) {
-                        LogPrintf("ProcessMessageSwiftTX::ix - Found Existing Complete IX Lock\n");
-
-                        //reprocess the last 15 blocks
-                        ReprocessBlocks(15);
-                        mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
-                    }
+            //we only care if we have a complete tx lock
+            if (txLockManager.GetSignatures(tx.GetHash()) >= SWIFTTX_SIGNATURES_REQUIRED) {
+                if (!txLockManager.CheckForConflictingLocks(tx)) {
+                    LogPrintf("ProcessMessageSwiftTX::ix - Found Existing Complete IX Lock\n");
+
+                    //reprocess the last 15 blocks
+                    ReprocessBlocks(15);
+                    txLockManager.AddRequest(tx);
                 }
             }
 
@@ -130,12 +121,10 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockVote.count(ctx.GetHash())) {
+        if (!txLockManager.AddVote(ctx)) {
             return;
         }
 
-        mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
-
         if (ProcessConsensusVote(pfrom, ctx)) {
             //Spam/Dos protection
             /*
@@ -143,20 +132,11 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
                 This tracks those messages and allows it at the same rate of the rest of the network, if
                 a peer violates it, it will simply be ignored
             */
-            if (!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)) {
-                if (!mapUnknownVotes.count(ctx.vinMasternode.prevout.hash)) {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
-                }
-
-                if (mapUnknownVotes[ctx.vinMasternode.prevout.hash] > GetTime() &&
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] - GetAverageVoteTime() > 60 * 10) {
-                    LogPrintf("ProcessMessageSwiftTX::ix - masternode is spamming transaction votes: %s %s\n",
-                        ctx.vinMasternode.ToString().c_str(),
-                        ctx.txHash.ToString().c_str());
-                    return;
-                } else {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
-                }
+            if (txLockManager.IsUnknownVoteSpam(ctx)) {
+                LogPrintf("ProcessMessageSwiftTX::ix - masternode is spamming transaction votes: %s %s\n",
+                    ctx.vinMasternode.ToString().c_str(),
+                    ctx.txHash.ToString().c_str());
+                return;
             }
             RelayInv(inv);
         }
@@ -178,12 +158,10 @@ bool IsIXTXValid(const CTransaction& txCollateral)
         nValueOut += o.nValue;
 
     BOOST_FOREACH (const CTxIn i, txCollateral.vin) {
-        CTransaction tx2;
-        uint256 hash;
-        if (GetTransaction(i.prevout.hash, tx2, hash, true)) {
-            if (tx2.vout.size() > i.prevout.n) {
-                nValueIn += tx2.vout[i.prevout.n].nValue;
-            }
+        CTxOut txoutPrev;
+        CBlockIndex* pindexPrev;
+        if (GetPrevOut(i.prevout, txoutPrev, pindexPrev)) {
+            nValueIn += txoutPrev.nValue;
         } else {
             missingTx = true;
         }
@@ -231,17 +209,9 @@ int64_t CreateNewLock(CTransaction tx)
     */
     int nBlockHeight = (chainActive.Tip()->nHeight - nTxAge) + 4;
 
-    if (!mapTxLocks.count(tx.GetHash())) {
+    if (txLockManager.CreateLock(tx.GetHash(), nBlockHeight)) {
         LogPrintf("CreateNewLock - New Transaction Lock %s !\n", tx.GetHash().ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = nBlockHeight;
-        newLock.nExpiration = GetTime() + (60 * 60); //locks expire after 60 minutes (24 confirmations)
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = tx.GetHash();
-        mapTxLocks.insert(make_pair(tx.GetHash(), newLock));
     } else {
-        mapTxLocks[tx.GetHash()].nBlockHeight = nBlockHeight;
         LogPrint("swifttx", "CreateNewLock - Transaction Lock Exists %s !\n", tx.GetHash().ToString().c_str());
     }
 
@@ -254,7 +224,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 {
     if (!fMasterNode) return;
 
-    int n = mnodeman.GetMasternodeRank(activeMasternode.vin, nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    int n = txLockManager.GetMasternodeRank(activeMasternode.vin, nBlockHeight);
 
     if (n == -1) {
         LogPrint("swifttx", "SwiftTX::DoConsensusVote - Unknown Masternode\n");
@@ -284,7 +254,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
         return;
     }
 
-    mapTxLockVote[ctx.GetHash()] = ctx;
+    txLockManager.AddVote(ctx);
 
     CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
     RelayInv(inv);
@@ -293,7 +263,16 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 //received a consensus vote
 bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
 {
-    int n = mnodeman.GetMasternodeRank(ctx.vinMasternode, ctx.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    // The masternodes are ranked at the height the vote names before its signature can be checked.
+    // Votes at another height than the lock's are never counted, and there are no ranks above the tip.
+    int nLockHeight = txLockManager.GetLockHeight(ctx.txHash);
+    if (ctx.nBlockHeight <= 0 || ctx.nBlockHeight > chainActive.Height() || (nLockHeight != 0 && ctx.nBlockHeight != nLockHeight)) {
+        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Vote at height %d, lock at %d, tip at %d - %s\n",
+            ctx.nBlockHeight, nLockHeight, chainActive.Height(), ctx.GetHash().ToString().c_str());
+        return false;
+    }
+
+    int n = txLockManager.GetMasternodeRank(ctx.vinMasternode, ctx.nBlockHeight);
 
     CMasternode* pmn = mnodeman.Find(ctx.vinMasternode);
     if (pmn != NULL)
@@ -318,71 +297,229 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
         return false;
     }
 
-    if (!mapTxLocks.count(ctx.txHash)) {
-        LogPrintf("SwiftTX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = 0;
-        newLock.nExpiration = GetTime() + (60 * 60);
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = ctx.txHash;
-        mapTxLocks.insert(make_pair(ctx.txHash, newLock));
-    } else
-        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
-
     //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(ctx.txHash);
-    if (i != mapTxLocks.end()) {
-        (*i).second.AddSignature(ctx);
+    int nSignatures = 0;
+    if (!txLockManager.AddLockVote(ctx, nSignatures)) {
+        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Masternode already voted on %s\n", ctx.txHash.ToString().c_str());
+        return false;
+    }
 
 #ifdef ENABLE_WALLET
-        if (pwalletMain) {
-            //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
-            if (pwalletMain->mapRequestCount.count(ctx.txHash))
-                pwalletMain->mapRequestCount[ctx.txHash]++;
-        }
+    if (pwalletMain) {
+        //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
+        if (pwalletMain->mapRequestCount.count(ctx.txHash))
+            pwalletMain->mapRequestCount[ctx.txHash]++;
+    }
 #endif
 
-        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", (*i).second.CountSignatures(), ctx.GetHash().ToString().c_str());
+    LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", nSignatures, ctx.GetHash().ToString().c_str());
 
-        if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
-            LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", (*i).second.GetHash().ToString().c_str());
+    if (nSignatures >= SWIFTTX_SIGNATURES_REQUIRED) {
+        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", ctx.txHash.ToString().c_str());
 
-            CTransaction& tx = mapTxLockReq[ctx.txHash];
-            if (!CheckForConflictingLocks(tx)) {
+        // without the request there are no inputs to lock yet
+        CTransaction tx;
+        bool fHaveRequest = txLockManager.GetRequest(ctx.txHash, tx);
+        if (!txLockManager.CheckForConflictingLocks(tx)) {
 #ifdef ENABLE_WALLET
-                if (pwalletMain) {
-                    if (pwalletMain->UpdatedTransaction((*i).second.txHash)) {
-                        nCompleteTXLocks++;
-                    }
+            if (pwalletMain) {
+                if (pwalletMain->UpdatedTransaction(ctx.txHash)) {
+                    nCompleteTXLocks++;
                 }
+            }
 #endif
 
-                if (mapTxLockReq.count(ctx.txHash)) {
-                    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                        if (!mapLockedInputs.count(in.prevout)) {
-                            mapLockedInputs.insert(make_pair(in.prevout, ctx.txHash));
-                        }
-                    }
-                }
+            if (fHaveRequest) {
+                txLockManager.LockInputs(tx);
+                if (nSignatures == SWIFTTX_SIGNATURES_REQUIRED)
+                    GetMainSignals().NotifyTransactionLock(tx);
+            }
 
-                // resolve conflicts
+            // resolve conflicts
 
-                //if this tx lock was rejected, we need to remove the conflicting blocks
-                if (mapTxLockReqRejected.count((*i).second.txHash)) {
-                    //reprocess the last 15 blocks
-                    ReprocessBlocks(15);
-                }
+            //if this tx lock was rejected, we need to remove the conflicting blocks
+            if (txLockManager.IsRejected(ctx.txHash)) {
+                //reprocess the last 15 blocks
+                ReprocessBlocks(15);
             }
         }
-        return true;
     }
+    return true;
+}
+
+void CleanTransactionLocksList()
+{
+    if (chainActive.Tip() == NULL) return;
+
+    txLockManager.CheckAndRemove();
+}
+
+CSaltedOutPointHasher::CSaltedOutPointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+}
+
+CTransactionLock& CTxLockManager::GetOrCreateLock(const uint256& txHash, bool& fNew)
+{
+    std::map<uint256, CTransactionLock>::iterator it = mapLocks.find(txHash);
+    fNew = (it == mapLocks.end());
+    if (!fNew)
+        return it->second;
+
+    CTransactionLock& lock = mapLocks[txHash];
+    lock.nBlockHeight = 0;
+    lock.txHash = txHash;
+    lock.nExpiration = 0;
+    lock.nTimeout = GetTime() + (60 * 5);
+    SetExpiration(lock, GetTime() + (60 * 60)); //locks expire after 60 minutes (24 confirmations)
+    return lock;
+}
+
+void CTxLockManager::SetExpiration(CTransactionLock& lock, int64_t nExpiration)
+{
+    setLockExpirations.erase(std::make_pair((int64_t)lock.nExpiration, lock.txHash));
+    lock.nExpiration = nExpiration;
+    setLockExpirations.insert(std::make_pair(nExpiration, lock.txHash));
+}
+
+bool CTxLockManager::HasRequest(const uint256& txHash) const
+{
+    LOCK(cs);
+    return mapLockRequests.count(txHash) || mapLockRequestsRejected.count(txHash);
+}
 
+bool CTxLockManager::GetRequest(const uint256& txHash, CTransaction& txRet) const
+{
+    LOCK(cs);
+    std::map<uint256, CTransaction>::const_iterator it = mapLockRequests.find(txHash);
+    if (it == mapLockRequests.end())
+        return false;
+    txRet = it->second;
+    return true;
+}
 
+bool CTxLockManager::IsRejected(const uint256& txHash) const
+{
+    LOCK(cs);
+    return mapLockRequestsRejected.count(txHash);
+}
+
+void CTxLockManager::AddRequest(const CTransaction& tx)
+{
+    LOCK(cs);
+    mapLockRequests.insert(make_pair(tx.GetHash(), tx));
+}
+
+void CTxLockManager::AddRejectedRequest(const CTransaction& tx)
+{
+    LOCK(cs);
+    mapLockRequestsRejected.insert(make_pair(tx.GetHash(), tx));
+}
+
+bool CTxLockManager::HasVote(const uint256& hash) const
+{
+    LOCK(cs);
+    return mapVotes.count(hash);
+}
+
+bool CTxLockManager::GetVote(const uint256& hash, CConsensusVote& voteRet) const
+{
+    LOCK(cs);
+    std::map<uint256, CConsensusVote>::const_iterator it = mapVotes.find(hash);
+    if (it == mapVotes.end())
+        return false;
+    voteRet = it->second;
+    return true;
+}
+
+bool CTxLockManager::AddVote(const CConsensusVote& vote)
+{
+    LOCK(cs);
+    return mapVotes.insert(make_pair(vote.GetHash(), vote)).second;
+}
+
+bool CTxLockManager::CreateLock(const uint256& txHash, int nBlockHeight)
+{
+    LOCK(cs);
+    bool fNew;
+    GetOrCreateLock(txHash, fNew).nBlockHeight = nBlockHeight;
+    return fNew;
+}
+
+bool CTxLockManager::AddLockVote(const CConsensusVote& vote, int& nSignaturesRet)
+{
+    LOCK(cs);
+    bool fNew;
+    CTransactionLock& lock = GetOrCreateLock(vote.txHash, fNew);
+    if (fNew)
+        LogPrintf("CTxLockManager::AddLockVote - New Transaction Lock %s !\n", vote.txHash.ToString());
+    bool fAdded = lock.AddSignature(vote);
+    nSignaturesRet = lock.CountSignatures();
+    return fAdded;
+}
+
+int CTxLockManager::GetLockHeight(const uint256& txHash) const
+{
+    LOCK(cs);
+    std::map<uint256, CTransactionLock>::const_iterator it = mapLocks.find(txHash);
+    if (it == mapLocks.end())
+        return 0;
+    return it->second.nBlockHeight;
+}
+
+int CTxLockManager::GetSignatures(const uint256& txHash) const
+{
+    LOCK(cs);
+    std::map<uint256, CTransactionLock>::const_iterator it = mapLocks.find(txHash);
+    if (it == mapLocks.end())
+        return -1;
+    return it->second.CountSignatures();
+}
+
+bool CTxLockManager::IsTimedOut(const uint256& txHash) const
+{
+    LOCK(cs);
+    std::map<uint256, CTransactionLock>::const_iterator it = mapLocks.find(txHash);
+    if (it == mapLocks.end())
+        return false;
+    return GetTime() > it->second.nTimeout;
+}
+
+void CTxLockManager::LockInputs(const CTransaction& tx)
+{
+    LOCK(cs);
+    uint256 txHash = tx.GetHash();
+    BOOST_FOREACH (const CTxIn& in, tx.vin)
+        mapLockedInputs.insert(make_pair(in.prevout, txHash));
+}
+
+void CTxLockManager::UnlockInputs(const CTransaction& tx)
+{
+    uint256 txHash = tx.GetHash();
+    BOOST_FOREACH (const CTxIn& in, tx.vin) {
+        boost::unordered_map<COutPoint, uint256, CSaltedOutPointHasher>::iterator it = mapLockedInputs.find(in.prevout);
+        if (it != mapLockedInputs.end() && it->second == txHash)
+            mapLockedInputs.erase(it);
+    }
+}
+
+bool CTxLockManager::GetConflictingLock(const CTransaction& tx, uint256& hashLockRet) const
+{
+    LOCK(cs);
+    if (mapLockedInputs.empty())
+        return false;
+
+    uint256 txHash = tx.GetHash();
+    BOOST_FOREACH (const CTxIn& in, tx.vin) {
+        boost::unordered_map<COutPoint, uint256, CSaltedOutPointHasher>::const_iterator it = mapLockedInputs.find(in.prevout);
+        if (it != mapLockedInputs.end() && it->second != txHash) {
+            hashLockRet = it->second;
+            return true;
+        }
+    }
     return false;
 }
 
-bool CheckForConflictingLocks(CTransaction& tx)
+bool CTxLockManager::CheckForConflictingLocks(const CTransaction& tx)
 {
     /*
         It's possible (very unlikely though) to get 2 conflicting transaction locks approved by the network.
@@ -391,62 +528,138 @@ bool CheckForConflictingLocks(CTransaction& tx)
         Blocks could have been rejected during this time, which is OK. After they cancel out, the client will
         rescan the blocks and find they're acceptable and then take the chain with the most work.
     */
+    LOCK(cs);
+    uint256 txHash = tx.GetHash();
     BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                LogPrintf("SwiftTX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), mapLockedInputs[in.prevout].ToString().c_str());
-                if (mapTxLocks.count(tx.GetHash())) mapTxLocks[tx.GetHash()].nExpiration = GetTime();
-                if (mapTxLocks.count(mapLockedInputs[in.prevout])) mapTxLocks[mapLockedInputs[in.prevout]].nExpiration = GetTime();
-                return true;
-            }
-        }
+        boost::unordered_map<COutPoint, uint256, CSaltedOutPointHasher>::iterator itInput = mapLockedInputs.find(in.prevout);
+        if (itInput == mapLockedInputs.end() || itInput->second == txHash)
+            continue;
+
+        LogPrintf("SwiftTX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", txHash.ToString().c_str(), itInput->second.ToString().c_str());
+        std::map<uint256, CTransactionLock>::iterator it = mapLocks.find(txHash);
+        if (it != mapLocks.end()) SetExpiration(it->second, GetTime());
+        it = mapLocks.find(itInput->second);
+        if (it != mapLocks.end()) SetExpiration(it->second, GetTime());
+        return true;
     }
 
     return false;
 }
 
-int64_t GetAverageVoteTime()
+void CTxLockManager::SetUnknownVoteTime(const uint256& hashMasternode, int64_t nTime)
 {
-    std::map<uint256, int64_t>::iterator it = mapUnknownVotes.begin();
-    int64_t total = 0;
-    int64_t count = 0;
-
-    while (it != mapUnknownVotes.end()) {
-        total += it->second;
-        count++;
-        it++;
+    std::map<uint256, int64_t>::iterator it = mapUnknownVotes.find(hashMasternode);
+    if (it == mapUnknownVotes.end()) {
+        mapUnknownVotes.insert(make_pair(hashMasternode, nTime));
+    } else {
+        nUnknownVoteTimeTotal -= it->second;
+        it->second = nTime;
     }
-
-    return total / count;
+    nUnknownVoteTimeTotal += nTime;
 }
 
-void CleanTransactionLocksList()
+bool CTxLockManager::IsUnknownVoteSpam(const CConsensusVote& vote)
 {
-    if (chainActive.Tip() == NULL) return;
-
-    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
+    //Spam/Dos protection
+    /*
+        Masternodes will sometimes propagate votes before the transaction is known to the client.
+        This tracks those messages and allows it at the same rate of the rest of the network, if
+        a peer violates it, it will simply be ignored
+    */
+    LOCK(cs);
+    if (mapLockRequests.count(vote.txHash) || mapLockRequestsRejected.count(vote.txHash))
+        return false;
 
-    while (it != mapTxLocks.end()) {
-        if (GetTime() > it->second.nExpiration) { //keep them for an hour
-            LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
+    const uint256& hashMasternode = vote.vinMasternode.prevout.hash;
+    int64_t nNow = GetTime();
+    if (!mapUnknownVotes.count(hashMasternode))
+        SetUnknownVoteTime(hashMasternode, nNow + (60 * 10));
 
-            if (mapTxLockReq.count(it->second.txHash)) {
-                CTransaction& tx = mapTxLockReq[it->second.txHash];
+    // the average is kept as a running total, rather than summed over every masternode per vote
+    int64_t nVoteTime = mapUnknownVotes[hashMasternode];
+    int64_t nAverageVoteTime = nUnknownVoteTimeTotal / (int64_t)mapUnknownVotes.size();
+    if (nVoteTime > nNow && nVoteTime - nAverageVoteTime > 60 * 10)
+        return true;
 
-                BOOST_FOREACH (const CTxIn& in, tx.vin)
-                    mapLockedInputs.erase(in.prevout);
+    SetUnknownVoteTime(hashMasternode, nNow + (60 * 10));
+    return false;
+}
 
-                mapTxLockReq.erase(it->second.txHash);
-                mapTxLockReqRejected.erase(it->second.txHash);
+int CTxLockManager::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight)
+{
+    int64_t nNow = GetTime();
+    int nMasternodes = mnodeman.size();
+    {
+        LOCK(cs);
+        std::map<int64_t, CMasternodeRanks>::const_iterator it = mapRankCache.find(nBlockHeight);
+        if (it != mapRankCache.end() && nNow - it->second.nTime < SWIFTTX_RANK_CACHE_SECONDS && it->second.nMasternodes == nMasternodes) {
+            std::map<COutPoint, int>::const_iterator itRank = it->second.mapRanks.find(vin.prevout);
+            return itRank == it->second.mapRanks.end() ? -1 : itRank->second;
+        }
+    }
 
-                BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
-                    mapTxLockVote.erase(v.GetHash());
-            }
+    // Ranking every masternode costs the same as ranking one, so do it once for all votes at this height
+    CMasternodeRanks ranks;
+    ranks.nTime = nNow;
+    ranks.nMasternodes = nMasternodes;
+    if (!mnodeman.GetMasternodeRanks(ranks.mapRanks, nBlockHeight, MIN_SWIFTTX_PROTO_VERSION))
+        return -1;
+
+    std::map<COutPoint, int>::const_iterator itRank = ranks.mapRanks.find(vin.prevout);
+    int nRank = itRank == ranks.mapRanks.end() ? -1 : itRank->second;
+
+    LOCK(cs);
+    if (!mapRankCache.count(nBlockHeight) && mapRankCache.size() >= SWIFTTX_RANK_CACHE_SIZE) {
+        // make room by dropping the ranking computed longest ago
+        std::map<int64_t, CMasternodeRanks>::iterator itOldest = mapRankCache.begin();
+        for (std::map<int64_t, CMasternodeRanks>::iterator it = mapRankCache.begin(); it != mapRankCache.end(); ++it) {
+            if (it->second.nTime < itOldest->second.nTime)
+                itOldest = it;
+        }
+        mapRankCache.erase(itOldest);
+    }
+    std::swap(mapRankCache[nBlockHeight], ranks);
+    return nRank;
+}
 
-            mapTxLocks.erase(it++);
-        } else {
-            it++;
+void CTxLockManager::CheckAndRemove()
+{
+    LOCK(cs);
+    int64_t nNow = GetTime();
+
+    //keep them for an hour
+    while (!setLockExpirations.empty() && setLockExpirations.begin()->first < nNow) {
+        uint256 txHash = setLockExpirations.begin()->second;
+        setLockExpirations.erase(setLockExpirations.begin());
+
+        std::map<uint256, CTransactionLock>::iterator it = mapLocks.find(txHash);
+        if (it == mapLocks.end())
+            continue;
+        LogPrintf("Removing old transaction lock %s\n", txHash.ToString().c_str());
+
+        std::map<uint256, CTransaction>::iterator itRequest = mapLockRequests.find(txHash);
+        if (itRequest != mapLockRequests.end()) {
+            UnlockInputs(itRequest->second);
+            mapLockRequests.erase(itRequest);
+        }
+        itRequest = mapLockRequestsRejected.find(txHash);
+        if (itRequest != mapLockRequestsRejected.end()) {
+            UnlockInputs(itRequest->second);
+            mapLockRequestsRejected.erase(itRequest);
         }
+
+        for (std::map<COutPoint, CConsensusVote>::const_iterator itVote = it->second.mapConsensusVotes.begin(); itVote != it->second.mapConsensusVotes.end(); ++itVote)
+            mapVotes.erase(itVote->second.GetHash());
+
+        mapLocks.erase(it);
+    }
+
+    std::map<int64_t, CMasternodeRanks>::iterator itRanks = mapRankCache.begin();
+    while (itRanks != mapRankCache.end()) {
+        if (nNow - itRanks->second.nTime >= SWIFTTX_RANK_CACHE_SECONDS)
+            mapRankCache.erase(itRanks++);
+        else
+            ++itRanks;
     }
 }
 
@@ -508,8 +721,9 @@ bool CConsensusVote::Sign()
 
 bool CTransactionLock::SignaturesValid()
 {
-    BOOST_FOREACH (CConsensusVote vote, vecConsensusVotes) {
-        int n = mnodeman.GetMasternodeRank(vote.vinMasternode, vote.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    for (std::map<COutPoint, CConsensusVote>::iterator it = mapConsensusVotes.begin(); it != mapConsensusVotes.end(); ++it) {
+        CConsensusVote& vote = it->second;
+        int n = txLockManager.GetMasternodeRank(vote.vinMasternode, vote.nBlockHeight);
 
         if (n == -1) {
             LogPrintf("CTransactionLock::SignaturesValid() - Unknown Masternode\n");
@@ -530,12 +744,12 @@ bool CTransactionLock::SignaturesValid()
     return true;
 }
 
-void CTransactionLock::AddSignature(CConsensusVote& cv)
+bool CTransactionLock::AddSignature(const CConsensusVote& cv)
 {
-    vecConsensusVotes.push_back(cv);
+    return mapConsensusVotes.insert(make_pair(cv.vinMasternode.prevout, cv)).second;
 }
 
-int CTransactionLock::CountSignatures()
+int CTransactionLock::CountSignatures() const
 {
     /*
         Only count signatures where the BlockHeight matches the transaction's blockheight.
@@ -545,8 +759,8 @@ int CTransactionLock::CountSignatures()
     if (nBlockHeight == 0) return -1;
 
     int n = 0;
-    BOOST_FOREACH (CConsensusVote v, vecConsensusVotes) {
-        if (v.nBlockHeight == nBlockHeight) {
+    for (std::map<COutPoint, CConsensusVote>::const_iterator it = mapConsensusVotes.begin(); it != mapConsensusVotes.end(); ++it) {
+        if (it->second.nBlockHeight == nBlockHeight) {
             n++;
         }
     }
@@ -7,6 +7,7 @@
 #define SWIFTTX_H
 
 #include "base58.h"
+#include "hash.h"
 #include "key.h"
 #include "main.h"
 #include "net.h"
@@ -14,6 +15,10 @@
 #include "sync.h"
 #include "util.h"
 
+#include <set>
+
+#include <boost/unordered_map.hpp>
+
 /*
     At 15 signatures, 1/2 of the masternode network can be owned by
     one party without comprimising the security of SwiftTX
@@ -32,14 +37,15 @@ using namespace boost;
 class CConsensusVote;
 class CTransaction;
 class CTransactionLock;
+class CTxLockManager;
 
 static const int MIN_SWIFTTX_PROTO_VERSION = 70103;
+/** Seconds a masternode ranking computed for a lock height is reused, unless the list grows or shrinks */
+static const int SWIFTTX_RANK_CACHE_SECONDS = 60;
+/** Most masternode rankings kept at once, one per lock height */
+static const unsigned int SWIFTTX_RANK_CACHE_SIZE = 50;
 
-extern map<uint256, CTransaction> mapTxLockReq;
-extern map<uint256, CTransaction> mapTxLockReqRejected;
-extern map<uint256, CConsensusVote> mapTxLockVote;
-extern map<uint256, CTransactionLock> mapTxLocks;
-extern std::map<COutPoint, uint256> mapLockedInputs;
+extern CTxLockManager txLockManager;
 extern int nCompleteTXLocks;
 
 
@@ -47,9 +53,6 @@ int64_t CreateNewLock(CTransaction tx);
 
 bool IsIXTXValid(const CTransaction& txCollateral);
 
-// if two conflicting locks are approved by the network, they will cancel out
-bool CheckForConflictingLocks(CTransaction& tx);
-
 void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
 //check if we need to vote on this transaction
@@ -61,7 +64,20 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx);
 // keep transaction locks in memory for an hour
 void CleanTransactionLocksList();
 
-int64_t GetAverageVoteTime();
+/** Keyed hash of an outpoint, so peers cannot grind collisions among the locked inputs */
+class CSaltedOutPointHasher
+{
+private:
+    uint64_t k0, k1;
+
+public:
+    CSaltedOutPointHasher();
+
+    size_t operator()(const COutPoint& outpoint) const
+    {
+        return SipHashUint256(k0, k1, outpoint.hash) ^ outpoint.n;
+    }
+};
 
 class CConsensusVote
 {
@@ -93,13 +109,14 @@ class CTransactionLock
 public:
     int nBlockHeight;
     uint256 txHash;
-    std::vector<CConsensusVote> vecConsensusVotes;
+    // one vote per masternode, by collateral outpoint
+    std::map<COutPoint, CConsensusVote> mapConsensusVotes;
     int nExpiration;
     int nTimeout;
 
     bool SignaturesValid();
-    int CountSignatures();
-    void AddSignature(CConsensusVote& cv);
+    int CountSignatures() const;
+    bool AddSignature(const CConsensusVote& cv);
 
     uint256 GetHash()
     {
@@ -107,5 +124,82 @@ public:
     }
 };
 
+/**
+ * Lock requests, votes and the transaction locks they add up to, indexed by
+ * transaction, by vote, by locked input and by expiration time, so checking
+ * a transaction against the locks costs one lookup per input and expiring
+ * them only touches the expired ones.
+ */
+class CTxLockManager
+{
+private:
+    // critical section to protect the inner data structures; nothing is called out of it
+    mutable CCriticalSection cs;
+
+    struct CMasternodeRanks {
+        int64_t nTime;
+        int nMasternodes;
+        std::map<COutPoint, int> mapRanks;
+    };
+
+    std::map<uint256, CTransaction> mapLockRequests;
+    std::map<uint256, CTransaction> mapLockRequestsRejected;
+    std::map<uint256, CConsensusVote> mapVotes;
+    std::map<uint256, CTransactionLock> mapLocks;
+    // (expiration, transaction) of every lock, soonest first
+    std::set<std::pair<int64_t, uint256> > setLockExpirations;
+    boost::unordered_map<COutPoint, uint256, CSaltedOutPointHasher> mapLockedInputs;
+    // masternodes voting on unknown transactions, and until when they are not to do so again
+    std::map<uint256, int64_t> mapUnknownVotes;
+    int64_t nUnknownVoteTimeTotal;
+    // masternode ranks by lock height
+    std::map<int64_t, CMasternodeRanks> mapRankCache;
+
+    CTransactionLock& GetOrCreateLock(const uint256& txHash, bool& fNew);
+    void SetExpiration(CTransactionLock& lock, int64_t nExpiration);
+    void UnlockInputs(const CTransaction& tx);
+    void SetUnknownVoteTime(const uint256& hashMasternode, int64_t nTime);
+
+public:
+    CTxLockManager() : nUnknownVoteTimeTotal(0) {}
+
+    /// Whether a lock request for txHash was seen, accepted or not
+    bool HasRequest(const uint256& txHash) const;
+    bool GetRequest(const uint256& txHash, CTransaction& txRet) const;
+    bool IsRejected(const uint256& txHash) const;
+    void AddRequest(const CTransaction& tx);
+    void AddRejectedRequest(const CTransaction& tx);
+
+    bool HasVote(const uint256& hash) const;
+    bool GetVote(const uint256& hash, CConsensusVote& voteRet) const;
+    /// Remember a vote by its hash; false if it was already known
+    bool AddVote(const CConsensusVote& vote);
+
+    /// Create the lock of txHash if needed and set the block height its votes are for; true if it is new
+    bool CreateLock(const uint256& txHash, int nBlockHeight);
+    /// Count a masternode's vote towards its lock, creating the lock if needed; false if the masternode already voted on it
+    bool AddLockVote(const CConsensusVote& vote, int& nSignaturesRet);
+    /// Block height the votes on the lock of txHash are for, 0 if the lock request was not seen yet
+    int GetLockHeight(const uint256& txHash) const;
+    /// Votes for the lock of txHash at its block height, -1 if there is no such lock or height yet
+    int GetSignatures(const uint256& txHash) const;
+    bool IsTimedOut(const uint256& txHash) const;
+
+    /// Lock the inputs of tx not locked by another transaction already
+    void LockInputs(const CTransaction& tx);
+    /// Find an input of tx locked by another transaction, returned in hashLockRet
+    bool GetConflictingLock(const CTransaction& tx, uint256& hashLockRet) const;
+    /// If a complete lock on tx conflicts with another, expire both
+    bool CheckForConflictingLocks(const CTransaction& tx);
+
+    /// Rate limit masternodes voting on transactions not seen yet; true if this vote is one too many
+    bool IsUnknownVoteSpam(const CConsensusVote& vote);
+
+    /// Rank of a masternode among those eligible to vote on locks at nBlockHeight, -1 if unknown
+    int GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight);
+
+    /// Remove expired locks with their requests, votes and inputs
+    void CheckAndRemove();
+};
 
 #endif
@@ -9,9 +9,87 @@
 
 #include <stdio.h>
 
+#include <boost/chrono/chrono.hpp>
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 
+std::atomic<bool> fLockStats(false);
+
+/** The lock sites registered so far, guarded by a plain mutex as LOCK itself has a site */
+static boost::mutex& LockSitesMutex()
+{
+    static boost::mutex mutex;
+    return mutex;
+}
+
+static std::vector<CLockSite*>& LockSites()
+{
+    static std::vector<CLockSite*> vSites;
+    return vSites;
+}
+
+int LockStatsHistogramBucket(int64_t nNanos)
+{
+    int nBucket = 0;
+    for (int64_t nMicros = nNanos / 1000; nMicros > 0 && nBucket < CLockSite::HISTOGRAM_BUCKETS - 1; nMicros >>= 1)
+        nBucket++;
+    return nBucket;
+}
+
+CLockSite::CLockSite(const char* pszNameIn, const char* pszFileIn, int nLineIn) : pszName(pszNameIn), pszFile(pszFileIn), nLine(nLineIn), nWaiting(0)
+{
+    Reset();
+    boost::lock_guard<boost::mutex> guard(LockSitesMutex());
+    LockSites().push_back(this);
+}
+
+void CLockSite::AddAcquired(int64_t nWaitNanosIn, bool fContended)
+{
+    nAcquired.fetch_add(1, std::memory_order_relaxed);
+    if (fContended) {
+        nContended.fetch_add(1, std::memory_order_relaxed);
+        nWaitNanos.fetch_add(nWaitNanosIn, std::memory_order_relaxed);
+    }
+    vWaitHistogram[LockStatsHistogramBucket(nWaitNanosIn)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void CLockSite::AddHold(int64_t nHoldNanosIn)
+{
+    nHoldNanos.fetch_add(nHoldNanosIn, std::memory_order_relaxed);
+    vHoldHistogram[LockStatsHistogramBucket(nHoldNanosIn)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void CLockSite::Reset()
+{
+    nAcquired = 0;
+    nContended = 0;
+    nTriesFailed = 0;
+    nWaitNanos = 0;
+    nHoldNanos = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        vWaitHistogram[i] = 0;
+        vHoldHistogram[i] = 0;
+    }
+}
+
+int64_t GetLockStatsNanos()
+{
+    return boost::chrono::duration_cast<boost::chrono::nanoseconds>(boost::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::vector<CLockSite*> GetLockSites()
+{
+    boost::lock_guard<boost::mutex> guard(LockSitesMutex());
+    return LockSites();
+}
+
+void ResetLockStats()
+{
+    std::vector<CLockSite*> vSites = GetLockSites();
+    for (unsigned int i = 0; i < vSites.size(); i++)
+        vSites[i]->Reset();
+}
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 {
@@ -8,6 +8,10 @@
 
 #include "threadsafety.h"
 
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
@@ -104,16 +108,88 @@ void static inline AssertLockHeldInternal(const char* pszName, const char* pszFi
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * A place in the code that takes a lock, and what taking it there cost while
+ * lock statistics are on (-lockstats, getlockstats). Every LOCK, LOCK2 and
+ * TRY_LOCK has one, registered the first time it runs. Sites stay
+ * registered, so they are static, like those of the macros.
+ *
+ * The histograms count times under 1us in their first bucket, from 2^(i-1)
+ * to 2^i us in bucket i, and the longer ones in the last bucket.
+ */
+class CLockSite
+{
+public:
+    static const int HISTOGRAM_BUCKETS = 20;
+
+    const char* const pszName;
+    const char* const pszFile;
+    const int nLine;
+
+    std::atomic<uint64_t> nAcquired;
+    //! Acquisitions that had to wait for another thread to release the lock
+    std::atomic<uint64_t> nContended;
+    std::atomic<uint64_t> nTriesFailed;
+    //! Threads waiting for the lock there right now, which Reset leaves alone
+    std::atomic<uint64_t> nWaiting;
+    std::atomic<uint64_t> nWaitNanos;
+    std::atomic<uint64_t> nHoldNanos;
+    std::atomic<uint64_t> vWaitHistogram[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> vHoldHistogram[HISTOGRAM_BUCKETS];
+
+    CLockSite(const char* pszNameIn, const char* pszFileIn, int nLineIn);
+
+    void AddAcquired(int64_t nWaitNanosIn, bool fContended);
+    void AddHold(int64_t nHoldNanosIn);
+    void Reset();
+};
+
+//! Whether lock sites count acquisitions and time them
+extern std::atomic<bool> fLockStats;
+
+//! Monotonic clock lock sites are timed with
+int64_t GetLockStatsNanos();
+
+//! The CLockSite histogram bucket a time falls in
+int LockStatsHistogramBucket(int64_t nNanos);
+
+//! Every lock site that ran so far
+std::vector<CLockSite*> GetLockSites();
+
+void ResetLockStats();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex>
 class CMutexLock
 {
 private:
     boost::unique_lock<Mutex> lock;
+    CLockSite* psite;
+    //! When the lock was acquired, if how long it is held is measured
+    int64_t nLockedNanos;
+
+    void EnterMeasured()
+    {
+        if (lock.try_lock()) {
+            nLockedNanos = GetLockStatsNanos();
+            psite->AddAcquired(0, false);
+            return;
+        }
+        int64_t nStart = GetLockStatsNanos();
+        psite->nWaiting.fetch_add(1, std::memory_order_relaxed);
+        lock.lock();
+        psite->nWaiting.fetch_sub(1, std::memory_order_relaxed);
+        nLockedNanos = GetLockStatsNanos();
+        psite->AddAcquired(nLockedNanos - nStart, true);
+    }
 
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
+        if (psite && fLockStats.load(std::memory_order_relaxed)) {
+            EnterMeasured();
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
@@ -130,11 +206,19 @@ private:
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+        if (psite && fLockStats.load(std::memory_order_relaxed)) {
+            if (lock.owns_lock()) {
+                nLockedNanos = GetLockStatsNanos();
+                psite->AddAcquired(0, false);
+            } else {
+                psite->nTriesFailed.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
         return lock.owns_lock();
     }
 
 public:
-    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) : lock(mutexIn, boost::defer_lock)
+    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false, CLockSite* psiteIn = NULL) : lock(mutexIn, boost::defer_lock), psite(psiteIn), nLockedNanos(0)
     {
         if (fTry)
             TryEnter(pszName, pszFile, nLine);
@@ -144,8 +228,11 @@ public:
 
     ~CMutexLock()
     {
-        if (lock.owns_lock())
+        if (lock.owns_lock()) {
+            if (nLockedNanos != 0)
+                psite->AddHold(GetLockStatsNanos() - nLockedNanos);
             LeaveCritical();
+        }
     }
 
     operator bool()
@@ -156,9 +243,16 @@ public:
 
 typedef CMutexLock<CCriticalSection> CCriticalBlock;
 
-#define LOCK(cs) CCriticalBlock criticalblock(cs, #cs, __FILE__, __LINE__)
-#define LOCK2(cs1, cs2) CCriticalBlock criticalblock1(cs1, #cs1, __FILE__, __LINE__), criticalblock2(cs2, #cs2, __FILE__, __LINE__)
-#define TRY_LOCK(cs, name) CCriticalBlock name(cs, #cs, __FILE__, __LINE__, true)
+#define LOCK(cs)                                        \
+    static CLockSite locksite(#cs, __FILE__, __LINE__); \
+    CCriticalBlock criticalblock(cs, #cs, __FILE__, __LINE__, false, &locksite)
+#define LOCK2(cs1, cs2)                                                                             \
+    static CLockSite locksite1(#cs1, __FILE__, __LINE__), locksite2(#cs2, __FILE__, __LINE__);      \
+    CCriticalBlock criticalblock1(cs1, #cs1, __FILE__, __LINE__, false, &locksite1),                \
+        criticalblock2(cs2, #cs2, __FILE__, __LINE__, false, &locksite2)
+#define TRY_LOCK(cs, name)                                   \
+    static CLockSite name##_site(#cs, __FILE__, __LINE__); \
+    CCriticalBlock name(cs, #cs, __FILE__, __LINE__, true, &name##_site)
 
 #define ENTER_CRITICAL_SECTION(cs)                            \
     {                                                         \
@@ -0,0 +1,164 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "key.h"
+#include "main.h"
+#include "script/standard.h"
+#include "txdb.h"
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+BOOST_AUTO_TEST_CASE(addressindex_script_keys)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    int nType;
+    uint160 hash;
+
+    CScript p2pkh = GetScriptForDestination(pubkey.GetID());
+    BOOST_CHECK(GetAddressIndexKey(p2pkh, nType, hash));
+    BOOST_CHECK_EQUAL(nType, ADDRESS_INDEX_PUBKEYHASH);
+    BOOST_CHECK(hash == pubkey.GetID());
+    BOOST_CHECK(GetAddressIndexScript(nType, hash) == p2pkh);
+
+    // pay-to-pubkey (coinstake) outputs fold onto the key id
+    CScript p2pk = CScript() << ToByteVector(pubkey) << OP_CHECKSIG;
+    BOOST_CHECK(GetAddressIndexKey(p2pk, nType, hash));
+    BOOST_CHECK_EQUAL(nType, ADDRESS_INDEX_PUBKEYHASH);
+    BOOST_CHECK(hash == pubkey.GetID());
+
+    CScript p2sh = GetScriptForDestination(CScriptID(p2pkh));
+    BOOST_CHECK(GetAddressIndexKey(p2sh, nType, hash));
+    BOOST_CHECK_EQUAL(nType, ADDRESS_INDEX_SCRIPTHASH);
+    BOOST_CHECK(hash == CScriptID(p2pkh));
+    BOOST_CHECK(GetAddressIndexScript(nType, hash) == p2sh);
+
+    BOOST_CHECK(!GetAddressIndexKey(CScript() << OP_RETURN, nType, hash));
+    BOOST_CHECK(!GetAddressIndexKey(CScript() << OP_TRUE, nType, hash));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_key_order)
+{
+    // heights must sort numerically once serialized, which requires big endian
+    uint160 hash(123);
+    CDataStream ssLow(SER_DISK, CLIENT_VERSION), ssHigh(SER_DISK, CLIENT_VERSION);
+    ssLow << CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hash, 255, 7, uint256(2), 0, false);
+    ssHigh << CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hash, 256, 0, uint256(1), 0, false);
+    BOOST_CHECK(ssLow.str() < ssHigh.str());
+
+    CAddressIndexKey key;
+    ssHigh >> key;
+    BOOST_CHECK_EQUAL(key.blockHeight, 256);
+    BOOST_CHECK(key.txhash == uint256(1));
+}
+
+/** Register a block index for hash on top of pprev, as the connect and disconnect code finds them */
+static CBlockIndex* AddBlockIndex(const uint256& hash, CBlockIndex* pprev)
+{
+    CBlockIndex* pindex = new CBlockIndex();
+    BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindex)).first;
+    pindex->phashBlock = &mi->first;
+    pindex->pprev = pprev;
+    pindex->nHeight = pprev ? pprev->nHeight + 1 : 0;
+    pindex->BuildSkip();
+    return pindex;
+}
+
+static void CheckBalance(const uint160& hash, CAmount nBalance, CAmount nReceived, int64_t nEntries)
+{
+    CAddressBalance balance;
+    BOOST_CHECK(pblocktree->ReadAddressBalance(ADDRESS_INDEX_PUBKEYHASH, hash, balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, nBalance);
+    BOOST_CHECK_EQUAL(balance.nReceived, nReceived);
+    BOOST_CHECK_EQUAL(balance.nEntries, nEntries);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_connect_disconnect)
+{
+    LOCK(cs_main);
+    uint160 hash(42);
+    uint256 txA(1), txB(2), txC(3);
+    CBlockIndex* pindex0 = AddBlockIndex(uint256(1000), NULL);
+    CBlockIndex* pindex1 = AddBlockIndex(uint256(1001), pindex0);
+    CBlockIndex* pindex2 = AddBlockIndex(uint256(1002), pindex1);
+    CBlockIndex* pindex2Fork = AddBlockIndex(uint256(1003), pindex1);
+
+    // block 1: A pays 10 to the address; block 2: B spends it, paying 4 back
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vIndex1, vIndex2;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent1, vUnspent2;
+    vIndex1.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hash, 1, 1, txA, 0, false), 10 * COIN));
+    vUnspent1.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, txA, 0), CAddressUnspentValue(10 * COIN, CScript(), 1)));
+    vIndex2.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hash, 2, 1, txB, 0, true), -10 * COIN));
+    vUnspent2.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, txA, 0), CAddressUnspentValue()));
+    vIndex2.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hash, 2, 1, txB, 1, false), 4 * COIN));
+    vUnspent2.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, txB, 1), CAddressUnspentValue(4 * COIN, CScript(), 2)));
+
+    BOOST_CHECK(pblocktree->UpdateAddressIndex(pindex1, vIndex1, vUnspent1, false, boost::bind(ChainIncludesBlock, _1, pindex1)));
+    BOOST_CHECK(pblocktree->UpdateAddressIndex(pindex2, vIndex2, vUnspent2, false, boost::bind(ChainIncludesBlock, _1, pindex2)));
+    CheckBalance(hash, 4 * COIN, 14 * COIN, 3);
+
+    // connecting a block again, as after a crash before the chainstate was flushed, counts it once
+    BOOST_CHECK(pblocktree->UpdateAddressIndex(pindex2, vIndex2, vUnspent2, false, boost::bind(ChainIncludesBlock, _1, pindex2)));
+    CheckBalance(hash, 4 * COIN, 14 * COIN, 3);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_PUBKEYHASH, hash, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txhash == txB);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vHistory;
+    BOOST_CHECK(pblocktree->ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, hash, vHistory, 2, 2));
+    BOOST_CHECK_EQUAL(vHistory.size(), 2U);
+
+    // newest first, skipping one
+    vHistory.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndexReverse(ADDRESS_INDEX_PUBKEYHASH, hash, vHistory, 1, 10));
+    BOOST_CHECK_EQUAL(vHistory.size(), 2U);
+    BOOST_CHECK(vHistory[0].first.spending);
+    BOOST_CHECK_EQUAL(vHistory[1].first.blockHeight, 1);
+
+    // disconnect block 2: restore the spent output, once however often it is replayed
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUndo;
+    vUndo.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, txB, 1), CAddressUnspentValue()));
+    vUndo.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, txA, 0), CAddressUnspentValue(10 * COIN, CScript(), 1)));
+    BOOST_CHECK(pblocktree->UpdateAddressIndex(pindex2, vIndex2, vUndo, true, boost::bind(ChainIncludesBlock, _1, pindex2)));
+    BOOST_CHECK(pblocktree->UpdateAddressIndex(pindex2, vIndex2, vUndo, true, boost::bind(ChainIncludesBlock, _1, pindex2)));
+    CheckBalance(hash, 10 * COIN, 10 * COIN, 1);
+    vUnspent.clear();
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_PUBKEYHASH, hash, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txhash == txA);
+
+    // a competing block 2 pays 3 more; replaying the old block 2 on either side leaves it alone
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vIndexFork;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspentFork;
+    vIndexFork.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hash, 2, 1, txC, 0, false), 3 * COIN));
+    vUnspentFork.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, txC, 0), CAddressUnspentValue(3 * COIN, CScript(), 2)));
+    BOOST_CHECK(pblocktree->UpdateAddressIndex(pindex2Fork, vIndexFork, vUnspentFork, false, boost::bind(ChainIncludesBlock, _1, pindex2Fork)));
+    BOOST_CHECK(pblocktree->UpdateAddressIndex(pindex2, vIndex2, vUndo, true, boost::bind(ChainIncludesBlock, _1, pindex2)));
+    BOOST_CHECK(pblocktree->UpdateAddressIndex(pindex2Fork, vIndexFork, vUnspentFork, false, boost::bind(ChainIncludesBlock, _1, pindex2Fork)));
+    CheckBalance(hash, 13 * COIN, 13 * COIN, 2);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUndoFork(1, std::make_pair(vUnspentFork[0].first, CAddressUnspentValue()));
+    BOOST_CHECK(pblocktree->UpdateAddressIndex(pindex2Fork, vIndexFork, vUndoFork, true, boost::bind(ChainIncludesBlock, _1, pindex2Fork)));
+    BOOST_CHECK(pblocktree->UpdateAddressIndex(pindex1, vIndex1, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >(1, std::make_pair(vUnspent1[0].first, CAddressUnspentValue())), true, boost::bind(ChainIncludesBlock, _1, pindex1)));
+    CAddressBalance balance;
+    BOOST_CHECK(pblocktree->ReadAddressBalance(ADDRESS_INDEX_PUBKEYHASH, hash, balance));
+    BOOST_CHECK(balance.IsEmpty());
+
+    CBlockIndex* vpindex[] = {pindex0, pindex1, pindex2, pindex2Fork};
+    for (unsigned int i = 0; i < 4; i++) {
+        uint256 hashBlock = vpindex[i]->GetBlockHash();
+        mapBlockIndex.erase(hashBlock);
+        delete vpindex[i];
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,167 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockencodings_tests)
+
+/** A block of a coinbase and three transactions spending each other */
+static CBlock BuildBlockTestCase()
+{
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+
+    block.vtx.resize(4);
+    block.vtx[0] = tx;
+    block.nVersion = 42;
+    block.hashPrevBlock = uint256S("0x2a");
+    block.nBits = 0x207fffff;
+
+    tx.vin[0].prevout.hash = uint256S("0x7");
+    tx.vin[0].prevout.n = 0;
+    block.vtx[1] = tx;
+
+    tx.vin.resize(10);
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        tx.vin[i].prevout.hash = block.vtx[1].GetHash();
+        tx.vin[i].prevout.n = i;
+    }
+    block.vtx[2] = tx;
+
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = block.vtx[2].GetHash();
+    block.vtx[3] = tx;
+
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+/** A compact block whose prefilled transactions and short IDs are set by hand */
+class TestHeaderAndShortIDs : public CBlockHeaderAndShortTxIDs
+{
+public:
+    explicit TestHeaderAndShortIDs(const CBlock& block) : CBlockHeaderAndShortTxIDs(block) {}
+
+    void SetTxs(size_t nPrefilledTxs, const CTransaction& tx, size_t nShortIDs)
+    {
+        prefilledtxn.clear();
+        for (size_t i = 0; i < nPrefilledTxs; i++)
+            prefilledtxn.push_back(PrefilledTransaction(i, tx));
+        shorttxids.assign(nShortIDs, 0);
+        for (size_t i = 0; i < nShortIDs; i++)
+            shorttxids[i] = i;
+    }
+};
+
+static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs cmpctblock2;
+    stream >> cmpctblock2;
+    BOOST_CHECK(stream.empty());
+    return cmpctblock2;
+}
+
+BOOST_AUTO_TEST_CASE(blockencodings_reconstruct)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlockTestCase();
+    pool.addUnchecked(block.vtx[2].GetHash(), CTxMemPoolEntry(block.vtx[2], 0, 0, 0.0, 1));
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), 4U);
+    BOOST_CHECK_EQUAL(cmpctblock.PrefilledTxCount(), 1U);
+
+    // The coinbase is prefilled, one transaction comes from the mempool
+    PartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, pool) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(partialBlock.IsTxAvailable(2));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(3));
+    BOOST_CHECK_EQUAL(partialBlock.nPrefilled, 1U);
+    BOOST_CHECK_EQUAL(partialBlock.nFromMempool, 1U);
+
+    // The request for the rest survives the wire
+    BlockTransactionsRequest req;
+    req.blockhash = block.GetHash();
+    req.indexes.push_back(1);
+    req.indexes.push_back(3);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req;
+    BlockTransactionsRequest req2;
+    stream >> req2;
+    BOOST_CHECK(req2.blockhash == req.blockhash);
+    BOOST_CHECK(req2.indexes == req.indexes);
+
+    CBlock block2;
+    std::vector<CTransaction> vtx_missing;
+    vtx_missing.push_back(block.vtx[1]);
+    BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_INVALID);
+
+    // The wrong transaction gives a different merkle root
+    vtx_missing.push_back(block.vtx[1]);
+    BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_FAILED);
+
+    vtx_missing[1] = block.vtx[3];
+    BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_OK);
+    BOOST_CHECK(block2.GetHash() == block.GetHash());
+    BOOST_CHECK(block2.BuildMerkleTree() == block.hashMerkleRoot);
+}
+
+BOOST_AUTO_TEST_CASE(blockencodings_from_mempool)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlockTestCase();
+    for (size_t i = 1; i < block.vtx.size(); i++)
+        pool.addUnchecked(block.vtx[i].GetHash(), CTxMemPoolEntry(block.vtx[i], 0, 0, 0.0, 1));
+
+    // Everything but the coinbase is in the mempool, no round trip needed
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    PartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, pool) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(partialBlock.nFromMempool, 3U);
+
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, std::vector<CTransaction>()) == READ_STATUS_OK);
+    BOOST_CHECK(block2.GetHash() == block.GetHash());
+    BOOST_CHECK(block2.BuildMerkleTree() == block.hashMerkleRoot);
+
+    // A compact block without any transaction is bogus
+    CBlock empty;
+    empty.nBits = 0x207fffff;
+    PartiallyDownloadedBlock partialEmpty;
+    BOOST_CHECK(partialEmpty.InitData(RoundTrip(CBlockHeaderAndShortTxIDs(empty)), pool) == READ_STATUS_INVALID);
+}
+
+BOOST_AUTO_TEST_CASE(blockencodings_index_bound)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlockTestCase();
+    TestHeaderAndShortIDs cmpctblock(block);
+
+    // Every 16 bit index prefilled leaves no slot for the short ID
+    cmpctblock.SetTxs(std::numeric_limits<uint16_t>::max() + 1, block.vtx[1], 1);
+    PartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, pool) == READ_STATUS_INVALID);
+
+    // The largest block that can be addressed is still fine
+    cmpctblock.SetTxs(std::numeric_limits<uint16_t>::max() - 1, block.vtx[1], 1);
+    BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), MAX_COMPACT_BLOCK_TXS);
+    PartiallyDownloadedBlock partialLargest;
+    BOOST_CHECK(partialLargest.InitData(cmpctblock, pool) == READ_STATUS_OK);
+    BOOST_CHECK(!partialLargest.IsTxAvailable(MAX_COMPACT_BLOCK_TXS - 1));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,172 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockreader.h"
+#include "chainparams.h"
+#include "main.h"
+#include "txdb.h"
+#include "utiltime.h"
+
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockreader_tests)
+
+/** Store the genesis block in block file nFile and index its coinbase */
+static CDiskBlockPos WriteTestBlock(int nFile, CBlock& block)
+{
+    block = Params().GenesisBlock();
+    CDiskBlockPos pos(nFile, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    vPos.push_back(std::make_pair(block.vtx[0].GetHash(), CDiskTxPos(pos, GetSizeOfCompactSize(block.vtx.size()))));
+    BOOST_REQUIRE(pblocktree->WriteTxIndex(vPos));
+    return pos;
+}
+
+BOOST_AUTO_TEST_CASE(blockreader_handle_cache)
+{
+    CBlock block, block2;
+    CDiskBlockPos pos1 = WriteTestBlock(901, block);
+    CDiskBlockPos pos2 = WriteTestBlock(902, block);
+    CDiskBlockPos pos3 = WriteTestBlock(903, block);
+
+    CBlockFileCache cache(2);
+    BOOST_CHECK(!cache.Get(CDiskBlockPos(904, 0), "blk"));
+
+    boost::shared_ptr<CBlockFileHandle> handle1 = cache.Get(pos1, "blk");
+    BOOST_CHECK(handle1);
+    BOOST_CHECK(cache.Get(pos1, "blk") == handle1);
+    cache.Get(pos2, "blk");
+    cache.Get(pos3, "blk");
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+
+    // an evicted handle keeps working for whoever still holds it
+    char ch;
+    BOOST_CHECK_EQUAL(handle1->Read(pos1.nPos, &ch, 1), 1U);
+    BOOST_CHECK(cache.Get(pos1, "blk") != handle1);
+
+    CBlockFileReader reader(pos3, "blk", SER_DISK, CLIENT_VERSION, cache);
+    reader >> block2;
+    BOOST_CHECK(block2.GetHash() == block.GetHash());
+    BOOST_CHECK_THROW(reader >> block2, std::ios_base::failure);
+
+    cache.Close(pos3.nFile);
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(blockreader_mmap)
+{
+    CBlock block, block2;
+    CDiskBlockPos pos1 = WriteTestBlock(911, block);
+    CDiskBlockPos pos2 = WriteTestBlock(912, block);
+
+    CBlockFileCache cache(4, true);
+    cache.SetAppendFile(pos2.nFile);
+
+    // finished files are mapped and read straight from the mapping
+    boost::shared_ptr<CBlockFileHandle> handle1 = cache.Get(pos1, "blk");
+    BOOST_CHECK(handle1->IsMapped());
+    BOOST_CHECK(handle1->GetMapped(pos1.nPos, 80) != NULL);
+    BOOST_CHECK(handle1->GetMapped(handle1->GetMapSize(), 1) == NULL);
+    CBlockFileReader reader1(pos1, "blk", SER_DISK, CLIENT_VERSION, cache);
+    reader1 >> block2;
+    BOOST_CHECK(block2.GetHash() == block.GetHash());
+
+    // the append file is not, and later appends are visible to its readers
+    BOOST_CHECK(!cache.Get(pos2, "blk")->IsMapped());
+    CDiskBlockPos posAppended(pos2.nFile, pos2.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION));
+    BOOST_REQUIRE(WriteBlockToDisk(block, posAppended));
+    CBlockFileReader reader2(posAppended, "blk", SER_DISK, CLIENT_VERSION, cache);
+    reader2 >> block2;
+    BOOST_CHECK(block2.GetHash() == block.GetHash());
+
+    // moving on to the next file lets the finished one be mapped
+    cache.SetAppendFile(pos2.nFile + 1);
+    BOOST_CHECK(cache.Get(pos2, "blk")->IsMapped());
+
+    CBlockFileCacheStats stats;
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nMapped, 2U);
+    BOOST_CHECK(stats.nHits > 0);
+    BOOST_CHECK(stats.nMisses > 0);
+
+    // without mapping everything still reads the same
+    CBlockFileCache cacheNoMap(4, false);
+    BOOST_CHECK(!cacheNoMap.Get(pos1, "blk")->IsMapped());
+    CBlockFileReader reader3(pos1, "blk", SER_DISK, CLIENT_VERSION, cacheNoMap);
+    reader3 >> block2;
+    BOOST_CHECK(block2.GetHash() == block.GetHash());
+}
+
+static void ReadWithoutLock(CDiskBlockPos pos, uint256 hash, bool* pfOk)
+{
+    CBlock block;
+    *pfOk = ReadBlockFromDisk(block, pos) && block.GetHash() == hash;
+}
+
+BOOST_AUTO_TEST_CASE(blockreader_read_outside_cs_main)
+{
+    CBlock block;
+    CDiskBlockPos pos = WriteTestBlock(905, block);
+
+    // A block read must not wait for cs_main
+    bool fOk = false;
+    {
+        LOCK(cs_main);
+        boost::thread reader(boost::bind(&ReadWithoutLock, pos, block.GetHash(), &fOk));
+        BOOST_CHECK(reader.timed_join(boost::posix_time::seconds(10)));
+    }
+    BOOST_CHECK(fOk);
+}
+
+static void RPCLoad(const uint256& txid, const CDiskBlockPos& pos, const uint256& hashBlock, int nIterations, int* pnFailures)
+{
+    for (int i = 0; i < nIterations; i++) {
+        CTransaction tx;
+        uint256 hashTxBlock;
+        CBlock block;
+        if (!GetTransaction(txid, tx, hashTxBlock, true) || tx.GetHash() != txid || hashTxBlock != hashBlock)
+            (*pnFailures)++;
+        if (!ReadBlockFromDisk(block, pos) || block.GetHash() != hashBlock)
+            (*pnFailures)++;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockreader_stress)
+{
+    CBlock block;
+    CDiskBlockPos pos = WriteTestBlock(906, block);
+    const uint256 txid = block.vtx[0].GetHash();
+
+    // Readers hammer getrawtransaction/getblock style lookups while this
+    // thread plays validation and keeps taking cs_main
+    const int nThreads = 4;
+    std::vector<int> vFailures(nThreads, 0);
+    boost::thread_group readers;
+    for (int i = 0; i < nThreads; i++)
+        readers.create_thread(boost::bind(&RPCLoad, boost::cref(txid), boost::cref(pos), block.GetHash(), 500, &vFailures[i]));
+
+    int64_t nMaxWait = 0;
+    int64_t nTotalWait = 0;
+    const int nRounds = 200;
+    for (int i = 0; i < nRounds; i++) {
+        int64_t nStart = GetTimeMicros();
+        {
+            LOCK(cs_main);
+            int64_t nWait = GetTimeMicros() - nStart;
+            nMaxWait = std::max(nMaxWait, nWait);
+            nTotalWait += nWait;
+        }
+        MilliSleep(1);
+    }
+    readers.join_all();
+
+    BOOST_TEST_MESSAGE(strprintf("cs_main wait under parallel RPC load: avg %dus, max %dus", nTotalWait / nRounds, nMaxWait));
+    for (int i = 0; i < nThreads; i++)
+        BOOST_CHECK_EQUAL(vFailures[i], 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
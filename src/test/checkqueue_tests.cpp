@@ -0,0 +1,145 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "crypto/sha256.h"
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+/** A check that hashes nRounds times, counts its runs and returns fOk */
+struct CTestCheck {
+    std::atomic<unsigned int>* pnRun;
+    unsigned int nRounds;
+    bool fOk;
+
+    CTestCheck() : pnRun(NULL), nRounds(0), fOk(true) {}
+    CTestCheck(std::atomic<unsigned int>* pnRunIn, unsigned int nRoundsIn, bool fOkIn) : pnRun(pnRunIn), nRounds(nRoundsIn), fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        unsigned char hash[CSHA256::OUTPUT_SIZE] = {};
+        for (unsigned int i = 0; i < nRounds; i++)
+            CSHA256().Write(hash, sizeof(hash)).Finalize(hash);
+        if (pnRun)
+            (*pnRun)++;
+        return fOk;
+    }
+
+    void swap(CTestCheck& other)
+    {
+        std::swap(pnRun, other.pnRun);
+        std::swap(nRounds, other.nRounds);
+        std::swap(fOk, other.fOk);
+    }
+};
+
+/** Queue nTx transactions of nInputs checks each, the way ConnectBlock does */
+template <typename Queue>
+static void AddBlock(Queue& queue, std::atomic<unsigned int>* pnRun, unsigned int nTx, unsigned int nInputs, unsigned int nRounds)
+{
+    for (unsigned int i = 0; i < nTx; i++) {
+        std::vector<CTestCheck> vChecks;
+        for (unsigned int j = 0; j < nInputs; j++)
+            vChecks.push_back(CTestCheck(pnRun, nRounds, true));
+        queue.Add(vChecks);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_ok)
+{
+    // Master alone, with workers, and with more workers than queues
+    const int nWorkerCounts[] = {0, 3, 5};
+    BOOST_FOREACH (int nWorkers, nWorkerCounts) {
+        CCheckQueue<CTestCheck> queue(128, 2);
+        boost::thread_group workers;
+        for (int i = 0; i < nWorkers; i++)
+            workers.create_thread(boost::bind(&CCheckQueue<CTestCheck>::Thread, &queue));
+
+        for (int nBlock = 0; nBlock < 10; nBlock++) {
+            std::atomic<unsigned int> nRun(0);
+            {
+                CCheckQueueControl<CTestCheck> control(&queue);
+                AddBlock(control, &nRun, 200 * nBlock, 1 + nBlock % 3, 1);
+                BOOST_CHECK(control.Wait());
+            }
+            BOOST_CHECK_EQUAL(nRun.load(), 200U * nBlock * (1 + nBlock % 3));
+            BOOST_CHECK(queue.IsIdle());
+        }
+
+        // The controller waits for the checks when it goes out of scope
+        std::atomic<unsigned int> nRun(0);
+        {
+            CCheckQueueControl<CTestCheck> control(&queue);
+            AddBlock(control, &nRun, 1000, 2, 1);
+        }
+        BOOST_CHECK_EQUAL(nRun.load(), 2000U);
+        BOOST_CHECK(queue.IsIdle());
+
+        workers.interrupt_all();
+        workers.join_all();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    CCheckQueue<CTestCheck> queue(128);
+    boost::thread_group workers;
+    for (int i = 0; i < 3; i++)
+        workers.create_thread(boost::bind(&CCheckQueue<CTestCheck>::Thread, &queue));
+
+    // A failure anywhere fails the whole batch, whether or not it comes last
+    for (unsigned int nFail = 0; nFail < 1000; nFail += 333) {
+        std::atomic<unsigned int> nRun(0);
+        CCheckQueueControl<CTestCheck> control(&queue);
+        for (unsigned int i = 0; i < 1000; i++) {
+            std::vector<CTestCheck> vChecks(1, CTestCheck(&nRun, 1, i != nFail));
+            control.Add(vChecks);
+        }
+        BOOST_CHECK(!control.Wait());
+        BOOST_CHECK(queue.IsIdle());
+    }
+
+    // The queue is reset for the next block
+    std::atomic<unsigned int> nRun(0);
+    {
+        CCheckQueueControl<CTestCheck> control(&queue);
+        AddBlock(control, &nRun, 100, 3, 1);
+        BOOST_CHECK(control.Wait());
+    }
+    BOOST_CHECK_EQUAL(nRun.load(), 300U);
+
+    workers.interrupt_all();
+    workers.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_early_abort)
+{
+    CCheckQueue<CTestCheck> queue(128);
+    boost::thread_group workers;
+    for (int i = 0; i < 3; i++)
+        workers.create_thread(boost::bind(&CCheckQueue<CTestCheck>::Thread, &queue));
+
+    // Once the failing check ran, the expensive ones behind it are skipped
+    std::atomic<unsigned int> nRun(0);
+    CCheckQueueControl<CTestCheck> control(&queue);
+    std::vector<CTestCheck> vChecks(1, CTestCheck(&nRun, 1, false));
+    control.Add(vChecks);
+    for (int i = 0; i < 1000 && nRun == 0; i++)
+        MilliSleep(1);
+    AddBlock(control, &nRun, 1000, 10, 100);
+    BOOST_CHECK(!control.Wait());
+    BOOST_CHECK(nRun.load() < 10001U);
+    BOOST_TEST_MESSAGE(strprintf("checks run after a failure: %u of 10001", nRun.load()));
+
+    workers.interrupt_all();
+    workers.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
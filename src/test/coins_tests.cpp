@@ -175,4 +175,105 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+BOOST_AUTO_TEST_CASE(coins_cache_fetched_test)
+{
+    CCoinsViewTest base;
+    uint256 txid = GetRandHash();
+    {
+        CCoinsViewCache writer(&base);
+        {
+            CCoinsModifier coins = writer.ModifyCoins(txid);
+            coins->vout.resize(2);
+            coins->vout[0].nValue = 42;
+            coins->vout[1].nValue = 43;
+            coins->nHeight = 5;
+        }
+        BOOST_CHECK(writer.Flush());
+    }
+
+    // Coins read from the base on the side end up cached as if they had been looked up
+    CCoinsViewCache cache(&base);
+    BOOST_CHECK(cache.GetBackend() == &base);
+    BOOST_CHECK(!cache.HaveCoinsInCache(txid));
+    CCoins coins;
+    BOOST_CHECK(cache.GetBackend()->GetCoins(txid, coins));
+    cache.AddFetchedCoins(txid, coins);
+    BOOST_CHECK(cache.HaveCoinsInCache(txid));
+    const CCoins* cached = cache.AccessCoins(txid);
+    BOOST_CHECK(cached && cached->nHeight == 5 && cached->vout.size() == 2 && cached->vout[1].nValue == 43);
+
+    // They never replace what the cache already has
+    cache.ModifyCoins(txid)->Spend(1);
+    CCoins stale;
+    BOOST_CHECK(base.GetCoins(txid, stale));
+    cache.AddFetchedCoins(txid, stale);
+    BOOST_CHECK(!cache.AccessCoins(txid)->IsAvailable(1));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(base.GetCoins(txid, coins) && !coins.IsAvailable(1));
+}
+
+BOOST_AUTO_TEST_CASE(coins_cache_writeback_test)
+{
+    CCoinsViewTest base;
+    CCoinsViewCache cache(&base);
+    size_t nEmptyUsage = cache.DynamicMemoryUsage();
+
+    // 100 transactions created at heights 0-99, with scripts of growing size
+    std::vector<uint256> vTxid;
+    for (int i = 0; i < 100; i++) {
+        vTxid.push_back(GetRandHash());
+        CCoinsModifier coins = cache.ModifyCoins(vTxid.back());
+        coins->vout.resize(2);
+        coins->vout[0].nValue = 1;
+        coins->vout[0].scriptPubKey = CScript() << std::vector<unsigned char>(i * 10, 1);
+        coins->vout[1].nValue = 2;
+        coins->nHeight = i;
+    }
+    size_t nUsage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > nEmptyUsage + 100 * 10 * 99 / 2);
+
+    // Changes made through a child cache are accounted for in the parent
+    {
+        CCoinsViewCache child(&cache);
+        for (int i = 0; i < 10; i++)
+            child.ModifyCoins(vTxid[i])->vout[0].scriptPubKey = CScript() << std::vector<unsigned char>(1000, 1);
+        BOOST_CHECK(child.Flush());
+    }
+    BOOST_CHECK(cache.DynamicMemoryUsage() > nUsage + 10 * 900);
+
+    // Spend all of the first 20 transactions, and half of the others
+    for (int i = 0; i < 100; i++) {
+        CCoinsModifier coins = cache.ModifyCoins(vTxid[i]);
+        coins->Spend(1);
+        if (i < 20)
+            coins->Spend(0);
+    }
+
+    // Writing back keeps the unspent entries and drops the spent ones
+    BOOST_CHECK(cache.WriteBack());
+    for (int i = 0; i < 100; i++) {
+        CCoins coins;
+        BOOST_CHECK_EQUAL(base.GetCoins(vTxid[i], coins) && !coins.IsPruned(), i >= 20);
+        BOOST_CHECK_EQUAL(cache.HaveCoinsInCache(vTxid[i]), i >= 20);
+    }
+
+    // Trimming drops the coins created longest ago, but never unwritten changes
+    cache.ModifyCoins(vTxid[20])->Spend(0);
+    nUsage = cache.DynamicMemoryUsage();
+    cache.Trim(nEmptyUsage + (nUsage - nEmptyUsage) / 2);
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= nEmptyUsage + (nUsage - nEmptyUsage) / 2);
+    BOOST_CHECK(cache.HaveCoinsInCache(vTxid[20]));
+    BOOST_CHECK(!cache.HaveCoinsInCache(vTxid[21]));
+    BOOST_CHECK(cache.HaveCoinsInCache(vTxid[99]));
+    cache.Trim(0);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+    BOOST_CHECK(cache.DynamicMemoryUsage() < nEmptyUsage + 4096);
+
+    // What was dropped is read again from the base
+    BOOST_CHECK(cache.AccessCoins(vTxid[50]) && cache.AccessCoins(vTxid[50])->IsAvailable(0));
+    BOOST_CHECK(cache.Flush());
+    CCoins coins;
+    BOOST_CHECK(!base.GetCoins(vTxid[20], coins) || coins.IsPruned());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,350 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "random.h"
+#include "streams.h"
+#include "tinyformat.h"
+#include "txdb.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/** In-memory coins database, optionally with the layout of one record per transaction of earlier versions */
+class CCoinsViewTestDB : public CCoinsViewDB
+{
+public:
+    bool fLegacy;
+
+    CCoinsViewTestDB(bool fLegacyIn) : CCoinsViewDB(1 << 23, true), fLegacy(fLegacyIn) {}
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const
+    {
+        if (!fLegacy)
+            return CCoinsViewDB::GetCoins(txid, coins);
+        return db.Read(std::make_pair('c', txid), coins);
+    }
+
+    bool HaveCoins(const uint256& txid) const
+    {
+        if (!fLegacy)
+            return CCoinsViewDB::HaveCoins(txid);
+        return db.Exists(std::make_pair('c', txid));
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    {
+        if (!fLegacy)
+            return CCoinsViewDB::BatchWrite(mapCoins, hashBlock);
+        CLevelDBBatch batch;
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+                continue;
+            if (it->second.coins.IsPruned())
+                batch.Erase(std::make_pair('c', it->first));
+            else
+                batch.Write(std::make_pair('c', it->first), it->second.coins);
+        }
+        mapCoins.clear();
+        batch.Write('B', hashBlock);
+        return db.WriteBatch(batch);
+    }
+
+    bool WriteVersion(int nVersion)
+    {
+        return db.Write('V', nVersion);
+    }
+
+    /** Number of records whose key starts with chType, and the bytes of their keys and values */
+    size_t CountRecords(char chType, size_t& nBytes)
+    {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+        size_t nRecords = 0;
+        nBytes = 0;
+        for (pcursor->Seek(leveldb::Slice(&chType, 1)); pcursor->Valid() && pcursor->key()[0] == chType; pcursor->Next()) {
+            nRecords++;
+            nBytes += pcursor->key().size() + pcursor->value().size();
+        }
+        return nRecords;
+    }
+};
+
+/** A hash from insecure_rand, so that it can be made deterministic */
+uint256 InsecureHash()
+{
+    uint256 hash;
+    for (unsigned char* p = hash.begin(); p != hash.end(); p++)
+        *p = insecure_rand();
+    return hash;
+}
+
+CCoins RandomCoins(unsigned int nOutputs, int nHeight)
+{
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = nHeight;
+    coins.fCoinStake = nOutputs > 2;
+    coins.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        coins.vout[i].nValue = 1 + insecure_rand() % 100000;
+        std::vector<unsigned char> vchKeyId(20);
+        for (unsigned int j = 0; j < vchKeyId.size(); j++)
+            vchKeyId[j] = insecure_rand();
+        coins.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vchKeyId << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    return coins;
+}
+
+/** Whether the statistics db keeps match those of a scan of its records */
+bool CheckStats(const CCoinsViewTestDB& db, CCoinsStats& stats)
+{
+    CCoinsStats statsScanned;
+    if (!db.GetStats(stats) || !db.ScanStats(statsScanned))
+        return false;
+    return stats.nTransactions == statsScanned.nTransactions && stats.nTransactionOutputs == statsScanned.nTransactionOutputs &&
+           stats.nTotalAmount == statsScanned.nTotalAmount && stats.hashOutputs == statsScanned.hashOutputs;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(coinsdb_tests)
+
+BOOST_AUTO_TEST_CASE(coinsdb_outputs)
+{
+    CCoinsViewTestDB db(false);
+    uint256 txid = GetRandHash();
+    CCoins coins = RandomCoins(20, 10);
+    {
+        CCoinsViewCache cache(&db);
+        *cache.ModifyCoins(txid) = coins;
+        BOOST_CHECK(cache.Flush());
+    }
+    size_t nBytes;
+    BOOST_CHECK_EQUAL(db.CountRecords('C', nBytes), 20U);
+    CCoinsStats stats;
+    BOOST_CHECK(CheckStats(db, stats));
+    BOOST_CHECK_EQUAL(stats.nTransactions, 1U);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 20U);
+    BOOST_CHECK_EQUAL(stats.nSerializedSize, nBytes);
+    CAmount nTotal = 0;
+    for (unsigned int n = 0; n < coins.vout.size(); n++)
+        nTotal += coins.vout[n].nValue;
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, nTotal);
+    CCoins read;
+    BOOST_CHECK(db.GetCoins(txid, read) && read == coins);
+    BOOST_CHECK(db.HaveCoins(txid));
+    BOOST_CHECK(!db.HaveCoins(GetRandHash()));
+
+    // Spending outputs erases their records, trailing ones included
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(txid);
+            for (unsigned int n = 0; n < 20; n++) {
+                if (n % 3 == 0 || n >= 15) {
+                    modifier->Spend(n);
+                    coins.Spend(n);
+                }
+            }
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    {
+        CCoinsViewCache cache(&db);
+        cache.ModifyCoins(txid)->Spend(4);
+        coins.Spend(4);
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(db.GetCoins(txid, read) && read == coins);
+    BOOST_CHECK_EQUAL(read.vout.size(), 15U);
+    BOOST_CHECK_EQUAL(db.CountRecords('C', nBytes), 9U);
+    BOOST_CHECK(CheckStats(db, stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 9U);
+    BOOST_CHECK_EQUAL(stats.nSerializedSize, nBytes);
+    uint256 hashOutputs = stats.hashOutputs;
+
+    // A transaction connected again at another height gets its outputs rewritten
+    coins.nHeight = 11;
+    {
+        CCoinsViewCache cache(&db);
+        *cache.ModifyCoins(txid) = coins;
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(db.GetCoins(txid, read) && read == coins);
+    BOOST_CHECK_EQUAL(read.nHeight, 11);
+    BOOST_CHECK_EQUAL(db.CountRecords('C', nBytes), 9U);
+    BOOST_CHECK(CheckStats(db, stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 9U);
+    BOOST_CHECK(stats.hashOutputs != hashOutputs);
+
+    // Spending them all leaves nothing behind
+    {
+        CCoinsViewCache cache(&db);
+        cache.ModifyCoins(txid)->Clear();
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!db.GetCoins(txid, read));
+    BOOST_CHECK(!db.HaveCoins(txid));
+    BOOST_CHECK_EQUAL(db.CountRecords('C', nBytes), 0U);
+    BOOST_CHECK(CheckStats(db, stats));
+    BOOST_CHECK_EQUAL(stats.nTransactions, 0U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 0);
+    CCoinsStats statsEmpty;
+    BOOST_CHECK(CCoinsViewTestDB(false).GetStats(statsEmpty));
+    BOOST_CHECK(stats.hashOutputs == statsEmpty.hashOutputs);
+}
+
+/**
+ * Connect a synthetic chain of nBlocks blocks to db. Every block has a
+ * coinstake paying out to 30 outputs, and 20 transactions each spending one
+ * output of an earlier payout into 2 outputs. The cache is flushed after every
+ * block, so the spent coins are read from the database.
+ */
+static int64_t ConnectSyntheticChain(CCoinsViewTestDB& db, int nBlocks)
+{
+    seed_insecure_rand(true);
+    std::vector<uint256> vPayouts;
+    int64_t nStart = GetTimeMicros();
+    for (int nHeight = 1; nHeight <= nBlocks; nHeight++) {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 20 && !vPayouts.empty(); i++) {
+            const uint256& txidSpent = vPayouts[insecure_rand() % vPayouts.size()];
+            {
+                CCoinsModifier coins = cache.ModifyCoins(txidSpent);
+                for (unsigned int n = 0; n < coins->vout.size(); n++) {
+                    if (coins->IsAvailable(n)) {
+                        coins->Spend(n);
+                        break;
+                    }
+                }
+            }
+            *cache.ModifyCoins(InsecureHash()) = RandomCoins(2, nHeight);
+        }
+        uint256 txidPayout = InsecureHash();
+        *cache.ModifyCoins(txidPayout) = RandomCoins(30, nHeight);
+        vPayouts.push_back(txidPayout);
+        cache.SetBestBlock(InsecureHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    return GetTimeMicros() - nStart;
+}
+
+BOOST_AUTO_TEST_CASE(coinsdb_upgrade)
+{
+    // The same chain connected with both layouts
+    const int nBlocks = 300;
+    CCoinsViewTestDB legacy(true);
+    int64_t nLegacyTime = ConnectSyntheticChain(legacy, nBlocks);
+    size_t nLegacyBytes;
+    size_t nLegacyRecords = legacy.CountRecords('c', nLegacyBytes);
+    CCoinsViewTestDB outputs(false);
+    int64_t nOutputsTime = ConnectSyntheticChain(outputs, nBlocks);
+    size_t nOutputsBytes;
+    size_t nOutputsRecords = outputs.CountRecords('C', nOutputsBytes);
+    BOOST_TEST_MESSAGE(strprintf("%d blocks, one record per transaction: %.1fms, %u records, %u key and value bytes", nBlocks, nLegacyTime * 0.001, nLegacyRecords, nLegacyBytes));
+    BOOST_TEST_MESSAGE(strprintf("%d blocks, one record per output:      %.1fms, %u records, %u key and value bytes", nBlocks, nOutputsTime * 0.001, nOutputsRecords, nOutputsBytes));
+
+    // Upgrading the first gives the second
+    size_t nBytes;
+    legacy.fLegacy = false;
+    BOOST_CHECK(legacy.Upgrade());
+    BOOST_CHECK_EQUAL(legacy.CountRecords('c', nBytes), 0U);
+    BOOST_CHECK_EQUAL(legacy.CountRecords('C', nBytes), nOutputsRecords);
+    BOOST_CHECK_EQUAL(nBytes, nOutputsBytes);
+    CCoinsStats statsUpgraded, statsOutputs;
+    BOOST_CHECK(CheckStats(legacy, statsUpgraded));
+    BOOST_CHECK(CheckStats(outputs, statsOutputs));
+    BOOST_CHECK(statsUpgraded.hashOutputs == statsOutputs.hashOutputs);
+    BOOST_CHECK_EQUAL(statsUpgraded.nTransactions, statsOutputs.nTransactions);
+    BOOST_CHECK_EQUAL(statsUpgraded.nTransactionOutputs, nOutputsRecords);
+    BOOST_CHECK_EQUAL(statsUpgraded.nTotalAmount, statsOutputs.nTotalAmount);
+
+    // The serialized hash takes a scan of its own, which agrees with that of the statistics
+    CCoinsStats statsHashed, statsScanned;
+    BOOST_CHECK(legacy.HashStats(statsHashed));
+    BOOST_CHECK(outputs.ScanStats(statsScanned));
+    BOOST_CHECK(statsHashed.hashSerialized != uint256(0));
+    BOOST_CHECK(statsHashed.hashSerialized == statsScanned.hashSerialized);
+    BOOST_CHECK(statsHashed.hashOutputs == statsUpgraded.hashOutputs);
+
+    // Upgrading again does nothing
+    BOOST_CHECK(legacy.Upgrade());
+    BOOST_CHECK_EQUAL(legacy.CountRecords('C', nBytes), nOutputsRecords);
+
+    // Records an earlier version wrote since are not mixed in
+    legacy.fLegacy = true;
+    ConnectSyntheticChain(legacy, 1);
+    legacy.fLegacy = false;
+    BOOST_CHECK(!legacy.Upgrade());
+    BOOST_CHECK_EQUAL(legacy.CountRecords('C', nBytes), nOutputsRecords);
+
+    // Nor are those of a later version read
+    BOOST_CHECK(outputs.Upgrade());
+    BOOST_CHECK(outputs.WriteVersion(COINS_DB_VERSION + 1));
+    BOOST_CHECK(!outputs.Upgrade());
+    seed_insecure_rand();
+}
+
+BOOST_AUTO_TEST_CASE(coinsdb_snapshot)
+{
+    CCoinsViewTestDB db(false);
+    ConnectSyntheticChain(db, 50);
+    seed_insecure_rand();
+    CCoinsStats stats;
+    BOOST_CHECK(CheckStats(db, stats));
+    size_t nBytes;
+    size_t nRecords = db.CountRecords('C', nBytes);
+
+    // Outputs written from a snapshot of the database are not those written after it
+    CAutoFile file(tmpfile(), SER_DISK, CLIENT_VERSION);
+    const leveldb::Snapshot* snapshot = db.GetSnapshot();
+    {
+        CCoinsViewCache cache(&db);
+        *cache.ModifyCoins(GetRandHash()) = RandomCoins(3, 51);
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    CCoinsStats statsSnapshot;
+    BOOST_CHECK(db.GetSnapshotStats(snapshot, statsSnapshot));
+    BOOST_CHECK(statsSnapshot.hashOutputs == stats.hashOutputs);
+    BOOST_CHECK(db.DumpOutputs(snapshot, file));
+    db.ReleaseSnapshot(snapshot);
+    long nFileSize = ftell(file.Get());
+
+    // Loading them gives the same records, and the statistics along with them
+    CCoinsViewTestDB loaded(false);
+    rewind(file.Get());
+    BOOST_CHECK(loaded.LoadOutputs(file, stats));
+    BOOST_CHECK_EQUAL(ftell(file.Get()), nFileSize);
+    CCoinsStats statsLoaded;
+    BOOST_CHECK(CheckStats(loaded, statsLoaded));
+    BOOST_CHECK(statsLoaded.hashOutputs == stats.hashOutputs);
+    BOOST_CHECK(loaded.GetBestBlock() == stats.hashBlock);
+    size_t nLoadedBytes;
+    BOOST_CHECK_EQUAL(loaded.CountRecords('C', nLoadedBytes), nRecords);
+    BOOST_CHECK_EQUAL(nLoadedBytes, nBytes);
+
+    // Not into a database that has outputs already
+    rewind(file.Get());
+    BOOST_CHECK(!loaded.LoadOutputs(file, stats));
+
+    // Outputs that do not match the statistics leave nothing behind
+    CCoinsViewTestDB corrupted(false);
+    CCoinsStats statsWrong = stats;
+    statsWrong.nTotalAmount++;
+    rewind(file.Get());
+    BOOST_CHECK(!corrupted.LoadOutputs(file, statsWrong));
+    BOOST_CHECK_EQUAL(corrupted.CountRecords('C', nBytes), 0U);
+    statsWrong = stats;
+    statsWrong.nTransactions++;
+    rewind(file.Get());
+    BOOST_CHECK_THROW(corrupted.LoadOutputs(file, statsWrong), std::ios_base::failure);
+    BOOST_CHECK_EQUAL(corrupted.CountRecords('C', nBytes), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,147 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+#include "random.h"
+#include "utiltime.h"
+
+#include <atomic>
+#include <map>
+
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/** Read-only view over a map, counting its lookups */
+class CCoinsViewMap : public CCoinsView
+{
+public:
+    std::map<uint256, CCoins> mapCoins;
+    mutable std::atomic<unsigned int> nReads;
+
+    CCoinsViewMap() : nReads(0) {}
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const
+    {
+        nReads++;
+        std::map<uint256, CCoins>::const_iterator it = mapCoins.find(txid);
+        if (it == mapCoins.end())
+            return false;
+        coins = it->second;
+        return true;
+    }
+
+    bool HaveCoins(const uint256& txid) const { return mapCoins.count(txid) > 0; }
+};
+
+/** Wait for the prefetcher to have read nCount transactions */
+void WaitForReads(CCoinsPrefetcher& prefetcher, uint64_t nCount)
+{
+    for (int i = 0; i < 10000; i++) {
+        CCoinsPrefetchStats stats;
+        prefetcher.GetStats(stats);
+        if (stats.nRead >= nCount)
+            return;
+        MilliSleep(1);
+    }
+}
+}
+
+BOOST_AUTO_TEST_SUITE(coinsprefetch_tests)
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_take)
+{
+    CCoinsViewMap base;
+    std::vector<uint256> vTxid;
+    for (int i = 0; i < 100; i++) {
+        vTxid.push_back(GetRandHash());
+        CCoins& coins = base.mapCoins[vTxid.back()];
+        coins.vout.resize(1 + i % 3);
+        coins.vout[0].nValue = i + 1;
+        coins.nHeight = i;
+    }
+
+    CCoinsPrefetcher prefetcher;
+    prefetcher.SetBackend(&base);
+    boost::thread_group threads;
+    for (int i = 0; i < 2; i++)
+        threads.create_thread(boost::bind(&CCoinsPrefetcher::Thread, &prefetcher));
+
+    // Half of the transactions read ahead, plus some the database does not have
+    std::vector<uint256> vRequest(vTxid.begin(), vTxid.begin() + 50);
+    for (int i = 0; i < 10; i++)
+        vRequest.push_back(GetRandHash());
+    prefetcher.Request(vRequest);
+    WaitForReads(prefetcher, vRequest.size());
+
+    // Those already read are not queued again
+    prefetcher.Request(std::vector<uint256>(vTxid.begin(), vTxid.begin() + 50));
+    CCoinsPrefetchStats stats;
+    prefetcher.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nRequested, vRequest.size());
+    BOOST_CHECK_EQUAL(stats.nReady, 50U);
+
+    // What was read ends up in the cache without another lookup, the rest is left to read
+    CCoinsViewCache cache(&base);
+    std::vector<uint256> vTake = vTxid;
+    prefetcher.TakeInto(cache, vTake);
+    BOOST_CHECK_EQUAL(vTake.size(), 50U);
+    unsigned int nReads = base.nReads;
+    for (int i = 0; i < 50; i++) {
+        BOOST_CHECK(cache.HaveCoinsInCache(vTxid[i]));
+        const CCoins* coins = cache.AccessCoins(vTxid[i]);
+        BOOST_CHECK(coins && *coins == base.mapCoins[vTxid[i]]);
+    }
+    BOOST_CHECK_EQUAL(base.nReads, nReads);
+    for (int i = 50; i < 100; i++)
+        BOOST_CHECK(!cache.HaveCoinsInCache(vTxid[i]));
+
+    prefetcher.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nHits, 50U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 50U);
+    BOOST_CHECK_EQUAL(stats.nReady, 0U);
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_invalidate)
+{
+    CCoinsViewMap base;
+    uint256 txid = GetRandHash();
+    base.mapCoins[txid].vout.resize(1);
+    base.mapCoins[txid].vout[0].nValue = 1;
+
+    CCoinsPrefetcher prefetcher;
+    prefetcher.SetBackend(&base);
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&CCoinsPrefetcher::Thread, &prefetcher));
+
+    prefetcher.Request(std::vector<uint256>(1, txid));
+    WaitForReads(prefetcher, 1);
+
+    // After a database write nothing read before is handed out
+    base.mapCoins[txid].vout[0].nValue = 2;
+    prefetcher.Invalidate();
+    CCoinsViewCache cache(&base);
+    std::vector<uint256> vTake(1, txid);
+    prefetcher.TakeInto(cache, vTake);
+    BOOST_CHECK_EQUAL(vTake.size(), 1U);
+    BOOST_CHECK(!cache.HaveCoinsInCache(txid));
+    BOOST_CHECK_EQUAL(cache.AccessCoins(txid)->vout[0].nValue, 2);
+
+    // Without a backend requests are ignored
+    prefetcher.SetBackend(NULL);
+    prefetcher.Request(std::vector<uint256>(1, GetRandHash()));
+    CCoinsPrefetchStats stats;
+    prefetcher.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nRequested, 1U);
+    BOOST_CHECK_EQUAL(stats.nQueued, 0U);
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
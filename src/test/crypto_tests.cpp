@@ -2,6 +2,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "crypto/muhash.h"
 #include "crypto/rfc6979_hmac_sha256.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
@@ -10,6 +11,8 @@
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
 #include "random.h"
+#include "streams.h"
+#include "uint256.h"
 #include "utilstrencodings.h"
 
 #include <vector>
@@ -282,4 +285,57 @@ BOOST_AUTO_TEST_CASE(rfc6979_hmac_sha256)
             ("7597887cbd76321f32e30440679a22cf7f8d9d2eac390e581fea091ce202ba94"));
 }
 
+static uint256 FinalizeMuHash(const MuHash3072& hash)
+{
+    uint256 result;
+    hash.Finalize(result.begin());
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    // An inverse times its number is one, and numbers from 2^3072 - 1103717 up are reduced
+    unsigned char data[Num3072::BYTE_SIZE], one[Num3072::BYTE_SIZE], reduced[Num3072::BYTE_SIZE];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = insecure_rand();
+    Num3072 num(data);
+    Num3072 product = num.GetInverse();
+    product.Multiply(num);
+    product.ToBytes(reduced);
+    Num3072().ToBytes(one);
+    BOOST_CHECK(memcmp(reduced, one, sizeof(one)) == 0);
+    memset(data, 0xff, sizeof(data));
+    Num3072(data).ToBytes(reduced);
+    BOOST_CHECK(reduced[0] == (1103716 & 0xff) && reduced[1] == ((1103716 >> 8) & 0xff) && reduced[2] == (1103716 >> 16));
+    for (size_t i = 3; i < sizeof(reduced); i++)
+        BOOST_CHECK(reduced[i] == 0);
+
+    // The order elements come and go in does not matter
+    uint256 elements[4];
+    for (int i = 0; i < 4; i++)
+        elements[i] = GetRandHash();
+    MuHash3072 a, b;
+    a.Insert(elements[0].begin(), 32).Insert(elements[1].begin(), 32).Insert(elements[2].begin(), 32);
+    b.Insert(elements[3].begin(), 32).Insert(elements[2].begin(), 32).Insert(elements[0].begin(), 32);
+    b.Remove(elements[3].begin(), 32).Insert(elements[1].begin(), 32);
+    BOOST_CHECK(FinalizeMuHash(a) == FinalizeMuHash(b));
+    BOOST_CHECK(FinalizeMuHash(a) != FinalizeMuHash(MuHash3072().Insert(elements[0].begin(), 32)));
+
+    // Nothing left is the empty set, and sets merge
+    MuHash3072 c;
+    c.Insert(elements[1].begin(), 32).Remove(elements[1].begin(), 32);
+    BOOST_CHECK(FinalizeMuHash(c) == FinalizeMuHash(MuHash3072()));
+    c.Insert(elements[0].begin(), 32);
+    MuHash3072 d;
+    d.Insert(elements[2].begin(), 32).Insert(elements[1].begin(), 32);
+    c *= d;
+    BOOST_CHECK(FinalizeMuHash(c) == FinalizeMuHash(a));
+
+    CDataStream ss(SER_DISK, 0);
+    ss << b;
+    MuHash3072 e;
+    ss >> e;
+    BOOST_CHECK(FinalizeMuHash(e) == FinalizeMuHash(a));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,125 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "random.h"
+
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(cuckoocache_tests)
+
+static std::vector<uint256> RandomDigests(size_t n)
+{
+    std::vector<uint256> v;
+    for (size_t i = 0; i < n; i++)
+        v.push_back(GetRandHash());
+    return v;
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_insert_contains)
+{
+    CCuckooCache cache;
+    BOOST_CHECK(!cache.Contains(GetRandHash(), false));
+
+    size_t nSlots = cache.Setup(1 << 16);
+    BOOST_CHECK_EQUAL(nSlots, cache.Size());
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= (1 << 16));
+
+    // Half full, everything inserted is found and nothing else is
+    std::vector<uint256> vIn = RandomDigests(nSlots / 2);
+    std::vector<uint256> vOut = RandomDigests(nSlots / 2);
+    for (size_t i = 0; i < vIn.size(); i++)
+        cache.Insert(vIn[i]);
+    BOOST_CHECK_EQUAL(cache.CountUsed(), vIn.size());
+    for (size_t i = 0; i < vIn.size(); i++) {
+        BOOST_CHECK(cache.Contains(vIn[i], false));
+        BOOST_CHECK(!cache.Contains(vOut[i], false));
+    }
+
+    // Inserting again does not take another slot
+    cache.Insert(vIn[0]);
+    BOOST_CHECK_EQUAL(cache.CountUsed(), vIn.size());
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_erase)
+{
+    CCuckooCache cache;
+    size_t nSlots = cache.Setup(1 << 16);
+    std::vector<uint256> vIn = RandomDigests(nSlots / 2);
+    for (size_t i = 0; i < vIn.size(); i++)
+        cache.Insert(vIn[i]);
+
+    // Erased digests stay visible until their slot is taken
+    for (size_t i = 0; i < vIn.size() / 2; i++)
+        BOOST_CHECK(cache.Contains(vIn[i], true));
+    BOOST_CHECK_EQUAL(cache.CountUsed(), vIn.size() - vIn.size() / 2);
+    BOOST_CHECK(cache.Contains(vIn[0], false));
+
+    // New digests fill the erased slots first, the others survive
+    std::vector<uint256> vNew = RandomDigests(vIn.size() / 2);
+    for (size_t i = 0; i < vNew.size(); i++)
+        cache.Insert(vNew[i]);
+    size_t nKept = 0;
+    for (size_t i = vIn.size() / 2; i < vIn.size(); i++)
+        nKept += cache.Contains(vIn[i], false);
+    BOOST_CHECK_EQUAL(nKept, vIn.size() - vIn.size() / 2);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_overfill)
+{
+    CCuckooCache cache;
+    size_t nSlots = cache.Setup(1 << 16);
+
+    // Twice the capacity: the table stays bounded and keeps most of the recent digests
+    std::vector<uint256> vIn = RandomDigests(nSlots * 2);
+    for (size_t i = 0; i < vIn.size(); i++)
+        cache.Insert(vIn[i]);
+    BOOST_CHECK(cache.CountUsed() <= nSlots);
+    BOOST_CHECK(cache.CountUsed() > nSlots * 9 / 10);
+
+    size_t nFound = 0;
+    for (size_t i = vIn.size() - nSlots / 4; i < vIn.size(); i++)
+        nFound += cache.Contains(vIn[i], false);
+    BOOST_CHECK(nFound > nSlots / 4 * 7 / 10);
+}
+
+static void LookupWhileInserting(CCuckooCache* cache, const std::vector<uint256>* vIn, const std::vector<uint256>* vOut, size_t* pnFalsePositives, size_t* pnFound)
+{
+    for (int n = 0; n < 20; n++) {
+        for (size_t i = 0; i < vOut->size(); i++)
+            *pnFalsePositives += cache->Contains((*vOut)[i], false);
+        for (size_t i = 0; i < vIn->size(); i++)
+            *pnFound += cache->Contains((*vIn)[i], false);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_concurrent_lookups)
+{
+    CCuckooCache cache;
+    size_t nSlots = cache.Setup(1 << 16);
+    std::vector<uint256> vIn = RandomDigests(nSlots / 4);
+    std::vector<uint256> vOut = RandomDigests(nSlots / 4);
+    std::vector<uint256> vLater = RandomDigests(nSlots / 2);
+    for (size_t i = 0; i < vIn.size(); i++)
+        cache.Insert(vIn[i]);
+
+    // Readers never find what was not inserted, while a writer keeps inserting
+    const int nThreads = 4;
+    std::vector<size_t> vFalsePositives(nThreads, 0);
+    std::vector<size_t> vFound(nThreads, 0);
+    boost::thread_group readers;
+    for (int i = 0; i < nThreads; i++)
+        readers.create_thread(boost::bind(&LookupWhileInserting, &cache, &vIn, &vOut, &vFalsePositives[i], &vFound[i]));
+    for (size_t i = 0; i < vLater.size(); i++)
+        cache.Insert(vLater[i]);
+    readers.join_all();
+
+    for (int i = 0; i < nThreads; i++) {
+        BOOST_CHECK_EQUAL(vFalsePositives[i], 0U);
+        BOOST_CHECK(vFound[i] > 0);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
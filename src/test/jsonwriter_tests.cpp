@@ -0,0 +1,147 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonwriter.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+BOOST_AUTO_TEST_SUITE(jsonwriter_tests)
+
+static bool AppendChunk(std::vector<std::string>* pvChunks, const std::string& strChunk)
+{
+    pvChunks->push_back(strChunk);
+    return true;
+}
+
+static bool RefuseChunk(int* pnCalls, const std::string&)
+{
+    ++*pnCalls;
+    return false;
+}
+
+/** Write {"a\"b":[1,"x\n",{},[]],"c":{"d":null,"e":true},"f":[{"g":1.5}]} */
+static void WriteSample(CJSONWriter& writer)
+{
+    writer.BeginObject();
+    writer.Key("a\"b");
+    writer.BeginArray();
+    writer.Value(1);
+    writer.Value("x\n");
+    writer.BeginObject();
+    writer.End();
+    writer.BeginArray();
+    writer.End();
+    writer.End();
+    writer.Key("c");
+    writer.BeginObject();
+    writer.Pair("d", NullUniValue);
+    writer.Pair("e", true);
+    writer.End();
+    writer.Key("f");
+    writer.BeginArray();
+    writer.BeginObject();
+    writer.Pair("g", 1.5);
+    writer.End();
+    writer.End();
+    writer.End();
+}
+
+static UniValue Sample()
+{
+    UniValue inner(UniValue::VARR);
+    inner.push_back(1);
+    inner.push_back("x\n");
+    inner.push_back(UniValue(UniValue::VOBJ));
+    inner.push_back(UniValue(UniValue::VARR));
+    UniValue c(UniValue::VOBJ);
+    c.push_back(Pair("d", NullUniValue));
+    c.push_back(Pair("e", true));
+    UniValue g(UniValue::VOBJ);
+    g.push_back(Pair("g", 1.5));
+    UniValue f(UniValue::VARR);
+    f.push_back(g);
+    UniValue sample(UniValue::VOBJ);
+    sample.push_back(Pair("a\"b", inner));
+    sample.push_back(Pair("c", c));
+    sample.push_back(Pair("f", f));
+    return sample;
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_text)
+{
+    std::vector<std::string> vChunks;
+    CJSONTextWriter writer(boost::bind(&AppendChunk, &vChunks, _1));
+    WriteSample(writer);
+    // Nothing reaches the sink before the default flush size or Flush
+    BOOST_CHECK(vChunks.empty());
+    BOOST_CHECK(!writer.Flushed());
+    BOOST_CHECK_EQUAL(writer.Buffered(), Sample().write());
+
+    BOOST_CHECK(writer.Flush());
+    BOOST_CHECK(writer.Flushed());
+    BOOST_CHECK(writer.Buffered().empty());
+    BOOST_CHECK_EQUAL(vChunks.size(), 1U);
+    BOOST_CHECK_EQUAL(vChunks[0], Sample().write());
+
+    // Top-level values other than objects
+    CJSONTextWriter scalar(boost::bind(&AppendChunk, &vChunks, _1));
+    scalar.Value(42);
+    BOOST_CHECK_EQUAL(scalar.Buffered(), "42");
+    CJSONTextWriter empty(boost::bind(&AppendChunk, &vChunks, _1));
+    empty.BeginArray();
+    empty.End();
+    BOOST_CHECK_EQUAL(empty.Buffered(), "[]");
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_chunks)
+{
+    std::vector<std::string> vChunks;
+    CJSONTextWriter writer(boost::bind(&AppendChunk, &vChunks, _1), 4);
+    WriteSample(writer);
+    writer.Write("\n");
+    writer.Flush();
+
+    BOOST_CHECK(vChunks.size() > 1);
+    std::string strText;
+    for (unsigned int i = 0; i < vChunks.size(); i++) {
+        BOOST_CHECK(!vChunks[i].empty());
+        strText += vChunks[i];
+    }
+    BOOST_CHECK_EQUAL(strText, Sample().write() + "\n");
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_failed_sink)
+{
+    int nCalls = 0;
+    CJSONTextWriter writer(boost::bind(&RefuseChunk, &nCalls, _1), 4);
+    BOOST_CHECK(!writer.Failed());
+    WriteSample(writer);
+    BOOST_CHECK(writer.Failed());
+    BOOST_CHECK(!writer.Flush());
+    // The sink is not asked again once it refused
+    BOOST_CHECK_EQUAL(nCalls, 1);
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_univalue)
+{
+    UniValue result;
+    CUniValueWriter writer(result);
+    WriteSample(writer);
+    BOOST_CHECK(!writer.Failed());
+    BOOST_CHECK_EQUAL(result.write(), Sample().write());
+
+    UniValue scalar;
+    CUniValueWriter scalarWriter(scalar);
+    scalarWriter.Value("s");
+    BOOST_CHECK(scalar.isStr());
+    BOOST_CHECK_EQUAL(scalar.get_str(), "s");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -187,19 +187,19 @@ BOOST_AUTO_TEST_CASE(json_parse_errors)
     BOOST_CHECK_THROW(ParseNonRFCJSONValue("3J98t1WpEZ73CNmQviecrnyiWrnqRhWNL"), std::runtime_error);
 }
 
-BOOST_AUTO_TEST_CASE(rpc_boostasiotocnetaddr)
+BOOST_AUTO_TEST_CASE(rpc_convert_object_params)
 {
-    // Check IPv4 addresses
-    BOOST_CHECK_EQUAL(BoostAsioToCNetAddr(boost::asio::ip::address::from_string("1.2.3.4")).ToString(), "1.2.3.4");
-    BOOST_CHECK_EQUAL(BoostAsioToCNetAddr(boost::asio::ip::address::from_string("127.0.0.1")).ToString(), "127.0.0.1");
-    // Check IPv6 addresses
-    BOOST_CHECK_EQUAL(BoostAsioToCNetAddr(boost::asio::ip::address::from_string("::1")).ToString(), "::1");
-    BOOST_CHECK_EQUAL(BoostAsioToCNetAddr(boost::asio::ip::address::from_string("123:4567:89ab:cdef:123:4567:89ab:cdef")).ToString(),
-                                         "123:4567:89ab:cdef:123:4567:89ab:cdef");
-    // v4 compatible must be interpreted as IPv4
-    BOOST_CHECK_EQUAL(BoostAsioToCNetAddr(boost::asio::ip::address::from_string("::0:127.0.0.1")).ToString(), "127.0.0.1");
-    // v4 mapped must be interpreted as IPv4
-    BOOST_CHECK_EQUAL(BoostAsioToCNetAddr(boost::asio::ip::address::from_string("::ffff:127.0.0.1")).ToString(), "127.0.0.1");
+    // An address stays a string, an object of addresses is parsed
+    vector<string> vArgs;
+    vArgs.push_back("175tWpb8K1S7NmH4Zx6rewF9WQrcZv245W");
+    vArgs.push_back("20");
+    UniValue params = RPCConvertValues("getaddresshistory", vArgs);
+    BOOST_CHECK(params[0].isStr());
+    BOOST_CHECK(params[1].isNum());
+    vArgs[0] = "{\"addresses\":[\"175tWpb8K1S7NmH4Zx6rewF9WQrcZv245W\"]}";
+    params = RPCConvertValues("getaddresshistory", vArgs);
+    BOOST_CHECK(params[0].isObject());
+    BOOST_CHECK_EQUAL(find_value(params[0].get_obj(), "addresses")[0].get_str(), "175tWpb8K1S7NmH4Zx6rewF9WQrcZv245W");
 }
 
 BOOST_AUTO_TEST_SUITE_END()
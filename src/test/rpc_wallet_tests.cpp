@@ -125,6 +125,20 @@ BOOST_AUTO_TEST_CASE(rpc_wallet)
     BOOST_CHECK_NO_THROW(CallRPC("listreceivedbyaccount 0 true"));
     BOOST_CHECK_THROW(CallRPC("listreceivedbyaccount 0 true extra"), runtime_error);
 
+    /*********************************
+     * 		listtransactions
+     *********************************/
+    BOOST_CHECK_NO_THROW(CallRPC("listtransactions"));
+    BOOST_CHECK_NO_THROW(CallRPC("listtransactions * 10 0 false 5:0"));
+    BOOST_CHECK_THROW(CallRPC("listtransactions * 10 0 false not_a_cursor"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("listtransactions * 10 0 false 5:0 extra"), runtime_error);
+
+    /*********************************
+     * 		listsinceblock
+     *********************************/
+    BOOST_CHECK_NO_THROW(CallRPC("listsinceblock"));
+    BOOST_CHECK_NO_THROW(CallRPC("listsinceblock " + chainActive.Genesis()->GetBlockHash().GetHex()));
+
     /*********************************
      * 		getrawchangeaddress
      *********************************/
@@ -99,4 +99,41 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(chainsnapshot_test)
+{
+    std::vector<uint256> vHashMain(10000);
+    std::vector<CBlockIndex> vBlocksMain(10000);
+    for (unsigned int i=0; i<vBlocksMain.size(); i++) {
+        vHashMain[i] = i;
+        vBlocksMain[i].nHeight = i;
+        vBlocksMain[i].pprev = i ? &vBlocksMain[i - 1] : NULL;
+        vBlocksMain[i].phashBlock = &vHashMain[i];
+        vBlocksMain[i].BuildSkip();
+    }
+
+    CChain chain;
+    chain.SetTip(&vBlocksMain[7999]);
+    CChainSnapshot snapshot(chain.Tip());
+
+    // Moving the chain on does not change what the snapshot sees.
+    chain.SetTip(&vBlocksMain.back());
+
+    BOOST_CHECK(snapshot.Tip() == &vBlocksMain[7999]);
+    BOOST_CHECK_EQUAL(snapshot.Height(), 7999);
+    for (int n=0; n<100; n++) {
+        int nHeight = insecure_rand() % 8000;
+        BOOST_CHECK(snapshot[nHeight] == chain[nHeight]);
+        BOOST_CHECK(snapshot.Contains(&vBlocksMain[nHeight]));
+        if (nHeight < 7999)
+            BOOST_CHECK(snapshot.Next(&vBlocksMain[nHeight]) == &vBlocksMain[nHeight + 1]);
+    }
+    BOOST_CHECK(snapshot[8000] == NULL);
+    BOOST_CHECK(snapshot[-1] == NULL);
+    BOOST_CHECK(!snapshot.Contains(&vBlocksMain[8000]));
+    BOOST_CHECK(snapshot.Next(&vBlocksMain[7999]) == NULL);
+
+    BOOST_CHECK_EQUAL(CChainSnapshot(NULL).Height(), -1);
+    BOOST_CHECK(CChainSnapshot(NULL)[0] == NULL);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,63 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "spentindex.h"
+#include "txdb.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(spentindex_tests)
+
+BOOST_AUTO_TEST_CASE(spentindex_serialize)
+{
+    CTxOut txout(50 * COIN, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 7) << OP_EQUALVERIFY << OP_CHECKSIG);
+    CSpentIndexValue value(uint256(3), 2, 1000, 900, txout);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << value;
+    // the output is stored compressed: a P2PKH script takes 21 bytes instead of 26
+    BOOST_CHECK(ss.size() < 32 + 3 * 2 + 8 + 26);
+
+    CSpentIndexValue value2;
+    ss >> value2;
+    BOOST_CHECK(value2.txid == uint256(3));
+    BOOST_CHECK_EQUAL(value2.inputIndex, 2U);
+    BOOST_CHECK_EQUAL(value2.blockHeight, 1000);
+    BOOST_CHECK_EQUAL(value2.prevHeight, 900);
+    BOOST_CHECK(value2.prevout == txout);
+    BOOST_CHECK(CSpentIndexValue().IsNull());
+}
+
+BOOST_AUTO_TEST_CASE(spentindex_update_and_resolve)
+{
+    COutPoint outpoint(uint256(77), 1);
+    CTxOut txout(12 * COIN, CScript() << OP_TRUE);
+
+    std::vector<std::pair<COutPoint, CSpentIndexValue> > vSpent;
+    vSpent.push_back(std::make_pair(outpoint, CSpentIndexValue(uint256(78), 0, 5, 0, txout)));
+    BOOST_CHECK(pblocktree->UpdateSpentIndex(vSpent));
+
+    CSpentIndexValue value;
+    BOOST_CHECK(pblocktree->ReadSpentIndex(outpoint, value));
+    BOOST_CHECK(value.txid == uint256(78));
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(COutPoint(uint256(77), 0), value));
+
+    // the output is gone from the coins cache, the spent index still resolves it
+    bool fSpentIndexOld = fSpentIndex;
+    fSpentIndex = true;
+    CTxOut txoutRet;
+    CBlockIndex* pindex = NULL;
+    BOOST_CHECK(GetPrevOut(outpoint, txoutRet, pindex));
+    BOOST_CHECK(txoutRet == txout);
+    BOOST_CHECK(pindex == chainActive.Genesis());
+    fSpentIndex = fSpentIndexOld;
+
+    // disconnecting erases the record
+    vSpent[0].second.SetNull();
+    BOOST_CHECK(pblocktree->UpdateSpentIndex(vSpent));
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(outpoint, value));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
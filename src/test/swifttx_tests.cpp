@@ -0,0 +1,133 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "swifttx.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(swifttx_tests)
+
+static CTransaction LockRequest(const COutPoint& prevout1, const COutPoint& prevout2, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    tx.vin[0].prevout = prevout1;
+    tx.vin[1].prevout = prevout2;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    return tx;
+}
+
+static CConsensusVote Vote(const uint256& txHash, uint32_t nMasternode, int nBlockHeight)
+{
+    CConsensusVote vote;
+    vote.vinMasternode = CTxIn(COutPoint(uint256(1000), nMasternode));
+    vote.txHash = txHash;
+    vote.nBlockHeight = nBlockHeight;
+    return vote;
+}
+
+BOOST_AUTO_TEST_CASE(swifttx_votes)
+{
+    CTxLockManager manager;
+    CTransaction tx = LockRequest(COutPoint(uint256(1), 0), COutPoint(uint256(2), 0), 1);
+
+    BOOST_CHECK(!manager.HasRequest(tx.GetHash()));
+    manager.AddRejectedRequest(tx);
+    BOOST_CHECK(manager.HasRequest(tx.GetHash()));
+    BOOST_CHECK(manager.IsRejected(tx.GetHash()));
+    CTransaction txRet;
+    BOOST_CHECK(!manager.GetRequest(tx.GetHash(), txRet));
+    manager.AddRequest(tx);
+    BOOST_CHECK(manager.GetRequest(tx.GetHash(), txRet));
+    BOOST_CHECK(txRet.GetHash() == tx.GetHash());
+
+    // no lock yet
+    BOOST_CHECK_EQUAL(manager.GetSignatures(tx.GetHash()), -1);
+    BOOST_CHECK_EQUAL(manager.GetLockHeight(tx.GetHash()), 0);
+
+    // a lock created by votes has no height to count them at
+    int nSignatures = 0;
+    BOOST_CHECK(manager.AddLockVote(Vote(tx.GetHash(), 0, 100), nSignatures));
+    BOOST_CHECK_EQUAL(nSignatures, -1);
+    BOOST_CHECK_EQUAL(manager.GetLockHeight(tx.GetHash()), 0);
+    BOOST_CHECK(!manager.CreateLock(tx.GetHash(), 100));
+    BOOST_CHECK_EQUAL(manager.GetLockHeight(tx.GetHash()), 100);
+    BOOST_CHECK_EQUAL(manager.GetSignatures(tx.GetHash()), 1);
+
+    // one vote per masternode, whatever the height it is for
+    BOOST_CHECK(!manager.AddLockVote(Vote(tx.GetHash(), 0, 100), nSignatures));
+    BOOST_CHECK(!manager.AddLockVote(Vote(tx.GetHash(), 0, 101), nSignatures));
+    BOOST_CHECK(manager.AddLockVote(Vote(tx.GetHash(), 1, 101), nSignatures));
+    BOOST_CHECK_EQUAL(nSignatures, 1);
+    for (uint32_t n = 2; n <= SWIFTTX_SIGNATURES_REQUIRED; n++)
+        BOOST_CHECK(manager.AddLockVote(Vote(tx.GetHash(), n, 100), nSignatures));
+    BOOST_CHECK_EQUAL(nSignatures, SWIFTTX_SIGNATURES_REQUIRED);
+
+    // votes are known by hash
+    CConsensusVote vote = Vote(tx.GetHash(), 0, 100);
+    BOOST_CHECK(manager.AddVote(vote));
+    BOOST_CHECK(!manager.AddVote(vote));
+    BOOST_CHECK(manager.HasVote(vote.GetHash()));
+    CConsensusVote voteRet;
+    BOOST_CHECK(manager.GetVote(vote.GetHash(), voteRet));
+    BOOST_CHECK(voteRet.vinMasternode == vote.vinMasternode);
+}
+
+BOOST_AUTO_TEST_CASE(swifttx_conflicts_and_expiry)
+{
+    SetMockTime(1500000000);
+    CTxLockManager manager;
+    CTransaction tx1 = LockRequest(COutPoint(uint256(1), 0), COutPoint(uint256(2), 0), 1);
+    CTransaction tx2 = LockRequest(COutPoint(uint256(2), 0), COutPoint(uint256(3), 0), 2);
+    CTransaction tx3 = LockRequest(COutPoint(uint256(4), 0), COutPoint(uint256(5), 0), 3);
+
+    uint256 hashLocked;
+    BOOST_CHECK(!manager.GetConflictingLock(tx2, hashLocked));
+
+    BOOST_CHECK(manager.CreateLock(tx1.GetHash(), 100));
+    manager.AddRequest(tx1);
+    manager.LockInputs(tx1);
+    BOOST_CHECK(!manager.GetConflictingLock(tx1, hashLocked));
+    BOOST_CHECK(manager.GetConflictingLock(tx2, hashLocked));
+    BOOST_CHECK(hashLocked == tx1.GetHash());
+    BOOST_CHECK(!manager.CheckForConflictingLocks(tx1));
+
+    // tx2 does not take over the input tx1 locked
+    BOOST_CHECK(manager.CreateLock(tx2.GetHash(), 100));
+    manager.AddRequest(tx2);
+    manager.LockInputs(tx2);
+    BOOST_CHECK(manager.GetConflictingLock(tx2, hashLocked));
+    BOOST_CHECK(hashLocked == tx1.GetHash());
+
+    BOOST_CHECK(manager.CreateLock(tx3.GetHash(), 100));
+    manager.AddRequest(tx3);
+    manager.LockInputs(tx3);
+
+    // nothing expires within the hour
+    SetMockTime(1500000000 + 60 * 30);
+    manager.CheckAndRemove();
+    BOOST_CHECK(manager.IsTimedOut(tx1.GetHash()));
+    BOOST_CHECK(manager.HasRequest(tx1.GetHash()));
+
+    // conflicting locks cancel out at once, leaving the others
+    BOOST_CHECK(manager.CheckForConflictingLocks(tx2));
+    SetMockTime(1500000000 + 60 * 30 + 1);
+    manager.CheckAndRemove();
+    BOOST_CHECK(!manager.HasRequest(tx1.GetHash()));
+    BOOST_CHECK(!manager.HasRequest(tx2.GetHash()));
+    BOOST_CHECK_EQUAL(manager.GetSignatures(tx1.GetHash()), -1);
+    BOOST_CHECK(!manager.GetConflictingLock(tx2, hashLocked));
+    BOOST_CHECK(manager.HasRequest(tx3.GetHash()));
+    BOOST_CHECK(manager.GetConflictingLock(LockRequest(COutPoint(uint256(5), 0), COutPoint(uint256(6), 0), 4), hashLocked));
+
+    SetMockTime(1500000000 + 60 * 60 + 1);
+    manager.CheckAndRemove();
+    BOOST_CHECK(!manager.HasRequest(tx3.GetHash()));
+    BOOST_CHECK(!manager.GetConflictingLock(LockRequest(COutPoint(uint256(5), 0), COutPoint(uint256(6), 0), 4), hashLocked));
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
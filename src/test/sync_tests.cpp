@@ -0,0 +1,77 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sync.h"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(sync_tests)
+
+static void LockAtSite(CCriticalSection* cs, CLockSite* psite)
+{
+    CCriticalBlock block(*cs, "cs", __FILE__, __LINE__, false, psite);
+}
+
+static void TryLockAtSite(CCriticalSection* cs, CLockSite* psite, bool* pfLocked)
+{
+    CCriticalBlock block(*cs, "cs", __FILE__, __LINE__, true, psite);
+    *pfLocked = block;
+}
+
+BOOST_AUTO_TEST_CASE(lockstats_counts)
+{
+    CCriticalSection cs;
+    static CLockSite site("cs", __FILE__, __LINE__);
+    std::vector<CLockSite*> vSites = GetLockSites();
+    BOOST_CHECK(std::find(vSites.begin(), vSites.end(), &site) != vSites.end());
+
+    // Nothing is counted while statistics are off
+    fLockStats = false;
+    LockAtSite(&cs, &site);
+    BOOST_CHECK_EQUAL(site.nAcquired.load(), 0U);
+
+    fLockStats = true;
+    LockAtSite(&cs, &site);
+    LockAtSite(&cs, &site);
+    BOOST_CHECK_EQUAL(site.nAcquired.load(), 2U);
+    BOOST_CHECK_EQUAL(site.nContended.load(), 0U);
+    BOOST_CHECK_EQUAL(site.vWaitHistogram[0].load(), 2U);
+    uint64_t nHolds = 0;
+    for (int i = 0; i < CLockSite::HISTOGRAM_BUCKETS; i++)
+        nHolds += site.vHoldHistogram[i].load();
+    BOOST_CHECK_EQUAL(nHolds, 2U);
+
+    // A thread waiting for the lock held here counts as contended
+    {
+        cs.lock();
+        bool fLocked = true;
+        boost::thread tryThread(boost::bind(TryLockAtSite, &cs, &site, &fLocked));
+        tryThread.join();
+        BOOST_CHECK(!fLocked);
+        BOOST_CHECK_EQUAL(site.nTriesFailed.load(), 1U);
+
+        boost::thread lockThread(boost::bind(LockAtSite, &cs, &site));
+        while (site.nWaiting.load() == 0)
+            boost::this_thread::yield();
+        cs.unlock();
+        lockThread.join();
+    }
+    BOOST_CHECK_EQUAL(site.nWaiting.load(), 0U);
+    BOOST_CHECK_EQUAL(site.nAcquired.load(), 3U);
+    BOOST_CHECK_EQUAL(site.nContended.load(), 1U);
+    BOOST_CHECK(site.nWaitNanos.load() > 0);
+
+    ResetLockStats();
+    BOOST_CHECK_EQUAL(site.nAcquired.load(), 0U);
+    BOOST_CHECK_EQUAL(site.nTriesFailed.load(), 0U);
+    BOOST_CHECK_EQUAL(site.nHoldNanos.load(), 0U);
+    BOOST_CHECK_EQUAL(site.vWaitHistogram[0].load(), 0U);
+    fLockStats = false;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
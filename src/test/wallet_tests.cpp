@@ -305,4 +305,128 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(wallet_tx_indexes)
+{
+    CWallet indexWallet;
+    LOCK2(cs_main, indexWallet.cs_wallet);
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(indexWallet.AddKeyPubKey(key, key.GetPubKey()));
+    CTxDestination dest = key.GetPubKey().GetID();
+    indexWallet.SetAddressBook(dest, "label", "receive");
+
+    // A payment to us in the genesis block, one in no block, and one not to us
+    uint256 hashes[3];
+    for (int i = 0; i < 3; i++) {
+        CMutableTransaction tx;
+        tx.nLockTime = i;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = CENT;
+        tx.vout[0].scriptPubKey = i < 2 ? GetScriptForDestination(dest) : CScript() << OP_TRUE;
+        CWalletTx wtx(&indexWallet, tx);
+        wtx.nOrderPos = i;
+        if (i == 0)
+            wtx.hashBlock = chainActive.Genesis()->GetBlockHash();
+        hashes[i] = wtx.GetHash();
+        indexWallet.mapWallet[hashes[i]] = wtx;
+    }
+    indexWallet.ReindexWalletTxs();
+
+    BOOST_CHECK_EQUAL(indexWallet.wtxOrdered.size(), 3U);
+    set<int64_t> setOurs;
+    setOurs.insert(0);
+    setOurs.insert(1);
+    BOOST_CHECK(indexWallet.mapAccountOrderPos["label"] == setOurs);
+    BOOST_CHECK(indexWallet.mapDestinationOrderPos[dest] == setOurs);
+    BOOST_CHECK_EQUAL(indexWallet.mapAccountOrderPos.count(""), 0U);
+    BOOST_CHECK_EQUAL(indexWallet.setWalletTxHeights.size(), 3U);
+    BOOST_CHECK(indexWallet.setWalletTxHeights.count(make_pair(0, hashes[0])));
+    BOOST_CHECK(indexWallet.setWalletTxHeights.count(make_pair(-1, hashes[1])));
+    BOOST_CHECK(indexWallet.setWalletTxHeights.count(make_pair(-1, hashes[2])));
+
+    // Relabelling the address files its transactions under the new account too
+    indexWallet.SetAddressBook(dest, "other", "");
+    BOOST_CHECK(indexWallet.mapAccountOrderPos["other"] == setOurs);
+
+    // A transaction leaving the active chain is refiled
+    CWalletTx& wtx = indexWallet.mapWallet[hashes[0]];
+    wtx.hashBlock = 0;
+    indexWallet.IndexWalletTx(wtx);
+    BOOST_CHECK_EQUAL(indexWallet.setWalletTxHeights.size(), 3U);
+    BOOST_CHECK(indexWallet.setWalletTxHeights.count(make_pair(-1, hashes[0])));
+}
+
+static void CheckBalances(const CWallet& balanceWallet)
+{
+    CAmount nBalance, nUnconfirmed, nImmature, nWatchOnly, nWatchUnconfirmed, nWatchImmature;
+    balanceWallet.GetBalances(nBalance, nUnconfirmed, nImmature, nWatchOnly, nWatchUnconfirmed, nWatchImmature);
+    BOOST_CHECK_EQUAL(nBalance, balanceWallet.GetBalance());
+    BOOST_CHECK_EQUAL(nUnconfirmed, balanceWallet.GetUnconfirmedBalance());
+    BOOST_CHECK_EQUAL(nImmature, balanceWallet.GetImmatureBalance());
+    BOOST_CHECK_EQUAL(nWatchOnly, balanceWallet.GetWatchOnlyBalance());
+    BOOST_CHECK_EQUAL(nWatchUnconfirmed, balanceWallet.GetUnconfirmedWatchOnlyBalance());
+    BOOST_CHECK_EQUAL(nWatchImmature, balanceWallet.GetImmatureWatchOnlyBalance());
+}
+
+BOOST_AUTO_TEST_CASE(wallet_get_balances)
+{
+    CWallet balanceWallet;
+    LOCK2(cs_main, balanceWallet.cs_wallet);
+    CKey key, watchKey;
+    key.MakeNewKey(true);
+    watchKey.MakeNewKey(true);
+    BOOST_CHECK(balanceWallet.AddKeyPubKey(key, key.GetPubKey()));
+    CScript watchScript = GetScriptForDestination(watchKey.GetPubKey().GetID());
+    BOOST_CHECK(balanceWallet.AddWatchOnly(watchScript));
+
+    // Confirmed, coinbase, in the mempool, watch-only confirmed and watch-only in the mempool
+    uint256 hashes[5];
+    for (int i = 0; i < 5; i++) {
+        CMutableTransaction tx;
+        tx.nLockTime = i;
+        if (i == 1)
+            tx.vin.resize(1);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = (i + 1) * CENT;
+        tx.vout[0].scriptPubKey = i < 3 ? GetScriptForDestination(key.GetPubKey().GetID()) : watchScript;
+        CWalletTx wtx(&balanceWallet, tx);
+        if (i == 2 || i == 4) {
+            mempool.addUnchecked(wtx.GetHash(), CTxMemPoolEntry(tx, 0, GetTime(), 0.0, 0));
+        } else {
+            wtx.hashBlock = chainActive.Genesis()->GetBlockHash();
+            wtx.nIndex = 0;
+            wtx.fMerkleVerified = true;
+        }
+        hashes[i] = wtx.GetHash();
+        balanceWallet.mapWallet[hashes[i]] = wtx;
+    }
+
+    CAmount nBalance, nUnconfirmed, nImmature, nWatchOnly, nWatchUnconfirmed, nWatchImmature;
+    balanceWallet.GetBalances(nBalance, nUnconfirmed, nImmature, nWatchOnly, nWatchUnconfirmed, nWatchImmature);
+    BOOST_CHECK_EQUAL(nBalance, 1 * CENT);
+    BOOST_CHECK_EQUAL(nImmature, 2 * CENT);
+    BOOST_CHECK_EQUAL(nUnconfirmed, 3 * CENT);
+    BOOST_CHECK_EQUAL(nWatchOnly, 4 * CENT);
+    BOOST_CHECK_EQUAL(nWatchUnconfirmed, 5 * CENT);
+    BOOST_CHECK_EQUAL(nWatchImmature, 0);
+    CheckBalances(balanceWallet);
+
+    // A pending transaction is summed again without the wallet reporting a change
+    mempool.clear();
+    CheckBalances(balanceWallet);
+    CWalletTx& wtxPending = balanceWallet.mapWallet[hashes[2]];
+    wtxPending.hashBlock = chainActive.Genesis()->GetBlockHash();
+    wtxPending.nIndex = 0;
+    wtxPending.fMerkleVerified = true;
+    CheckBalances(balanceWallet);
+
+    // A settled transaction is only counted again once the wallet reports it changed
+    CWalletTx& wtxSettled = balanceWallet.mapWallet[hashes[0]];
+    wtxSettled.hashBlock = 0;
+    wtxSettled.MarkDirty();
+    CheckBalances(balanceWallet);
+    balanceWallet.GetBalances(nBalance, nUnconfirmed, nImmature, nWatchOnly, nWatchUnconfirmed, nWatchImmature);
+    BOOST_CHECK_EQUAL(nBalance, 3 * CENT);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,22 +6,307 @@
 
 #include "txdb.h"
 
+#include "compressor.h"
+#include "crypto/common.h"
+#include "hash.h"
 #include "main.h"
 #include "pow.h"
+#include "ui_interface.h"
 #include "uint256.h"
+#include "utilmoneystr.h"
+#include "utxosnapshot.h"
 
+#include <atomic>
 #include <stdint.h>
+#include <string.h>
 
 #include <boost/thread.hpp>
 
 using namespace std;
 
-void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoins& coins)
+namespace
 {
-    if (coins.IsPruned())
-        batch.Erase(make_pair('c', hash));
-    else
-        batch.Write(make_pair('c', hash), coins);
+/** An unspent output as stored under its outpoint, along with what it shares with the other outputs of its transaction */
+class CDiskCoinsOutput
+{
+public:
+    int nTxVersion;
+    int nHeight;
+    bool fCoinBase;
+    bool fCoinStake;
+    CTxOut out;
+
+    CDiskCoinsOutput() : nTxVersion(0), nHeight(0), fCoinBase(false), fCoinStake(false) {}
+    CDiskCoinsOutput(const CCoins& coins, unsigned int n) : nTxVersion(coins.nVersion), nHeight(coins.nHeight), fCoinBase(coins.fCoinBase), fCoinStake(coins.fCoinStake), out(coins.vout[n]) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return ::GetSerializeSize(VARINT(nTxVersion), nType, nVersion) +
+               ::GetSerializeSize(VARINT(nHeight * 4 + (fCoinBase ? 1 : 0) + (fCoinStake ? 2 : 0)), nType, nVersion) +
+               ::GetSerializeSize(CTxOutCompressor(REF(out)), nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, VARINT(nTxVersion), nType, nVersion);
+        ::Serialize(s, VARINT(nHeight * 4 + (fCoinBase ? 1 : 0) + (fCoinStake ? 2 : 0)), nType, nVersion);
+        ::Serialize(s, CTxOutCompressor(REF(out)), nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned int nCode = 0;
+        ::Unserialize(s, VARINT(nTxVersion), nType, nVersion);
+        ::Unserialize(s, VARINT(nCode), nType, nVersion);
+        nHeight = nCode / 4;
+        fCoinBase = nCode & 1;
+        fCoinStake = (nCode & 2) != 0;
+        ::Unserialize(s, REF(CTxOutCompressor(out)), nType, nVersion);
+    }
+};
+}
+
+/** Key of an unspent output. The outpoints of a transaction share the 'C' + txid prefix. */
+static std::pair<char, COutPoint> CoinsOutputKey(const uint256& txid, unsigned int n)
+{
+    return make_pair('C', COutPoint(txid, n));
+}
+
+/**
+ * Read the outputs of txid with pcursor, into coins with the spent ones null.
+ * Returns false when the database has none.
+ */
+static bool ReadCoinsOutputs(leveldb::Iterator* pcursor, const uint256& txid, CCoins& coins)
+{
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << CoinsOutputKey(txid, 0);
+    leveldb::Slice slPrefix(&ssPrefix[0], 1 + sizeof(uint256));
+
+    coins.Clear();
+    bool fFound = false;
+    for (pcursor->Seek(slPrefix); pcursor->Valid() && pcursor->key().starts_with(slPrefix); pcursor->Next()) {
+        leveldb::Slice slKey = pcursor->key();
+        CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+        std::pair<char, COutPoint> key;
+        ssKey >> key;
+        leveldb::Slice slValue = pcursor->value();
+        CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        CDiskCoinsOutput output;
+        ssValue >> output;
+
+        coins.nVersion = output.nTxVersion;
+        coins.nHeight = output.nHeight;
+        coins.fCoinBase = output.fCoinBase;
+        coins.fCoinStake = output.fCoinStake;
+        if (coins.vout.size() <= key.second.n)
+            coins.vout.resize(key.second.n + 1);
+        coins.vout[key.second.n] = output.out;
+        fFound = true;
+    }
+    HandleError(pcursor->status());
+    return fFound;
+}
+
+/**
+ * Find which outputs of txid the database has, into vStored, without
+ * decoding them, and whether they were all written for a transaction at the
+ * height and with the version and flags of coins. Those BatchWriteCoins will
+ * erase or rewrite are counted out of stats.
+ */
+static void ReadStoredOutputs(leveldb::Iterator* pcursor, const uint256& txid, const CCoins& coins, std::vector<bool>& vStored, bool& fSameTx, CCoinsDBStats& stats)
+{
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << CoinsOutputKey(txid, 0);
+    leveldb::Slice slPrefix(&ssPrefix[0], 1 + sizeof(uint256));
+
+    vStored.clear();
+    fSameTx = true;
+    for (pcursor->Seek(slPrefix); pcursor->Valid() && pcursor->key().starts_with(slPrefix); pcursor->Next()) {
+        unsigned int n = ReadLE32((const unsigned char*)pcursor->key().data() + slPrefix.size());
+        if (vStored.size() <= n)
+            vStored.resize(n + 1, false);
+        vStored[n] = true;
+
+        leveldb::Slice slValue = pcursor->value();
+        CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        int nTxVersion = 0;
+        unsigned int nCode = 0;
+        ssValue >> VARINT(nTxVersion) >> VARINT(nCode);
+        if (nTxVersion != coins.nVersion || nCode != (unsigned int)(coins.nHeight * 4 + (coins.fCoinBase ? 1 : 0) + (coins.fCoinStake ? 2 : 0)))
+            fSameTx = false;
+        if (!coins.IsAvailable(n))
+            stats.RemoveOutput(pcursor->key(), slValue);
+    }
+    HandleError(pcursor->status());
+
+    if (fSameTx)
+        return;
+    for (pcursor->Seek(slPrefix); pcursor->Valid() && pcursor->key().starts_with(slPrefix); pcursor->Next()) {
+        unsigned int n = ReadLE32((const unsigned char*)pcursor->key().data() + slPrefix.size());
+        if (coins.IsAvailable(n))
+            stats.RemoveOutput(pcursor->key(), pcursor->value());
+    }
+    HandleError(pcursor->status());
+}
+
+/**
+ * Queue the changes turning the outputs of txid the database has, vStored,
+ * into coins, and count those written into stats. Outputs never change, so
+ * one already stored is only rewritten when its transaction was connected
+ * again in a reorganization.
+ */
+static void BatchWriteCoins(CLevelDBBatch& batch, const uint256& txid, const CCoins& coins, const std::vector<bool>& vStored, bool fSameTx, CCoinsDBStats& stats)
+{
+    CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+    bool fWasStored = false;
+    for (unsigned int n = 0; n < std::max(coins.vout.size(), vStored.size()); n++) {
+        bool fStored = n < vStored.size() && vStored[n];
+        fWasStored |= fStored;
+        if (coins.IsAvailable(n)) {
+            if (!fStored || !fSameTx) {
+                ssRecord.clear();
+                ssRecord << CoinsOutputKey(txid, n);
+                size_t nKeySize = ssRecord.size();
+                ssRecord << CDiskCoinsOutput(coins, n);
+                leveldb::Slice slKey(&ssRecord[0], nKeySize);
+                leveldb::Slice slValue(&ssRecord[nKeySize], ssRecord.size() - nKeySize);
+                batch.Put(slKey, slValue);
+                stats.AddOutput(slKey, slValue);
+            }
+        } else if (fStored) {
+            batch.Erase(CoinsOutputKey(txid, n));
+        }
+    }
+    if (!fWasStored && !coins.IsPruned())
+        stats.nTransactions++;
+    else if (fWasStored && coins.IsPruned())
+        stats.nTransactions--;
+}
+
+/** Value of an output record, decoding no more of it than needed */
+static CAmount ReadOutputValue(const leveldb::Slice& slValue)
+{
+    CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+    int nTxVersion = 0;
+    unsigned int nCode = 0;
+    uint64_t nAmount = 0;
+    ssValue >> VARINT(nTxVersion) >> VARINT(nCode) >> VARINT(nAmount);
+    return CTxOutCompressor::DecompressAmount(nAmount);
+}
+
+void CCoinsDBStats::AddOutput(const leveldb::Slice& slKey, const leveldb::Slice& slValue)
+{
+    std::vector<unsigned char> vchRecord(slKey.data(), slKey.data() + slKey.size());
+    vchRecord.insert(vchRecord.end(), slValue.data(), slValue.data() + slValue.size());
+    hash.Insert(&vchRecord[0], vchRecord.size());
+    nTransactionOutputs++;
+    nSerializedSize += vchRecord.size();
+    nTotalAmount += ReadOutputValue(slValue);
+}
+
+void CCoinsDBStats::RemoveOutput(const leveldb::Slice& slKey, const leveldb::Slice& slValue)
+{
+    std::vector<unsigned char> vchRecord(slKey.data(), slKey.data() + slKey.size());
+    vchRecord.insert(vchRecord.end(), slValue.data(), slValue.data() + slValue.size());
+    hash.Remove(&vchRecord[0], vchRecord.size());
+    nTransactionOutputs--;
+    nSerializedSize -= vchRecord.size();
+    nTotalAmount -= ReadOutputValue(slValue);
+}
+
+CCoinsDBStats& CCoinsDBStats::operator+=(const CCoinsDBStats& other)
+{
+    nTransactions += other.nTransactions;
+    nTransactionOutputs += other.nTransactionOutputs;
+    nSerializedSize += other.nSerializedSize;
+    nTotalAmount += other.nTotalAmount;
+    hash *= other.hash;
+    return *this;
+}
+
+void CCoinsDBStats::GetCoinsStats(CCoinsStats& statsOut) const
+{
+    statsOut.hashBlock = hashBlock;
+    statsOut.nTransactions = nTransactions;
+    statsOut.nTransactionOutputs = nTransactionOutputs;
+    statsOut.nSerializedSize = nSerializedSize;
+    statsOut.nTotalAmount = nTotalAmount;
+    hash.Finalize(statsOut.hashOutputs.begin());
+}
+
+namespace
+{
+/** Number of ranges of txids, by their first byte, a scan of the outputs is split into */
+const int SCAN_RANGES = 16;
+
+/** A scan of the output records of a snapshot, which threads take ranges of until none is left */
+class COutputScan
+{
+public:
+    const CLevelDBWrapper& db;
+    const leveldb::Snapshot* snapshot;
+    std::vector<CCoinsDBStats> vStats;
+    std::atomic<int> nNextRange;
+    std::atomic<bool> fAbort;
+    std::atomic<bool> fFailed;
+
+    COutputScan(const CLevelDBWrapper& dbIn, const leveldb::Snapshot* snapshotIn) : db(dbIn), snapshot(snapshotIn), vStats(SCAN_RANGES), nNextRange(0), fAbort(false), fFailed(false) {}
+
+    void ScanRange(int nRange)
+    {
+        CCoinsDBStats& stats = vStats[nRange];
+        char chBegin[2] = {'C', (char)(nRange * 256 / SCAN_RANGES)};
+        unsigned int nEnd = (nRange + 1) * 256 / SCAN_RANGES;
+        boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewSnapshotIterator(snapshot));
+        unsigned char txid[sizeof(uint256)];
+        size_t nRecords = 0;
+        for (pcursor->Seek(leveldb::Slice(chBegin, sizeof(chBegin))); pcursor->Valid(); pcursor->Next()) {
+            leveldb::Slice slKey = pcursor->key();
+            if (slKey.size() < 1 + sizeof(txid) || slKey[0] != 'C' || (unsigned char)slKey[1] >= nEnd)
+                break;
+            // The outputs of a transaction are next to each other, and in the same range
+            if (nRecords++ == 0 || memcmp(txid, slKey.data() + 1, sizeof(txid)) != 0) {
+                memcpy(txid, slKey.data() + 1, sizeof(txid));
+                stats.nTransactions++;
+            }
+            stats.AddOutput(slKey, pcursor->value());
+            if (nRecords % 1000 == 0) {
+                if (fAbort)
+                    return;
+                boost::this_thread::interruption_point();
+            }
+        }
+        HandleError(pcursor->status());
+    }
+
+    void Thread()
+    {
+        try {
+            int nRange;
+            while (!fAbort && (nRange = nNextRange++) < SCAN_RANGES)
+                ScanRange(nRange);
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+            fFailed = true;
+            fAbort = true;
+        }
+    }
+};
+
+/** Snapshot of a database, released when going out of scope */
+class CDBSnapshot
+{
+private:
+    const CLevelDBWrapper& db;
+
+public:
+    const leveldb::Snapshot* snapshot;
+
+    CDBSnapshot(const CLevelDBWrapper& dbIn) : db(dbIn), snapshot(dbIn.GetSnapshot()) {}
+    ~CDBSnapshot() { db.ReleaseSnapshot(snapshot); }
+};
 }
 
 void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
@@ -29,18 +314,90 @@ void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+/**
+ * An iterator for one lookup, taken from those earlier lookups left when
+ * there is one. It is left for later lookups unless the database was
+ * written to in the meantime.
+ */
+class CCoinsViewDB::CCursorLease
+{
+private:
+    const CCoinsViewDB& view;
+    uint64_t nWrites;
+
+public:
+    leveldb::Iterator* pcursor;
+
+    CCursorLease(const CCoinsViewDB& viewIn) : view(viewIn), pcursor(NULL)
+    {
+        {
+            LOCK(view.cs_cursors);
+            nWrites = view.nWrites;
+            if (!view.vIdleCursors.empty()) {
+                pcursor = view.vIdleCursors.back();
+                view.vIdleCursors.pop_back();
+            }
+        }
+        if (!pcursor)
+            pcursor = view.db.NewCachingIterator();
+    }
+
+    ~CCursorLease()
+    {
+        {
+            LOCK(view.cs_cursors);
+            if (nWrites == view.nWrites) {
+                view.vIdleCursors.push_back(pcursor);
+                return;
+            }
+        }
+        delete pcursor;
+    }
+};
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe), nWrites(0)
+{
+    db.Read('S', stats);
+}
+
+CCoinsViewDB::CCoinsViewDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe) : db(path, nCacheSize, fMemory, fWipe), nWrites(0)
+{
+    db.Read('S', stats);
+}
+
+CCoinsViewDB::~CCoinsViewDB()
+{
+    ResetCursors();
+}
+
+void CCoinsViewDB::ResetCursors()
 {
+    std::vector<leveldb::Iterator*> vStale;
+    {
+        LOCK(cs_cursors);
+        nWrites++;
+        vStale.swap(vIdleCursors);
+    }
+    BOOST_FOREACH (leveldb::Iterator* pcursor, vStale)
+        delete pcursor;
 }
 
 bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
 {
-    return db.Read(make_pair('c', txid), coins);
+    CCursorLease cursor(*this);
+    return ReadCoinsOutputs(cursor.pcursor, txid, coins);
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256& txid) const
 {
-    return db.Exists(make_pair('c', txid));
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << CoinsOutputKey(txid, 0);
+    leveldb::Slice slPrefix(&ssPrefix[0], 1 + sizeof(uint256));
+    CCursorLease cursor(*this);
+    cursor.pcursor->Seek(slPrefix);
+    bool fFound = cursor.pcursor->Valid() && cursor.pcursor->key().starts_with(slPrefix);
+    HandleError(cursor.pcursor->status());
+    return fFound;
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const
@@ -54,22 +411,43 @@ uint256 CCoinsViewDB::GetBestBlock() const
 bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
 {
     CLevelDBBatch batch;
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewCachingIterator());
+    CCoinsDBStats statsNew;
+    {
+        LOCK(cs_stats);
+        statsNew = stats;
+    }
     size_t count = 0;
     size_t changed = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            // Only outputs that appear or go are written, which takes knowing
+            // those the database has, unless it has none of this transaction
+            std::vector<bool> vStored;
+            bool fSameTx = true;
+            if (!(it->second.flags & CCoinsCacheEntry::FRESH))
+                ReadStoredOutputs(pcursor.get(), it->first, it->second.coins, vStored, fSameTx, statsNew);
+            BatchWriteCoins(batch, it->first, it->second.coins, vStored, fSameTx, statsNew);
             changed++;
         }
         count++;
         CCoinsMap::iterator itOld = it++;
         mapCoins.erase(itOld);
     }
-    if (hashBlock != uint256(0))
+    if (hashBlock != uint256(0)) {
         BatchWriteHashBestChain(batch, hashBlock);
+        statsNew.hashBlock = hashBlock;
+    }
+    batch.Write('S', statsNew);
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    bool fWritten = db.WriteBatch(batch);
+    ResetCursors();
+    if (!fWritten)
+        return false;
+    LOCK(cs_stats);
+    stats = statsNew;
+    return true;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
@@ -115,70 +493,632 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read('l', nFile);
 }
 
-bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
+bool CCoinsViewDB::GetStats(CCoinsStats& statsOut) const
 {
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
+    CCoinsDBStats statsNow;
+    {
+        LOCK(cs_stats);
+        statsNow = stats;
+    }
+    statsNow.GetCoinsStats(statsOut);
+    BlockMap::const_iterator mi = mapBlockIndex.find(statsOut.hashBlock);
+    statsOut.nHeight = mi != mapBlockIndex.end() ? mi->second->nHeight : 0;
+    return true;
+}
 
+/** Add the coins of txid to the hash of the outputs in txid order */
+static void HashCoins(CHashWriter& ss, const uint256& txid, const CCoins& coins)
+{
+    ss << txid;
+    ss << VARINT(coins.nVersion);
+    ss << (coins.fCoinBase ? 'c' : 'n');
+    ss << VARINT(coins.nHeight);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        const CTxOut& out = coins.vout[i];
+        if (!out.IsNull()) {
+            ss << VARINT(i + 1);
+            ss << out;
+        }
+    }
+    ss << VARINT(0);
+}
+
+/**
+ * Hash the outputs of a snapshot one transaction after the other, which
+ * gives the hash_serialized of the records of whole transactions of
+ * earlier versions. Unlike the MuHash, it can only be had by a scan.
+ */
+static bool HashSerializedOutputs(const CLevelDBWrapper& db, const leveldb::Snapshot* snapshot, const uint256& hashBlock, uint256& hashRet)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewSnapshotIterator(snapshot));
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
-    ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
+    ss << hashBlock;
+    // The outputs of a transaction are next to each other, ordered by txid
+    uint256 txid;
+    CCoins coins;
+    size_t nRecords = 0;
+    for (pcursor->Seek(leveldb::Slice("C", 1)); pcursor->Valid() && pcursor->key().starts_with(leveldb::Slice("C", 1)); pcursor->Next()) {
+        if (++nRecords % 1000 == 0)
+            boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            std::pair<char, COutPoint> key;
+            ssKey >> key;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CDiskCoinsOutput output;
+            ssValue >> output;
+
+            if (key.second.hash != txid) {
+                if (!coins.vout.empty())
+                    HashCoins(ss, txid, coins);
+                txid = key.second.hash;
+                coins.Clear();
+                coins.nVersion = output.nTxVersion;
+                coins.nHeight = output.nHeight;
+                coins.fCoinBase = output.fCoinBase;
+                coins.fCoinStake = output.fCoinStake;
+            }
+            if (coins.vout.size() <= key.second.n)
+                coins.vout.resize(key.second.n + 1);
+            coins.vout[key.second.n] = output.out;
+        } catch (const std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    HandleError(pcursor->status());
+    if (!coins.vout.empty())
+        HashCoins(ss, txid, coins);
+    hashRet = ss.GetHash();
+    return true;
+}
+
+bool CCoinsViewDB::HashStats(CCoinsStats& statsOut) const
+{
+    int64_t nStart = GetTimeMillis();
+    CDBSnapshot snapshot(db);
+    CCoinsDBStats statsKept;
+    if (!db.Read('S', statsKept, snapshot.snapshot))
+        return error("%s : no statistics kept", __func__);
+    statsKept.GetCoinsStats(statsOut);
+    if (!HashSerializedOutputs(db, snapshot.snapshot, statsOut.hashBlock, statsOut.hashSerialized))
+        return false;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(statsOut.hashBlock);
+        statsOut.nHeight = mi != mapBlockIndex.end() ? mi->second->nHeight : 0;
+    }
+    LogPrint("coindb", "Hashed %u unspent outputs in %dms\n", statsOut.nTransactionOutputs, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CCoinsViewDB::ScanOutputs(const leveldb::Snapshot* snapshot, CCoinsDBStats& statsOut) const
+{
+    COutputScan scan(db, snapshot);
+    int nThreads = std::max(1, std::min(SCAN_RANGES, (int)boost::thread::hardware_concurrency()));
+    boost::thread_group workers;
+    for (int i = 1; i < nThreads; i++)
+        workers.create_thread(boost::bind(&COutputScan::Thread, &scan));
+    try {
+        scan.Thread();
+    } catch (const boost::thread_interrupted&) {
+        scan.fAbort = true;
+        workers.join_all();
+        throw;
+    }
+    workers.join_all();
+    if (scan.fFailed)
+        return false;
+
+    uint256 hashBlock;
+    if (!db.Read('B', hashBlock, snapshot))
+        hashBlock = uint256(0);
+    statsOut = CCoinsDBStats();
+    statsOut.hashBlock = hashBlock;
+    for (int i = 0; i < SCAN_RANGES; i++)
+        statsOut += scan.vStats[i];
+    return true;
+}
+
+bool CCoinsViewDB::ScanStats(CCoinsStats& statsOut) const
+{
+    int64_t nStart = GetTimeMillis();
+    CDBSnapshot snapshot(db);
+    CCoinsDBStats statsScanned, statsKept;
+    if (!db.Read('S', statsKept, snapshot.snapshot))
+        return error("%s : no statistics to check against", __func__);
+    if (!ScanOutputs(snapshot.snapshot, statsScanned))
+        return false;
+    statsScanned.GetCoinsStats(statsOut);
+    if (!HashSerializedOutputs(db, snapshot.snapshot, statsOut.hashBlock, statsOut.hashSerialized))
+        return false;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(statsOut.hashBlock);
+        statsOut.nHeight = mi != mapBlockIndex.end() ? mi->second->nHeight : 0;
+    }
+    LogPrint("coindb", "Scanned %u unspent outputs in %dms\n", statsOut.nTransactionOutputs, GetTimeMillis() - nStart);
+
+    CCoinsStats statsCheck;
+    statsKept.GetCoinsStats(statsCheck);
+    if (statsCheck.hashBlock != statsOut.hashBlock || statsCheck.nTransactions != statsOut.nTransactions ||
+        statsCheck.nTransactionOutputs != statsOut.nTransactionOutputs || statsCheck.nSerializedSize != statsOut.nSerializedSize ||
+        statsCheck.nTotalAmount != statsOut.nTotalAmount || statsCheck.hashOutputs != statsOut.hashOutputs)
+        return error("%s : statistics kept (%u transactions, %u outputs, %s, %s) differ from those scanned (%u transactions, %u outputs, %s, %s)", __func__,
+            statsCheck.nTransactions, statsCheck.nTransactionOutputs, FormatMoney(statsCheck.nTotalAmount), statsCheck.hashOutputs.GetHex(),
+            statsOut.nTransactions, statsOut.nTransactionOutputs, FormatMoney(statsOut.nTotalAmount), statsOut.hashOutputs.GetHex());
+    return true;
+}
+
+/**
+ * Convert the records of whole transactions to records per output. Once
+ * converted, records of whole transactions can only have been written by an
+ * earlier version, which saw none of the outputs.
+ */
+static bool UpgradeRecords(CLevelDBWrapper& db, bool fUpgraded)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    pcursor->Seek(leveldb::Slice("c", 1));
+    if (!pcursor->Valid() || !pcursor->key().starts_with(leveldb::Slice("c", 1)))
+        return true;
+    if (fUpgraded)
+        return error("%s : an earlier version wrote to the coins database after it was upgraded, it needs to be rebuilt", __func__);
+
+    LogPrintf("Upgrading the coins database to one record per unspent output...\n");
+    uiInterface.InitMessage(_("Upgrading the coins database..."));
+    int64_t nStart = GetTimeMillis();
+    size_t nTransactions = 0, nOutputs = 0;
+    CLevelDBBatch batch;
+    for (; pcursor->Valid() && pcursor->key().starts_with(leveldb::Slice("c", 1)); pcursor->Next()) {
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            std::pair<char, uint256> key;
+            ssKey >> key;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins coins;
+            ssValue >> coins;
+
+            // Each batch replaces whole transactions, so an interrupted upgrade picks up where it stopped
+            for (unsigned int n = 0; n < coins.vout.size(); n++) {
+                if (coins.IsAvailable(n)) {
+                    batch.Write(CoinsOutputKey(key.second, n), CDiskCoinsOutput(coins, n));
+                    nOutputs++;
+                }
+            }
+            batch.Erase(key);
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+        if (++nTransactions % 10000 == 0) {
+            db.WriteBatch(batch);
+            batch.Clear();
+        }
+    }
+    HandleError(pcursor->status());
+    db.WriteBatch(batch, true);
+    LogPrintf("Upgraded %u transactions into %u outputs in %dms\n", nTransactions, nOutputs, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CCoinsViewDB::Upgrade()
+{
+    int nVersion = 0;
+    db.Read('V', nVersion);
+    if (nVersion > COINS_DB_VERSION)
+        return error("%s : the coins database was written by a later version (layout %d)", __func__, nVersion);
+    bool fUpgraded = UpgradeRecords(db, nVersion == COINS_DB_VERSION);
+    ResetCursors();
+    if (!fUpgraded)
+        return false;
+    if (nVersion != COINS_DB_VERSION && !db.Write('V', COINS_DB_VERSION, true))
+        return false;
+
+    uint256 hashBestBlock = GetBestBlock();
+    CCoinsDBStats statsNew;
+    if (db.Read('S', statsNew) && statsNew.hashBlock == hashBestBlock)
+        return true;
+
+    // Written by an earlier version, or by one that did not keep the statistics up to date
+    LogPrintf("Computing the statistics of the coins database...\n");
+    uiInterface.InitMessage(_("Computing UTXO set statistics..."));
+    int64_t nStart = GetTimeMillis();
+    {
+        CDBSnapshot snapshot(db);
+        if (!ScanOutputs(snapshot.snapshot, statsNew))
+            return false;
+    }
+    statsNew.hashBlock = hashBestBlock;
+    if (!db.Write('S', statsNew, true))
+        return false;
+    LogPrintf("Counted %u unspent outputs of %u transactions in %dms\n", statsNew.nTransactionOutputs, statsNew.nTransactions, GetTimeMillis() - nStart);
+    LOCK(cs_stats);
+    stats = statsNew;
+    return true;
+}
+
+const leveldb::Snapshot* CCoinsViewDB::GetSnapshot() const
+{
+    return db.GetSnapshot();
+}
+
+void CCoinsViewDB::ReleaseSnapshot(const leveldb::Snapshot* snapshot) const
+{
+    db.ReleaseSnapshot(snapshot);
+}
+
+bool CCoinsViewDB::GetSnapshotStats(const leveldb::Snapshot* snapshot, CCoinsStats& statsOut) const
+{
+    CCoinsDBStats statsKept;
+    if (!db.Read('S', statsKept, snapshot))
+        return false;
+    statsKept.GetCoinsStats(statsOut);
+    return true;
+}
+
+/** Write the outputs of a transaction read by DumpOutputs, the values of their records without what they share */
+static void WriteTransactionOutputs(CAutoFile& fileout, const uint256& txid, int nTxVersion, unsigned int nCode, const std::vector<std::pair<unsigned int, std::string> >& vOutputs)
+{
+    uint64_t nOutputs = vOutputs.size();
+    fileout << txid << VARINT(nTxVersion) << VARINT(nCode) << VARINT(nOutputs);
+    for (unsigned int i = 0; i < vOutputs.size(); i++) {
+        fileout << VARINT(vOutputs[i].first);
+        fileout.write(vOutputs[i].second.data(), vOutputs[i].second.size());
+    }
+}
+
+bool CCoinsViewDB::DumpOutputs(const leveldb::Snapshot* snapshot, CAutoFile& fileout) const
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewSnapshotIterator(snapshot));
+    uint256 txid;
+    int nTxVersion = 0;
+    unsigned int nCode = 0;
+    std::vector<std::pair<unsigned int, std::string> > vOutputs;
+    size_t nRecords = 0;
+    for (pcursor->Seek(leveldb::Slice("C", 1)); pcursor->Valid() && pcursor->key().starts_with(leveldb::Slice("C", 1)); pcursor->Next()) {
+        leveldb::Slice slKey = pcursor->key();
+        if (slKey.size() != 1 + sizeof(uint256) + 4)
+            return error("%s : unexpected output record key", __func__);
+        leveldb::Slice slValue = pcursor->value();
+        CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        int nTxVersionOut = 0;
+        unsigned int nCodeOut = 0;
+        ssValue >> VARINT(nTxVersionOut) >> VARINT(nCodeOut);
+
+        if (vOutputs.empty() || memcmp(txid.begin(), slKey.data() + 1, sizeof(uint256)) != 0) {
+            if (!vOutputs.empty())
+                WriteTransactionOutputs(fileout, txid, nTxVersion, nCode, vOutputs);
+            memcpy(txid.begin(), slKey.data() + 1, sizeof(uint256));
+            nTxVersion = nTxVersionOut;
+            nCode = nCodeOut;
+            vOutputs.clear();
+        } else if (nTxVersionOut != nTxVersion || nCodeOut != nCode) {
+            return error("%s : outputs of transaction %s written for different transactions", __func__, txid.ToString());
+        }
+        vOutputs.push_back(std::make_pair(ReadLE32((const unsigned char*)slKey.data() + 1 + sizeof(uint256)), ssValue.str()));
+        if (++nRecords % 1000 == 0)
+            boost::this_thread::interruption_point();
+    }
+    HandleError(pcursor->status());
+    if (!vOutputs.empty())
+        WriteTransactionOutputs(fileout, txid, nTxVersion, nCode, vOutputs);
+    return true;
+}
+
+/**
+ * Write the output records of the transactions read by LoadOutputs, in
+ * batches, and check them against statsExpected. statsNew gets their
+ * statistics.
+ */
+static bool ReadTransactionOutputs(CLevelDBWrapper& db, CAutoFile& filein, const CCoinsStats& statsExpected, CCoinsDBStats& statsNew)
+{
+    // Transactions come in the order of their records, so none is read twice
+    // and each batch adds records after those of the previous one
+    const size_t nBatchBytes = 16 << 20;
+    CLevelDBBatch batch;
+    size_t nBytes = 0;
+    uint256 txidPrev;
+    CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+    for (uint64_t nTx = 0; nTx < statsExpected.nTransactions; nTx++) {
+        uint256 txid;
+        CDiskCoinsOutput output;
+        unsigned int nCode = 0;
+        uint64_t nOutputs = 0;
+        filein >> txid >> VARINT(output.nTxVersion) >> VARINT(nCode) >> VARINT(nOutputs);
+        if ((nTx > 0 && memcmp(txid.begin(), txidPrev.begin(), sizeof(uint256)) <= 0) || nOutputs == 0)
+            return error("%s : transaction %s out of order or without outputs", __func__, txid.ToString());
+        output.nHeight = nCode / 4;
+        output.fCoinBase = nCode & 1;
+        output.fCoinStake = (nCode & 2) != 0;
+
+        unsigned int nPrev = 0;
+        for (uint64_t i = 0; i < nOutputs; i++) {
+            unsigned int n = 0;
+            filein >> VARINT(n) >> REF(CTxOutCompressor(output.out));
+            if (i > 0 && n <= nPrev)
+                return error("%s : outputs of transaction %s out of order", __func__, txid.ToString());
+            nPrev = n;
+
+            ssRecord.clear();
+            ssRecord << CoinsOutputKey(txid, n);
+            size_t nKeySize = ssRecord.size();
+            ssRecord << output;
+            leveldb::Slice slKey(&ssRecord[0], nKeySize);
+            leveldb::Slice slValue(&ssRecord[nKeySize], ssRecord.size() - nKeySize);
+            batch.Put(slKey, slValue);
+            statsNew.AddOutput(slKey, slValue);
+            nBytes += ssRecord.size();
+        }
+        statsNew.nTransactions++;
+        txidPrev = txid;
+
+        if (nBytes >= nBatchBytes) {
+            boost::this_thread::interruption_point();
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+            nBytes = 0;
+        }
+    }
+
+    CCoinsStats statsRead;
+    statsNew.hashBlock = statsExpected.hashBlock;
+    statsNew.GetCoinsStats(statsRead);
+    if (statsRead.nTransactionOutputs != statsExpected.nTransactionOutputs || statsRead.nSerializedSize != statsExpected.nSerializedSize ||
+        statsRead.nTotalAmount != statsExpected.nTotalAmount || statsRead.hashOutputs != statsExpected.hashOutputs)
+        return error("%s : read %u outputs (%s, %s), expected %u (%s, %s)", __func__,
+            statsRead.nTransactionOutputs, FormatMoney(statsRead.nTotalAmount), statsRead.hashOutputs.GetHex(),
+            statsExpected.nTransactionOutputs, FormatMoney(statsExpected.nTotalAmount), statsExpected.hashOutputs.GetHex());
+    return db.WriteBatch(batch);
+}
+
+/** Erase the output records left by a load that failed */
+static void EraseTransactionOutputs(CLevelDBWrapper& db)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CLevelDBBatch batch;
+    size_t nRecords = 0;
+    for (pcursor->Seek(leveldb::Slice("C", 1)); pcursor->Valid() && pcursor->key().starts_with(leveldb::Slice("C", 1)); pcursor->Next()) {
+        batch.Delete(pcursor->key());
+        if (++nRecords % 100000 == 0) {
+            db.WriteBatch(batch);
+            batch.Clear();
+        }
+    }
+    HandleError(pcursor->status());
+    db.WriteBatch(batch, true);
+}
+
+bool CCoinsViewDB::LoadOutputs(CAutoFile& filein, const CCoinsStats& statsExpected)
+{
+    {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+        pcursor->Seek(leveldb::Slice("C", 1));
+        if (pcursor->Valid() && pcursor->key().starts_with(leveldb::Slice("C", 1)))
+            return error("%s : the coins database is not empty", __func__);
+        HandleError(pcursor->status());
+    }
+
+    CCoinsDBStats statsNew;
+    bool fRead;
+    try {
+        fRead = ReadTransactionOutputs(db, filein, statsExpected, statsNew);
+    } catch (...) {
+        EraseTransactionOutputs(db);
+        throw;
+    }
+    if (!fRead) {
+        EraseTransactionOutputs(db);
+        return false;
+    }
+
+    CLevelDBBatch batch;
+    BatchWriteHashBestChain(batch, statsExpected.hashBlock);
+    batch.Write('S', statsNew);
+    bool fWritten = db.WriteBatch(batch, true);
+    ResetCursors();
+    if (!fWritten)
+        return false;
+    LOCK(cs_stats);
+    stats = statsNew;
+    return true;
+}
+
+bool CBlockTreeDB::ReadTxIndex(const uint256& txid, CDiskTxPos& pos)
+{
+    return Read(make_pair('t', txid), pos);
+}
+
+bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<uint256, CDiskTxPos> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Write(make_pair('t', it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::UpdateAddressIndex(const CBlockIndex* pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> >& vAddressIndex, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vAddressUnspent, bool fUndo, const boost::function<bool(const uint256&)>& fIncludes)
+{
+    CLevelDBBatch batch;
+    std::map<CAddressBalanceKey, CAddressBalance> mapDelta;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vAddressIndex.begin(); it != vAddressIndex.end(); it++) {
+        if (fUndo)
+            batch.Erase(make_pair('a', it->first));
+        else
+            batch.Write(make_pair('a', it->first), it->second);
+        mapDelta[CAddressBalanceKey(it->first.type, it->first.hashBytes)].Apply(it->second, fUndo);
+    }
+
+    // Entries must be applied in the order given: an output created and spent
+    // in the same block is first added and then erased (or the reverse on undo).
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vAddressUnspent.begin(); it != vAddressUnspent.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('u', it->first));
+        else
+            batch.Write(make_pair('u', it->first), it->second);
+    }
+
+    // The 'a' and 'u' records are keyed, so writing them again is harmless, but the totals
+    // are only changed if this block was not applied (or undone) to them already
+    for (std::map<CAddressBalanceKey, CAddressBalance>::const_iterator it = mapDelta.begin(); it != mapDelta.end(); it++) {
+        CAddressBalance balance;
+        Read(make_pair('v', it->first), balance);
+        if (fIncludes(balance.hashBlock) == !fUndo)
+            continue;
+        balance += it->second;
+        balance.hashBlock = fUndo ? pindex->pprev->GetBlockHash() : pindex->GetBlockHash();
+        if (balance.IsEmpty())
+            batch.Erase(make_pair('v', it->first));
+        else
+            batch.Write(make_pair('v', it->first), balance);
+    }
+
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(int type, const uint160& hashBytes, std::vector<std::pair<CAddressIndexKey, CAmount> >& vAddressIndex, int nStart, int nEnd)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    if (nStart > 0)
+        ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, hashBytes, nStart));
+    else
+        ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, hashBytes));
+    pcursor->Seek(ssKeySet.str());
+
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
             leveldb::Slice slKey = pcursor->key();
             CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
+            CAddressIndexKey indexKey;
             ssKey >> chType;
-            if (chType == 'c') {
+            if (chType != 'a')
+                break;
+            ssKey >> indexKey;
+            if (indexKey.type != type || indexKey.hashBytes != hashBytes)
+                break;
+            if (nEnd > 0 && indexKey.blockHeight > nEnd)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount nValue;
+            ssValue >> nValue;
+            vAddressIndex.push_back(make_pair(indexKey, nValue));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressIndexReverse(int type, const uint160& hashBytes, std::vector<std::pair<CAddressIndexKey, CAmount> >& vAddressIndex, int nSkip, int nCount)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    // Position just past the last entry of this address, then walk backwards
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, hashBytes, -1));
+    pcursor->Seek(ssKeySet.str());
+    if (pcursor->Valid())
+        pcursor->Prev();
+    else
+        pcursor->SeekToLast();
+
+    while (pcursor->Valid() && nCount > 0) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressIndexKey indexKey;
+            ssKey >> chType;
+            if (chType != 'a')
+                break;
+            ssKey >> indexKey;
+            if (indexKey.type != type || indexKey.hashBytes != hashBytes)
+                break;
+            if (nSkip > 0) {
+                nSkip--;
+            } else {
                 leveldb::Slice slValue = pcursor->value();
                 CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i = 0; i < coins.vout.size(); i++) {
-                    const CTxOut& out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i + 1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
+                CAmount nValue;
+                ssValue >> nValue;
+                vAddressIndex.push_back(make_pair(indexKey, nValue));
+                nCount--;
             }
+            pcursor->Prev();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(int type, const uint160& hashBytes, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vAddressUnspent)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('u', CAddressIndexIteratorKey(type, hashBytes));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressUnspentKey unspentKey;
+            ssKey >> chType;
+            if (chType != 'u')
+                break;
+            ssKey >> unspentKey;
+            if (unspentKey.type != type || unspentKey.hashBytes != hashBytes)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue unspentValue;
+            ssValue >> unspentValue;
+            vAddressUnspent.push_back(make_pair(unspentKey, unspentValue));
             pcursor->Next();
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
-    stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
+
     return true;
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256& txid, CDiskTxPos& pos)
+bool CBlockTreeDB::ReadAddressBalance(int type, const uint160& hashBytes, CAddressBalance& balance)
 {
-    return Read(make_pair('t', txid), pos);
+    if (!Read(make_pair('v', CAddressBalanceKey(type, hashBytes)), balance))
+        balance = CAddressBalance();
+    return true;
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& vect)
+bool CBlockTreeDB::ReadSpentIndex(const COutPoint& outpoint, CSpentIndexValue& value)
+{
+    return Read(make_pair('p', outpoint), value);
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<COutPoint, CSpentIndexValue> >& vSpentIndex)
 {
     CLevelDBBatch batch;
-    for (std::vector<std::pair<uint256, CDiskTxPos> >::const_iterator it = vect.begin(); it != vect.end(); it++)
-        batch.Write(make_pair('t', it->first), it->second);
+    for (std::vector<std::pair<COutPoint, CSpentIndexValue> >::const_iterator it = vSpentIndex.begin(); it != vSpentIndex.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('p', it->first));
+        else
+            batch.Write(make_pair('p', it->first), it->second);
+    }
     return WriteBatch(batch);
 }
 
@@ -206,6 +1146,21 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
+bool CBlockTreeDB::WriteUtxoSnapshot(const CUtxoSnapshotMetadata& metadata)
+{
+    return Write('U', metadata, true);
+}
+
+bool CBlockTreeDB::ReadUtxoSnapshot(CUtxoSnapshotMetadata& metadata)
+{
+    return Read('U', metadata);
+}
+
+bool CBlockTreeDB::EraseUtxoSnapshot()
+{
+    return Erase('U', true);
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
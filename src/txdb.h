@@ -7,15 +7,23 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
+#include "amount.h"
+#include "crypto/muhash.h"
 #include "leveldbwrapper.h"
 #include "main.h"
+#include "spentindex.h"
 
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/function.hpp>
+
+class CAutoFile;
 class CCoins;
+class CUtxoSnapshotMetadata;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -24,21 +32,122 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! Layout of the coins database records, kept under 'V'; earlier versions wrote none
+static const int COINS_DB_VERSION = 1;
+
+/**
+ * Totals and MuHash of the unspent output records of a coins database, kept
+ * in it next to the best block and written in the same batches as the
+ * records, so that statistics about the UTXO set take no scan.
+ */
+class CCoinsDBStats
+{
+public:
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nSerializedSize;
+    CAmount nTotalAmount;
+    MuHash3072 hash;
+
+    CCoinsDBStats() : hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
 
-/** CCoinsView backed by the LevelDB coin database (chainstate/) */
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nSerializedSize);
+        READWRITE(nTotalAmount);
+        READWRITE(hash);
+    }
+
+    //! Count an output record in or out, by its key and value as stored
+    void AddOutput(const leveldb::Slice& slKey, const leveldb::Slice& slValue);
+    void RemoveOutput(const leveldb::Slice& slKey, const leveldb::Slice& slValue);
+
+    //! Merge the statistics of records that do not overlap
+    CCoinsDBStats& operator+=(const CCoinsDBStats& other);
+
+    void GetCoinsStats(CCoinsStats& stats) const;
+};
+
+/**
+ * CCoinsView backed by the LevelDB coin database (chainstate/).
+ *
+ * Each unspent output is a record of its own, keyed by its outpoint, so that
+ * spending one output of a transaction erases one small record instead of
+ * rewriting the record of all its outputs. The coins of a transaction are
+ * read back with a scan over the outpoints sharing its txid.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
 
+    mutable CCriticalSection cs_stats;
+    //! Statistics of the records as last written
+    CCoinsDBStats stats;
+
+    class CCursorLease;
+    mutable CCriticalSection cs_cursors;
+    //! Iterators of earlier lookups, kept for later ones until a write, as they do not see later records
+    mutable std::vector<leveldb::Iterator*> vIdleCursors;
+    //! Number of writes, by which a lookup tells whether its iterator may still be kept
+    uint64_t nWrites;
+
+    //! Have the lookups from now on see what was written
+    void ResetCursors();
+
+    bool ScanOutputs(const leveldb::Snapshot* snapshot, CCoinsDBStats& statsOut) const;
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    //! A coins database other than chainstate/
+    CCoinsViewDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CCoinsViewDB();
 
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+    //! The statistics kept in a snapshot, and the hash of its outputs in txid order
+    bool HashStats(CCoinsStats& stats) const;
+    //! Scans a snapshot from several threads, one range of txids each
+    bool ScanStats(CCoinsStats& stats) const;
+
+    /**
+     * Convert the records of whole transactions written by earlier versions
+     * to records per output, and compute the statistics of the records when
+     * the database has none for its best block. Fails on a database written
+     * by a later version, or by an earlier one after it was converted.
+     */
+    bool Upgrade();
+
+    //! A consistent view of the records while the database keeps changing, to be released with ReleaseSnapshot
+    const leveldb::Snapshot* GetSnapshot() const;
+    void ReleaseSnapshot(const leveldb::Snapshot* snapshot) const;
+    //! The statistics kept in a snapshot
+    bool GetSnapshotStats(const leveldb::Snapshot* snapshot, CCoinsStats& stats) const;
+
+    /**
+     * Write the unspent outputs of a snapshot, grouped by transaction in the
+     * order of their records: the txid, what the outputs share, their number,
+     * then the index and compressed output of each.
+     */
+    bool DumpOutputs(const leveldb::Snapshot* snapshot, CAutoFile& fileout) const;
+
+    /**
+     * Read the outputs of stats.nTransactions transactions written by
+     * DumpOutputs into this database, which must have none, in large
+     * batches. The statistics of what was read must be those given, which
+     * then makes stats.hashBlock the best block.
+     */
+    bool LoadOutputs(CAutoFile& filein, const CCoinsStats& statsExpected);
 };
 
 /** Access to the block database (blocks/index/) */
@@ -61,10 +170,21 @@ public:
     bool ReadReindexing(bool& fReindex);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    //! Apply (or undo) the entries of pindex, fIncludes telling whether the totals kept as of a block include them already
+    bool UpdateAddressIndex(const CBlockIndex* pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> >& vAddressIndex, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vAddressUnspent, bool fUndo, const boost::function<bool(const uint256&)>& fIncludes);
+    bool ReadAddressIndex(int type, const uint160& hashBytes, std::vector<std::pair<CAddressIndexKey, CAmount> >& vAddressIndex, int nStart = 0, int nEnd = 0);
+    bool ReadAddressIndexReverse(int type, const uint160& hashBytes, std::vector<std::pair<CAddressIndexKey, CAmount> >& vAddressIndex, int nSkip, int nCount);
+    bool ReadAddressUnspentIndex(int type, const uint160& hashBytes, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vAddressUnspent);
+    bool ReadAddressBalance(int type, const uint160& hashBytes, CAddressBalance& balance);
+    bool ReadSpentIndex(const COutPoint& outpoint, CSpentIndexValue& value);
+    bool UpdateSpentIndex(const std::vector<std::pair<COutPoint, CSpentIndexValue> >& vSpentIndex);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
+    bool WriteUtxoSnapshot(const CUtxoSnapshotMetadata& metadata);
+    bool ReadUtxoSnapshot(CUtxoSnapshotMetadata& metadata);
+    bool EraseUtxoSnapshot();
     bool LoadBlockIndexGuts();
 };
 
@@ -0,0 +1,357 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxosnapshot.h"
+
+#include "chainparams.h"
+#include "coins.h"
+#include "main.h"
+#include "net.h"
+#include "streams.h"
+#include "txdb.h"
+#include "ui_interface.h"
+#include "util.h"
+#include "utilmoneystr.h"
+
+#include <string.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+static const unsigned char pchSnapshotMagic[5] = {'u', 't', 'x', 'o', 0xff};
+
+/** Counts the blocks of the history stored, which ConnectSnapshotHistory waits on */
+static CWaitableCriticalSection csHistoryBlocks;
+static CConditionVariable cvHistoryBlocks;
+static uint64_t nHistoryBlocksStored = 0;
+
+CUtxoSnapshotMetadata::CUtxoSnapshotMetadata() : nVersion(CURRENT_VERSION), hashBlock(0), nHeight(0), nChainTx(0), nMoneySupply(0),
+                                                 nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0), hashOutputs(0)
+{
+    memcpy(pchMagic, pchSnapshotMagic, sizeof(pchMagic));
+    memcpy(pchMessageStart, Params().MessageStart(), sizeof(pchMessageStart));
+}
+
+bool CUtxoSnapshotMetadata::IsKnown() const
+{
+    return memcmp(pchMagic, pchSnapshotMagic, sizeof(pchMagic)) == 0 && nVersion == CURRENT_VERSION;
+}
+
+void CUtxoSnapshotMetadata::SetCoinsStats(const CCoinsStats& stats)
+{
+    hashBlock = stats.hashBlock;
+    nTransactions = stats.nTransactions;
+    nTransactionOutputs = stats.nTransactionOutputs;
+    nSerializedSize = stats.nSerializedSize;
+    nTotalAmount = stats.nTotalAmount;
+    hashOutputs = stats.hashOutputs;
+}
+
+void CUtxoSnapshotMetadata::GetCoinsStats(CCoinsStats& stats) const
+{
+    stats.hashBlock = hashBlock;
+    stats.nTransactions = nTransactions;
+    stats.nTransactionOutputs = nTransactionOutputs;
+    stats.nSerializedSize = nSerializedSize;
+    stats.nTotalAmount = nTotalAmount;
+    stats.hashOutputs = hashOutputs;
+}
+
+namespace
+{
+/** Snapshot of the coins database, released when going out of scope */
+class CCoinsDBSnapshot
+{
+private:
+    const CCoinsViewDB& db;
+
+public:
+    const leveldb::Snapshot* snapshot;
+
+    CCoinsDBSnapshot(const CCoinsViewDB& dbIn) : db(dbIn), snapshot(db.GetSnapshot()) {}
+    ~CCoinsDBSnapshot() { db.ReleaseSnapshot(snapshot); }
+};
+}
+
+bool DumpUtxoSnapshot(const boost::filesystem::path& path, CUtxoSnapshotMetadata& metadata, std::string& strError)
+{
+    if (boost::filesystem::exists(path)) {
+        strError = strprintf("%s already exists", path.string());
+        return false;
+    }
+
+    // Once the tip is flushed, the database holds its outputs until the next
+    // block is connected, which the snapshot keeps them from
+    boost::scoped_ptr<CCoinsDBSnapshot> snapshot;
+    std::vector<CBlockHeader> vHeaders;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        CBlockIndex* pindexBase = chainActive.Tip();
+        if (pindexBase->nHeight == 0) {
+            strError = "There are no outputs to dump before the first block";
+            return false;
+        }
+        snapshot.reset(new CCoinsDBSnapshot(*pcoinsdbview));
+        metadata.nHeight = pindexBase->nHeight;
+        metadata.nChainTx = pindexBase->nChainTx;
+        metadata.nMoneySupply = pindexBase->nMoneySupply;
+        vHeaders.resize(pindexBase->nHeight);
+        for (CBlockIndex* pindex = pindexBase; pindex->pprev; pindex = pindex->pprev)
+            vHeaders[pindex->nHeight - 1] = pindex->GetBlockHeader();
+    }
+    CCoinsStats stats;
+    if (!pcoinsdbview->GetSnapshotStats(snapshot->snapshot, stats) || stats.hashBlock != vHeaders.back().GetHash()) {
+        strError = "The coins database is not at the tip";
+        return false;
+    }
+    metadata.SetCoinsStats(stats);
+
+    boost::filesystem::path pathTmp = path.string() + ".incomplete";
+    CAutoFile fileout(fopen(pathTmp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        strError = strprintf("Failed to create %s", pathTmp.string());
+        return false;
+    }
+    bool fWritten = false;
+    try {
+        fileout << metadata;
+        for (unsigned int i = 0; i < vHeaders.size(); i++)
+            fileout << vHeaders[i];
+        fWritten = pcoinsdbview->DumpOutputs(snapshot->snapshot, fileout);
+        if (!fWritten)
+            strError = "Failed to read the coins database";
+        else
+            FileCommit(fileout.Get());
+    } catch (const std::exception& e) {
+        strError = strprintf("Failed to write %s: %s", pathTmp.string(), e.what());
+    }
+    fileout.fclose();
+    if (!fWritten || !RenameOver(pathTmp, path)) {
+        if (fWritten)
+            strError = strprintf("Failed to rename %s to %s", pathTmp.string(), path.string());
+        boost::filesystem::remove(pathTmp);
+        return false;
+    }
+    LogPrintf("Dumped the %u unspent outputs of block %s at height %d to %s\n",
+        metadata.nTransactionOutputs, metadata.hashBlock.ToString(), metadata.nHeight, path.string());
+    return true;
+}
+
+/**
+ * Whether the snapshot is one the chain parameters list. Its headers and
+ * outputs are only checked against the block hash and statistics it comes
+ * with, and its history may be days of downloading away, so that block and
+ * those outputs have to be known good beforehand.
+ */
+static bool IsAssumedUtxoSnapshot(const CUtxoSnapshotMetadata& metadata)
+{
+    MapAssumeUtxo::const_iterator it = Params().AssumeUtxo().find(metadata.nHeight);
+    if (it != Params().AssumeUtxo().end())
+        return it->second.hashBlock == metadata.hashBlock && it->second.hashOutputs == metadata.hashOutputs;
+
+    // Regression test chains are made up as the tests go
+    if (Params().NetworkID() == CBaseChainParams::REGTEST && mapArgs.count("-assumeutxo"))
+        return GetArg("-assumeutxo", "") == metadata.hashBlock.GetHex() + ":" + metadata.hashOutputs.GetHex();
+    return false;
+}
+
+bool LoadUtxoSnapshot(const boost::filesystem::path& path, std::string& strError)
+{
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        strError = strprintf(_("Failed to open UTXO set snapshot %s"), path.string());
+        return false;
+    }
+
+    try {
+        CUtxoSnapshotMetadata metadata;
+        filein >> metadata;
+        if (!metadata.IsKnown()) {
+            strError = strprintf(_("%s is not a UTXO set snapshot this version can read"), path.string());
+            return false;
+        }
+        if (memcmp(metadata.pchMessageStart, Params().MessageStart(), sizeof(metadata.pchMessageStart)) != 0) {
+            strError = strprintf(_("UTXO set snapshot %s was made on another network"), path.string());
+            return false;
+        }
+        if (!IsAssumedUtxoSnapshot(metadata)) {
+            strError = strprintf(_("UTXO set snapshot %s of block %s at height %d is not one this version knows"),
+                path.string(), metadata.hashBlock.ToString(), metadata.nHeight);
+            return false;
+        }
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(metadata.hashBlock);
+            if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second)) {
+                LogPrintf("UTXO set snapshot of block %s already loaded\n", metadata.hashBlock.ToString());
+                return true;
+            }
+            if (chainActive.Height() != 0) {
+                strError = _("A UTXO set snapshot can only be loaded before any block is connected");
+                return false;
+            }
+        }
+        LogPrintf("Loading the UTXO set snapshot of block %s at height %d, %u unspent outputs\n",
+            metadata.hashBlock.ToString(), metadata.nHeight, metadata.nTransactionOutputs);
+
+        // The headers, whose stake modifiers the kernel of the blocks after the
+        // snapshot is checked with
+        CBlockIndex* pindex = NULL;
+        for (int nHeight = 1; nHeight <= metadata.nHeight; nHeight++) {
+            CBlockHeader header;
+            filein >> header;
+            LOCK(cs_main);
+            CValidationState state;
+            if (!AcceptBlockHeader(header, state, &pindex) || pindex->nHeight != nHeight) {
+                strError = strprintf(_("UTXO set snapshot %s has an invalid header at height %d"), path.string(), nHeight);
+                return false;
+            }
+        }
+        if (pindex == NULL || pindex->GetBlockHash() != metadata.hashBlock) {
+            strError = strprintf(_("The headers of UTXO set snapshot %s do not lead to its block"), path.string());
+            return false;
+        }
+
+        // Written first, so that a load that does not finish is noticed on the next start
+        if (!pblocktree->WriteUtxoSnapshot(metadata)) {
+            strError = _("Failed to write to the block index database");
+            return false;
+        }
+        CCoinsStats stats;
+        metadata.GetCoinsStats(stats);
+        if (!pcoinsdbview->LoadOutputs(filein, stats)) {
+            pblocktree->EraseUtxoSnapshot();
+            strError = strprintf(_("The unspent outputs of UTXO set snapshot %s do not match its statistics"), path.string());
+            return false;
+        }
+
+        LOCK(cs_main);
+        if (!ActivateSnapshotBase(pindex, metadata)) {
+            strError = _("Failed to make the block of the UTXO set snapshot the tip");
+            return false;
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf(_("Failed to read UTXO set snapshot %s: %s"), path.string(), e.what());
+        return false;
+    }
+    return true;
+}
+
+void NotifySnapshotHistoryBlock()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csHistoryBlocks);
+        nHistoryBlocksStored++;
+    }
+    cvHistoryBlocks.notify_all();
+}
+
+/**
+ * Connect the blocks after pindexSnapshotHistory to view, waiting for them to
+ * be downloaded, until pindexSnapshotBase is. False if one does not connect.
+ */
+static bool ConnectSnapshotHistory(CCoinsViewCache& view, size_t nCoinCacheUsage)
+{
+    while (true) {
+        CBlockIndex* pindex;
+        bool fHaveData;
+        uint64_t nStored;
+        {
+            boost::unique_lock<boost::mutex> lock(csHistoryBlocks);
+            nStored = nHistoryBlocksStored;
+        }
+        {
+            LOCK(cs_main);
+            if (pindexSnapshotHistory == pindexSnapshotBase)
+                return true;
+            pindex = pindexSnapshotBase->GetAncestor(pindexSnapshotHistory ? pindexSnapshotHistory->nHeight + 1 : 0);
+            fHaveData = (pindex->nStatus & BLOCK_HAVE_DATA) != 0;
+        }
+        if (!fHaveData) {
+            // Requested from peers by FindHistoryBlocksToDownload, look again once one is stored
+            boost::unique_lock<boost::mutex> lock(csHistoryBlocks);
+            while (nHistoryBlocksStored == nStored)
+                cvHistoryBlocks.wait(lock);
+            continue;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex))
+            return error("%s : failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        {
+            LOCK(cs_main);
+            CValidationState state;
+            if (!ConnectBlock(block, state, pindex, view, false))
+                return error("%s : block %s at height %d does not connect: %s", __func__,
+                    pindex->GetBlockHash().ToString(), pindex->nHeight, state.GetRejectReason());
+            pindexSnapshotHistory = pindex;
+        }
+        if (view.DynamicMemoryUsage() > nCoinCacheUsage && !view.Flush())
+            return error("%s : failed to write the history chain state", __func__);
+        if (pindex->nHeight % 10000 == 0)
+            LogPrintf("Validated the history of the UTXO set snapshot up to height %d\n", pindex->nHeight);
+    }
+}
+
+void ThreadValidateSnapshotHistory(size_t nCoinDBCache, size_t nCoinCacheUsage)
+{
+    RenameThread("userv-snapshot");
+
+    CUtxoSnapshotMetadata metadata;
+    {
+        LOCK(cs_main);
+        if (pindexSnapshotBase == NULL || !pblocktree->ReadUtxoSnapshot(metadata))
+            return;
+    }
+
+    boost::filesystem::path pathHistory = GetDataDir() / "chainstate_history";
+    bool fConnected = false;
+    CCoinsStats stats;
+    try {
+        CCoinsViewDB dbHistory(pathHistory, nCoinDBCache);
+        CCoinsViewCache view(&dbHistory);
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(view.GetBestBlock());
+            pindexSnapshotHistory = mi != mapBlockIndex.end() ? mi->second : NULL;
+        }
+        LogPrintf("Validating the history of the UTXO set snapshot at height %d, from height %d\n",
+            metadata.nHeight, pindexSnapshotHistory ? pindexSnapshotHistory->nHeight + 1 : 0);
+        try {
+            fConnected = ConnectSnapshotHistory(view, nCoinCacheUsage);
+        } catch (const boost::thread_interrupted&) {
+            // Resumed from there on the next start
+            view.Flush();
+            throw;
+        }
+        fConnected = fConnected && view.Flush() && dbHistory.GetStats(stats);
+    } catch (const std::exception& e) {
+        AbortNode(std::string("System error: ") + e.what());
+        return;
+    }
+
+    {
+        LOCK(cs_main);
+        if (!fConnected || stats.hashOutputs != metadata.hashOutputs || stats.nTransactionOutputs != metadata.nTransactionOutputs ||
+            stats.nTotalAmount != metadata.nTotalAmount || pindexSnapshotBase->pprev->nChainTx + pindexSnapshotBase->nTx != metadata.nChainTx ||
+            pindexSnapshotBase->nMoneySupply != metadata.nMoneySupply) {
+            LogPrintf("%s : history gives %u outputs (%s, %s), the UTXO set snapshot has %u (%s, %s)\n", __func__,
+                stats.nTransactionOutputs, FormatMoney(stats.nTotalAmount), stats.hashOutputs.GetHex(),
+                metadata.nTransactionOutputs, FormatMoney(metadata.nTotalAmount), metadata.hashOutputs.GetHex());
+            AbortNode("The history of the UTXO set snapshot does not give its unspent outputs",
+                _("The UTXO set snapshot does not match the history of the block chain. Restart with -reindex to rebuild the chain state from the blocks."));
+            return;
+        }
+
+        FlushStateToDisk();
+        pblocktree->EraseUtxoSnapshot();
+        pindexSnapshotBase = NULL;
+        pindexSnapshotHistory = NULL;
+        if (!fPruneMode)
+            nLocalServices |= NODE_NETWORK;
+    }
+    LogPrintf("The history of the UTXO set snapshot at height %d gives its unspent outputs\n", metadata.nHeight);
+    boost::filesystem::remove_all(pathHistory);
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2018 The UserV developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTXOSNAPSHOT_H
+#define BITCOIN_UTXOSNAPSHOT_H
+
+#include "amount.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+
+struct CCoinsStats;
+
+/**
+ * What a UTXO set snapshot file starts with: the block its unspent outputs
+ * are those of, what the block index needs to make that block the tip
+ * without its history, and the statistics the outputs are checked against.
+ * It is followed by the headers of the chain up to the block and by the
+ * outputs, grouped by transaction.
+ *
+ * A node that loaded the snapshot keeps it in its block tree database
+ * until the history has been validated and found to give the same outputs.
+ */
+class CUtxoSnapshotMetadata
+{
+public:
+    static const int CURRENT_VERSION = 1;
+
+    unsigned char pchMagic[5];
+    int nVersion;
+    //! Message start of the network the snapshot was made on
+    unsigned char pchMessageStart[4];
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nChainTx;
+    CAmount nMoneySupply;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nSerializedSize;
+    CAmount nTotalAmount;
+    uint256 hashOutputs;
+
+    CUtxoSnapshotMetadata();
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(FLATDATA(pchMagic));
+        READWRITE(this->nVersion);
+        READWRITE(FLATDATA(pchMessageStart));
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(nChainTx);
+        READWRITE(nMoneySupply);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nSerializedSize);
+        READWRITE(nTotalAmount);
+        READWRITE(hashOutputs);
+    }
+
+    //! Whether it is the start of a snapshot file this version reads
+    bool IsKnown() const;
+
+    void SetCoinsStats(const CCoinsStats& stats);
+    void GetCoinsStats(CCoinsStats& stats) const;
+};
+
+/**
+ * Write the unspent outputs of the tip, along with the headers of its chain,
+ * to a new file at path. The coins database is read from a snapshot, so
+ * blocks keep being connected meanwhile.
+ */
+bool DumpUtxoSnapshot(const boost::filesystem::path& path, CUtxoSnapshotMetadata& metadata, std::string& strError);
+
+/**
+ * Make the UTXO set snapshot at path the chain state of a node that has not
+ * connected any block yet, and the block it was made at the tip. Its history
+ * is then downloaded and checked by ThreadValidateSnapshotHistory.
+ */
+bool LoadUtxoSnapshot(const boost::filesystem::path& path, std::string& strError);
+
+/** Wake ThreadValidateSnapshotHistory up, a block of the history was stored */
+void NotifySnapshotHistoryBlock();
+
+/**
+ * Connect the blocks of the history of pindexSnapshotBase as they get
+ * downloaded, into a chain state of their own in chainstate_history/, and
+ * check that they give the unspent outputs the snapshot had. Shuts the node
+ * down if they do not.
+ */
+void ThreadValidateSnapshotHistory(size_t nCoinDBCache, size_t nCoinCacheUsage);
+
+#endif // BITCOIN_UTXOSNAPSHOT_H
@@ -16,9 +16,15 @@ CMainSignals& GetMainSignals()
 
 void RegisterValidationInterface(CValidationInterface* pwalletIn) {
 // XX42 g_signals.EraseTransaction.connect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
-    g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
+    g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2));
     g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
     g_signals.NotifyTransactionLock.connect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
+    g_signals.TransactionRemovedFromMempool.connect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
+    g_signals.MasternodeUpdated.connect(boost::bind(&CValidationInterface::MasternodeUpdated, pwalletIn, _1));
+    g_signals.MasternodeRemoved.connect(boost::bind(&CValidationInterface::MasternodeRemoved, pwalletIn, _1));
+    g_signals.BudgetVoteAccepted.connect(boost::bind(&CValidationInterface::BudgetVoteAccepted, pwalletIn, _1));
+    g_signals.FinalizedBudgetVoteAccepted.connect(boost::bind(&CValidationInterface::FinalizedBudgetVoteAccepted, pwalletIn, _1));
+    g_signals.SporkUpdated.connect(boost::bind(&CValidationInterface::SporkUpdated, pwalletIn, _1));
     g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
@@ -36,9 +42,15 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
     g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
+    g_signals.SporkUpdated.disconnect(boost::bind(&CValidationInterface::SporkUpdated, pwalletIn, _1));
+    g_signals.FinalizedBudgetVoteAccepted.disconnect(boost::bind(&CValidationInterface::FinalizedBudgetVoteAccepted, pwalletIn, _1));
+    g_signals.BudgetVoteAccepted.disconnect(boost::bind(&CValidationInterface::BudgetVoteAccepted, pwalletIn, _1));
+    g_signals.MasternodeRemoved.disconnect(boost::bind(&CValidationInterface::MasternodeRemoved, pwalletIn, _1));
+    g_signals.MasternodeUpdated.disconnect(boost::bind(&CValidationInterface::MasternodeUpdated, pwalletIn, _1));
+    g_signals.TransactionRemovedFromMempool.disconnect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
     g_signals.NotifyTransactionLock.disconnect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
     g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
-    g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
+    g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2));
 // XX42    g_signals.EraseTransaction.disconnect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
 }
 
@@ -50,6 +62,12 @@ void UnregisterAllValidationInterfaces() {
     g_signals.Inventory.disconnect_all_slots();
     g_signals.SetBestChain.disconnect_all_slots();
     g_signals.UpdatedTransaction.disconnect_all_slots();
+    g_signals.SporkUpdated.disconnect_all_slots();
+    g_signals.FinalizedBudgetVoteAccepted.disconnect_all_slots();
+    g_signals.BudgetVoteAccepted.disconnect_all_slots();
+    g_signals.MasternodeRemoved.disconnect_all_slots();
+    g_signals.MasternodeUpdated.disconnect_all_slots();
+    g_signals.TransactionRemovedFromMempool.disconnect_all_slots();
     g_signals.NotifyTransactionLock.disconnect_all_slots();
     g_signals.SyncTransaction.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
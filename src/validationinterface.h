@@ -14,8 +14,13 @@
 class CBlock;
 struct CBlockLocator;
 class CBlockIndex;
+class CBudgetVote;
+class CFinalizedBudgetVote;
+class CMasternodeBroadcast;
 class CReserveScript;
+class CSporkMessage;
 class CTransaction;
+class CTxIn;
 class CValidationInterface;
 class CValidationState;
 class uint256;
@@ -34,9 +39,15 @@ void SyncWithWallets(const CTransaction& tx, const CBlock* pblock);
 class CValidationInterface {
 protected:
 // XX42    virtual void EraseFromWallet(const uint256& hash){};
-    virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
+    virtual void UpdatedBlockTip(const CBlockIndex *pindex, const CBlock *pblock) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock) {}
     virtual void NotifyTransactionLock(const CTransaction &tx) {}
+    virtual void TransactionRemovedFromMempool(const CTransaction &tx) {}
+    virtual void MasternodeUpdated(const CMasternodeBroadcast &mnb) {}
+    virtual void MasternodeRemoved(const CTxIn &vin) {}
+    virtual void BudgetVoteAccepted(const CBudgetVote &vote) {}
+    virtual void FinalizedBudgetVoteAccepted(const CFinalizedBudgetVote &vote) {}
+    virtual void SporkUpdated(const CSporkMessage &spork) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual bool UpdatedTransaction(const uint256 &hash) { return false;}
     virtual void Inventory(const uint256 &hash) {}
@@ -52,12 +63,24 @@ protected:
 
 struct CMainSignals {
 // XX42    boost::signals2::signal<void(const uint256&)> EraseTransaction;
-    /** Notifies listeners of updated block chain tip */
-    boost::signals2::signal<void (const CBlockIndex *)> UpdatedBlockTip;
+    /** Notifies listeners of updated block chain tip, and the tip block itself if it is in memory (NULL otherwise) */
+    boost::signals2::signal<void (const CBlockIndex *, const CBlock *)> UpdatedBlockTip;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
     boost::signals2::signal<void (const CTransaction &, const CBlock *)> SyncTransaction;
     /** Notifies listeners of an updated transaction lock without new data. */
     boost::signals2::signal<void (const CTransaction &)> NotifyTransactionLock;
+    /** Notifies listeners of a transaction leaving the mempool, for any reason including being mined. */
+    boost::signals2::signal<void (const CTransaction &)> TransactionRemovedFromMempool;
+    /** Notifies listeners of a masternode added to the list, or updated from a newer announcement. */
+    boost::signals2::signal<void (const CMasternodeBroadcast &)> MasternodeUpdated;
+    /** Notifies listeners of a masternode removed from the list. */
+    boost::signals2::signal<void (const CTxIn &)> MasternodeRemoved;
+    /** Notifies listeners of a new or updated masternode vote on a budget proposal. */
+    boost::signals2::signal<void (const CBudgetVote &)> BudgetVoteAccepted;
+    /** Notifies listeners of a new or updated masternode vote on a finalized budget. */
+    boost::signals2::signal<void (const CFinalizedBudgetVote &)> FinalizedBudgetVoteAccepted;
+    /** Notifies listeners of a newly signed spork value taking effect. */
+    boost::signals2::signal<void (const CSporkMessage &)> SporkUpdated;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
     boost::signals2::signal<bool (const uint256 &)> UpdatedTransaction;
     /** Notifies listeners of a new active block chain. */
@@ -13,7 +13,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70916;
+static const int PROTOCOL_VERSION = 70918;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -21,6 +21,12 @@ static const int INIT_PROTO_VERSION = 209;
 //! In this version, 'getheaders' was introduced.
 static const int GETHEADERS_VERSION = 70077;
 
+//! 'getheaders' is answered with 'headers' and blocks are synced headers-first starting with this version
+static const int HEADERS_FIRST_VERSION = 70917;
+
+//! new blocks are announced as 'cmpctblock', completed with 'getblocktxn'/'blocktxn', starting with this version
+static const int COMPACT_BLOCKS_VERSION = 70918;
+
 //! disconnect from peers older than this proto version
 static const int MIN_PEER_PROTO_VERSION = 70916;
 static const int MIN_PEER_PROTO_VERSION_AFTER_ENFORCEMENT = 70916;
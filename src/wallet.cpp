@@ -640,7 +640,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         mapWallet[hash] = wtxIn;
         CWalletTx& wtx = mapWallet[hash];
         wtx.BindWallet(this);
-        wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
+        // wtxOrdered and the other indexes are built once the whole wallet is loaded
         AddToSpends(hash);
     } else {
         LOCK(cs_wallet);
@@ -686,6 +686,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         // Break debit/credit balance caches:
         wtx.MarkDirty();
 
+        // The block holding the transaction may have changed, or left the active chain
+        IndexWalletTx(wtx);
+
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -700,6 +703,58 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
     return true;
 }
 
+void CWallet::IndexWalletTx(CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    uint256 hash = wtx.GetHash();
+
+    int nHeight = -1;
+    if (wtx.hashBlock != 0) {
+        BlockMap::iterator mi = mapBlockIndex.find(wtx.hashBlock);
+        if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second))
+            nHeight = mi->second->nHeight;
+    }
+    if (nHeight != wtx.nIndexedHeight) {
+        setWalletTxHeights.erase(make_pair(wtx.nIndexedHeight, hash));
+        setWalletTxHeights.insert(make_pair(nHeight, hash));
+        wtx.nIndexedHeight = nHeight;
+    }
+
+    // Accounts, the same way ListTransactions assigns them
+    if (wtx.IsFromMe(ISMINE_ALL))
+        mapAccountOrderPos[wtx.strFromAccount].insert(wtx.nOrderPos);
+    BOOST_FOREACH (const CTxOut& txout, wtx.vout) {
+        if (IsMine(txout) == ISMINE_NO)
+            continue;
+        CTxDestination address;
+        if (!ExtractDestination(txout.scriptPubKey, address))
+            address = CNoDestination();
+        mapDestinationOrderPos[address].insert(wtx.nOrderPos);
+        std::map<CTxDestination, CAddressBookData>::const_iterator mi = mapAddressBook.find(address);
+        mapAccountOrderPos[mi != mapAddressBook.end() ? mi->second.name : ""].insert(wtx.nOrderPos);
+    }
+}
+
+void CWallet::ReindexWalletTxs()
+{
+    LOCK(cs_wallet);
+    wtxOrdered.clear();
+    mapAccountOrderPos.clear();
+    mapDestinationOrderPos.clear();
+    setWalletTxHeights.clear();
+
+    for (map<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        CWalletTx& wtx = (*it).second;
+        wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
+        wtx.nIndexedHeight = -2;
+        IndexWalletTx(wtx);
+    }
+    BOOST_FOREACH (CAccountingEntry& entry, laccentries) {
+        wtxOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
+        mapAccountOrderPos[entry.strAccount].insert(entry.nOrderPos);
+    }
+}
+
 /**
  * Add a transaction to the wallet, or update it.
  * pblock is optional, but should be provided if the transaction is known to be in a block.
@@ -743,8 +798,13 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        std::map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end()) {
+            setWalletTxHeights.erase(make_pair(mi->second.nIndexedHeight, hash));
+            mapWallet.erase(mi);
+            MarkBalancesDirty();
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
     }
     return;
 }
@@ -1247,7 +1307,7 @@ void CWalletTx::RelayWalletTransaction(std::string strCommand)
             LogPrintf("Relaying wtx %s\n", hash.ToString());
 
             if (strCommand == "ix") {
-                mapTxLockReq.insert(make_pair(hash, (CTransaction) * this));
+                txLockManager.AddRequest((CTransaction) * this);
                 CreateNewLock(((CTransaction) * this));
                 RelayTransactionLockReq((CTransaction) * this, true);
             } else {
@@ -1414,6 +1474,56 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const
     return nTotal;
 }
 
+void CWallet::GetBalances(CAmount& nBalance, CAmount& nUnconfirmed, CAmount& nImmature, CAmount& nWatchOnly, CAmount& nWatchUnconfirmed, CAmount& nWatchImmature) const
+{
+    LOCK2(cs_main, cs_wallet);
+
+    // After a wallet transaction changed or the chain reorganized, settle them all again
+    if (fBalancesDirty || pindexBalances == NULL || !chainActive.Contains(pindexBalances)) {
+        nSettledBalance = nSettledWatchOnly = 0;
+        setBalancePending.clear();
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            setBalancePending.insert(it->first);
+        fBalancesDirty = false;
+    }
+    pindexBalances = chainActive.Tip();
+
+    nBalance = nSettledBalance;
+    nWatchOnly = nSettledWatchOnly;
+    nUnconfirmed = nImmature = 0;
+    nWatchUnconfirmed = nWatchImmature = 0;
+    std::set<uint256>::iterator it = setBalancePending.begin();
+    while (it != setBalancePending.end()) {
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(*it);
+        if (mi == mapWallet.end()) {
+            setBalancePending.erase(it++);
+            continue;
+        }
+        const CWalletTx* pcoin = &(*mi).second;
+        bool fTrusted = pcoin->IsTrusted();
+        if (fTrusted) {
+            nBalance += pcoin->GetAvailableCredit();
+            nWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
+        }
+
+        // Confirmed without counting swiftTX locks, and mature: later blocks leave it alone
+        if (fTrusted && pcoin->GetDepthInMainChain(false) > 0 && pcoin->GetBlocksToMaturity() == 0) {
+            nSettledBalance += pcoin->GetAvailableCredit();
+            nSettledWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
+            setBalancePending.erase(it++);
+            continue;
+        }
+
+        if (!IsFinalTx(*pcoin) || (!fTrusted && pcoin->GetDepthInMainChain() == 0)) {
+            nUnconfirmed += pcoin->GetAvailableCredit();
+            nWatchUnconfirmed += pcoin->GetAvailableWatchOnlyCredit();
+        }
+        nImmature += pcoin->GetImmatureCredit();
+        nWatchImmature += pcoin->GetImmatureWatchOnlyCredit();
+        ++it;
+    }
+}
+
 CAmount CWallet::GetLockedWatchOnlyBalance() const
 {
     CAmount nTotal = 0;
@@ -2149,7 +2259,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
         nTxNewTime = GetAdjustedTime();
 
         //iterates each utxo inside of CheckStakeKernelHash()
-        if (CheckStakeKernelHash(nBits, block, *pcoin.first, prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
+        if (CheckStakeKernelHash(nBits, block, pcoin.first->vout[pcoin.second], prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
             //Double check that this will pass time requirements
             if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
                 LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
@@ -2320,6 +2430,7 @@ bool CWallet::AddAccountingEntry(const CAccountingEntry& acentry, CWalletDB & pw
     laccentries.push_back(acentry);
     CAccountingEntry & entry = laccentries.back();
     wtxOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
+    mapAccountOrderPos[entry.strAccount].insert(entry.nOrderPos);
 
     return true;
 }
@@ -2419,6 +2530,10 @@ bool CWallet::SetAddressBook(const CTxDestination& address, const string& strNam
         std::map<CTxDestination, CAddressBookData>::iterator mi = mapAddressBook.find(address);
         fUpdated = mi != mapAddressBook.end();
         mapAddressBook[address].name = strName;
+        // Transactions paying the address now belong to the account it is labelled with
+        std::map<CTxDestination, std::set<int64_t> >::const_iterator itPos = mapDestinationOrderPos.find(address);
+        if (itPos != mapDestinationOrderPos.end())
+            mapAccountOrderPos[strName].insert(itPos->second.begin(), itPos->second.end());
         if (!strPurpose.empty()) /* update purpose only if requested */
             mapAddressBook[address].purpose = strPurpose;
     }
@@ -2444,6 +2559,9 @@ bool CWallet::DelAddressBook(const CTxDestination& address)
             }
         }
         mapAddressBook.erase(address);
+        std::map<CTxDestination, std::set<int64_t> >::const_iterator itPos = mapDestinationOrderPos.find(address);
+        if (itPos != mapDestinationOrderPos.end())
+            mapAccountOrderPos[""].insert(itPos->second.begin(), itPos->second.end());
     }
 
     NotifyAddressBookChanged(this, address, "", ::IsMine(*this, address) != ISMINE_NO, "", CT_DELETED);
@@ -3335,23 +3453,12 @@ int CMerkleTx::GetTransactionLockSignatures() const
     if (!fEnableSwiftTX) return -1;
 
     //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()) {
-        return (*i).second.CountSignatures();
-    }
-
-    return -1;
+    return txLockManager.GetSignatures(GetHash());
 }
 
 bool CMerkleTx::IsTransactionLockTimedOut() const
 {
     if (!fEnableSwiftTX) return 0;
 
-    //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()) {
-        return GetTime() > (*i).second.nTimeout;
-    }
-
-    return false;
+    return txLockManager.IsTimedOut(GetHash());
 }
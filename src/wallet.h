@@ -160,6 +160,16 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    //! GetBalances totals of the settled transactions: confirmed, final and mature,
+    //! so that only spending them or a reorganization changes what they add
+    mutable CAmount nSettledBalance;
+    mutable CAmount nSettledWatchOnly;
+    //! Transactions GetBalances sums again on every call, because blocks still change their share
+    mutable std::set<uint256> setBalancePending;
+    //! Tip GetBalances last ran against, and whether a wallet transaction changed since
+    mutable const CBlockIndex* pindexBalances;
+    mutable bool fBalancesDirty;
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
@@ -234,6 +244,10 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fWalletUnlockStakingOnly = false;
+        nSettledBalance = 0;
+        nSettledWatchOnly = 0;
+        pindexBalances = NULL;
+        fBalancesDirty = true;
 
         // Stake Settings
         nHashDrift = 45;
@@ -273,6 +287,14 @@ public:
     typedef std::multimap<int64_t, TxPair > TxItems;
     TxItems wtxOrdered;
 
+    //! Order positions of the transactions and accounting entries of each account. Positions
+    //! stay filed under labels an address had before, so callers check the account themselves.
+    std::map<std::string, std::set<int64_t> > mapAccountOrderPos;
+    //! Order positions of the transactions paying each of our destinations
+    std::map<CTxDestination, std::set<int64_t> > mapDestinationOrderPos;
+    //! Wallet transactions by the height of the block of the active chain holding them, -1 if none
+    std::set<std::pair<int, uint256> > setWalletTxHeights;
+
     int64_t nOrderPosNext;
     std::map<uint256, int> mapRequestCount;
 
@@ -364,6 +386,10 @@ public:
 
     void GetKeyBirthTimes(std::map<CKeyID, int64_t>& mapKeyBirth) const;
     unsigned int ComputeTimeSmart(const CWalletTx& wtx) const;
+    //! File a wallet transaction in the indexes above, or under the height it is at now
+    void IndexWalletTx(CWalletTx& wtx);
+    //! Rebuild wtxOrdered and the indexes above from mapWallet and laccentries
+    void ReindexWalletTxs();
 
     /**
      * Increment the next transaction order id
@@ -387,6 +413,10 @@ public:
     CAmount GetWatchOnlyBalance() const;
     CAmount GetUnconfirmedWatchOnlyBalance() const;
     CAmount GetImmatureWatchOnlyBalance() const;
+    //! Balance, unconfirmed and immature balance, and their watch-only counterparts, in one pass over the wallet
+    void GetBalances(CAmount& nBalance, CAmount& nUnconfirmed, CAmount& nImmature, CAmount& nWatchOnly, CAmount& nWatchUnconfirmed, CAmount& nWatchImmature) const;
+    //! Make the next GetBalances go over every wallet transaction again
+    void MarkBalancesDirty() const { fBalancesDirty = true; }
     CAmount GetLockedWatchOnlyBalance() const;
     bool CreateTransaction(CScript scriptPubKey, int64_t nValue, CWalletTx& wtxNew, CReserveKey& reservekey, int64_t& nFeeRet, std::string& strFailReason, const CCoinControl* coinControl);
     bool CreateTransaction(const std::vector<std::pair<CScript, CAmount> >& vecSend,
@@ -700,6 +730,7 @@ public:
     int64_t nOrderPos; //! position in ordered transaction list
 
     // memory only
+    int nIndexedHeight; //! height the transaction is filed under in CWallet::setWalletTxHeights
     mutable bool fDebitCached;
     mutable bool fCreditCached;
     mutable bool fImmatureCreditCached;
@@ -768,6 +799,7 @@ public:
         nImmatureWatchCreditCached = 0;
         nChangeCached = 0;
         nOrderPos = -1;
+        nIndexedHeight = -2;
     }
 
     ADD_SERIALIZE_METHODS;
@@ -824,6 +856,8 @@ public:
         fImmatureWatchCreditCached = false;
         fDebitCached = false;
         fChangeCached = false;
+        if (pwallet)
+            pwallet->MarkBalancesDirty();
     }
 
     void BindWallet(CWallet* pwalletIn)
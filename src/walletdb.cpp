@@ -735,8 +735,12 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 
     // Any wallet corruption at all: skip any rewriting or
     // upgrading, we don't want to make it worse.
-    if (result != DB_LOAD_OK)
+    if (result != DB_LOAD_OK) {
+        // The wallet is still used after noncritical errors
+        if (result == DB_NONCRITICAL_ERROR)
+            pwallet->ReindexWalletTxs();
         return result;
+    }
 
     LogPrintf("nFileVersion = %d\n", wss.nFileVersion);
 
@@ -762,9 +766,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 
     pwallet->laccentries.clear();
     ListAccountCreditDebit("*", pwallet->laccentries);
-    BOOST_FOREACH(CAccountingEntry& entry, pwallet->laccentries) {
-        pwallet->wtxOrdered.insert(make_pair(entry.nOrderPos, CWallet::TxPair((CWalletTx*)0, &entry)));
-    }
+    pwallet->ReindexWalletTxs();
 
     return result;
 }
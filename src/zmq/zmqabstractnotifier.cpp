@@ -3,25 +3,104 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "zmqabstractnotifier.h"
+#include "main.h"
 #include "util.h"
 
 
+const CDataStream* CZMQRawData::GetSerialized()
+{
+    if (!fSerialized)
+    {
+        fSerialized = true;
+        fValid = Serialize(ss);
+    }
+    return fValid ? &ss : NULL;
+}
+
+bool CZMQRawTransaction::Serialize(CDataStream& s) const
+{
+    s << tx;
+    return true;
+}
+
+CZMQRawBlock::CZMQRawBlock(const CBlockIndex *pindexIn, const CBlock *pblockIn) : pindex(pindexIn), pblock(pblockIn)
+{
+    if (pblock)
+        return;
+
+    // Only when several blocks were connected at once. Pruning may move on
+    // from the block position, so it is taken under cs_main, and the block
+    // is read later without it.
+    LOCK(cs_main);
+    if (pindex->nStatus & BLOCK_HAVE_DATA)
+        pos = pindex->GetBlockPos();
+}
+
+bool CZMQRawBlock::Serialize(CDataStream& s) const
+{
+    if (pblock)
+    {
+        s << *pblock;
+        return true;
+    }
+
+    // The file may have been pruned since
+    CBlock block;
+    if (pos.IsNull() || !ReadBlockFromDisk(block, pos) || block.GetHash() != pindex->GetBlockHash())
+    {
+        LogPrint("zmq", "zmq: Block %s is no longer on disk\n", pindex->GetBlockHash().GetHex());
+        return false;
+    }
+    s << block;
+    return true;
+}
+
 CZMQAbstractNotifier::~CZMQAbstractNotifier()
 {
     assert(!psocket);
 }
 
-bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/)
+bool CZMQAbstractNotifier::NotifyBlock(CZMQRawBlock &/*block*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTransaction(CZMQRawTransaction &/*transaction*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTransactionLock(CZMQRawTransaction &/*transaction*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTransactionRemoved(const CTransaction &/*transaction*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyMasternode(const CMasternodeBroadcast &/*mnb*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyMasternodeRemoved(const CTxIn &/*vin*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyBudgetVote(const CBudgetVote &/*vote*/)
 {
     return true;
 }
 
-bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::NotifyFinalizedBudgetVote(const CFinalizedBudgetVote &/*vote*/)
 {
     return true;
 }
 
-bool CZMQAbstractNotifier::NotifyTransactionLock(const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::NotifySpork(const CSporkMessage &/*spork*/)
 {
     return true;
 }
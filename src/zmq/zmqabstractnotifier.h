@@ -7,15 +7,77 @@
 
 #include "zmqconfig.h"
 
+#include "chain.h"
+#include "streams.h"
+#include "version.h"
+
 class CBlockIndex;
+class CBudgetVote;
+class CFinalizedBudgetVote;
+class CMasternodeBroadcast;
+class CSporkMessage;
 class CZMQAbstractNotifier;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
+/** Default for -zmqpub<type>hwm, the number of messages queued per subscriber before more are dropped */
+static const int DEFAULT_ZMQ_SNDHWM = 1000;
+
+/**
+ * A block or transaction being published. It is serialized the first time
+ * a notifier publishes it raw, and the same bytes are used by any other
+ * notifier publishing it on another address.
+ */
+class CZMQRawData
+{
+public:
+    CZMQRawData() : ss(SER_NETWORK, PROTOCOL_VERSION), fSerialized(false), fValid(false) { }
+    virtual ~CZMQRawData() { }
+
+    /** The serialized object, or NULL if it could not be had */
+    const CDataStream* GetSerialized();
+
+protected:
+    virtual bool Serialize(CDataStream& s) const = 0;
+
+private:
+    CDataStream ss;
+    bool fSerialized;
+    bool fValid;
+};
+
+class CZMQRawTransaction : public CZMQRawData
+{
+public:
+    explicit CZMQRawTransaction(const CTransaction &txIn) : tx(txIn) { }
+
+    const CTransaction &tx;
+
+protected:
+    bool Serialize(CDataStream& s) const;
+};
+
+class CZMQRawBlock : public CZMQRawData
+{
+public:
+    /** pblockIn is the block of pindexIn if validation still had it in memory, NULL otherwise */
+    CZMQRawBlock(const CBlockIndex *pindexIn, const CBlock *pblockIn);
+
+    const CBlockIndex *pindex;
+
+protected:
+    bool Serialize(CDataStream& s) const;
+
+private:
+    const CBlock *pblock;
+    //! Where the block was stored when it was announced, null if it was not or is pruned
+    CDiskBlockPos pos;
+};
+
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(0) { }
+    CZMQAbstractNotifier() : psocket(0), nSendHighWaterMark(DEFAULT_ZMQ_SNDHWM) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -28,18 +90,27 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    int GetSendHighWaterMark() const { return nSendHighWaterMark; }
+    void SetSendHighWaterMark(int n) { nSendHighWaterMark = n; }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
-    virtual bool NotifyTransaction(const CTransaction &transaction);
-    virtual bool NotifyTransactionLock(const CTransaction &transaction);
+    virtual bool NotifyBlock(CZMQRawBlock &block);
+    virtual bool NotifyTransaction(CZMQRawTransaction &transaction);
+    virtual bool NotifyTransactionLock(CZMQRawTransaction &transaction);
+    virtual bool NotifyTransactionRemoved(const CTransaction &transaction);
+    virtual bool NotifyMasternode(const CMasternodeBroadcast &mnb);
+    virtual bool NotifyMasternodeRemoved(const CTxIn &vin);
+    virtual bool NotifyBudgetVote(const CBudgetVote &vote);
+    virtual bool NotifyFinalizedBudgetVote(const CFinalizedBudgetVote &vote);
+    virtual bool NotifySpork(const CSporkMessage &spork);
 
 protected:
     void *psocket;
     std::string type;
     std::string address;
+    int nSendHighWaterMark;
 };
 
 #endif // BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
@@ -10,6 +10,9 @@
 #include "streams.h"
 #include "util.h"
 
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
 void zmqError(const char *str)
 {
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
@@ -38,9 +41,15 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     factories["pubhashblock"] = CZMQAbstractNotifier::Create<CZMQPublishHashBlockNotifier>;
     factories["pubhashtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
     factories["pubhashtxlock"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionLockNotifier>;
+    factories["pubhashtxremove"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionRemovedNotifier>;
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
     factories["pubrawtxlock"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionLockNotifier>;
+    factories["pubrawmasternode"] = CZMQAbstractNotifier::Create<CZMQPublishRawMasternodeNotifier>;
+    factories["pubmasternoderemove"] = CZMQAbstractNotifier::Create<CZMQPublishMasternodeRemovedNotifier>;
+    factories["pubrawbudgetvote"] = CZMQAbstractNotifier::Create<CZMQPublishRawBudgetVoteNotifier>;
+    factories["pubrawfinalbudgetvote"] = CZMQAbstractNotifier::Create<CZMQPublishRawFinalizedBudgetVoteNotifier>;
+    factories["pubrawspork"] = CZMQAbstractNotifier::Create<CZMQPublishRawSporkNotifier>;
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i)
     {
@@ -52,6 +61,9 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
             CZMQAbstractNotifier *notifier = factory();
             notifier->SetType(i->first);
             notifier->SetAddress(address);
+            std::map<std::string, std::string>::const_iterator hwm = args.find("-zmq" + i->first + "hwm");
+            if (hwm!=args.end())
+                notifier->SetSendHighWaterMark(std::max(0, atoi(hwm->second)));
             notifiers.push_back(notifier);
         }
     }
@@ -112,6 +124,7 @@ bool CZMQNotificationInterface::Initialize()
 void CZMQNotificationInterface::Shutdown()
 {
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
+    LOCK(cs_notifiers);
     if (pcontext)
     {
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
@@ -126,12 +139,15 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+// Hand the event to every notifier, shutting down and dropping those that fail
+template <typename Function>
+void CZMQNotificationInterface::TryForEachAndRemoveFailed(const Function& func)
 {
+    LOCK(cs_notifiers);
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex))
+        if (func(notifier))
         {
             i++;
         }
@@ -143,36 +159,51 @@ void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
     }
 }
 
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex, const CBlock *pblock)
+{
+    // Serialized at most once, by the first notifier publishing it raw
+    CZMQRawBlock block(pindex, pblock);
+    TryForEachAndRemoveFailed(boost::bind(&CZMQAbstractNotifier::NotifyBlock, _1, boost::ref(block)));
+}
+
 void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
-    {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
-    }
+    CZMQRawTransaction transaction(tx);
+    TryForEachAndRemoveFailed(boost::bind(&CZMQAbstractNotifier::NotifyTransaction, _1, boost::ref(transaction)));
 }
 
 void CZMQNotificationInterface::NotifyTransactionLock(const CTransaction &tx)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
-    {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransactionLock(tx))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
-    }
+    CZMQRawTransaction transaction(tx);
+    TryForEachAndRemoveFailed(boost::bind(&CZMQAbstractNotifier::NotifyTransactionLock, _1, boost::ref(transaction)));
+}
+
+void CZMQNotificationInterface::TransactionRemovedFromMempool(const CTransaction &tx)
+{
+    TryForEachAndRemoveFailed(boost::bind(&CZMQAbstractNotifier::NotifyTransactionRemoved, _1, boost::cref(tx)));
+}
+
+void CZMQNotificationInterface::MasternodeUpdated(const CMasternodeBroadcast &mnb)
+{
+    TryForEachAndRemoveFailed(boost::bind(&CZMQAbstractNotifier::NotifyMasternode, _1, boost::cref(mnb)));
+}
+
+void CZMQNotificationInterface::MasternodeRemoved(const CTxIn &vin)
+{
+    TryForEachAndRemoveFailed(boost::bind(&CZMQAbstractNotifier::NotifyMasternodeRemoved, _1, boost::cref(vin)));
+}
+
+void CZMQNotificationInterface::BudgetVoteAccepted(const CBudgetVote &vote)
+{
+    TryForEachAndRemoveFailed(boost::bind(&CZMQAbstractNotifier::NotifyBudgetVote, _1, boost::cref(vote)));
+}
+
+void CZMQNotificationInterface::FinalizedBudgetVoteAccepted(const CFinalizedBudgetVote &vote)
+{
+    TryForEachAndRemoveFailed(boost::bind(&CZMQAbstractNotifier::NotifyFinalizedBudgetVote, _1, boost::cref(vote)));
+}
+
+void CZMQNotificationInterface::SporkUpdated(const CSporkMessage &spork)
+{
+    TryForEachAndRemoveFailed(boost::bind(&CZMQAbstractNotifier::NotifySpork, _1, boost::cref(spork)));
 }
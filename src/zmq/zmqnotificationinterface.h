@@ -5,6 +5,7 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
+#include "sync.h"
 #include "validationinterface.h"
 #include <string>
 #include <map>
@@ -25,13 +26,25 @@ protected:
 
     // CValidationInterface
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
-    void UpdatedBlockTip(const CBlockIndex *pindex);
+    void UpdatedBlockTip(const CBlockIndex *pindex, const CBlock *pblock);
     void NotifyTransactionLock(const CTransaction &tx);
+    void TransactionRemovedFromMempool(const CTransaction &tx);
+    void MasternodeUpdated(const CMasternodeBroadcast &mnb);
+    void MasternodeRemoved(const CTxIn &vin);
+    void BudgetVoteAccepted(const CBudgetVote &vote);
+    void FinalizedBudgetVoteAccepted(const CFinalizedBudgetVote &vote);
+    void SporkUpdated(const CSporkMessage &spork);
 
 private:
     CZMQNotificationInterface();
 
+    template <typename Function>
+    void TryForEachAndRemoveFailed(const Function& func);
+
     void *pcontext;
+
+    //! Signals come from several threads, and zmq sockets may only be used by one at a time
+    CCriticalSection cs_notifiers;
     std::list<CZMQAbstractNotifier*> notifiers;
 };
 
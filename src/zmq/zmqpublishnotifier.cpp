@@ -5,6 +5,9 @@
 #include "chainparams.h"
 #include "zmqpublishnotifier.h"
 #include "main.h"
+#include "masternode.h"
+#include "masternode-budget.h"
+#include "spork.h"
 #include "util.h"
 #include "crypto/common.h"
 
@@ -13,9 +16,15 @@ static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifi
 static const char *MSG_HASHBLOCK  = "hashblock";
 static const char *MSG_HASHTX     = "hashtx";
 static const char *MSG_HASHTXLOCK = "hashtxlock";
+static const char *MSG_HASHTXREMOVE = "hashtxremove";
 static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
 static const char *MSG_RAWTXLOCK = "rawtxlock";
+static const char *MSG_RAWMASTERNODE = "rawmasternode";
+static const char *MSG_MASTERNODEREMOVE = "masternoderemove";
+static const char *MSG_RAWBUDGETVOTE = "rawbudgetvote";
+static const char *MSG_RAWFINALBUDGETVOTE = "rawfinalbudgetvote";
+static const char *MSG_RAWSPORK = "rawspork";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -73,7 +82,16 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
             return false;
         }
 
-        int rc = zmq_bind(psocket, address.c_str());
+        // must be set before binding to apply to subscribers connecting later
+        int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &nSendHighWaterMark, sizeof(nSendHighWaterMark));
+        if (rc!=0)
+        {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            return false;
+        }
+
+        rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
             zmqError("Failed to bind address");
@@ -88,6 +106,8 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
     else
     {
         LogPrint("zmq", "zmq: Reusing socket for address %s\n", address);
+        if (nSendHighWaterMark != i->second->nSendHighWaterMark)
+            LogPrint("zmq", "zmq: High water mark %d of %s ignored, socket uses %d\n", nSendHighWaterMark, type, i->second->nSendHighWaterMark);
 
         psocket = i->second->psocket;
         mapPublishNotifiers.insert(std::make_pair(address, this));
@@ -143,72 +163,106 @@ bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* d
     return true;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQAbstractPublishNotifier::SendHash(const char *command, const uint256 &hash)
 {
-    uint256 hash = pindex->GetBlockHash();
-    LogPrint("zmq", "zmq: Publish hashblock %s\n", hash.GetHex());
     char data[32];
     for (unsigned int i = 0; i < 32; i++)
         data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHBLOCK, data, 32);
+    return SendMessage(command, data, 32);
 }
 
-bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQAbstractPublishNotifier::SendStream(const char *command, const CDataStream &ss)
 {
-    uint256 hash = transaction.GetHash();
+    return SendMessage(command, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishHashBlockNotifier::NotifyBlock(CZMQRawBlock &block)
+{
+    uint256 hash = block.pindex->GetBlockHash();
+    LogPrint("zmq", "zmq: Publish hashblock %s\n", hash.GetHex());
+    return SendHash(MSG_HASHBLOCK, hash);
+}
+
+bool CZMQPublishHashTransactionNotifier::NotifyTransaction(CZMQRawTransaction &transaction)
+{
+    uint256 hash = transaction.tx.GetHash();
     LogPrint("zmq", "zmq: Publish hashtx %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHTX, data, 32);
+    return SendHash(MSG_HASHTX, hash);
 }
 
-bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(const CTransaction &transaction)
+bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(CZMQRawTransaction &transaction)
 {
-    uint256 hash = transaction.GetHash();
+    uint256 hash = transaction.tx.GetHash();
     LogPrint("zmq", "zmq: Publish hashtxlock %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHTXLOCK, data, 32);
+    return SendHash(MSG_HASHTXLOCK, hash);
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishHashTransactionRemovedNotifier::NotifyTransactionRemoved(const CTransaction &transaction)
 {
-    LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
+    uint256 hash = transaction.GetHash();
+    LogPrint("zmq", "zmq: Publish hashtxremove %s\n", hash.GetHex());
+    return SendHash(MSG_HASHTXREMOVE, hash);
+}
 
-// XX42    const Consensus::Params& consensusParams = Params().GetConsensus();
+bool CZMQPublishRawBlockNotifier::NotifyBlock(CZMQRawBlock &block)
+{
+    LogPrint("zmq", "zmq: Publish rawblock %s\n", block.pindex->GetBlockHash().GetHex());
+
+    // A block pruned before it could be read is skipped; the socket is fine
+    const CDataStream* pss = block.GetSerialized();
+    if (!pss)
+        return true;
+    return SendStream(MSG_RAWBLOCK, *pss);
+}
+
+bool CZMQPublishRawTransactionNotifier::NotifyTransaction(CZMQRawTransaction &transaction)
+{
+    LogPrint("zmq", "zmq: Publish rawtx %s\n", transaction.tx.GetHash().GetHex());
+    return SendStream(MSG_RAWTX, *transaction.GetSerialized());
+}
+
+bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(CZMQRawTransaction &transaction)
+{
+    LogPrint("zmq", "zmq: Publish rawtxlock %s\n", transaction.tx.GetHash().GetHex());
+    return SendStream(MSG_RAWTXLOCK, *transaction.GetSerialized());
+}
+
+bool CZMQPublishRawMasternodeNotifier::NotifyMasternode(const CMasternodeBroadcast &mnb)
+{
+    LogPrint("zmq", "zmq: Publish rawmasternode %s\n", mnb.vin.prevout.ToStringShort());
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    {
-        LOCK(cs_main);
-        CBlock block;
-// XX42        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        if(!ReadBlockFromDisk(block, pindex))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
+    ss << mnb;
+    return SendStream(MSG_RAWMASTERNODE, ss);
+}
 
-        ss << block;
-    }
+bool CZMQPublishMasternodeRemovedNotifier::NotifyMasternodeRemoved(const CTxIn &vin)
+{
+    LogPrint("zmq", "zmq: Publish masternoderemove %s\n", vin.prevout.ToStringShort());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << vin.prevout;
+    return SendStream(MSG_MASTERNODEREMOVE, ss);
+}
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+bool CZMQPublishRawBudgetVoteNotifier::NotifyBudgetVote(const CBudgetVote &vote)
+{
+    LogPrint("zmq", "zmq: Publish rawbudgetvote %s on %s\n", vote.vin.prevout.ToStringShort(), vote.nProposalHash.GetHex());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << vote;
+    return SendStream(MSG_RAWBUDGETVOTE, ss);
 }
 
-bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishRawFinalizedBudgetVoteNotifier::NotifyFinalizedBudgetVote(const CFinalizedBudgetVote &vote)
 {
-    uint256 hash = transaction.GetHash();
-    LogPrint("zmq", "zmq: Publish rawtx %s\n", hash.GetHex());
+    LogPrint("zmq", "zmq: Publish rawfinalbudgetvote %s on %s\n", vote.vin.prevout.ToStringShort(), vote.nBudgetHash.GetHex());
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    ss << vote;
+    return SendStream(MSG_RAWFINALBUDGETVOTE, ss);
 }
 
-bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const CTransaction &transaction)
+bool CZMQPublishRawSporkNotifier::NotifySpork(const CSporkMessage &spork)
 {
-    uint256 hash = transaction.GetHash();
-    LogPrint("zmq", "zmq: Publish rawtxlock %s\n", hash.GetHex());
+    LogPrint("zmq", "zmq: Publish rawspork %d\n", spork.nSporkID);
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTXLOCK, &(*ss.begin()), ss.size());
+    ss << spork;
+    return SendStream(MSG_RAWSPORK, ss);
 }
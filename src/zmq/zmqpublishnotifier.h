@@ -23,6 +23,8 @@ public:
           * message sequence number
     */
     bool SendMessage(const char *command, const void* data, size_t size);
+    bool SendHash(const char *command, const uint256 &hash);
+    bool SendStream(const char *command, const CDataStream &ss);
 
     bool Initialize(void *pcontext);
     void Shutdown();
@@ -31,37 +33,73 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(CZMQRawBlock &block);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    bool NotifyTransaction(CZMQRawTransaction &transaction);
 };
 
 class CZMQPublishHashTransactionLockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransactionLock(const CTransaction &transaction);
+    bool NotifyTransactionLock(CZMQRawTransaction &transaction);
+};
+
+class CZMQPublishHashTransactionRemovedNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyTransactionRemoved(const CTransaction &transaction);
 };
 
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(CZMQRawBlock &block);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    bool NotifyTransaction(CZMQRawTransaction &transaction);
 };
 
 class CZMQPublishRawTransactionLockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransactionLock(const CTransaction &transaction);
+    bool NotifyTransactionLock(CZMQRawTransaction &transaction);
+};
+
+class CZMQPublishRawMasternodeNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyMasternode(const CMasternodeBroadcast &mnb);
+};
+
+class CZMQPublishMasternodeRemovedNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyMasternodeRemoved(const CTxIn &vin);
+};
+
+class CZMQPublishRawBudgetVoteNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBudgetVote(const CBudgetVote &vote);
+};
+
+class CZMQPublishRawFinalizedBudgetVoteNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyFinalizedBudgetVote(const CFinalizedBudgetVote &vote);
+};
+
+class CZMQPublishRawSporkNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifySpork(const CSporkMessage &spork);
 };
 
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H